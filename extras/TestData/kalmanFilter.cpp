@@ -1,5 +1,33 @@
 /*
-g++ -o kalmanFilter kalmanFilter.cpp -lgsl && ./kalmanFilter raw.log | tee data.txt
+g++ -O3 -fno-math-errno -pthread -o kalmanFilter kalmanFilter.cpp ../../src/decode.cpp \
+    ../../src/crank-estimators.cpp && ./kalmanFilter raw.log | tee data.txt
+(add -march=native for the widest vectors the machine has, at the cost of last bit differences
+from FMA)
+./kalmanFilter -s raw.log prints the state the firmware estimated instead: t, θ (turns), ω (RPM), α
+./kalmanFilter -x raw.log replays the log through the fixed point filter of src/ekf-fixed.h and
+writes its state as -s does, so the two diff line for line. Its formats are a provisional model of
+the firmware's, not taken from its sources, so the comparison is for information: stderr has how
+many state records it reproduces bit for bit, the first that it does not, and its largest difference
+from the double filter. With --strict a divergence is an error, exit status 2
+./kalmanFilter -g raw.log filters with the gain schedule of src/ekf-schedule.h instead: gains looked
+up by ω and θ at a steady cadence, the full EKF only while starting and through transients
+./kalmanFilter -r raw.log writes the Rauch–Tung–Striebel smoothed t, θ, ω, α and their standard
+deviations, each step estimated from the whole log, and grades the filter and the firmware against
+it. The log is cut into --segment 60 s pieces smoothed in parallel, each run --overlap 10 s further
+than it keeps
+./kalmanFilter --bench logs/ runs the estimators of src/crank-estimators.h (the EKF, a UKF, a
+complementary filter and a phase locked loop, or --estimators ekf,pll) over each log on one thread
+and lists their ns per sample, fitted RPM and angle error against the firmware's state
+./kalmanFilter -b raw.log writes each line as native doubles rather than text
+./kalmanFilter -o out -j 8 logs/ '100rpm*.log' ... filters every log in parallel into out/, one .txt
+(or .bin) per log, and prints a table of the fitted RPM, the RMS innovation and the angle error
+against the firmware's state for each
+./kalmanFilter --sweep logs/ runs a grid of σ²α × σ²acc (× RATIO with --ratio) over each log, eight
+filters to a vector, and lists the settings with the least angle error against the firmware's state
+(or RPM fit residual if the log has no state records, or --metric to choose). Lists are a,b,c or
+from:to:count, for example --va 0.001:100:11 --vacc 1,10,100
+raw.log is the raw records as the firmware sends them, op codes as in decode.h. It is mapped and
+filtered in one pass, so logs of any length run in constant memory.
 cat cutecom.log | sed -n 's|.*ic: x: \([-0-9]*\).*|\1|p' > angle.txt
 gnuplot
 set title "InfoCrank Electronics - Accelerometer Testing\n100 Cadence, σ@^2_α = 0.1, σ@^2_{acc} = 10.0"
@@ -9,7 +37,8 @@ set xlabel "time (seconds)"
 set ylabel "See legend"
 f(x) = m*x + b
 fit [5.0:] f(x) "data.txt" using 1:6 via m,b
-plot "angle.txt" using ($0/32):($1*360/8192)  lw 3 title "nRF52840", "data.txt" using ($0/32):($1*57.29) lw 3 title "PC C++"
+plot "angle.txt" using ($0/32):($1*360/8192)  lw 3 title "nRF52840", \
+"data.txt" using ($0/32):($1*57.29) lw 3 title "PC C++"
 plot \
 "data.txt" u 1:2 t "@^{..}_{x_1} m/s^2", \
 "" u 1:3 t "@^{..}_{y_1} m/s^2", \
@@ -21,108 +50,830 @@ plot \
 f(x) ls 0 t sprintf("fit = %0.1f RPM",m*9.5493)
 
  */
-#include <iostream>
 #include <cstdio>
-#include <fstream>
 #include <cstring>
+#include <cmath>
+#include <charconv>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
 #include <vector>
-#include <gsl/gsl_linalg.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define GRAVITY 9.81
-#define r1 0.0284
-#define r2 0.0614
+#include "../../src/crank-estimators.h"
+#include "../../src/decode.h"
+#include "../../src/ekf.h"
+#include "../../src/ekf-fixed.h"
+#include "../../src/ekf-lanes.h"
+#include "../../src/ekf-schedule.h"
+#include "../../src/rts-smoother.h"
+#include "../../src/work-pool.h"
+
+#define R1 0.0284
+#define R2 0.0614
 #define RATIO 0 //0.9545
 #define DT 0.0078125
-#define DT2 (DT*DT)
-#define DT3 (DT*DT*DT)
-#define DT4 (DT*DT*DT*DT)
 #define VA 0.10  // Variance of rotational acceleration α
 #define VACC 10.0  // Variance of accelerometers
 
-double F_data[] = {
-  1, DT, 0.5*DT*DT,
-  0,  1,        DT,
-  0,  0,         1
+double a1[9] = {
+  -19445, 512, -674,
+  621, -19409, -1373,
+  -163, -767, 19580
 };
 
-double Q_data[] = {
-  VA*DT4/4.0, VA*DT3/2.0, VA*DT2/2.0,
-  VA*DT3/2.0, VA*DT2,     VA*DT,
-  VA*DT2/2.0, VA*DT,      VA
+double a2[9] = {
+  19241, 307, 320,
+  -1101, -19107, 1088,
+  -246, -136, -19854
 };
 
-double R_data[] = {
-  VACC, 0.0, 0.0, 0.0,
-  0.0, VACC, 0.0, 0.0,
-  0.0, 0.0, VACC, 0.0,
-  0.0, 0.0, 0.0, VACC
-};
+// Row of the calibration matrix applied to the accelerometer counts, in m/s²
+static double calibrate(const double a[9], int row, double x, double y, double z) {
+  return (a[3*row]*x + a[3*row+1]*y + a[3*row+2]*z) / (double) 0x00800000;
+}
 
-struct observation_s {
-  double   t;
-  double   x1;
-  double   y1;
-  double   x2;
-  double   y2;
-};
+// The filter model of the settings above
+static CrankModel crankModel() {
+  CrankModel model(DT, VA, VACC);
+  model.r1 = R1;
+  model.r2 = R2;
+  model.ratio = RATIO;
+  return model;
+}
+
+// Buffered output to a file, as text lines or as native doubles
+class Sink {
+public:
+  Sink(int fd, bool binary) : fd(fd), binary(binary), buffer(1 << 20), used(0) {}
+  ~Sink() { Flush(); }
 
+  // Values with the first printed to first decimals and the rest to rest decimals
+  void Line(const double *values, int n, int first, int rest) {
+    if (buffer.size() - used < (size_t) n * 32) {
+      Flush();
+    }
+    char *p = &buffer[used];
+    if (binary) {
+      memcpy(p, values, n * sizeof(double));
+      used += n * sizeof(double);
+      return;
+    }
+    char *end = &buffer[buffer.size()];
+    for (int i = 0; i < n; i++) {
+      std::to_chars_result result = std::to_chars(p, end, values[i], std::chars_format::fixed, i ? rest : first);
+      p = result.ptr;
+      *p++ = i + 1 < n ? ' ' : '\n';
+    }
+    used = p - &buffer[0];
+  }
 
-#pragma pack(push, 1)
-struct raw_data_s {
-  uint8_t op_code;
-  union {
-    struct {
-      int32_t unused: 6;
-      int32_t strain: 18;
-    } strain;
-    struct {
-      int16_t accel1_x;
-      int16_t accel1_y;
-      int16_t accel1_z;
-      int16_t accel2_x;
-      int16_t accel2_y;
-      int16_t accel2_z;
-    } acceleration;
-    struct {
-      int16_t integral;
-      int32_t fractional;
-    } temperature;
-    struct {
-      int32_t theta;
-      int32_t omega;
-      int32_t alpha;
-    } state;
-  } data;
+  void Flush() {
+    for (size_t done = 0; done < used;) {
+      ssize_t n = write(fd, &buffer[done], used - done);
+      if (n < 0) {
+        perror("write");
+        break;
+      }
+      done += n;
+    }
+    used = 0;
+  }
+
+private:
+  int fd;
+  bool binary;
+  std::vector<char> buffer;
+  size_t used;
 };
-#pragma pack(pop)
 
-enum op_codes {
-  STRAIN_DATA = 0,
-  ACCELERATION_DATA,
-  TEMPERATURE_DATA,
-  STATE_DATA,
+// What became of one log
+struct Summary {
+  bool ok = false;
+  uint64_t samples = 0;
+  double seconds = 0.0;
+  double rpm = NAN;               // Slope of θ fitted from 5 s on, as with gnuplot
+  double innovation = NAN;        // RMS over the four accelerometer axes, m/s²
+  uint64_t compared = 0;          // State records
+  double errorMean = NAN;         // Host less firmware θ, °
+  double errorRms = NAN;
+  double errorMaximum = NAN;
+  // Fixed point emulation only
+  uint64_t matched = 0;           // State records it reproduces exactly
+  int64_t divergence = -1;        // Index of the first it does not, in the state records
+  double divergenceTime = NAN;
+  int32_t recorded[3] = {};       // Position, velocity and acceleration of that record
+  int32_t emulated[3] = {};
+  double quantization = NAN;      // Largest θ difference from the double filter, °
+  double quantizationRate = NAN;  // ω, °/s
+  // Gain schedule only
+  uint64_t full = 0;              // Steps taken by the full EKF
+  // Smoother only, which the error above is then against
+  double filterRms = NAN;         // The filter's θ against the smoothed, °
 };
 
-double a1[9] = {
-  -19445, 512, -674,
-  621, -19409, -1373,
-  -163, -767, 19580
+// Least squares line, one point at a time
+struct LineFit {
+  double n = 0.0, mx = 0.0, my = 0.0, cxx = 0.0, cxy = 0.0, cyy = 0.0;
+  void Add(double x, double y) {
+    n += 1.0;
+    double dx = x - mx;
+    double dy = y - my;
+    mx += dx / n;
+    my += dy / n;
+    cxx += dx * (x - mx);
+    cxy += dx * (y - my);
+    cyy += dy * (y - my);
+  }
+  double Slope() const { return cxx > 0.0 ? cxy / cxx : NAN; }
+  // RMS distance of the points from the line
+  double Residual() const { return cxx > 0.0 ? sqrt(std::max(0.0, cyy - cxy * cxy / cxx) / n) : NAN; }
 };
 
-double a2[9] = {
-  19241, 307, 320,
-  -1101, -19107, 1088,
-  -246, -136, -19854
+// Host less firmware angle, ° wrapped to ±180
+static double angleError(double theta, int32_t position) {
+  double e = fmod(theta * 180.0 / M_PI - position * 360.0 / 8192.0, 360.0);
+  return e + (e < -180.0 ? 360.0 : e >= 180.0 ? -360.0 : 0.0);
+}
+
+// Calls callback(const struct raw_data &) for every record of a log, mapped a block at a time and
+// handing back the pages of each block once it is done with
+template <class Callback> static bool walk(const char *filename, Callback &&callback) {
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(filename);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  size_t size = st.st_size;
+  const uint8_t *data = NULL;
+  if (size) {
+    data = (const uint8_t *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      perror(filename);
+      close(fd);
+      return false;
+    }
+    madvise((void *) data, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  const size_t BLOCK = 16 << 20;
+  size_t offset = 0;
+  for (size_t block = 0; block < size; block += BLOCK) {
+    size_t end = std::min(block + BLOCK, size);
+    while (offset < end) {
+      const struct raw_data &raw = *(const struct raw_data *) &data[offset];
+      int length = RawRecordSize(raw.op_code);
+      if (length == 0) {
+        offset++;                               // Not an op code, look for the next record
+        continue;
+      }
+      if (offset + length > size) {
+        offset = size;                          // Cut short at the end of the log
+        break;
+      }
+      offset += length;
+      callback(raw);
+    }
+    madvise((void *) &data[block], end - block, MADV_DONTNEED);
+  }
+  if (size) {
+    munmap((void *) data, size);
+  }
+  return true;
+}
+
+// The calibrated accelerometer axes of an acceleration record, x1 y1 x2 y2
+static void observe(const struct raw_data &raw, double z[4]) {
+  const auto &a = raw.data.acceleration;
+  z[0] = calibrate(a1, 0, a.accel1_x, a.accel1_y, a.accel1_z);
+  z[1] = calibrate(a1, 1, a.accel1_x, a.accel1_y, a.accel1_z);
+  z[2] = calibrate(a2, 0, a.accel2_x, a.accel2_y, a.accel2_z);
+  z[3] = calibrate(a2, 1, a.accel2_x, a.accel2_y, a.accel2_z);
+}
+
+// A state record as -s writes it
+static void stateLine(Sink &sink, double t, int32_t position, int32_t velocity, int32_t acceleration) {
+  double line[4] = {t, position/8192.0, velocity*60.0*128.0/524288.0, acceleration* 16384.0 / 1677216.0};
+  sink.Line(line, 4, 6, 6);
+}
+
+// Filters one log into out, either the filter's lines or the firmware state if state is set. The
+// filter is a CrankEkf or a ScheduledCrankEkf, just reset: stationary with zero angle, covariance
+// zero.
+template <class Filter>
+static bool Process(const char *filename, Filter &ekf, int out, bool state, bool binary, Summary &summary) {
+  Sink sink(out, binary);
+  LineFit fit;
+  double innovation = 0.0;
+  double errorSum = 0.0, errorSquares = 0.0, errorMaximum = 0.0;
+
+  // Calibrate the accelerometers and filter as the records come
+  double t = 0.0;
+  bool ok = walk(filename, [&](const struct raw_data &raw) {
+    switch (raw.op_code) {
+      case ACCELERATION_DATA: {
+        double z[4];
+        observe(raw, z);
+        ekf.Step(z);
+        summary.samples++;
+        innovation += ekf.y[0]*ekf.y[0] + ekf.y[1]*ekf.y[1] + ekf.y[2]*ekf.y[2] + ekf.y[3]*ekf.y[3];
+        if (t >= 5.0) {
+          fit.Add(t, ekf.x[0]);
+        }
+        if (!state) {
+          double line[8] = {t, z[0], z[1], z[2], z[3], ekf.x[0], ekf.x[1], ekf.x[2]};
+          sink.Line(line, 8, 7, 6);
+        }
+        t += DT;
+        break;
+      }
+      case STATE_DATA:
+        if (state) {
+          stateLine(sink, t, raw.data.state.position, raw.data.state.velocity, raw.data.state.acceleration);
+        }
+        if (summary.samples) {
+          double e = angleError(ekf.x[0], raw.data.state.position);
+          errorSum += e;
+          errorSquares += e * e;
+          errorMaximum = std::max(errorMaximum, fabs(e));
+          summary.compared++;
+        }
+        break;
+    }
+  });
+  sink.Flush();
+  if (!ok) {
+    return false;
+  }
+
+  summary.ok = true;
+  summary.seconds = t;
+  summary.rpm = fit.Slope() * 60.0 / (2.0 * M_PI);
+  if (summary.samples) {
+    summary.innovation = sqrt(innovation / (4.0 * summary.samples));
+  }
+  if (summary.compared) {
+    summary.errorMean = errorSum / summary.compared;
+    summary.errorRms = sqrt(errorSquares / summary.compared);
+    summary.errorMaximum = errorMaximum;
+  }
+  return true;
+}
+
+// Replays one log through the fixed point filter, writing its state at every state record as -s
+// writes the firmware's and comparing the two. The double filter runs alongside to measure the
+// quantization error.
+static bool Emulate(const char *filename, int out, bool binary, Summary &summary) {
+  int32_t rows[4][3];
+  for (int i = 0; i < 3; i++) {
+    rows[0][i] = (int32_t) a1[i];
+    rows[1][i] = (int32_t) a1[3 + i];
+    rows[2][i] = (int32_t) a2[i];
+    rows[3][i] = (int32_t) a2[3 + i];
+  }
+  CrankEkfFixed fixed(VA, VACC, RATIO, R1, R2);
+  CrankEkf ekf(crankModel());
+  Sink sink(out, binary);
+  double quantization = 0.0, quantizationRate = 0.0;
+
+  double t = 0.0;
+  bool ok = walk(filename, [&](const struct raw_data &raw) {
+    switch (raw.op_code) {
+      case ACCELERATION_DATA: {
+        int64_t z[4];
+        double zd[4];
+        const auto &a = raw.data.acceleration;
+        for (int i = 0; i < 4; i++) {
+          z[i] = i < 2 ? CrankEkfFixed::Calibrate(rows[i], a.accel1_x, a.accel1_y, a.accel1_z)
+                       : CrankEkfFixed::Calibrate(rows[i], a.accel2_x, a.accel2_y, a.accel2_z);
+          zd[i] = ldexp((double) z[i], -CrankEkfFixed::Z_BITS);
+        }
+        fixed.Step(z);
+        ekf.Step(zd);
+        summary.samples++;
+        double theta = ldexp((double) fixed.x[0], -CrankEkfFixed::X_BITS) * 2.0 * M_PI;
+        double omega = ldexp((double) fixed.x[1], -CrankEkfFixed::X_BITS) * 2.0 * M_PI / DT;
+        quantization = std::max(quantization, fabs(theta - ekf.x[0]) * 180.0 / M_PI);
+        quantizationRate = std::max(quantizationRate, fabs(omega - ekf.x[1]) * 180.0 / M_PI);
+        t += DT;
+        break;
+      }
+      case STATE_DATA: {
+        int32_t emulated[3] = {fixed.Position(), fixed.Velocity(), fixed.Acceleration()};
+        stateLine(sink, t, emulated[0], emulated[1], emulated[2]);
+        if (!summary.samples) {
+          break;
+        }
+        int32_t recorded[3] = {raw.data.state.position, raw.data.state.velocity, raw.data.state.acceleration};
+        if (!memcmp(emulated, recorded, sizeof(emulated))) {
+          summary.matched++;
+        } else if (summary.divergence < 0) {
+          summary.divergence = summary.compared;
+          summary.divergenceTime = t;
+          memcpy(summary.recorded, recorded, sizeof(recorded));
+          memcpy(summary.emulated, emulated, sizeof(emulated));
+        }
+        summary.compared++;
+        break;
+      }
+    }
+  });
+  sink.Flush();
+  if (!ok) {
+    return false;
+  }
+  summary.ok = true;
+  summary.seconds = t;
+  if (summary.samples) {
+    summary.quantization = quantization;
+    summary.quantizationRate = quantizationRate;
+  }
+  return true;
+}
+
+// The first state record the emulation does not reproduce, or none
+static void printDivergence(FILE *file, const Summary &s) {
+  if (s.divergence < 0) {
+    fprintf(file, "none");
+    return;
+  }
+  fprintf(file, "record %lld at %.4f s: firmware %d %d %d, emulated %d %d %d", (long long) s.divergence, s.divergenceTime,
+          s.recorded[0], s.recorded[1], s.recorded[2], s.emulated[0], s.emulated[1], s.emulated[2]);
+}
+
+// The observations of a whole log, and its state records as the steps before each and the
+// firmware's position
+static bool decode(const char *filename, std::vector<std::array<double, 4>> &observations,
+                   std::vector<std::pair<size_t, int32_t>> &states) {
+  return walk(filename, [&](const struct raw_data &raw) {
+    if (raw.op_code == ACCELERATION_DATA) {
+      observations.emplace_back();
+      observe(raw, observations.back().data());
+    } else if (raw.op_code == STATE_DATA && !observations.empty()) {
+      states.emplace_back(observations.size(), raw.data.state.position);
+    }
+  });
+}
+
+// Values of a sweep option: "a,b,c", or "from:to:count" spaced geometrically when both ends are
+// positive and evenly otherwise
+static bool parseList(const char *text, std::vector<double> &values) {
+  values.clear();
+  double from, to;
+  int count;
+  if (sscanf(text, "%lf:%lf:%d", &from, &to, &count) == 3) {
+    if (count < 1) {
+      return false;
+    }
+    bool geometric = from > 0.0 && to > 0.0;
+    for (int i = 0; i < count; i++) {
+      double f = count > 1 ? (double) i / (count - 1) : 0.0;
+      values.push_back(geometric ? from * pow(to / from, f) : from + (to - from) * f);
+    }
+    return true;
+  }
+  for (const char *p = text; *p;) {
+    char *end;
+    values.push_back(strtod(p, &end));
+    if (end == p || (*end && *end != ',')) {
+      return false;
+    }
+    p = *end ? end + 1 : end;
+  }
+  return !values.empty();
+}
+
+enum Metric { ERROR, FIT, INNOVATION };
+
+// One parameter set of a sweep and how it did
+struct Trial {
+  double va, vacc, ratio;
+  double innovation;              // RMS, m/s²
+  double rpm;
+  double fit;                     // RMS residual of θ about the fitted line, rad
+  double errorRms;                // Against the firmware's state, °
+  double errorMaximum;
+  double Score(Metric metric) const {
+    double score = metric == ERROR ? errorRms : metric == FIT ? fit : innovation;
+    return std::isnan(score) ? INFINITY : score;
+  }
 };
 
-int main (int argc, char *argv[]) {
-  char buffer[256];
-  struct observation_s observation;
-  std::vector<struct observation_s> observations;
+// Runs the filter over one log for every combination of the swept values and prints the best. The
+// log is decoded once and the combinations go LANES at a time through CrankEkfLanes, the batches
+// spread over the pool.
+static bool Sweep(const char *filename, const std::vector<double> &vas, const std::vector<double> &vaccs,
+                  const std::vector<double> &ratios, int metric, WorkPool &pool) {
+  typedef CrankEkfLanes<8> Lanes;
+  const size_t L = Lanes::LANES;
+  auto start = std::chrono::steady_clock::now();
 
-  char filename[256] = "raw.log";
-  if (argc > 1) {
-    strcpy(filename,argv[1]);
+  std::vector<std::array<double, 4>> observations;
+  std::vector<std::pair<size_t, int32_t>> states;
+  if (!decode(filename, observations, states)) {
+    return false;
+  }
+  if (metric < 0) {
+    metric = states.empty() ? FIT : ERROR;
+  }
+
+  std::vector<Trial> trials;
+  for (double va : vas) {
+    for (double vacc : vaccs) {
+      for (double ratio : ratios) {
+        trials.push_back({va, vacc, ratio, NAN, NAN, NAN, NAN, NAN});
+      }
+    }
+  }
+  size_t batches = (trials.size() + L - 1) / L;
+  pool.ForEach(batches, [&](size_t b) {
+    // Spare lanes repeat the last trial and are dropped at the end
+    Lanes lanes(DT);
+    lanes.r1 = R1;
+    lanes.r2 = R2;
+    for (size_t l = 0; l < L; l++) {
+      const Trial &trial = trials[std::min(b * L + l, trials.size() - 1)];
+      lanes.va[l] = trial.va;
+      lanes.vacc[l] = trial.vacc;
+      lanes.ratio[l] = trial.ratio;
+    }
+    lanes.Reset();
+
+    // The line fit of LineFit, with x the time shared by every lane
+    double innovation[L] = {};
+    double n = 0.0, mt = 0.0, ctt = 0.0;
+    double my[L] = {}, cty[L] = {}, cyy[L] = {};
+    double errorSquares[L] = {}, errorMaximum[L] = {};
+    size_t state = 0;
+    for (size_t step = 0; step < observations.size(); step++) {
+      lanes.Step(observations[step].data());
+      for (size_t l = 0; l < L; l++) {
+        innovation[l] += lanes.y[0][l]*lanes.y[0][l] + lanes.y[1][l]*lanes.y[1][l] + lanes.y[2][l]*lanes.y[2][l] + lanes.y[3][l]*lanes.y[3][l];
+      }
+      double t = step * DT;
+      if (t >= 5.0) {
+        n += 1.0;
+        double dt = t - mt;
+        mt += dt / n;
+        for (size_t l = 0; l < L; l++) {
+          double dy = lanes.x[0][l] - my[l];
+          my[l] += dy / n;
+          cty[l] += dt * (lanes.x[0][l] - my[l]);
+          cyy[l] += dy * (lanes.x[0][l] - my[l]);
+        }
+        ctt += dt * (t - mt);
+      }
+      for (; state < states.size() && states[state].first == step + 1; state++) {
+        for (size_t l = 0; l < L; l++) {
+          double e = angleError(lanes.x[0][l], states[state].second);
+          errorSquares[l] += e * e;
+          errorMaximum[l] = std::max(errorMaximum[l], fabs(e));
+        }
+      }
+    }
+
+    for (size_t l = 0; l < L && b * L + l < trials.size(); l++) {
+      Trial &trial = trials[b * L + l];
+      if (!observations.empty()) {
+        trial.innovation = sqrt(innovation[l] / (4.0 * observations.size()));
+      }
+      if (ctt > 0.0) {
+        trial.rpm = cty[l] / ctt * 60.0 / (2.0 * M_PI);
+        trial.fit = sqrt(std::max(0.0, cyy[l] - cty[l] * cty[l] / ctt) / n);
+      }
+      if (!states.empty()) {
+        trial.errorRms = sqrt(errorSquares[l] / states.size());
+        trial.errorMaximum = errorMaximum[l];
+      }
+    }
+  });
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::stable_sort(trials.begin(), trials.end(), [&](const Trial &a, const Trial &b) {
+    return a.Score((Metric) metric) < b.Score((Metric) metric);
+  });
+  static const char *names[] = {"angle error RMS", "RPM fit residual", "innovation RMS"};
+  printf("%s: %zu samples, %zu states, %zu filters in %.2f s, best by %s\n", filename, observations.size(),
+         states.size(), trials.size(), seconds, names[metric]);
+  printf("%12s %12s %8s %12s %10s %12s %10s %10s\n", "σ²α", "σ²acc", "ratio", "innovation", "RPM", "fit (rad)", "error RMS", "error max");
+  for (size_t i = 0; i < trials.size() && i < 10; i++) {
+    const Trial &t = trials[i];
+    printf("%12.4g %12.4g %8.4g %12.4f %10.2f %12.5f %10.3f %10.3f\n", t.va, t.vacc, t.ratio, t.innovation, t.rpm, t.fit,
+           t.errorRms, t.errorMaximum);
+  }
+  printf("\n");
+  return true;
+}
+
+// Runs each estimator over one log, decoded once, on one thread, and prints its time per sample
+// and how it did: the angle against the firmware's state and the RPM fit from 5 s on. Only the
+// steps are timed, with θ kept aside for the grading afterwards.
+static bool Bench(const char *filename, const std::vector<std::string> &names) {
+  std::vector<std::array<double, 4>> observations;
+  std::vector<std::pair<size_t, int32_t>> states;
+  if (!decode(filename, observations, states)) {
+    return false;
+  }
+  size_t n = observations.size();
+  CrankModel model = crankModel();
+  printf("%s: %zu samples, %zu states\n", filename, n, states.size());
+  printf("%-14s %10s %10s %12s %10s %10s %10s\n", "estimator", "ns/sample", "RPM", "fit (rad)", "error mean", "RMS", "max");
+  std::vector<double> theta(n);
+  for (const std::string &name : names) {
+    std::unique_ptr<CrankEstimator> estimator = MakeCrankEstimator(name.c_str(), model);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < n; k++) {
+      estimator->Step(observations[k].data());
+      theta[k] = estimator->x[0];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LineFit fit;
+    for (size_t k = 0; k < n; k++) {
+      if (k * DT >= 5.0) {
+        fit.Add(k * DT, theta[k]);
+      }
+    }
+    double errorSum = 0.0, errorSquares = 0.0, errorMaximum = 0.0;
+    for (const std::pair<size_t, int32_t> &state : states) {
+      double e = angleError(theta[state.first - 1], state.second);
+      errorSum += e;
+      errorSquares += e * e;
+      errorMaximum = std::max(errorMaximum, fabs(e));
+    }
+    double count = states.empty() ? NAN : (double) states.size();
+    printf("%-14s %10.1f %10.2f %12.5f %10.3f %10.3f %10.3f\n", estimator->Name(), n ? seconds * 1e9 / n : NAN,
+           fit.Slope() * 60.0 / (2.0 * M_PI), fit.Residual(), errorSum / count, sqrt(errorSquares / count),
+           states.empty() ? NAN : errorMaximum);
+  }
+  printf("\n");
+  return true;
+}
+
+// Smooths one log, writing t, θ, ω, α and their standard deviations. A forward pass keeps the
+// filter as it stood at the start of every segment; then the segments run in parallel, each
+// filtering on from its checkpoint to overlap steps past its end and smoothing back. Only each
+// segment's own steps are kept, the overlap having let the smoother forget where it started.
+static bool Smooth(const char *filename, int out, bool binary, double segmentSeconds, double overlapSeconds,
+                   WorkPool &pool, Summary &summary) {
+  std::vector<std::array<double, 4>> observations;
+  std::vector<std::pair<size_t, int32_t>> states;
+  if (!decode(filename, observations, states)) {
+    return false;
+  }
+  size_t n = observations.size();
+  size_t segment = segmentSeconds > 0.0 ? std::max(1.0, round(segmentSeconds / DT)) : std::max<size_t>(n, 1);
+  size_t overlap = round(overlapSeconds / DT);
+
+  CrankModel model = crankModel();
+  CrankEkf ekf(model);
+  std::vector<CrankEkf> checkpoints;
+  std::vector<double> filtered(n);
+  for (size_t k = 0; k < n; k++) {
+    if (k % segment == 0) {
+      checkpoints.push_back(ekf);
+    }
+    ekf.Step(observations[k].data());
+    filtered[k] = ekf.x[0];
+  }
+
+  std::vector<std::array<double, 6>> smoothed(n);
+  pool.ForEach(checkpoints.size(), [&](size_t s) {
+    size_t begin = s * segment;
+    size_t end = std::min(begin + segment, n);
+    size_t last = std::min(end + overlap, n);
+    CrankEkf ekf = checkpoints[s];
+    CrankSmoother smoother;
+    smoother.estimates.reserve(last - begin);
+    for (size_t k = begin; k < last; k++) {
+      ekf.Step(observations[k].data());
+      smoother.Add(ekf);
+    }
+    smoother.Smooth(model);
+    for (size_t k = begin; k < end; k++) {
+      const CrankSmoother::Estimate &e = smoother.estimates[k - begin];
+      smoothed[k] = {e.x[0], e.x[1], e.x[2], sqrt(std::max(0.0, e.P[0][0])), sqrt(std::max(0.0, e.P[1][1])), sqrt(std::max(0.0, e.P[2][2]))};
+    }
+  });
+
+  // The smoothed trajectory, and the filter and the firmware graded against it
+  Sink sink(out, binary);
+  LineFit fit;
+  double filterSquares = 0.0;
+  for (size_t k = 0; k < n; k++) {
+    double t = k * DT;
+    const std::array<double, 6> &e = smoothed[k];
+    double line[7] = {t, e[0], e[1], e[2], e[3], e[4], e[5]};
+    sink.Line(line, 7, 7, 6);
+    double d = (filtered[k] - e[0]) * 180.0 / M_PI;
+    filterSquares += d * d;
+    if (t >= 5.0) {
+      fit.Add(t, e[0]);
+    }
+  }
+  sink.Flush();
+  double errorSum = 0.0, errorSquares = 0.0, errorMaximum = 0.0;
+  for (const std::pair<size_t, int32_t> &state : states) {
+    double e = angleError(smoothed[state.first - 1][0], state.second);
+    errorSum += e;
+    errorSquares += e * e;
+    errorMaximum = std::max(errorMaximum, fabs(e));
+  }
+
+  summary.ok = true;
+  summary.samples = n;
+  summary.seconds = n * DT;
+  summary.rpm = fit.Slope() * 60.0 / (2.0 * M_PI);
+  summary.compared = states.size();
+  if (n) {
+    summary.filterRms = sqrt(filterSquares / n);
+  }
+  if (!states.empty()) {
+    summary.errorMean = errorSum / states.size();
+    summary.errorRms = sqrt(errorSquares / states.size());
+    summary.errorMaximum = errorMaximum;
+  }
+  return true;
+}
+
+// The logs named by a path: a directory gives its *.log files, a pattern its matches
+static void Inputs(const char *path, std::vector<std::string> &inputs) {
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    std::vector<std::string> names;
+    DIR *dir = opendir(path);
+    if (!dir) {
+      perror(path);
+      return;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+      size_t n = strlen(entry->d_name);
+      if (n > 4 && !strcmp(entry->d_name + n - 4, ".log")) {
+        names.push_back(std::string(path) + "/" + entry->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    inputs.insert(inputs.end(), names.begin(), names.end());
+    return;
+  }
+  if (strpbrk(path, "*?[")) {
+    glob_t matches;
+    if (glob(path, 0, NULL, &matches) == 0) {
+      for (size_t i = 0; i < matches.gl_pathc; i++) {
+        inputs.push_back(matches.gl_pathv[i]);
+      }
+    } else {
+      fprintf(stderr, "%s: no match\n", path);
+    }
+    globfree(&matches);
+    return;
+  }
+  inputs.push_back(path);
+}
+
+int main (int argc, char *argv[]) {
+  bool state = false;
+  bool binary = false;
+  bool emulate = false;
+  bool strict = false;
+  bool scheduled = false;
+  bool smooth = false;
+  double segment = 60.0;
+  double overlap = 10.0;
+  const char *directory = NULL;
+  unsigned threads = 0;
+  bool sweep = false;
+  int metric = -1;
+  bool bench = false;
+  std::vector<std::string> estimators;
+  for (const char *const *name = crank_estimators; *name; name++) {
+    estimators.push_back(*name);
+  }
+  std::vector<double> vas, vaccs, ratios;
+  parseList("0.001:100:11", vas);
+  parseList("0.1:1000:9", vaccs);
+  parseList("0", ratios);
+  enum { SWEEP = 256, SWEEP_VA, SWEEP_VACC, SWEEP_RATIO, SWEEP_METRIC, SEGMENT, OVERLAP, BENCH, ESTIMATORS, STRICT };
+  static const struct option options[] = {
+    {"state", no_argument, NULL, 's'},
+    {"binary", no_argument, NULL, 'b'},
+    {"fixed", no_argument, NULL, 'x'},
+    {"strict", no_argument, NULL, STRICT},
+    {"scheduled", no_argument, NULL, 'g'},
+    {"smooth", no_argument, NULL, 'r'},
+    {"segment", required_argument, NULL, SEGMENT},
+    {"overlap", required_argument, NULL, OVERLAP},
+    {"output", required_argument, NULL, 'o'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"sweep", no_argument, NULL, SWEEP},
+    {"va", required_argument, NULL, SWEEP_VA},
+    {"vacc", required_argument, NULL, SWEEP_VACC},
+    {"ratio", required_argument, NULL, SWEEP_RATIO},
+    {"metric", required_argument, NULL, SWEEP_METRIC},
+    {"bench", no_argument, NULL, BENCH},
+    {"estimators", required_argument, NULL, ESTIMATORS},
+    {NULL, 0, NULL, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "sbxgro:j:h", options, NULL)) != -1) {
+    switch (opt) {
+      case 's':
+        state = true;
+        break;
+      case 'b':
+        binary = true;
+        break;
+      case 'x':
+        emulate = true;
+        break;
+      case STRICT:
+        strict = true;
+        break;
+      case 'g':
+        scheduled = true;
+        break;
+      case 'r':
+        smooth = true;
+        break;
+      case SEGMENT:
+        segment = atof(optarg);
+        break;
+      case OVERLAP:
+        overlap = atof(optarg);
+        break;
+      case 'o':
+        directory = optarg;
+        break;
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case SWEEP:
+        sweep = true;
+        break;
+      case SWEEP_VA:
+      case SWEEP_VACC:
+      case SWEEP_RATIO:
+        if (!parseList(optarg, opt == SWEEP_VA ? vas : opt == SWEEP_VACC ? vaccs : ratios)) {
+          fprintf(stderr, "%s: not a list or from:to:count\n", optarg);
+          return 1;
+        }
+        sweep = true;
+        break;
+      case SWEEP_METRIC:
+        metric = !strcmp(optarg, "error") ? ERROR : !strcmp(optarg, "fit") ? FIT : !strcmp(optarg, "innovation") ? INNOVATION : -2;
+        if (metric == -2) {
+          fprintf(stderr, "%s: metric is error, fit or innovation\n", optarg);
+          return 1;
+        }
+        break;
+      case BENCH:
+        bench = true;
+        break;
+      case ESTIMATORS:
+        estimators.clear();
+        for (const char *p = optarg; *p;) {
+          const char *end = strchrnul(p, ',');
+          estimators.emplace_back(p, end - p);
+          if (!MakeCrankEstimator(estimators.back().c_str(), CrankModel())) {
+            fprintf(stderr, "%s: estimators are ekf, ukf, complementary and pll\n", estimators.back().c_str());
+            return 1;
+          }
+          p = *end ? end + 1 : end;
+        }
+        bench = true;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-s | -x [--strict] | -g] [-b] [-o directory] [-j threads] [log|directory|pattern]...\n"
+                        "       %s --sweep [--va list] [--vacc list] [--ratio list] [--metric error|fit|innovation] [-j threads] [log|directory|pattern]...\n"
+                        "       %s -r [--segment seconds] [--overlap seconds] [-b] [-o directory] [-j threads] [log|directory|pattern]...\n"
+                        "       %s --bench [--estimators ekf,ukf,complementary,pll] [log|directory|pattern]...\n"
+                        "-x replays through a provisional fixed point model of the firmware's filter; --strict makes a\n"
+                        "divergence from its state records an error\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  std::vector<std::string> inputs;
+  for (int i = optind; i < argc; i++) {
+    Inputs(argv[i], inputs);
+  }
+  if (optind == argc) {
+    inputs.push_back("raw.log");
   }
 
   // Create noise free simulation data
@@ -134,216 +885,174 @@ int main (int argc, char *argv[]) {
 //    observation.y1 = 	GRAVITY*cos(theta);
 //    observation.x2 = 	GRAVITY*sin(theta)-thetadot*thetadot*r2;
 //    observation.y2 = 	GRAVITY*cos(theta);
-//    observations.push_back(observation);
 //    printf("%0.7lf %0.4lf %0.4lf %0.4lf %0.4lf\n",t,observation.x1,observation.y1,observation.x2,observation.y2);
 //  }
 
-  // Read the input file and calibrate the accelerometers
-  {
-    double t = 0.0;
-    gsl_matrix_view A1 = gsl_matrix_view_array (a1, 3, 3);
-    gsl_matrix_view A2 = gsl_matrix_view_array (a2, 3, 3);
-          gsl_vector *a = gsl_vector_alloc (3);
-          gsl_vector *a_ = gsl_vector_alloc (3);
-    FILE *infile = fopen(filename, "rb");
-    struct raw_data_s raw_data;
-    int n=0;
-    do {
-      fread(&raw_data.op_code,1,1,infile);
-      switch (raw_data.op_code) {
-        case STRAIN_DATA:
-          fread(&raw_data.data.strain,sizeof(raw_data.data.strain),1,infile);
-          break;
-        case ACCELERATION_DATA:
-          fread(&raw_data.data.acceleration,sizeof(raw_data.data.acceleration),1,infile);
-//          printf("%hd %hd %hd %hd %hd %hd\n",
-//                 raw_data.data.acceleration.accel1_x,
-//                 raw_data.data.acceleration.accel1_y,
-//                 raw_data.data.acceleration.accel1_z,
-//                 raw_data.data.acceleration.accel2_x,
-//                 raw_data.data.acceleration.accel2_y,
-//                 raw_data.data.acceleration.accel2_z);
-          gsl_vector_set(a, 0, raw_data.data.acceleration.accel1_x);
-          gsl_vector_set(a, 1, raw_data.data.acceleration.accel1_y);
-          gsl_vector_set(a, 2, raw_data.data.acceleration.accel1_z);
-          gsl_blas_dgemv(CblasNoTrans, 1.0/(double) 0x00800000, &A1.matrix, a, 0.0, a_);
-          observation.t = t;
-      observation.x1 = gsl_vector_get(a_,0);
-      observation.y1 = gsl_vector_get(a_,1);
-//          printf("%0.7lf %lf %lf ",t,
-//                 gsl_vector_get(a_,0),
-//                 gsl_vector_get(a_,1),
-//                 gsl_vector_get(a_,2));
-          gsl_vector_set(a, 0, raw_data.data.acceleration.accel2_x);
-          gsl_vector_set(a, 1, raw_data.data.acceleration.accel2_y);
-          gsl_vector_set(a, 2, raw_data.data.acceleration.accel2_z);
-          gsl_blas_dgemv(CblasNoTrans, 1.0/(double) 0x00800000, &A2.matrix, a, 0.0, a_);
-      observation.x2 = gsl_vector_get(a_,0);
-      observation.y2 = gsl_vector_get(a_,1);
-      observations.push_back(observation);
-//          printf("%lf %lf\n",
-//                 gsl_vector_get(a_,0),
-//                 gsl_vector_get(a_,1),
-//                 gsl_vector_get(a_,2));
-          t += DT;
-          break;
-        case TEMPERATURE_DATA:
-          fread(&raw_data.data.temperature,sizeof(raw_data.data.temperature),1,infile);
-          break;
-        case STATE_DATA:
-          fread(&raw_data.data.state,sizeof(raw_data.data.state),1,infile);
-          printf("%lf %lf %lf %lf\n", t,raw_data.data.state.theta/8192.0,raw_data.data.state.omega*60.0*128.0/524288.0,raw_data.data.state.alpha* 16384.0 / 1677216.0);
-          break;
+  // Tune the noise, every log on its own
+  if (sweep) {
+    WorkPool pool(threads);
+    int failed = 0;
+    for (const std::string &input : inputs) {
+      failed += !Sweep(input.c_str(), vas, vaccs, ratios, metric, pool);
+    }
+    return failed ? 1 : 0;
+  }
+
+  // Compare the estimators, one thread so the times are comparable
+  if (bench) {
+    int failed = 0;
+    for (const std::string &input : inputs) {
+      failed += !Bench(input.c_str(), estimators);
+    }
+    return failed ? 1 : 0;
+  }
+
+  // Smooth, each log split across the pool
+  if (smooth) {
+    WorkPool pool(threads);
+    if (!directory && inputs.size() == 1) {
+      Summary s;
+      if (!Smooth(inputs[0].c_str(), STDOUT_FILENO, binary, segment, overlap, pool, s)) {
+        return 1;
+      }
+      fprintf(stderr, "%llu samples, filter θ against smoothed %.3f° RMS, firmware against smoothed %.3f° mean %.3f° RMS %.3f° max over %llu states\n",
+              (unsigned long long) s.samples, s.filterRms, s.errorMean, s.errorRms, s.errorMaximum, (unsigned long long) s.compared);
+      return 0;
+    }
+    if (!directory) {
+      directory = ".";
+    }
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+      perror(directory);
+      return 1;
+    }
+    printf("%-32s %10s %9s %8s %12s %8s %10s %10s %10s\n", "log", "samples", "seconds", "RPM", "filter RMS", "states", "firmware", "RMS", "max");
+    int failed = 0;
+    for (const std::string &input : inputs) {
+      std::string name = input.substr(input.find_last_of('/') + 1);
+      name = name.substr(0, name.find_last_of('.'));
+      std::string path = std::string(directory) + "/" + name + (binary ? ".bin" : ".txt");
+      int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (out < 0) {
+        perror(path.c_str());
+        failed++;
+        continue;
+      }
+      Summary s;
+      bool ok = Smooth(input.c_str(), out, binary, segment, overlap, pool, s);
+      close(out);
+      if (!ok) {
+        printf("%-32s failed\n", input.c_str());
+        failed++;
+        continue;
       }
-    } while (!feof(infile));
-          gsl_vector_free(a);
-          gsl_vector_free(a_);
-
-    fclose(infile);
-  }
-
-  return 0;
-
-
-
-
-
-  // Kalman filter
-  {
-    // These matrices don't change
-    gsl_matrix_view F = gsl_matrix_view_array (F_data, 3, 3);
-    gsl_matrix_view Q = gsl_matrix_view_array (Q_data, 3, 3);
-    gsl_matrix_view R = gsl_matrix_view_array (R_data, 4, 4);
-
-    // Working vectors, matrices and permutations
-    gsl_vector *x = gsl_vector_alloc (3);
-    gsl_vector *xkk1 = gsl_vector_alloc (3);
-    gsl_vector *h = gsl_vector_alloc (4);
-    gsl_vector *y = gsl_vector_alloc (4);
-    gsl_matrix *P = gsl_matrix_alloc(3,3);
-    gsl_matrix *H = gsl_matrix_alloc(4,3);
-    gsl_matrix *S = gsl_matrix_alloc(4,4);
-    gsl_matrix *S1 = gsl_matrix_alloc(4,4);
-    gsl_matrix *K = gsl_matrix_alloc(3,4);
-    gsl_matrix *M33 = gsl_matrix_alloc(3,3);
-    gsl_matrix *M33_ = gsl_matrix_alloc(3,3);
-    gsl_matrix *M43 = gsl_matrix_alloc(4,3);
-    gsl_matrix *M34 = gsl_matrix_alloc(3,4);
-    gsl_permutation *p = gsl_permutation_alloc(4);
-
-    // Initialisation
-    // State - stationary with zero angle
-    gsl_vector_set_zero(x);
-    gsl_vector_set(x,1,0.0);
-    // Covariance - zero
-    gsl_matrix_set_zero(P);
-
-    for (std::vector<struct observation_s>::iterator it = observations.begin(); it < observations.end(); ++it) {
-
-      // Predicted state estimate
-      gsl_blas_dgemv(CblasNoTrans, 1.0, &F.matrix, x, 0.0, xkk1);
-      //std::cout << "x " << gsl_vector_get(xkk1,0) << " " << gsl_vector_get(xkk1,1) << " " << gsl_vector_get(xkk1,2) << std::endl;
-
-      // Predicted covariance estimate
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &F.matrix, P, 0.0, M33);
-      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, M33, &F.matrix, 0.0, P);
-      gsl_matrix_add(P, &Q.matrix);
-      //std::cout << "P " << gsl_matrix_get(P,0,0) << " " << gsl_matrix_get(P,0,1) << " " << gsl_matrix_get(P,0,2) << " " << std::endl
-      //          << "  " << gsl_matrix_get(P,1,0) << " " << gsl_matrix_get(P,1,1) << " " << gsl_matrix_get(P,1,2) << " " << std::endl
-      //          << "  " << gsl_matrix_get(P,2,0) << " " << gsl_matrix_get(P,2,1) << " " << gsl_matrix_get(P,2,2) << " " << std::endl;
-
-      // Innovation or measurement residual
-      gsl_vector_set(y, 0, it->x1);
-      gsl_vector_set(y, 1, it->y1);
-      gsl_vector_set(y, 2, it->x2);
-      gsl_vector_set(y, 3, it->y2);
-      //std::cout << "z " << gsl_vector_get(y,0) << " " << gsl_vector_get(y,1) << " " << gsl_vector_get(y,2) << " " << gsl_vector_get(y,3) << std::endl;
-      gsl_vector_set(h, 0,  RATIO*gsl_vector_get(xkk1,2)*cos(gsl_vector_get(xkk1,0)) + GRAVITY*sin(gsl_vector_get(xkk1,0)) - r1*gsl_vector_get(xkk1,1)*gsl_vector_get(xkk1,1));
-      gsl_vector_set(h, 1, -RATIO*gsl_vector_get(xkk1,2)*sin(gsl_vector_get(xkk1,0)) + GRAVITY*cos(gsl_vector_get(xkk1,0)) + r1*gsl_vector_get(xkk1,2));
-      gsl_vector_set(h, 2,  RATIO*gsl_vector_get(xkk1,2)*cos(gsl_vector_get(xkk1,0)) + GRAVITY*sin(gsl_vector_get(xkk1,0)) - r2*gsl_vector_get(xkk1,1)*gsl_vector_get(xkk1,1));
-      gsl_vector_set(h, 3, -RATIO*gsl_vector_get(xkk1,2)*sin(gsl_vector_get(xkk1,0)) + GRAVITY*cos(gsl_vector_get(xkk1,0)) + r2*gsl_vector_get(xkk1,2));
-      //std::cout << " h " << gsl_vector_get(h,0) << " " << gsl_vector_get(h,1) << " " << gsl_vector_get(h,2) << " " << gsl_vector_get(h,3);
-      gsl_vector_sub(y, h);
-      //std::cout << "y " << gsl_vector_get(y,0) << " " << gsl_vector_get(y,1) << " " << gsl_vector_get(y,2) << " " << gsl_vector_get(y,3) << std::endl;
-
-      // Innovation (or residual) covariance
-      gsl_matrix_set(H, 0, 0, -RATIO*gsl_vector_get(xkk1,2)*sin(gsl_vector_get(xkk1,0)) + GRAVITY*cos(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 1, 0, -RATIO*gsl_vector_get(xkk1,2)*cos(gsl_vector_get(xkk1,0)) - GRAVITY*sin(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 2, 0, -RATIO*gsl_vector_get(xkk1,2)*sin(gsl_vector_get(xkk1,0)) + GRAVITY*cos(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 3, 0, -RATIO*gsl_vector_get(xkk1,2)*cos(gsl_vector_get(xkk1,0)) - GRAVITY*sin(gsl_vector_get(xkk1,0)));
-
-      gsl_matrix_set(H, 0, 1, -2.0*r1*gsl_vector_get(xkk1,1));
-      gsl_matrix_set(H, 1, 1,  0.0);
-      gsl_matrix_set(H, 2, 1, -2.0*r2*gsl_vector_get(xkk1,1));
-      gsl_matrix_set(H, 3, 1,  0.0);
-
-      gsl_matrix_set(H, 0, 2,  RATIO*cos(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 1, 2, -RATIO*sin(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 2, 2,  RATIO*cos(gsl_vector_get(xkk1,0)));
-      gsl_matrix_set(H, 3, 2, -RATIO*sin(gsl_vector_get(xkk1,0)));
-      //std::cout << "H " << gsl_matrix_get(H,0,0) << " " << gsl_matrix_get(H,0,1) << " " << gsl_matrix_get(H,0,2) << std::endl
-      //          << "  " << gsl_matrix_get(H,1,0) << " " << gsl_matrix_get(H,1,1) << " " << gsl_matrix_get(H,1,2) << std::endl
-      //          << "  " << gsl_matrix_get(H,2,0) << " " << gsl_matrix_get(H,2,1) << " " << gsl_matrix_get(H,2,2) << std::endl
-      //          << "  " << gsl_matrix_get(H,3,0) << " " << gsl_matrix_get(H,3,1) << " " << gsl_matrix_get(H,3,2) << std::endl;
-
-
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, H, P, 0.0, M43);
-      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, M43, H, 0.0, S);
-      gsl_matrix_add(S, &R.matrix);
-      //std::cout << "S " << gsl_matrix_get(S,0,0) << " " << gsl_matrix_get(S,0,1) << " " << gsl_matrix_get(S,0,2) << " " << gsl_matrix_get(S,0,3) << std::endl
-      //          << "  " << gsl_matrix_get(S,1,0) << " " << gsl_matrix_get(S,1,1) << " " << gsl_matrix_get(S,1,2) << " " << gsl_matrix_get(S,1,3) << std::endl
-      //          << "  " << gsl_matrix_get(S,2,0) << " " << gsl_matrix_get(S,2,1) << " " << gsl_matrix_get(S,2,2) << " " << gsl_matrix_get(S,2,3) << std::endl
-      //          << "  " << gsl_matrix_get(S,3,0) << " " << gsl_matrix_get(S,3,1) << " " << gsl_matrix_get(S,3,2) << " " << gsl_matrix_get(S,3,3) << std::endl;
-
-      // Near-optimal Kalman gain
-      int s;
-      gsl_linalg_LU_decomp(S, p, &s);
-      gsl_linalg_LU_invert(S, p, S1);
-
-      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, P, H, 0.0, M34);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, M34, S1, 0.0, K);
-      //std::cout << "K " << gsl_matrix_get(K,0,0) << " " << gsl_matrix_get(K,0,1) << " " << gsl_matrix_get(K,0,2) << " " << gsl_matrix_get(K,0,3) << std::endl
-      //          << "  " << gsl_matrix_get(K,1,0) << " " << gsl_matrix_get(K,1,1) << " " << gsl_matrix_get(K,1,2) << " " << gsl_matrix_get(K,1,3) << std::endl
-      //          << "  " << gsl_matrix_get(K,2,0) << " " << gsl_matrix_get(K,2,1) << " " << gsl_matrix_get(K,2,2) << " " << gsl_matrix_get(K,2,3) << std::endl;
-
-
-      // Updated state estimate
-      gsl_blas_dgemv(CblasNoTrans, 1.0, K, y, 1.0, xkk1);
-      gsl_vector_memcpy(x, xkk1);
-
-      // Updated covariance estimate
-      gsl_matrix_set_identity(M33);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, K, H, 1.0, M33);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, M33, P, 0.0, M33_);
-      gsl_matrix_set_identity(M33);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, K, H, 1.0, M33);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, K, &R.matrix, 0.0, M34);
-      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, M34, K, 0.0, P);
-      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, M33_, M33, 1.0, P);
-      //std::cout << "P " << gsl_matrix_get(P,0,0) << " " << gsl_matrix_get(P,0,1) << " " << gsl_matrix_get(P,0,2) << " " << std::endl
-      //          << "  " << gsl_matrix_get(P,1,0) << " " << gsl_matrix_get(P,1,1) << " " << gsl_matrix_get(P,1,2) << " " << std::endl
-      //          << "  " << gsl_matrix_get(P,2,0) << " " << gsl_matrix_get(P,2,1) << " " << gsl_matrix_get(P,2,2) << " " << std::endl;
-
-
-      // Output
-      printf("%0.7lf %0.6lf %0.6lf %0.6lf %0.6lf %0.6lf %0.6lf %0.6lf\n",it->t,it->x1,it->y1,it->x2,it->y2,gsl_vector_get(x,0),gsl_vector_get(x,1),gsl_vector_get(x,2));
-//      std::cout << gsl_vector_get(x,0) << " " << gsl_vector_get(x,1) << " " << gsl_vector_get(x,2) << std::endl;
-    }
-    gsl_vector_free(x);
-    gsl_vector_free(xkk1);
-    gsl_vector_free(h);
-    gsl_vector_free(y);
-    gsl_matrix_free(P);
-    gsl_matrix_free(H);
-    gsl_matrix_free(S);
-    gsl_matrix_free(S1);
-    gsl_matrix_free(K);
-    gsl_matrix_free(M33);
-    gsl_matrix_free(M33_);
-    gsl_matrix_free(M43);
-    gsl_matrix_free(M34);
-    gsl_permutation_free(p);
+      printf("%-32s %10llu %9.1f %8.2f %12.3f %8llu %10.3f %10.3f %10.3f\n", input.c_str(), (unsigned long long) s.samples,
+             s.seconds, s.rpm, s.filterRms, (unsigned long long) s.compared, s.errorMean, s.errorRms, s.errorMaximum);
+    }
+    return failed ? 1 : 0;
   }
 
-}
+  // The filter for a log: the EKF, or the gain schedule with one table for all the logs
+  CrankModel model = crankModel();
+  std::unique_ptr<CrankGainSchedule> schedule;
+  if (scheduled) {
+    schedule.reset(new CrankGainSchedule(model));
+  }
+  auto filter = [&](const char *filename, int out, Summary &summary) {
+    if (!schedule) {
+      CrankEkf ekf(model);
+      return Process(filename, ekf, out, state, binary, summary);
+    }
+    ScheduledCrankEkf ekf(*schedule);
+    bool ok = Process(filename, ekf, out, state, binary, summary);
+    summary.full = ekf.fullSteps;
+    return ok;
+  };
+
+  // One log to stdout, as before
+  if (!directory && inputs.size() == 1) {
+    Summary summary;
+    if (!emulate) {
+      bool ok = filter(inputs[0].c_str(), STDOUT_FILENO, summary);
+      if (ok && schedule) {
+        fprintf(stderr, "%llu of %llu steps in the full EKF\n", (unsigned long long) summary.full, (unsigned long long) summary.samples);
+      }
+      return ok ? 0 : 1;
+    }
+    if (!Emulate(inputs[0].c_str(), STDOUT_FILENO, binary, summary)) {
+      return 1;
+    }
+    fprintf(stderr, "Provisional fixed point model: %llu of %llu state records reproduced, quantization %.6f° %.6f°/s, first divergence ",
+            (unsigned long long) summary.matched, (unsigned long long) summary.compared, summary.quantization, summary.quantizationRate);
+    printDivergence(stderr, summary);
+    fprintf(stderr, "\n");
+    return strict && summary.divergence >= 0 ? 2 : 0;
+  }
+
+  // A batch, each log to a file of its own in the output directory
+  if (!directory) {
+    directory = ".";
+  }
+  if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+    perror(directory);
+    return 1;
+  }
+  std::vector<Summary> summaries(inputs.size());
+  WorkPool pool(threads);
+  pool.ForEach(inputs.size(), [&](size_t i) {
+    std::string name = inputs[i].substr(inputs[i].find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    std::string path = std::string(directory) + "/" + name + (binary ? ".bin" : ".txt");
+    int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+      perror(path.c_str());
+      return;
+    }
+    if (emulate) {
+      Emulate(inputs[i].c_str(), out, binary, summaries[i]);
+    } else {
+      filter(inputs[i].c_str(), out, summaries[i]);
+    }
+    close(out);
+  });
 
+  if (emulate) {
+    printf("Provisional fixed point model, formats not confirmed against the firmware\n");
+    printf("%-32s %10s %8s %8s %12s %12s  %s\n", "log", "samples", "states", "matched", "quant θ °", "quant ω °/s", "first divergence");
+    int failed = 0;
+    int diverged = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      const Summary &s = summaries[i];
+      if (!s.ok) {
+        printf("%-32s failed\n", inputs[i].c_str());
+        failed++;
+        continue;
+      }
+      printf("%-32s %10llu %8llu %8llu %12.6f %12.6f  ", inputs[i].c_str(), (unsigned long long) s.samples, (unsigned long long) s.compared,
+             (unsigned long long) s.matched, s.quantization, s.quantizationRate);
+      printDivergence(stdout, s);
+      printf("\n");
+      diverged += s.divergence >= 0;
+    }
+    return failed ? 1 : strict && diverged ? 2 : 0;
+  }
+
+  printf("%-32s %10s %9s %8s %12s %8s %10s %10s %10s%s\n", "log", "samples", "seconds", "RPM", "innovation", "states", "error", "error RMS", "error max",
+         schedule ? "  full EKF %" : "");
+  int failed = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const Summary &s = summaries[i];
+    if (!s.ok) {
+      printf("%-32s failed\n", inputs[i].c_str());
+      failed++;
+      continue;
+    }
+    printf("%-32s %10llu %9.1f %8.2f %12.4f %8llu %10.3f %10.3f %10.3f", inputs[i].c_str(), (unsigned long long) s.samples,
+           s.seconds, s.rpm, s.innovation, (unsigned long long) s.compared, s.errorMean, s.errorRms, s.errorMaximum);
+    if (schedule) {
+      printf(" %12.1f", s.samples ? 100.0 * s.full / s.samples : 0.0);
+    }
+    printf("\n");
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+#include <string.h>
+#include <stdlib.h>
+#include <charconv>
+
+#include <wx/dcbuffer.h>
+
+#include "array-view.h"
+
+static const int GRAPH_HEIGHT = 80;
+
+//--------------------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------------------
+ArrayView::ArrayView(wxWindow *parent, double scale, int precision) :
+    wxWindow(parent, wxID_ANY, wxDefaultPosition, wxSize(-1, GRAPH_HEIGHT), wxFULL_REPAINT_ON_RESIZE),
+    scale(scale), precision(precision)
+{
+    SetBackgroundStyle(wxBG_STYLE_PAINT);
+    pending.reserve(MAXIMUM_ELEMENTS);
+    shown.reserve(MAXIMUM_ELEMENTS);
+    points.reserve(MAXIMUM_ELEMENTS);
+    Bind(wxEVT_PAINT, &ArrayView::OnPaint, this);
+    Bind(wxEVT_SIZE, &ArrayView::OnSize, this);
+}
+
+void ArrayView::SetMode(int mode)
+{
+    this->mode = mode;
+    UpdateHeight();
+    Refresh(false);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Height: graphs have a fixed height, numbers as many rows as the elements need at this width
+//--------------------------------------------------------------------------------------------------
+wxSize ArrayView::NumberCell()
+{
+    char text[24];
+    int length = Format(text, sizeof(text), -32768);
+    wxSize cell = GetTextExtent(wxString(text, length));
+    cell.x += 20;
+    return cell;
+}
+
+void ArrayView::UpdateHeight()
+{
+    int height = GRAPH_HEIGHT;
+    if (mode == NUMBERS && !shown.empty()) {
+        wxSize cell = NumberCell();
+        int columns = wxMax(1, GetClientSize().x / cell.x);
+        int rows = (shown.size() + columns - 1) / columns;
+        height = wxMax(GRAPH_HEIGHT, rows * cell.y);
+    }
+    sizedFor = shown.size();
+    if (GetMinSize().y != height) {
+        SetMinSize(wxSize(-1, height));
+        GetParent()->Layout();
+    }
+}
+
+void ArrayView::OnSize(wxSizeEvent &evt)
+{
+    // A new width can change the number of columns
+    if (mode == NUMBERS) {
+        CallAfter(&ArrayView::UpdateHeight);
+    }
+    evt.Skip();
+}
+
+//--------------------------------------------------------------------------------------------------
+// New values
+//--------------------------------------------------------------------------------------------------
+bool ArrayView::SetValues(const uint8_t *array, int count)
+{
+    if (count > MAXIMUM_ELEMENTS) {
+        count = MAXIMUM_ELEMENTS;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if ((int) pending.size() == count && !memcmp(pending.data(), array, count * sizeof(int16_t))) {
+        return false;
+    }
+    pending.resize(count);                  // Within the reserved capacity, no allocation
+    memcpy(pending.data(), array, count * sizeof(int16_t));
+    changed = true;
+    return true;
+}
+
+void ArrayView::Clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    pending.clear();
+    changed = true;
+}
+
+int ArrayView::Format(char *text, size_t size, int16_t value) const
+{
+    std::to_chars_result result = precision ?
+        std::to_chars(text, text + size, value * scale, std::chars_format::fixed, precision) :
+        std::to_chars(text, text + size, value);
+    return result.ec == std::errc() ? result.ptr - text : 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Painting
+//--------------------------------------------------------------------------------------------------
+void ArrayView::OnPaint(wxPaintEvent &evt)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (changed) {
+            shown.assign(pending.begin(), pending.end());
+            changed = false;
+        }
+    }
+
+    // Not from inside the paint handler, which must not change the layout
+    if (shown.size() != sizedFor) {
+        CallAfter(&ArrayView::UpdateHeight);
+    }
+
+    wxAutoBufferedPaintDC dc(this);
+    dc.SetBackground(GetParent()->GetBackgroundColour());
+    dc.Clear();
+    if (shown.empty()) {
+        return;
+    }
+
+    wxSize size = GetClientSize();
+    switch (mode) {
+        case BARS:
+            PaintBars(dc, size);
+            break;
+        case SPARKLINE:
+            PaintSparkline(dc, size);
+            break;
+        default:
+            PaintNumbers(dc, size);
+            break;
+    }
+}
+
+// The elements in cells of equal width, wrapped at the edge of the control
+void ArrayView::PaintNumbers(wxDC &dc, const wxSize &size)
+{
+    char text[24];
+    int length;
+    wxSize cell = NumberCell();
+    int columns = wxMax(1, size.x / cell.x);
+    size_t visible = wxMax(1, size.y / cell.y) * columns;
+
+    dc.SetTextForeground(GetForegroundColour());
+    for (size_t i = 0; i < shown.size(); i ++) {
+        int column = i % columns;
+        int row = i / columns;
+        if (i + 1 == visible && visible < shown.size()) {
+            // Clipped, only until the control has been given its new height
+            dc.DrawText("...", column * cell.x + 10, row * cell.y);
+            break;
+        }
+        length = Format(text, sizeof(text), shown[i]);
+        wxSize extent = dc.GetTextExtent(wxString(text, length));
+        dc.DrawText(wxString(text, length), column * cell.x + cell.x - 10 - extent.x, row * cell.y);
+    }
+}
+
+// Scale of the graphs, symmetric about zero so the sign of every element is visible
+static int FullScale(const std::vector<int16_t> &values)
+{
+    int maximum = 1;
+    for (int16_t value : values) {
+        maximum = wxMax(maximum, abs(value));
+    }
+    return maximum;
+}
+
+void ArrayView::PaintBars(wxDC &dc, const wxSize &size)
+{
+    int fullScale = FullScale(shown);
+    int zero = size.y / 2;
+    int width = wxMax(1, size.x / (int) shown.size());
+
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.SetBrush(wxBrush(wxColour(0x40, 0x70, 0xb0)));
+    for (size_t i = 0; i < shown.size(); i ++) {
+        int height = shown[i] * (size.y / 2) / fullScale;
+        if (height >= 0) {
+            dc.DrawRectangle(i * width, zero - height, wxMax(1, width - 1), height);
+        } else {
+            dc.DrawRectangle(i * width, zero, wxMax(1, width - 1), -height);
+        }
+    }
+    dc.SetPen(*wxGREY_PEN);
+    dc.DrawLine(0, zero, size.x, zero);
+}
+
+void ArrayView::PaintSparkline(wxDC &dc, const wxSize &size)
+{
+    int fullScale = FullScale(shown);
+    int zero = size.y / 2;
+
+    dc.SetPen(*wxGREY_PEN);
+    dc.DrawLine(0, zero, size.x, zero);
+    if (shown.size() < 2) {
+        return;
+    }
+
+    points.resize(shown.size());
+    for (size_t i = 0; i < shown.size(); i ++) {
+        points[i].x = i * (size.x - 1) / (shown.size() - 1);
+        points[i].y = zero - shown[i] * (size.y / 2 - 1) / fullScale;
+    }
+    dc.SetPen(wxPen(wxColour(0x40, 0x70, 0xb0), 2));
+    dc.DrawLines(points.size(), points.data());
+}
@@ -0,0 +1,61 @@
+#ifndef _ARRAY_VIEW_H
+#define _ARRAY_VIEW_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include <wx/wx.h>
+
+//--------------------------------------------------------------------------------------------------
+// Instantaneous force or torque magnitude array
+//
+// One custom painted control in place of a label per element. SetValues() copies the array into a
+// buffer that is reused from packet to packet. The paint handler draws from a second reused buffer,
+// so a notification never creates or destroys a window. Numbers wrap onto as many rows as they
+// need; the control only asks for a new layout when that number of rows changes.
+//--------------------------------------------------------------------------------------------------
+class ArrayView : public wxWindow
+{
+public:
+    enum modes {
+        NUMBERS,
+        BARS,
+        SPARKLINE,
+    };
+
+    // Elements are displayed as raw * scale with the given number of decimals
+    ArrayView(wxWindow *parent, double scale, int precision);
+
+    void SetMode(int mode);
+
+    // Any thread. Elements are little-endian int16 at arbitrary alignment. Returns true if the
+    // values changed and the control needs repainting (see ViewModel::Refresh).
+    bool SetValues(const uint8_t *array, int count);
+    void Clear();
+
+    static const int MAXIMUM_ELEMENTS = 256;
+
+private:
+    void OnPaint(wxPaintEvent &evt);
+    void OnSize(wxSizeEvent &evt);
+    wxSize NumberCell();
+    void UpdateHeight();
+    void PaintNumbers(wxDC &dc, const wxSize &size);
+    void PaintBars(wxDC &dc, const wxSize &size);
+    void PaintSparkline(wxDC &dc, const wxSize &size);
+    int Format(char *text, size_t size, int16_t value) const;
+
+    double scale;
+    int precision;
+    int mode = NUMBERS;
+
+    std::mutex lock;
+    std::vector<int16_t> pending;       // Written by SetValues
+    std::vector<int16_t> shown;         // Read by the paint handler
+    bool changed = false;
+    std::vector<wxPoint> points;        // Reused sparkline vertices
+    size_t sizedFor = 0;                // Element count the height was last set for
+};
+
+#endif /* _ARRAY_VIEW_H */
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "column-file.h"
+#include "session-log.h"
+#include "varint.h"
+
+namespace ColumnFile
+{
+
+//--------------------------------------------------------------------------------------------------
+// Writer
+//--------------------------------------------------------------------------------------------------
+Writer::~Writer()
+{
+    if (fd >= 0) {
+        Close();
+    }
+}
+
+bool Writer::Open(const char *path, int64_t created_realtime_ns, int64_t created_monotonic_ns)
+{
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    failed = false;
+    offset = 0;
+    columns.clear();
+    chunks.clear();
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.chunk_samples = CHUNK_SAMPLES;
+    header.created_realtime_ns = created_realtime_ns;
+    header.created_monotonic_ns = created_monotonic_ns;
+    return WriteAll(&header, sizeof(header));
+}
+
+int Writer::AddChannel(const char *name, const char *unit, double scale)
+{
+    if (columns.size() >= MAXIMUM_CHANNELS) {
+        return -1;
+    }
+    columns.emplace_back();
+    Column &column = columns.back();
+    memset(&column.info, 0, sizeof(column.info));
+    strncpy(column.info.name, name, sizeof(column.info.name) - 1);
+    strncpy(column.info.unit, unit, sizeof(column.info.unit) - 1);
+    column.info.scale = scale;
+    column.times.reserve(CHUNK_SAMPLES);
+    column.values.reserve(CHUNK_SAMPLES);
+    return columns.size() - 1;
+}
+
+bool Writer::WriteAll(const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    while (length) {
+        ssize_t n = write(fd, p, length);
+        if (n <= 0) {
+            perror("Column file");
+            failed = true;
+            return false;
+        }
+        p += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+void Writer::WriteChunk(int channel)
+{
+    Column &column = columns[channel];
+    size_t n = column.times.size();
+    if (n == 0) {
+        return;
+    }
+
+    // At most ten bytes a varint, two varints a sample
+    encoded.resize(n * 20);
+    uint8_t *p = encoded.data();
+    ChunkInfo chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    // Logs given out of order can take a channel back in time, so the span is not just the ends
+    auto span = std::minmax_element(column.times.begin(), column.times.end());
+    chunk.first_ns = *span.first;
+    chunk.last_ns = *span.second;
+    chunk.minimum = chunk.maximum = column.values[0];
+    int64_t previous = chunk.first_ns;
+    for (size_t i = 0; i < n; i++) {
+        p = PutVarint(p, ZigZag(column.times[i] - previous));
+        previous = column.times[i];
+    }
+    previous = 0;
+    for (size_t i = 0; i < n; i++) {
+        p = PutVarint(p, ZigZag(column.values[i] - previous));
+        previous = column.values[i];
+        chunk.minimum = std::min(chunk.minimum, previous);
+        chunk.maximum = std::max(chunk.maximum, previous);
+    }
+
+    chunk.offset = offset;
+    chunk.bytes = p - encoded.data();
+    chunk.samples = n;
+    chunk.channel = channel;
+    chunk.crc = SessionLog::Crc32(encoded.data(), chunk.bytes);
+    if (WriteAll(encoded.data(), chunk.bytes)) {
+        chunks.push_back(chunk);
+        column.info.samples += n;
+    }
+    column.times.clear();
+    column.values.clear();
+}
+
+bool Writer::Close()
+{
+    if (fd < 0) {
+        return false;
+    }
+    for (size_t c = 0; c < columns.size(); c++) {
+        WriteChunk(c);
+    }
+
+    // The chunks of each channel together, in time order
+    std::stable_sort(chunks.begin(), chunks.end(), [](const ChunkInfo &a, const ChunkInfo &b) {
+        return a.channel < b.channel;
+    });
+    uint32_t first = 0;
+    for (size_t c = 0; c < columns.size(); c++) {
+        ChannelInfo &info = columns[c].info;
+        info.first_chunk = first;
+        info.chunks = 0;
+        while (first + info.chunks < chunks.size() && chunks[first + info.chunks].channel == c) {
+            info.chunks++;
+        }
+        first += info.chunks;
+    }
+
+    Trailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.directory = offset;
+    trailer.channels = columns.size();
+    trailer.chunks = chunks.size();
+    memcpy(trailer.magic, TRAILER_MAGIC, sizeof(trailer.magic));
+    for (const Column &column : columns) {
+        WriteAll(&column.info, sizeof(column.info));
+    }
+    WriteAll(chunks.data(), chunks.size() * sizeof(ChunkInfo));
+    WriteAll(&trailer, sizeof(trailer));
+
+    if (close(fd) < 0) {
+        failed = true;
+    }
+    fd = -1;
+    columns.clear();
+    chunks.clear();
+    return !failed;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Reader
+//--------------------------------------------------------------------------------------------------
+Reader::~Reader()
+{
+    Close();
+}
+
+bool Reader::Open(const char *path)
+{
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) (sizeof(FileHeader) + sizeof(Trailer))) {
+        fprintf(stderr, "%s: not a column file\n", path);
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    map = (const uint8_t *) p;
+    size = st.st_size;
+
+    // Everything is found from the trailer, which is written last
+    const Trailer &trailer = *(const Trailer *) (map + size - sizeof(Trailer));
+    uint64_t directorySize = trailer.channels * sizeof(ChannelInfo) + (uint64_t) trailer.chunks * sizeof(ChunkInfo);
+    if (memcmp(Header().magic, MAGIC, sizeof(MAGIC)) || Header().version != VERSION ||
+        memcmp(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) || trailer.channels > MAXIMUM_CHANNELS ||
+        trailer.directory < sizeof(FileHeader) || trailer.directory + directorySize != size - sizeof(Trailer)) {
+        fprintf(stderr, "%s: not a complete column file\n", path);
+        Close();
+        return false;
+    }
+    channels = trailer.channels;
+    channelInfo = (const ChannelInfo *) (map + trailer.directory);
+    chunkInfo = (const ChunkInfo *) (map + trailer.directory + channels * sizeof(ChannelInfo));
+    for (int c = 0; c < channels; c++) {
+        if ((uint64_t) channelInfo[c].first_chunk + channelInfo[c].chunks > trailer.chunks) {
+            fprintf(stderr, "%s: damaged column file directory\n", path);
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void Reader::Close()
+{
+    if (map) {
+        munmap((void *) map, size);
+    }
+    map = nullptr;
+    size = 0;
+    channels = 0;
+    channelInfo = nullptr;
+    chunkInfo = nullptr;
+}
+
+int Reader::Find(const char *name) const
+{
+    for (int c = 0; c < channels; c++) {
+        if (strncmp(channelInfo[c].name, name, sizeof(channelInfo[c].name)) == 0) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+bool Reader::DecodeChunk(const ChunkInfo &chunk, std::vector<int64_t> &times, std::vector<int64_t> &values) const
+{
+    if (chunk.offset + chunk.bytes > size) {
+        return false;
+    }
+    const uint8_t *p = map + chunk.offset;
+    const uint8_t *end = p + chunk.bytes;
+    if (SessionLog::Crc32(p, chunk.bytes) != chunk.crc) {
+        return false;
+    }
+
+    size_t start = times.size();
+    times.resize(start + chunk.samples);
+    values.resize(start + chunk.samples);
+    uint64_t v;
+    int64_t previous = chunk.first_ns;
+    for (uint32_t i = 0; i < chunk.samples; i++) {
+        if (!GetVarint(p, end, v)) {
+            return false;
+        }
+        previous += UnZigZag(v);
+        times[start + i] = previous;
+    }
+    previous = 0;
+    for (uint32_t i = 0; i < chunk.samples; i++) {
+        if (!GetVarint(p, end, v)) {
+            return false;
+        }
+        previous += UnZigZag(v);
+        values[start + i] = previous;
+    }
+    return true;
+}
+
+bool Reader::Extremes(int channel, int64_t from, int64_t to, double &minimum, double &maximum)
+{
+    const ChannelInfo &info = channelInfo[channel];
+    int64_t low = INT64_MAX;
+    int64_t high = INT64_MIN;
+    for (uint32_t c = 0; c < info.chunks; c++) {
+        const ChunkInfo &chunk = Chunk(channel, c);
+        if (chunk.last_ns < from || chunk.first_ns >= to) {
+            continue;
+        }
+        if (chunk.first_ns >= from && chunk.last_ns < to) {
+            low = std::min(low, chunk.minimum);
+            high = std::max(high, chunk.maximum);
+            continue;
+        }
+        times.clear();
+        values.clear();
+        if (!DecodeChunk(chunk, times, values)) {
+            continue;
+        }
+        for (size_t i = 0; i < times.size(); i++) {
+            if (times[i] >= from && times[i] < to) {
+                low = std::min(low, values[i]);
+                high = std::max(high, values[i]);
+            }
+        }
+    }
+    if (low > high) {
+        return false;
+    }
+    // A negative scale swaps the ends
+    minimum = std::min(low * info.scale, high * info.scale);
+    maximum = std::max(low * info.scale, high * info.scale);
+    return true;
+}
+
+}
@@ -0,0 +1,205 @@
+#ifndef _COLUMN_FILE_H
+#define _COLUMN_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Column file format
+//
+// Decoded channels of a session, one column per channel, for analysis. Each column is cut into
+// chunks of up to CHUNK_SAMPLES samples, and each chunk is compressed on its own:
+//
+//  FileHeader      64 bytes
+//  chunks          of all channels, in the order they filled up
+//  directory       a ChannelInfo per channel, then a ChunkInfo per chunk, by channel then time
+//  Trailer         24 bytes at the end of the file, locating the directory
+//
+// A sample is a host time and an integer value. The channel scale turns the integer into the value
+// in the channel unit, so a channel keeps the raw counts it was recorded in. A chunk holds the
+// zigzag varint differences of its times from the previous time (the first from the chunk first_ns,
+// its earliest time), then the zigzag varint differences of its values from the previous value (the
+// first from zero). The ChunkInfo records the time span, the minimum and maximum value and the CRC
+// of the chunk, so a query over a time range only reads the chunks that overlap it, and the
+// extremes of a range only decode the chunks that the range cuts.
+//
+// All integers are little-endian. Host times are CLOCK_MONOTONIC nanoseconds as in the session log.
+//--------------------------------------------------------------------------------------------------
+namespace ColumnFile
+{
+    constexpr char MAGIC[8] = {'I', 'C', '2', 'S', 'C', 'O', 'L', 0};
+    constexpr char TRAILER_MAGIC[8] = {'I', 'C', '2', 'S', 'E', 'N', 'D', 0};
+    constexpr uint16_t VERSION = 1;
+    constexpr uint32_t CHUNK_SAMPLES = 4096;
+    constexpr int MAXIMUM_CHANNELS = 64;
+
+    struct FileHeader {
+        char magic[8];
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t chunk_samples;
+        int64_t created_realtime_ns;            // Of the session, from its log
+        int64_t created_monotonic_ns;
+        uint8_t reserved2[32];
+    };
+    static_assert(sizeof(FileHeader) == 64, "Column file header layout");
+
+    struct ChannelInfo {
+        char name[16];                          // NUL terminated
+        char unit[8];
+        double scale;                           // Value in unit per count
+        uint64_t samples;
+        uint32_t chunks;
+        uint32_t first_chunk;                   // Index of its first ChunkInfo
+    };
+    static_assert(sizeof(ChannelInfo) == 48, "Column file channel layout");
+
+    struct ChunkInfo {
+        int64_t first_ns;
+        int64_t last_ns;
+        int64_t minimum;                        // Counts
+        int64_t maximum;
+        uint64_t offset;                        // In the file
+        uint32_t bytes;
+        uint32_t samples;
+        uint16_t channel;
+        uint16_t reserved;
+        uint32_t crc;                           // Of the chunk bytes
+    };
+    static_assert(sizeof(ChunkInfo) == 56, "Column file chunk layout");
+
+    struct Trailer {
+        uint64_t directory;                     // Offset of the first ChannelInfo
+        uint16_t channels;
+        uint16_t reserved;
+        uint32_t chunks;
+        char magic[8];
+    };
+    static_assert(sizeof(Trailer) == 24, "Column file trailer layout");
+
+    //----------------------------------------------------------------------------------------------
+    // Writer
+    //
+    // Channels are added first, then samples are appended in time order within each channel. A
+    // channel only buffers the chunk it is filling, so memory does not grow with the session.
+    //----------------------------------------------------------------------------------------------
+    class Writer
+    {
+    public:
+        ~Writer();
+
+        bool Open(const char *path, int64_t created_realtime_ns, int64_t created_monotonic_ns);
+        // Before the first Append. Returns the channel number, -1 if there are too many.
+        int AddChannel(const char *name, const char *unit, double scale);
+        void Append(int channel, int64_t host_ns, int64_t value)
+        {
+            Column &column = columns[channel];
+            column.times.push_back(host_ns);
+            column.values.push_back(value);
+            if (column.times.size() == CHUNK_SAMPLES) {
+                WriteChunk(channel);
+            }
+        }
+        // Writes the partly filled chunks and the directory. False if anything failed to write.
+        bool Close();
+
+    private:
+        struct Column {
+            ChannelInfo info;
+            std::vector<int64_t> times;
+            std::vector<int64_t> values;
+        };
+
+        void WriteChunk(int channel);
+        bool WriteAll(const void *data, size_t length);
+
+        int fd = -1;
+        bool failed = false;
+        uint64_t offset = 0;
+        std::vector<Column> columns;
+        std::vector<ChunkInfo> chunks;
+        std::vector<uint8_t> encoded;
+    };
+
+    //----------------------------------------------------------------------------------------------
+    // Reader
+    //
+    // Maps the file read-only. Not for use from more than one thread at a time, as decoding reuses
+    // the same buffers.
+    //----------------------------------------------------------------------------------------------
+    class Reader
+    {
+    public:
+        ~Reader();
+
+        // False if the file is not a complete column file
+        bool Open(const char *path);
+        void Close();
+
+        const FileHeader &Header() const
+        {
+            return *(const FileHeader *) map;
+        }
+        int Channels() const
+        {
+            return channels;
+        }
+        const ChannelInfo &Channel(int channel) const
+        {
+            return channelInfo[channel];
+        }
+        // Channel number by name, -1 if there is none
+        int Find(const char *name) const;
+        const ChunkInfo &Chunk(int channel, uint32_t chunk) const
+        {
+            return chunkInfo[channelInfo[channel].first_chunk + chunk];
+        }
+
+        // Times and values (counts) of a chunk, appended. False if it is damaged.
+        bool DecodeChunk(const ChunkInfo &chunk, std::vector<int64_t> &times, std::vector<int64_t> &values) const;
+
+        // Calls callback(int64_t host_ns, double value) for the samples of the channel with
+        // from <= host_ns < to, decoding only the chunks that overlap the range. Returns the
+        // number of samples.
+        template <class Callback> size_t ForEachSample(int channel, int64_t from, int64_t to, Callback &&callback)
+        {
+            size_t count = 0;
+            const ChannelInfo &info = channelInfo[channel];
+            for (uint32_t c = 0; c < info.chunks; c++) {
+                const ChunkInfo &chunk = Chunk(channel, c);
+                if (chunk.last_ns < from || chunk.first_ns >= to) {
+                    continue;
+                }
+                times.clear();
+                values.clear();
+                if (!DecodeChunk(chunk, times, values)) {
+                    continue;
+                }
+                for (size_t i = 0; i < times.size(); i++) {
+                    if (times[i] >= from && times[i] < to) {
+                        callback(times[i], values[i] * info.scale);
+                        count++;
+                    }
+                }
+            }
+            return count;
+        }
+
+        // Smallest and largest value over a range. Chunks inside the range are answered from the
+        // directory. False if there is no sample in the range.
+        bool Extremes(int channel, int64_t from, int64_t to, double &minimum, double &maximum);
+
+    private:
+        const uint8_t *map = nullptr;
+        size_t size = 0;
+        int channels = 0;
+        const ChannelInfo *channelInfo = nullptr;
+        const ChunkInfo *chunkInfo = nullptr;
+        std::vector<int64_t> times;
+        std::vector<int64_t> values;
+    };
+}
+
+#endif /* _COLUMN_FILE_H */
@@ -0,0 +1,449 @@
+#ifndef _CONTROL_POINT_H
+#define _CONTROL_POINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+//--------------------------------------------------------------------------------------------------
+// Control point codec
+//
+// Every op code is described once, as an Op<> entry in the tables at the bottom of this file, by
+// its text command and the operand fields of the request and of the response payload in wire order.
+// The compiler derives from that entry the packed sizes (checked against the MTU), the encoder used
+// by the thread, the text parser and dispatch used by the command dispatcher and the decoder used
+// by the frame. Nothing here allocates and the field codecs are straight memcpy's into fixed sized
+// buffers.
+//--------------------------------------------------------------------------------------------------
+namespace ControlPoint {
+
+// Largest attribute value for the default ATT_MTU of 23 bytes. The cycling power service has to
+// work with any collector, so its op codes must fit.
+constexpr size_t DEFAULT_MTU_PAYLOAD = 20;
+
+// The InfoCrank firmware negotiates a larger ATT_MTU for its custom service.
+constexpr size_t INFOCRANK_MTU_PAYLOAD = 64;
+
+// Response header shared by both control points: RESPONSE_CODE, request op code, result
+constexpr size_t RESPONSE_HEADER_SIZE = 3;
+constexpr uint8_t RESPONSE_CODE = 0x20;
+
+enum response_codes {
+    SUCCESS = 1,
+    NOT_SUPPORTED,
+    INVALID_OPERAND,
+    OPERATION_FAILED,
+};
+
+//--------------------------------------------------------------------------------------------------
+// Field codecs
+//
+// A field has a value type, a fixed maximum wire size, and Encode/Decode/Parse functions. Decode
+// is only called once the whole payload length has been checked, so it does no bounds checking.
+//--------------------------------------------------------------------------------------------------
+inline const char *SkipBlanks(const char *first, const char *last)
+{
+    while (first < last && (*first == ' ' || *first == '\t')) {
+        first++;
+    }
+    return first;
+}
+
+// Little-endian integer or float, parsed in the given base; in base 16 an 0x prefix is allowed, as
+// the scanf parser took it
+template <class T, int Base = 10> struct Scalar {
+    using type = T;
+    static constexpr size_t size = sizeof(T);
+
+    static size_t Encode(uint8_t *out, const type &value)
+    {
+        memcpy(out, &value, size);
+        return size;
+    }
+
+    static size_t Decode(const uint8_t *in, type &value)
+    {
+        memcpy(&value, in, size);
+        return size;
+    }
+
+    static const char *Parse(const char *first, const char *last, type &value)
+    {
+        first = SkipBlanks(first, last);
+        if constexpr (Base == 16) {
+            if (last - first > 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')) {
+                first += 2;
+            }
+        }
+        std::from_chars_result result;
+        if constexpr (std::is_floating_point_v<T>) {
+            result = std::from_chars(first, last, value);
+        } else {
+            result = std::from_chars(first, last, value, Base);
+        }
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+};
+
+// Integer on the wire, value * Scale, presented as a double (e.g. crank length in 0.5 mm)
+template <class T, int Scale> struct Fixed {
+    using type = double;
+    static constexpr size_t size = sizeof(T);
+
+    static size_t Encode(uint8_t *out, const type &value)
+    {
+        T raw = (T) lround(value * Scale);
+        memcpy(out, &raw, size);
+        return size;
+    }
+
+    static size_t Decode(const uint8_t *in, type &value)
+    {
+        T raw;
+        memcpy(&raw, in, size);
+        value = raw / (double) Scale;
+        return size;
+    }
+
+    static const char *Parse(const char *first, const char *last, type &value)
+    {
+        first = SkipBlanks(first, last);
+        std::from_chars_result result = std::from_chars(first, last, value);
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+};
+
+// Fixed count of one field, blank separated in text
+template <class Field, size_t N> struct Array {
+    using type = std::array<typename Field::type, N>;
+    static constexpr size_t size = Field::size * N;
+
+    static size_t Encode(uint8_t *out, const type &value)
+    {
+        for (size_t i = 0; i < N; i++) {
+            Field::Encode(&out[i * Field::size], value[i]);
+        }
+        return size;
+    }
+
+    static size_t Decode(const uint8_t *in, type &value)
+    {
+        for (size_t i = 0; i < N; i++) {
+            Field::Decode(&in[i * Field::size], value[i]);
+        }
+        return size;
+    }
+
+    static const char *Parse(const char *first, const char *last, type &value)
+    {
+        for (size_t i = 0; i < N && first; i++) {
+            first = Field::Parse(first, last, value[i]);
+        }
+        return first;
+    }
+};
+
+// Unterminated string of at most N bytes, taking the rest of the text line
+template <size_t N> struct String {
+    using type = std::string_view;
+    static constexpr size_t size = N;
+
+    static size_t Encode(uint8_t *out, const type &value)
+    {
+        size_t length = value.size() < N ? value.size() : N;
+        memcpy(out, value.data(), length);
+        return length;
+    }
+
+    static size_t Decode(const uint8_t *in, type &value)
+    {
+        value = std::string_view((const char *) in, strnlen((const char *) in, N));
+        return value.size();
+    }
+
+    static const char *Parse(const char *first, const char *last, type &value)
+    {
+        if (last - first > (ptrdiff_t) N) {
+            return nullptr;
+        }
+        value = std::string_view(first, last - first);
+        return last;
+    }
+};
+
+struct DateTime {
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+};
+
+// YYYY-MM-DDTHH:MM:SS
+struct DateTimeField {
+    using type = DateTime;
+    static constexpr size_t size = 7;
+
+    static size_t Encode(uint8_t *out, const type &value)
+    {
+        memcpy(out, &value.year, 2);
+        out[2] = value.month;
+        out[3] = value.day;
+        out[4] = value.hour;
+        out[5] = value.minute;
+        out[6] = value.second;
+        return size;
+    }
+
+    static size_t Decode(const uint8_t *in, type &value)
+    {
+        memcpy(&value.year, in, 2);
+        value.month = in[2];
+        value.day = in[3];
+        value.hour = in[4];
+        value.minute = in[5];
+        value.second = in[6];
+        return size;
+    }
+
+    static const char *Parse(const char *first, const char *last, type &value)
+    {
+        static const char separators[] = "--T::";
+        uint8_t *parts[] = {&value.month, &value.day, &value.hour, &value.minute, &value.second};
+
+        first = SkipBlanks(first, last);
+        std::from_chars_result result = std::from_chars(first, last, value.year);
+        for (int i = 0; i < 5; i++) {
+            if (result.ec != std::errc() || result.ptr == last || *result.ptr != separators[i]) {
+                return nullptr;
+            }
+            result = std::from_chars(result.ptr + 1, last, *parts[i]);
+        }
+        return result.ec == std::errc() ? result.ptr : nullptr;
+    }
+};
+
+using U8 = Scalar<uint8_t>;
+using U16 = Scalar<uint16_t>;
+using U32 = Scalar<uint32_t>;
+using S16 = Scalar<int16_t>;
+using F32 = Scalar<float>;
+using Hex8 = Scalar<uint8_t, 16>;
+
+//--------------------------------------------------------------------------------------------------
+// Payload layout: a sequence of fields
+//--------------------------------------------------------------------------------------------------
+template <class... Field> struct Fields {
+    using Values = std::tuple<typename Field::type...>;
+    static constexpr size_t size = (0 + ... + Field::size);
+
+    static size_t Encode(uint8_t *out, const Values &values)
+    {
+        return EncodeAll(out, values, std::index_sequence_for<Field...>());
+    }
+
+    // Length is checked once for the whole layout, then every field is copied out unchecked
+    static bool Decode(const uint8_t *in, size_t length, Values &values)
+    {
+        if (length < size) {
+            return false;
+        }
+        DecodeAll(in, values, std::index_sequence_for<Field...>());
+        return true;
+    }
+
+    // Blank separated operands as typed in the user interface. Anything but blanks after the last
+    // operand makes the whole text invalid.
+    static bool Parse(const char *text, Values &values)
+    {
+        const char *last = text + strlen(text);
+        const char *end = ParseAll(text, last, values, std::index_sequence_for<Field...>());
+        return end && SkipBlanks(end, last) == last;
+    }
+
+private:
+    template <size_t... I> static size_t EncodeAll(uint8_t *out, const Values &values, std::index_sequence<I...>)
+    {
+        size_t length = 0;
+        ((length += Field::Encode(&out[length], std::get<I>(values))), ...);
+        return length;
+    }
+
+    template <size_t... I> static void DecodeAll(const uint8_t *in, Values &values, std::index_sequence<I...>)
+    {
+        size_t offset = 0;
+        ((offset += Field::Decode(&in[offset], std::get<I>(values))), ...);
+    }
+
+    template <size_t... I> static const char *ParseAll(const char *first, const char *last, Values &values, std::index_sequence<I...>)
+    {
+        ((first = first ? Field::Parse(first, last, std::get<I>(values)) : nullptr), ...);
+        return first;
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Op code entry: request operands, response payload, and the MTU both have to fit in. The entries
+// below derive from it and add the text command, so an op code is one line of its table.
+//--------------------------------------------------------------------------------------------------
+template <size_t MtuPayload, uint8_t OpCode, class RequestFields, class ResponseFields = Fields<>> struct Op {
+    static constexpr uint8_t op_code = OpCode;
+    using Request = RequestFields;
+    using Response = ResponseFields;
+    using Buffer = std::array<uint8_t, 1 + Request::size>;
+
+    static_assert(1 + Request::size <= MtuPayload, "control point request does not fit in the MTU");
+    static_assert(RESPONSE_HEADER_SIZE + Response::size <= MtuPayload, "control point response does not fit in the MTU");
+
+    static size_t Encode(Buffer &out, const typename Request::Values &values)
+    {
+        out[0] = op_code;
+        return 1 + Request::Encode(&out[1], values);
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Table of the op codes of one control point
+//--------------------------------------------------------------------------------------------------
+template <class... Ops> struct Table {
+    // Finds the op code whose text command starts the line, followed by a blank or the end of the
+    // line, and calls callback(Op(), operands) with the operands after that blank. False if there
+    // is none.
+    template <class Callback> static bool Dispatch(const char *line, Callback &&callback)
+    {
+        return (false || ... || Match<Ops>(line, callback));
+    }
+
+    // Decodes the response payload of the op code and calls callback(Op(), values). False for an
+    // op code not in the table or a payload too short for its response.
+    template <class Callback> static bool Decode(uint8_t op_code, const uint8_t *payload, size_t length, Callback &&callback)
+    {
+        return (false || ... || DecodeResponse<Ops>(op_code, payload, length, callback));
+    }
+
+private:
+    template <class Op, class Callback> static bool Match(const char *line, Callback &callback)
+    {
+        size_t length = strlen(Op::command);
+        if (strncmp(line, Op::command, length) || (line[length] != 0 && line[length] != ' ')) {
+            return false;
+        }
+        callback(Op(), &line[line[length] ? length + 1 : length]);
+        return true;
+    }
+
+    template <class Op, class Callback> static bool DecodeResponse(uint8_t op_code, const uint8_t *payload, size_t length, Callback &callback)
+    {
+        if (op_code != Op::op_code) {
+            return false;
+        }
+        typename Op::Response::Values values;
+        if (!Op::Response::Decode(payload, length, values)) {
+            return false;
+        }
+        callback(Op(), values);
+        return true;
+    }
+};
+
+// Overload set of handlers for Table::Decode, e.g. one per response plus [](auto, const auto &) {}
+template <class... Handler> struct Handlers : Handler... {
+    using Handler::operator()...;
+};
+template <class... Handler> Handlers(Handler...) -> Handlers<Handler...>;
+
+//--------------------------------------------------------------------------------------------------
+// Cycling power control point (0x2a66)
+//--------------------------------------------------------------------------------------------------
+namespace CyclingPower {
+    template <uint8_t OpCode, class Request, class Response = Fields<>> using Op = ControlPoint::Op<DEFAULT_MTU_PAYLOAD, OpCode, Request, Response>;
+
+    struct SetCumulativeValue : Op<0x01, Fields<U32>> { static constexpr const char *command = "Set cumulative value"; };
+    struct UpdateSensorLocation : Op<0x02, Fields<U8>> { static constexpr const char *command = "Set sensor location"; };
+    struct RequestSupportedSensorLocations : Op<0x03, Fields<>> { static constexpr const char *command = "Get supported sensor locations"; }; // Response is a list of locations
+    struct SetCrankLength : Op<0x04, Fields<Fixed<uint16_t, 2>>> { static constexpr const char *command = "Set crank length"; };
+    struct RequestCrankLength : Op<0x05, Fields<>, Fields<Fixed<uint16_t, 2>>> { static constexpr const char *command = "Get crank length"; };
+    struct SetChainLength : Op<0x06, Fields<U16>> { static constexpr const char *command = "Set chain length"; };
+    struct RequestChainLength : Op<0x07, Fields<>, Fields<U16>> { static constexpr const char *command = "Get chain length"; };
+    struct SetChainWeight : Op<0x08, Fields<U16>> { static constexpr const char *command = "Set chain weight"; };
+    struct RequestChainWeight : Op<0x09, Fields<>, Fields<U16>> { static constexpr const char *command = "Get chain weight"; };
+    struct SetSpanLength : Op<0x0a, Fields<U16>> { static constexpr const char *command = "Set span"; };
+    struct RequestSpanLength : Op<0x0b, Fields<>, Fields<U16>> { static constexpr const char *command = "Get span"; };
+    struct StartOffsetCompensation : Op<0x0c, Fields<>, Fields<Fixed<int16_t, 32>>> { static constexpr const char *command = "Start offset compensation"; };
+    struct MaskMeasurementContent : Op<0x0d, Fields<U16>> { static constexpr const char *command = "Mask measurement"; };
+    struct RequestSamplingRate : Op<0x0e, Fields<>, Fields<U8>> { static constexpr const char *command = "Get sampling rate"; };
+    struct RequestFactoryCalibrationDate : Op<0x0f, Fields<>, Fields<DateTimeField>> { static constexpr const char *command = "Get factory calibration date"; };
+    struct StartEnhancedOffsetCompensation : Op<0x10, Fields<>, Fields<Fixed<int16_t, 32>>> { static constexpr const char *command = "Start enhanced offset compensation"; };
+
+    using Commands = Table<
+        SetCumulativeValue,
+        UpdateSensorLocation,
+        RequestSupportedSensorLocations,
+        SetCrankLength,
+        RequestCrankLength,
+        SetChainLength,
+        RequestChainLength,
+        SetChainWeight,
+        RequestChainWeight,
+        SetSpanLength,
+        RequestSpanLength,
+        StartOffsetCompensation,
+        MaskMeasurementContent,
+        RequestSamplingRate,
+        RequestFactoryCalibrationDate,
+        StartEnhancedOffsetCompensation
+    >;
+}
+
+//--------------------------------------------------------------------------------------------------
+// InfoCrank custom control point
+//--------------------------------------------------------------------------------------------------
+namespace InfoCrank {
+    template <uint8_t OpCode, class Request, class Response = Fields<>> using Op = ControlPoint::Op<INFOCRANK_MTU_PAYLOAD, OpCode, Request, Response>;
+
+    struct SetSerialNumber : Op<0x01, Fields<String<19>>> { static constexpr const char *command = "Set serial number"; };
+    struct SetFactoryCalibrationDate : Op<0x02, Fields<DateTimeField>> { static constexpr const char *command = "Set factory calibration date"; };
+    struct SetCalibrationParameters : Op<0x03, Fields<Array<F32, 6>>> { static constexpr const char *command = "Set strain parameters"; };
+    struct RequestCalibrationParameters : Op<0x04, Fields<>, Fields<Array<F32, 6>>> { static constexpr const char *command = "Get strain parameters"; };
+    struct SetAccel1Transform : Op<0x05, Fields<Array<S16, 12>>> { static constexpr const char *command = "Set accelerometer 1 transform"; };
+    struct RequestAccel1Transform : Op<0x06, Fields<>, Fields<Array<S16, 12>>> { static constexpr const char *command = "Get accelerometer 1 transform"; };
+    struct SetAccel2Transform : Op<0x07, Fields<Array<S16, 12>>> { static constexpr const char *command = "Set accelerometer 2 transform"; };
+    struct RequestAccel2Transform : Op<0x08, Fields<>, Fields<Array<S16, 12>>> { static constexpr const char *command = "Get accelerometer 2 transform"; };
+    struct SetKFParameters : Op<0x09, Fields<F32, F32, F32, F32, F32>> { static constexpr const char *command = "Set KF parameters"; };
+    struct RequestKFParameters : Op<0x0a, Fields<>, Fields<F32, F32, F32, F32, F32>> { static constexpr const char *command = "Get KF parameters"; };
+    struct SetPartnerAddress : Op<0x0b, Fields<Array<Hex8, 6>>> { static constexpr const char *command = "Set partner address"; };
+    struct RequestPartnerAddress : Op<0x0c, Fields<>, Fields<Array<U8, 6>>> { static constexpr const char *command = "Get partner address"; };
+    struct DeletePartnerAddress : Op<0x0d, Fields<>> { static constexpr const char *command = "Delete partner address"; };
+    struct SetCyclingPowerVectorParameters : Op<0x0e, Fields<U8, U8>> { static constexpr const char *command = "Set cycling power vector parameters"; };
+    struct RequestCyclingPowerVectorParameters : Op<0x0f, Fields<>, Fields<U8, U8>> { static constexpr const char *command = "Get cycling power vector parameters"; };
+
+    using Commands = Table<
+        SetSerialNumber,
+        SetFactoryCalibrationDate,
+        SetCalibrationParameters,
+        RequestCalibrationParameters,
+        SetAccel1Transform,
+        RequestAccel1Transform,
+        SetAccel2Transform,
+        RequestAccel2Transform,
+        SetKFParameters,
+        RequestKFParameters,
+        SetPartnerAddress,
+        RequestPartnerAddress,
+        DeletePartnerAddress,
+        SetCyclingPowerVectorParameters,
+        RequestCyclingPowerVectorParameters
+    >;
+}
+
+} // namespace ControlPoint
+
+#endif /* _CONTROL_POINT_H */
@@ -0,0 +1,415 @@
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "crank-estimators.h"
+
+const char *const crank_estimators[] = {"ekf", "ukf", "complementary", "pll", nullptr};
+
+// The model's settings back from its matrices
+static double Interval(const CrankModel &model)
+{
+    return model.F[0][1];
+}
+
+static double AccelerationVariance(const CrankModel &model)
+{
+    return model.Q[2][2];
+}
+
+static double MeasurementVariance(const CrankModel &model)
+{
+    return model.R[0][0];
+}
+
+// Gravity turned through θ, g sin θ and g cos θ, with the centripetal and tangential terms
+// cancelled between the two radii. The weights are worked out once, so a step only multiplies.
+struct Gravity {
+    double w1, w2;                      // -r1 / (r2 - r1) and r2 / (r2 - r1)
+
+    explicit Gravity(const CrankModel &model)
+    {
+        double inverse = 1.0 / (model.r2 - model.r1);
+        w1 = -model.r1 * inverse;
+        w2 = model.r2 * inverse;
+    }
+
+    void Measure(const double z[4], double &gs, double &gc) const
+    {
+        gs = w2 * z[0] + w1 * z[2];
+        gc = w2 * z[1] + w1 * z[3];
+    }
+};
+
+// Loop bandwidth, rad/sec, where white α of variance va meets the noise of the gravity angle.
+// Per step that angle has variance vacc (r1² + r2²) / ((r2 - r1) g)², and its spectral density is
+// that times the step.
+static double Bandwidth(const CrankModel &model)
+{
+    double dt = Interval(model);
+    double spread = model.r2 - model.r1;
+    double angle = MeasurementVariance(model) * (model.r1 * model.r1 + model.r2 * model.r2) /
+                   (spread * spread * CrankModel::GRAVITY * CrankModel::GRAVITY);
+    return pow(AccelerationVariance(model) / (angle * dt), 1.0 / 6.0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// EKF
+//--------------------------------------------------------------------------------------------------
+class EkfEstimator : public CrankEstimator
+{
+public:
+    explicit EkfEstimator(const CrankModel &model) :
+        ekf(model)
+    {
+        Reset();
+    }
+
+    const char *Name() const override
+    {
+        return "ekf";
+    }
+
+    void Reset() override
+    {
+        ekf.Reset();
+        std::copy(ekf.x, ekf.x + 3, x);
+    }
+
+    void Step(const double z[4]) override
+    {
+        ekf.Step(z);
+        std::copy(ekf.x, ekf.x + 3, x);
+    }
+
+private:
+    CrankEkf ekf;
+};
+
+//--------------------------------------------------------------------------------------------------
+// UKF
+//
+// The transition is linear, so the prediction is the EKF's. The update spreads 2n sigma points at
+// x ± √n columns of chol(P), equally weighted (κ = 0), carries each through h, and takes the gain
+// from their spread: K = Pxz S⁻¹, P -= K S K'.
+//--------------------------------------------------------------------------------------------------
+class UkfEstimator : public CrankEstimator
+{
+public:
+    explicit UkfEstimator(const CrankModel &model) :
+        model(model)
+    {
+        Reset();
+    }
+
+    const char *Name() const override
+    {
+        return "ukf";
+    }
+
+    void Reset() override
+    {
+        for (int i = 0; i < 3; i++) {
+            x[i] = 0.0;
+            for (int j = 0; j < 3; j++) {
+                P[i][j] = 0.0;
+            }
+        }
+    }
+
+    void Step(const double z[4]) override
+    {
+        Predict();
+        Update(z);
+    }
+
+private:
+    static const int N = 3;
+    static const int M = 4;
+    static const int POINTS = 2 * N;
+
+    void Predict()
+    {
+        const double (&F)[N][N] = model.F;
+        double Fx[N];
+        double FP[N][N];
+        for (int i = 0; i < N; i++) {
+            Fx[i] = 0.0;
+            for (int j = 0; j < N; j++) {
+                FP[i][j] = 0.0;
+            }
+            for (int k = 0; k < N; k++) {
+                Fx[i] += F[i][k] * x[k];
+                for (int j = 0; j < N; j++) {
+                    FP[i][j] += F[i][k] * P[k][j];
+                }
+            }
+        }
+        for (int i = 0; i < N; i++) {
+            x[i] = Fx[i];
+            for (int j = i; j < N; j++) {
+                double s = model.Q[i][j];
+                for (int k = 0; k < N; k++) {
+                    s += FP[i][k] * F[j][k];
+                }
+                P[i][j] = P[j][i] = s;
+            }
+        }
+    }
+
+    void Update(const double z[4])
+    {
+        // Sigma points, from the lower factor of P; P is only semidefinite at the start, so a
+        // vanishing pivot leaves its column zero
+        double L[N][N] = {};
+        for (int j = 0; j < N; j++) {
+            double d = P[j][j];
+            for (int k = 0; k < j; k++) {
+                d -= L[j][k] * L[j][k];
+            }
+            if (!(d > 0.0)) {
+                continue;
+            }
+            L[j][j] = sqrt(d);
+            for (int i = j + 1; i < N; i++) {
+                double s = P[i][j];
+                for (int k = 0; k < j; k++) {
+                    s -= L[i][k] * L[j][k];
+                }
+                L[i][j] = s / L[j][j];
+            }
+        }
+        double spread = sqrt((double) N);
+        double X[POINTS][N];
+        double Z[POINTS][M];
+        double zm[M] = {};
+        for (int p = 0; p < POINTS; p++) {
+            double sign = p < N ? spread : -spread;
+            for (int i = 0; i < N; i++) {
+                X[p][i] = x[i] + sign * L[i][p % N];
+            }
+            double H[M][N];
+            model.Measure(X[p], Z[p], H);
+            for (int i = 0; i < M; i++) {
+                zm[i] += Z[p][i] / POINTS;
+            }
+        }
+
+        // S, and the cross covariance Pxz
+        double S[M][M];
+        double Pxz[N][M] = {};
+        for (int i = 0; i < M; i++) {
+            for (int j = i; j < M; j++) {
+                double s = model.R[i][j];
+                for (int p = 0; p < POINTS; p++) {
+                    s += (Z[p][i] - zm[i]) * (Z[p][j] - zm[j]) / POINTS;
+                }
+                S[i][j] = S[j][i] = s;
+            }
+        }
+        for (int p = 0; p < POINTS; p++) {
+            for (int i = 0; i < N; i++) {
+                for (int j = 0; j < M; j++) {
+                    Pxz[i][j] += (X[p][i] - x[i]) * (Z[p][j] - zm[j]) / POINTS;
+                }
+            }
+        }
+
+        // K' = S⁻¹Pxz' by Cholesky of S
+        double C[M][M];
+        for (int j = 0; j < M; j++) {
+            double d = S[j][j];
+            for (int k = 0; k < j; k++) {
+                d -= C[j][k] * C[j][k];
+            }
+            if (!(d > 0.0)) {
+                return;
+            }
+            C[j][j] = sqrt(d);
+            for (int i = j + 1; i < M; i++) {
+                double s = S[i][j];
+                for (int k = 0; k < j; k++) {
+                    s -= C[i][k] * C[j][k];
+                }
+                C[i][j] = s / C[j][j];
+            }
+        }
+        double Kt[M][N];
+        for (int i = 0; i < M; i++) {
+            for (int j = 0; j < N; j++) {
+                double v = Pxz[j][i];
+                for (int k = 0; k < i; k++) {
+                    v -= C[i][k] * Kt[k][j];
+                }
+                Kt[i][j] = v / C[i][i];
+            }
+        }
+        for (int i = M; i-- > 0;) {
+            for (int j = 0; j < N; j++) {
+                double v = Kt[i][j];
+                for (int k = i + 1; k < M; k++) {
+                    v -= C[k][i] * Kt[k][j];
+                }
+                Kt[i][j] = v / C[i][i];
+            }
+        }
+
+        // x += K(z - zm), P -= K Pxz', which is K S K'
+        for (int i = 0; i < N; i++) {
+            for (int k = 0; k < M; k++) {
+                x[i] += Kt[k][i] * (z[k] - zm[k]);
+            }
+        }
+        for (int i = 0; i < N; i++) {
+            for (int j = i; j < N; j++) {
+                double s = P[i][j];
+                for (int k = 0; k < M; k++) {
+                    s -= Kt[k][i] * Pxz[j][k];
+                }
+                P[i][j] = P[j][i] = s;
+            }
+        }
+    }
+
+    CrankModel model;
+    double P[N][N];
+};
+
+//--------------------------------------------------------------------------------------------------
+// Complementary filter
+//
+// The angle comes from gravity and the rate from the centripetal difference between the radii,
+// (x1 - x2) / (r2 - r1) = ω², which knows nothing of direction; the sign is that of the angle's
+// own drift. Each is low passed at the model's bandwidth and the angle is carried forward on the
+// rate in between, the usual complementary split. α is the low passed change in ω.
+//--------------------------------------------------------------------------------------------------
+class ComplementaryEstimator : public CrankEstimator
+{
+public:
+    explicit ComplementaryEstimator(const CrankModel &model) :
+        gravity(model)
+    {
+        dt = Interval(model);
+        inverseDt = 1.0 / dt;
+        inverseSpread = 1.0 / (model.r2 - model.r1);
+        double bandwidth = Bandwidth(model);
+        angleGain = std::min(1.0, bandwidth * dt);
+        rateGain = std::min(1.0, bandwidth * dt / 4.0);
+        Reset();
+    }
+
+    const char *Name() const override
+    {
+        return "complementary";
+    }
+
+    void Reset() override
+    {
+        for (int i = 0; i < 3; i++) {
+            x[i] = 0.0;
+        }
+        squared = 0.0;
+        drift = 0.0;
+    }
+
+    void Step(const double z[4]) override
+    {
+        double gs, gc;
+        gravity.Measure(z, gs, gc);
+
+        // Rate: the centripetal difference low passed, signed by the angle's drift
+        squared += rateGain * ((z[0] - z[2]) * inverseSpread - squared);
+        double omega = sqrt(std::max(squared, 0.0));
+        double predicted = x[0] + x[1] * dt;
+        double error = remainder(atan2(gs, gc) - predicted, 2.0 * M_PI);
+        drift += rateGain * (x[1] + error * inverseDt - drift);
+        omega = drift < 0.0 ? -omega : omega;
+
+        // Angle: carried on the rate, pulled to gravity
+        x[0] = predicted + angleGain * error;
+        x[2] += rateGain * ((omega - x[1]) * inverseDt - x[2]);
+        x[1] = omega;
+    }
+
+private:
+    Gravity gravity;
+    double dt;
+    double inverseDt;
+    double inverseSpread;               // 1 / (r2 - r1)
+    double angleGain;
+    double rateGain;
+    double squared;                     // ω², low passed
+    double drift;                       // Rate the angle corrections imply, low passed
+};
+
+//--------------------------------------------------------------------------------------------------
+// Phase locked loop
+//
+// The phase detector is the cross product of the gravity vector with the estimated direction,
+// g sin(θ - θ̂) scaled by 1/g, so a step is one sin and cos and some multiplies. The loop filter is
+// third order with its three poles at the model's bandwidth ωn, (s + ωn)³, which tracks a steady
+// α without error.
+//--------------------------------------------------------------------------------------------------
+class PllEstimator : public CrankEstimator
+{
+public:
+    explicit PllEstimator(const CrankModel &model) :
+        gravity(model)
+    {
+        dt = Interval(model);
+        double wn = Bandwidth(model);
+        k1 = 3.0 * wn;
+        k2 = 3.0 * wn * wn;
+        k3 = wn * wn * wn;
+        Reset();
+    }
+
+    const char *Name() const override
+    {
+        return "pll";
+    }
+
+    void Reset() override
+    {
+        for (int i = 0; i < 3; i++) {
+            x[i] = 0.0;
+        }
+    }
+
+    void Step(const double z[4]) override
+    {
+        double gs, gc;
+        gravity.Measure(z, gs, gc);
+        double theta = x[0] + x[1] * dt + 0.5 * x[2] * dt * dt;
+        double omega = x[1] + x[2] * dt;
+        double e = (gs * cos(theta) - gc * sin(theta)) * (1.0 / CrankModel::GRAVITY);
+        x[0] = theta + k1 * dt * e;
+        x[1] = omega + k2 * dt * e;
+        x[2] += k3 * dt * e;
+    }
+
+private:
+    Gravity gravity;
+    double dt;
+    double k1, k2, k3;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Factory
+//--------------------------------------------------------------------------------------------------
+std::unique_ptr<CrankEstimator> MakeCrankEstimator(const char *name, const CrankModel &model)
+{
+    if (!strcmp(name, "ekf")) {
+        return std::unique_ptr<CrankEstimator>(new EkfEstimator(model));
+    }
+    if (!strcmp(name, "ukf")) {
+        return std::unique_ptr<CrankEstimator>(new UkfEstimator(model));
+    }
+    if (!strcmp(name, "complementary")) {
+        return std::unique_ptr<CrankEstimator>(new ComplementaryEstimator(model));
+    }
+    if (!strcmp(name, "pll")) {
+        return std::unique_ptr<CrankEstimator>(new PllEstimator(model));
+    }
+    return nullptr;
+}
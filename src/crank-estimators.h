@@ -0,0 +1,44 @@
+#ifndef _CRANK_ESTIMATORS_H
+#define _CRANK_ESTIMATORS_H
+
+#include <memory>
+
+#include "ekf.h"
+
+//--------------------------------------------------------------------------------------------------
+// Crank angle estimators
+//
+// Interchangeable estimators of θ, ω and α from the calibrated accelerometer axes x1, y1, x2, y2
+// (m/s²), one acceleration record a step. They all take their settings from a CrankModel (step,
+// radii, σ² α, σ² accel), so a comparison is of the methods and not of their tuning:
+//
+//  ekf             The extended Kalman filter of ekf.h
+//  ukf             Unscented Kalman filter, same model; the measurement is carried through six
+//                  sigma points rather than linearized
+//  complementary   Angle from gravity, the centripetal term cancelled between the two radii, and
+//                  the rate from the difference of the centripetal terms, blended at a crossover
+//                  from the model's noise ratio
+//  pll             Third order phase locked loop on the same gravity angle, bandwidth from the
+//                  model's noise ratio; no divisions or square roots in a step
+//
+// The last two ignore the drive ratio. θ is not wrapped.
+//--------------------------------------------------------------------------------------------------
+class CrankEstimator
+{
+public:
+    double x[3];                        // θ rad, ω rad/sec, α rad/sec²
+
+    virtual ~CrankEstimator() {}
+    virtual const char *Name() const = 0;
+
+    // Stationary at zero
+    virtual void Reset() = 0;
+    virtual void Step(const double z[4]) = 0;
+};
+
+extern const char *const crank_estimators[];           // Names, null terminated
+
+// Null for an unknown name
+std::unique_ptr<CrankEstimator> MakeCrankEstimator(const char *name, const CrankModel &model);
+
+#endif /* _CRANK_ESTIMATORS_H */
@@ -0,0 +1,158 @@
+#include "decode.h"
+
+//--------------------------------------------------------------------------------------------------
+// Helpers for reading little-endian fields at arbitrary alignment
+//--------------------------------------------------------------------------------------------------
+template <class T> static bool Read(const uint8_t *data, int length, int &index, T &value)
+{
+    if (index + (int) sizeof(T) > length) {
+        return false;
+    }
+    memcpy(&value, &data[index], sizeof(T));
+    index += sizeof(T);
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Cycling power measurement
+//--------------------------------------------------------------------------------------------------
+bool MeasurementDecoder::Decode(const uint8_t *data, int length, CyclingPowerMeasurement &m)
+{
+    int index = 0;
+
+    memset(&m, 0, sizeof(m));
+    if (!Read(data, length, index, m.flags) || !Read(data, length, index, m.instantaneous_power)) {
+        return false;
+    }
+
+    if (m.flags.pedal_power_balance_present) {
+        uint8_t pedal_power_balance;
+        if (!Read(data, length, index, pedal_power_balance)) {
+            return false;
+        }
+        m.pedal_power_balance = pedal_power_balance * 0.5f;
+    }
+
+    if (m.flags.accumulated_torque_present) {
+        uint16_t accumulated_torque;
+        if (!Read(data, length, index, accumulated_torque)) {
+            return false;
+        }
+        m.accumulated_torque = accumulated_torque / 32.0f;
+        m.torque = ((int16_t) (accumulated_torque - previous_accumulated_torque)) / 32.0f;
+        previous_accumulated_torque = accumulated_torque;
+    }
+
+    if (m.flags.wheel_revolution_data_present) {
+        if (!Read(data, length, index, m.cumulative_wheel_revolutions) || !Read(data, length, index, m.last_wheel_event_time)) {
+            return false;
+        }
+        // Only a new wheel event gives a new speed
+        uint16_t ticks = m.last_wheel_event_time - previous_last_wheel_event_time;
+        if (ticks) {
+            wheel_speed = 60.0 * (uint32_t) (m.cumulative_wheel_revolutions - previous_cumulative_wheel_revolutions) / (ticks / 2048.0);
+        }
+        m.wheel_speed = wheel_speed;
+        previous_cumulative_wheel_revolutions = m.cumulative_wheel_revolutions;
+        previous_last_wheel_event_time = m.last_wheel_event_time;
+    }
+
+    if (m.flags.crank_revolution_data_present) {
+        if (!Read(data, length, index, m.cumulative_crank_revolutions) || !Read(data, length, index, m.last_crank_event_time)) {
+            return false;
+        }
+        uint16_t ticks = m.last_crank_event_time - previous_last_crank_event_time;
+        if (ticks) {
+            cadence = 60.0 * (uint16_t) (m.cumulative_crank_revolutions - previous_cumulative_crank_revolutions) / (ticks / 1024.0);
+        }
+        m.cadence = cadence;
+        previous_cumulative_crank_revolutions = m.cumulative_crank_revolutions;
+        previous_last_crank_event_time = m.last_crank_event_time;
+    }
+
+    if (m.flags.extreme_force_magnitudes_present) {
+        if (!Read(data, length, index, m.maximum_force_magnitude) || !Read(data, length, index, m.minimum_force_magnitude)) {
+            return false;
+        }
+    }
+
+    if (m.flags.extreme_torque_magnitudes_present) {
+        int16_t maximum;
+        int16_t minimum;
+        if (!Read(data, length, index, maximum) || !Read(data, length, index, minimum)) {
+            return false;
+        }
+        m.maximum_torque_magnitude = maximum / 32.0f;
+        m.minimum_torque_magnitude = minimum / 32.0f;
+    }
+
+    if (m.flags.extreme_angles_present) {
+        // Two 12 bit angles packed into 3 bytes
+        uint8_t angles[3];
+        if (!Read(data, length, index, angles)) {
+            return false;
+        }
+        m.maximum_angle = angles[0] | (angles[1] & 0x0f) << 8;
+        m.minimum_angle = angles[1] >> 4 | angles[2] << 4;
+    }
+
+    if (m.flags.top_dead_spot_angle_present && !Read(data, length, index, m.top_dead_spot_angle)) {
+        return false;
+    }
+
+    if (m.flags.bottom_dead_spot_angle_present && !Read(data, length, index, m.bottom_dead_spot_angle)) {
+        return false;
+    }
+
+    if (m.flags.accumulated_energy_present && !Read(data, length, index, m.accumulated_energy)) {
+        return false;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Cycling power vector
+//--------------------------------------------------------------------------------------------------
+const char *const measurement_directions[4] = {"Unknown", "Tangential Component", "Radial Component", "Lateral Component"};
+
+bool DecodeCyclingPowerVector(const uint8_t *data, int length, CyclingPowerVector &v)
+{
+    int index = 0;
+
+    memset(&v, 0, sizeof(v));
+    if (!Read(data, length, index, v.flags)) {
+        return false;
+    }
+
+    if (v.flags.crank_revolution_data_present) {
+        if (!Read(data, length, index, v.cumulative_crank_revolutions) || !Read(data, length, index, v.last_crank_event_time)) {
+            return false;
+        }
+    }
+
+    if (v.flags.first_crank_measurement_angle_present && !Read(data, length, index, v.first_crank_measurement_angle)) {
+        return false;
+    }
+
+    // The magnitude array takes the rest of the packet
+    if (v.flags.instantaneous_force_magnitude_array_present || v.flags.instantaneous_torque_magnitude_array_present) {
+        v.array = &data[index];
+        v.array_length = (length - index) / sizeof(int16_t);
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// InfoCrank raw data
+//--------------------------------------------------------------------------------------------------
+const uint8_t raw_record_sizes[RAW_OP_CODES] = {
+    4,      // STRAIN_DATA
+    13,     // ACCELERATION_DATA
+    7,      // TEMPERATURE_DATA
+    3,      // BATTERY_DATA
+    13,     // STATE_DATA
+    17,     // VECTOR4
+    37,     // MATRIX33
+};
@@ -0,0 +1,209 @@
+#ifndef _DECODE_H
+#define _DECODE_H
+
+#include <stdint.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------------------------
+// Notification payload decoders
+//
+// These only read the packet and keep whatever state is needed to derive rates from cumulative
+// counters. Nothing here touches the user interface, so the same code serves the live pages and
+// the offline tools.
+//--------------------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------------------
+// Cycling power measurement (0x2a63)
+//--------------------------------------------------------------------------------------------------
+#pragma pack(push, 1)
+struct cycling_power_measurement_flags {
+    uint16_t pedal_power_balance_present: 1;
+    uint16_t pedal_power_balance_reference: 1;
+    uint16_t accumulated_torque_present: 1;
+    uint16_t accumulated_torque_source: 1;
+    uint16_t wheel_revolution_data_present: 1;
+    uint16_t crank_revolution_data_present: 1;
+    uint16_t extreme_force_magnitudes_present: 1;
+    uint16_t extreme_torque_magnitudes_present: 1;
+    uint16_t extreme_angles_present: 1;
+    uint16_t top_dead_spot_angle_present: 1;
+    uint16_t bottom_dead_spot_angle_present: 1;
+    uint16_t accumulated_energy_present: 1;
+    uint16_t offset_compensation_indicator: 1;
+};
+#pragma pack(pop)
+
+struct CyclingPowerMeasurement {
+    struct cycling_power_measurement_flags flags;
+    int16_t instantaneous_power;                // W
+    float pedal_power_balance;                  // %
+    float accumulated_torque;                   // N.m
+    float torque;                               // N.m since the previous measurement
+    uint32_t cumulative_wheel_revolutions;
+    uint16_t last_wheel_event_time;             // s/2048
+    double wheel_speed;                         // RPM
+    uint16_t cumulative_crank_revolutions;
+    uint16_t last_crank_event_time;             // s/1024
+    double cadence;                             // RPM
+    int16_t maximum_force_magnitude;            // N
+    int16_t minimum_force_magnitude;            // N
+    float maximum_torque_magnitude;             // N.m
+    float minimum_torque_magnitude;             // N.m
+    uint16_t maximum_angle;                     // °
+    uint16_t minimum_angle;                     // °
+    uint16_t top_dead_spot_angle;               // °
+    uint16_t bottom_dead_spot_angle;            // °
+    uint16_t accumulated_energy;                // kJ
+};
+
+class MeasurementDecoder
+{
+public:
+    // False if the packet is shorter than its flags say
+    bool Decode(const uint8_t *data, int length, CyclingPowerMeasurement &measurement);
+
+private:
+    uint16_t previous_accumulated_torque = 0;
+    uint32_t previous_cumulative_wheel_revolutions = 0;
+    uint16_t previous_last_wheel_event_time = 0;
+    uint16_t previous_cumulative_crank_revolutions = 0;
+    uint16_t previous_last_crank_event_time = 0;
+    double wheel_speed = 0.0;
+    double cadence = 0.0;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Cycling power vector (0x2a64)
+//--------------------------------------------------------------------------------------------------
+#pragma pack(push, 1)
+struct cycling_power_vector_flags {
+    uint8_t crank_revolution_data_present: 1;
+    uint8_t first_crank_measurement_angle_present: 1;
+    uint8_t instantaneous_force_magnitude_array_present: 1;
+    uint8_t instantaneous_torque_magnitude_array_present: 1;
+    uint8_t instantaneous_measurement_direction: 2;
+};
+#pragma pack(pop)
+
+struct CyclingPowerVector {
+    struct cycling_power_vector_flags flags;
+    uint16_t cumulative_crank_revolutions;
+    uint16_t last_crank_event_time;             // s/1024
+    uint16_t first_crank_measurement_angle;     // °
+
+    // Force (N) or torque (1/32 N.m) magnitude array, left in the packet
+    const uint8_t *array;
+    int array_length;
+
+    int16_t Element(int i) const
+    {
+        int16_t value;
+        memcpy(&value, &array[i * sizeof(int16_t)], sizeof(value));
+        return value;
+    }
+};
+
+extern const char *const measurement_directions[4];
+
+bool DecodeCyclingPowerVector(const uint8_t *data, int length, CyclingPowerVector &vector);
+
+//--------------------------------------------------------------------------------------------------
+// InfoCrank raw data
+//--------------------------------------------------------------------------------------------------
+enum raw_op_codes {
+    STRAIN_DATA = 0,
+    ACCELERATION_DATA,
+    TEMPERATURE_DATA,
+    BATTERY_DATA,
+    STATE_DATA,
+    VECTOR4,
+    MATRIX33,
+    RAW_OP_CODES
+};
+
+#pragma pack(push, 1)
+struct raw_data {
+    uint8_t op_code;
+    union {
+        struct {
+            int32_t unused: 6;
+            int32_t strain: 18;
+        } strain;
+        struct {
+            int16_t accel1_x;
+            int16_t accel1_y;
+            int16_t accel1_z;
+            int16_t accel2_x;
+            int16_t accel2_y;
+            int16_t accel2_z;
+        } acceleration;
+        struct {
+            int16_t integral;
+            int32_t fractional;
+        } temperature;
+        uint16_t voltage;
+        struct {
+            int32_t position;
+            int32_t velocity;
+            int32_t acceleration;
+        } state;
+        float vector4[4];
+        float matrix33[3][3];
+    } data;
+};
+#pragma pack(pop)
+
+// Record size including the op code, zero for an unknown op code
+extern const uint8_t raw_record_sizes[RAW_OP_CODES];
+
+inline int RawRecordSize(uint8_t op_code)
+{
+    return op_code < RAW_OP_CODES ? raw_record_sizes[op_code] : 0;
+}
+
+// Calls callback(const struct raw_data &) for every complete record in the notification. Returns
+// the number of bytes consumed, which is short of length if an unknown op code or a truncated
+// record was found.
+template <class Callback> int ForEachRawRecord(const uint8_t *data, int length, Callback &&callback)
+{
+    int offset = 0;
+    while (offset < length) {
+        int size = RawRecordSize(data[offset]);
+        if (size == 0 || offset + size > length) {
+            break;
+        }
+        callback(*(const struct raw_data *) &data[offset]);
+        offset += size;
+    }
+    return offset;
+}
+
+// Scaling of the raw records
+constexpr double ACCEL_G_PER_COUNT = 8.0 / 32768.0;     // ±8g full scale
+
+inline double RawTemperature(const struct raw_data &raw)
+{
+    return raw.data.temperature.integral + 1.0e-6 * raw.data.temperature.fractional;
+}
+
+inline double RawBatteryVoltage(const struct raw_data &raw)
+{
+    return 0.6f * 6.0f * raw.data.voltage * 0x01p-12;
+}
+
+inline double RawStatePosition(const struct raw_data &raw)        // °
+{
+    return raw.data.state.position * 360.0 * 0x01p-13;
+}
+
+inline double RawStateVelocity(const struct raw_data &raw)        // °/sec
+{
+    return raw.data.state.velocity * 360.0 * 128.0 * 0x01p-35;
+}
+
+inline double RawStateAcceleration(const struct raw_data &raw)    // °/sec²
+{
+    return raw.data.state.acceleration * 360.0 * 16384.0 * 0x01p-40;
+}
+
+#endif /* _DECODE_H */
@@ -0,0 +1,291 @@
+#ifndef _EKF_FIXED_H
+#define _EKF_FIXED_H
+
+#include <stdint.h>
+#include <math.h>
+
+//--------------------------------------------------------------------------------------------------
+// Fixed point crank EKF
+//
+// The CrankModel filter of ekf.h in integer arithmetic only, as the firmware has to run it, so a
+// log can be replayed on the host with the device's quantization and its STATE_DATA records
+// checked against the emulation. What is left over against the double filter is quantization
+// error; a state record that does not match the emulation is a difference in the logic. The formats
+// below are a provisional model of the firmware's, not taken from its sources, so until they are
+// confirmed a mismatch may as well be one of format.
+//
+// Units are those of STATE_DATA: θ in turns, ω in turns per step and α in turns per step², a step
+// being one acceleration record (1/128 s). With dt one step, F is [1 1 ½; 0 1 1; 0 0 1] and the
+// prediction is adds and a shift. The formats are
+//
+//  x       Q40                         State; Position(), Velocity() and Acceleration() round it
+//                                      to the Q13, Q35 and Q40 int32 of the record
+//  P       Q60                         Covariance, in the state's units
+//  z, h, y Q32 m/s²                    Counts times the Q23 calibration, shifted up 9
+//  H       Q40
+//  k       Q60 state per m/s²
+//
+// Products are formed in 128 bits and rounded half up back to the destination format. sin and
+// cos come from a 1024 entry table of Q30 sines, linearly interpolated.
+//
+// The four measurements are applied one at a time, as they are independent (R diagonal), which
+// takes a division per measurement where the double filter takes a Cholesky factorization. Each
+// keeps the linearization of the prediction, less what the earlier ones have moved the state, so
+// the result is the double filter's batch update up to rounding. P is updated in the short form
+// P - khP, upper triangle mirrored. H is CrankModel's, which leaves the rα term of the y axes out
+// of ∂h/∂α, so that the two filters stay comparable.
+//--------------------------------------------------------------------------------------------------
+class CrankEkfFixed
+{
+public:
+    static const int X_BITS = 40;
+    static const int P_BITS = 60;
+    static const int Z_BITS = 32;
+    static const int H_BITS = 40;
+
+    int64_t x[3];                       // θ, ω, α
+    int64_t P[3][3];
+    int64_t y[4];                       // Innovation of the last update
+
+    // As CrankModel, with dt fixed at one step of 1/128 s
+    explicit CrankEkfFixed(double va = 0.10, double vacc = 10.0, double ratio = 0.0,
+                           double r1 = 0.0284, double r2 = 0.0614)
+    {
+        Configure(va, vacc, ratio, r1, r2);
+        Reset();
+    }
+
+    // The constants, from the floating point parameters as the device holds them
+    void Configure(double va, double vacc, double ratio, double r1, double r2)
+    {
+        const double STEP = 2.0 * M_PI * 128.0;         // rad/sec per turn/step
+        // σ² α in (turns/step²)²: va / (2π)² / 128⁴
+        int64_t q = Fixed(va / (4.0 * M_PI * M_PI) / 268435456.0, P_BITS);
+        int64_t quarter = Shift(q, 2);
+        int64_t half = Shift(q, 1);
+        int64_t qm[3][3] = {
+            {quarter, half, half},
+            {half, q, q},
+            {half, q, q},
+        };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                Q[i][j] = qm[i][j];
+            }
+        }
+        R = Fixed(vacc, H_BITS);
+        gravity = Fixed(9.81, Z_BITS);
+        twoPi = Fixed(2.0 * M_PI, 29);
+        centripetal[0] = Fixed(r1 * STEP * STEP, Z_BITS);
+        centripetal[1] = Fixed(r2 * STEP * STEP, Z_BITS);
+        tangential[0] = Fixed(r1 * STEP * 128.0, Z_BITS);
+        tangential[1] = Fixed(r2 * STEP * 128.0, Z_BITS);
+        coupling = Fixed(ratio * STEP * 128.0, Z_BITS);
+    }
+
+    // Zero state, known exactly
+    void Reset()
+    {
+        for (int i = 0; i < 3; i++) {
+            x[i] = 0;
+            for (int j = 0; j < 3; j++) {
+                P[i][j] = 0;
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            y[i] = 0;
+        }
+    }
+
+    // z: x1, y1, x2, y2 in Q32 m/s²
+    void Step(const int64_t z[4])
+    {
+        Predict();
+        Update(z);
+    }
+
+    // The state as STATE_DATA has it
+    int32_t Position() const
+    {
+        return (int32_t) (uint32_t) Shift(x[0], X_BITS - 13);
+    }
+
+    int32_t Velocity() const
+    {
+        return Saturate32(Shift(x[1], X_BITS - 35));
+    }
+
+    int32_t Acceleration() const
+    {
+        return Saturate32(Shift(x[2], X_BITS - 40));
+    }
+
+    // Accelerometer counts through a row of the firmware's Q23 calibration, in Q32 m/s²
+    static int64_t Calibrate(const int32_t a[3], int16_t cx, int16_t cy, int16_t cz)
+    {
+        return ((int64_t) a[0] * cx + (int64_t) a[1] * cy + (int64_t) a[2] * cz) * (1 << (Z_BITS - 23));
+    }
+
+private:
+    // x = Fx, P = FPF' + Q, with F doubled to keep it integral
+    void Predict()
+    {
+        static const int F2[3][3] = {
+            {2, 2, 1},
+            {0, 2, 2},
+            {0, 0, 2},
+        };
+        x[0] += x[1] + Shift(x[2], 1);
+        x[1] += x[2];
+
+        __int128 FP[3][3];
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                FP[i][j] = 0;
+                for (int k = 0; k < 3; k++) {
+                    FP[i][j] += (__int128) F2[i][k] * P[k][j];
+                }
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            for (int j = i; j < 3; j++) {
+                __int128 s = 0;
+                for (int k = 0; k < 3; k++) {
+                    s += FP[i][k] * F2[j][k];
+                }
+                P[i][j] = P[j][i] = Saturate(Shift(s, 2) + Q[i][j]);
+            }
+        }
+    }
+
+    void Update(const int64_t z[4])
+    {
+        // Linearize about the prediction
+        int64_t s, c;
+        SinCos(x[0], s, c);
+        __int128 w2 = (__int128) x[1] * x[1];                                  // Q80
+        int64_t a = Saturate(Shift((__int128) coupling * x[2], Z_BITS));       // Q40 m/s²
+        int64_t u = Saturate(Shift((__int128) a * c, 38) + Shift((__int128) gravity * s, 30));
+        int64_t v = Saturate(-Shift((__int128) a * s, 38) + Shift((__int128) gravity * c, 30));
+        int64_t h[4];
+        int64_t H[4][3];
+        for (int r = 0; r < 2; r++) {
+            h[2 * r] = Saturate(u - Shift(centripetal[r] * w2, 2 * X_BITS));
+            h[2 * r + 1] = Saturate(v + Shift((__int128) tangential[r] * x[2], X_BITS));
+            H[2 * r][0] = Saturate(Shift((__int128) twoPi * v, 29 + Z_BITS - H_BITS));
+            H[2 * r + 1][0] = Saturate(-Shift((__int128) twoPi * u, 29 + Z_BITS - H_BITS));
+            H[2 * r][1] = Saturate(-Shift((__int128) centripetal[r] * x[1], Z_BITS + X_BITS - H_BITS - 1));
+            H[2 * r + 1][1] = 0;
+            H[2 * r][2] = Saturate(Shift((__int128) coupling * c, Z_BITS + 30 - H_BITS));
+            H[2 * r + 1][2] = Saturate(-Shift((__int128) coupling * s, Z_BITS + 30 - H_BITS));
+        }
+
+        int64_t predicted[3] = {x[0], x[1], x[2]};
+        for (int m = 0; m < 4; m++) {
+            // hP, which is also Ph' as P is symmetric, and s = hPh' + R
+            int64_t hp[3];
+            for (int j = 0; j < 3; j++) {
+                __int128 sum = 0;
+                for (int k = 0; k < 3; k++) {
+                    sum += (__int128) H[m][k] * P[k][j];
+                }
+                hp[j] = Saturate(Shift(sum, H_BITS));
+            }
+            __int128 sum = 0;
+            for (int j = 0; j < 3; j++) {
+                sum += (__int128) hp[j] * H[m][j];
+            }
+            int64_t innovationVariance = Saturate(Shift(sum, P_BITS) + R);
+            if (innovationVariance <= 0) {
+                y[m] = 0;
+                continue;
+            }
+
+            // y = z - h - H(x - predicted), then x += ky
+            __int128 moved = 0;
+            for (int k = 0; k < 3; k++) {
+                moved += (__int128) H[m][k] * (x[k] - predicted[k]);
+            }
+            y[m] = Saturate(z[m] - h[m] - Shift(moved, H_BITS + X_BITS - Z_BITS));
+            int64_t gain[3];
+            for (int i = 0; i < 3; i++) {
+                gain[i] = Saturate(Divide((__int128) hp[i] << H_BITS, innovationVariance));
+                x[i] += Saturate(Shift((__int128) gain[i] * y[m], P_BITS + Z_BITS - X_BITS));
+            }
+
+            // P -= k hP
+            for (int i = 0; i < 3; i++) {
+                for (int j = i; j < 3; j++) {
+                    P[i][j] = P[j][i] = Saturate(P[i][j] - Shift((__int128) gain[i] * hp[j], P_BITS));
+                }
+            }
+        }
+    }
+
+    // sin and cos of θ, Q40 turns, in Q30
+    static void SinCos(int64_t theta, int64_t &s, int64_t &c)
+    {
+        static const Table table;
+        uint64_t turn = (uint64_t) theta & ((1ull << X_BITS) - 1);
+        s = table.Lookup(turn);
+        c = table.Lookup((turn + (1ull << (X_BITS - 2))) & ((1ull << X_BITS) - 1));
+    }
+
+    struct Table {
+        static const int BITS = 10;
+        int32_t sine[(1 << BITS) + 1];
+
+        Table()
+        {
+            for (int i = 0; i <= 1 << BITS; i++) {
+                sine[i] = (int32_t) llround(sin(2.0 * M_PI * i / (1 << BITS)) * 0x1p30);
+            }
+        }
+
+        int64_t Lookup(uint64_t turn) const
+        {
+            const int FRACTION = X_BITS - BITS;
+            uint64_t i = turn >> FRACTION;
+            int64_t f = turn & ((1ull << FRACTION) - 1);
+            return sine[i] + Shift((__int128) (sine[i + 1] - sine[i]) * f, FRACTION);
+        }
+    };
+
+    // Rounded half up, an arithmetic shift
+    static __int128 Shift(__int128 v, int n)
+    {
+        return n > 0 ? (v + ((__int128) 1 << (n - 1))) >> n : v;
+    }
+
+    // Rounded to nearest, halves away from zero
+    static __int128 Divide(__int128 n, int64_t d)
+    {
+        __int128 half = d / 2;
+        return (n >= 0 ? n + half : n - half) / d;
+    }
+
+    static int64_t Saturate(__int128 v)
+    {
+        return v > INT64_MAX ? INT64_MAX : v < INT64_MIN ? INT64_MIN : (int64_t) v;
+    }
+
+    static int32_t Saturate32(__int128 v)
+    {
+        return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t) v;
+    }
+
+    static int64_t Fixed(double v, int bits)
+    {
+        return llround(ldexp(v, bits));
+    }
+
+    int64_t Q[3][3];
+    int64_t R;                          // Q40 (m/s²)²
+    int64_t gravity;                    // Q32 m/s²
+    int64_t twoPi;                      // Q29
+    int64_t centripetal[2];             // Q32 m/s² per (turn/step)², rω² at r1 and r2
+    int64_t tangential[2];              // Q32 m/s² per turn/step², rα
+    int64_t coupling;                   // Q32 m/s² per turn/step², ratio α
+};
+
+#endif /* _EKF_FIXED_H */
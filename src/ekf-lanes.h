@@ -0,0 +1,291 @@
+#ifndef _EKF_LANES_H
+#define _EKF_LANES_H
+
+#include <stddef.h>
+#include <math.h>
+
+#include "ekf.h"
+
+//--------------------------------------------------------------------------------------------------
+// Crank EKFs side by side
+//
+// L instances of the CrankModel filter in ekf.h, each with its own σ² α, σ² accel and drive ratio,
+// all fed the same measurements. Every quantity is stored as an array across the lanes (structure
+// of arrays) and every loop has the lanes innermost, so with L a multiple of the vector width each
+// arithmetic instruction advances several filters at once. It is the same arithmetic as Ekf, in
+// the same order, so a lane follows the scalar filter with the same parameters.
+//
+// Build with -fno-math-errno (or -ffast-math) so the square roots vectorize too. A lane whose
+// innovation covariance stops being positive definite skips the update, as Ekf::Update does.
+//--------------------------------------------------------------------------------------------------
+template <size_t L> class CrankEkfLanes
+{
+public:
+    static constexpr size_t LANES = L;
+
+    double dt;
+    double r1 = 0.0284;                 // m, shared by the lanes
+    double r2 = 0.0614;
+    double va[L];                       // σ² α, (rad/sec²)²
+    double vacc[L];                     // σ² accel, (m/sec²)²
+    double ratio[L];                    // See CrankModel
+
+    double x[3][L];                     // θ, ω, α
+    double P[3][3][L];
+    double y[4][L];                     // Innovation of the last update
+
+    explicit CrankEkfLanes(double dt = 1.0 / 128.0) :
+        dt(dt)
+    {
+        for (size_t l = 0; l < L; l++) {
+            va[l] = 0.10;
+            vacc[l] = 10.0;
+            ratio[l] = 0.0;
+        }
+        Reset();
+    }
+
+    // Zero state, known exactly. Call after changing the parameters.
+    void Reset()
+    {
+        for (size_t l = 0; l < L; l++) {
+            CrankModel model(dt, va[l], vacc[l]);
+            for (size_t i = 0; i < 3; i++) {
+                for (size_t j = 0; j < 3; j++) {
+                    F[i][j] = model.F[i][j];
+                    Q[i][j][l] = model.Q[i][j];
+                    P[i][j][l] = 0.0;
+                }
+                x[i][l] = 0.0;
+            }
+            for (size_t i = 0; i < 4; i++) {
+                y[i][l] = 0.0;
+            }
+        }
+    }
+
+    void Step(const double z[4])
+    {
+        Predict();
+        Update(z);
+    }
+
+private:
+    void Predict()
+    {
+        double Fx[3][L];
+        double FP[3][3][L];
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t l = 0; l < L; l++) {
+                Fx[i][l] = 0.0;
+            }
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    FP[i][j][l] = 0.0;
+                }
+            }
+            for (size_t k = 0; k < 3; k++) {
+                for (size_t l = 0; l < L; l++) {
+                    Fx[i][l] += F[i][k] * x[k][l];
+                }
+                for (size_t j = 0; j < 3; j++) {
+                    for (size_t l = 0; l < L; l++) {
+                        FP[i][j][l] += F[i][k] * P[k][j][l];
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t l = 0; l < L; l++) {
+                x[i][l] = Fx[i][l];
+            }
+            for (size_t j = i; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    double s = Q[i][j][l];
+                    for (size_t k = 0; k < 3; k++) {
+                        s += FP[i][k][l] * F[j][k];
+                    }
+                    P[i][j][l] = P[j][i][l] = s;
+                }
+            }
+        }
+    }
+
+    void Update(const double z[4])
+    {
+        // Linearize, as CrankModel::Measure
+        double h[4][L];
+        double H[4][3][L];
+        double s[L];
+        double c[L];
+        for (size_t l = 0; l < L; l++) {
+            s[l] = sin(x[0][l]);
+            c[l] = cos(x[0][l]);
+        }
+        for (size_t l = 0; l < L; l++) {
+            double w2 = x[1][l] * x[1][l];
+            double a = x[2][l];
+            h[0][l] = ratio[l] * a * c[l] + CrankModel::GRAVITY * s[l] - r1 * w2;
+            h[1][l] = -ratio[l] * a * s[l] + CrankModel::GRAVITY * c[l] + r1 * a;
+            h[2][l] = ratio[l] * a * c[l] + CrankModel::GRAVITY * s[l] - r2 * w2;
+            h[3][l] = -ratio[l] * a * s[l] + CrankModel::GRAVITY * c[l] + r2 * a;
+            H[0][0][l] = H[2][0][l] = -ratio[l] * a * s[l] + CrankModel::GRAVITY * c[l];
+            H[1][0][l] = H[3][0][l] = -ratio[l] * a * c[l] - CrankModel::GRAVITY * s[l];
+            H[0][1][l] = -2.0 * r1 * x[1][l];
+            H[1][1][l] = 0.0;
+            H[2][1][l] = -2.0 * r2 * x[1][l];
+            H[3][1][l] = 0.0;
+            H[0][2][l] = H[2][2][l] = ratio[l] * c[l];
+            H[1][2][l] = H[3][2][l] = -ratio[l] * s[l];
+        }
+
+        // HP, then S = HPH' + R
+        double HP[4][3][L];
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    HP[i][j][l] = 0.0;
+                }
+            }
+            for (size_t k = 0; k < 3; k++) {
+                for (size_t j = 0; j < 3; j++) {
+                    for (size_t l = 0; l < L; l++) {
+                        HP[i][j][l] += H[i][k][l] * P[k][j][l];
+                    }
+                }
+            }
+        }
+        double S[4][4][L];
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = i; j < 4; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    double sum = i == j ? vacc[l] : 0.0;
+                    for (size_t k = 0; k < 3; k++) {
+                        sum += HP[i][k][l] * H[j][k][l];
+                    }
+                    S[i][j][l] = S[j][i][l] = sum;
+                }
+            }
+        }
+
+        // Cholesky, a failed lane getting a zero factor and so a zero gain
+        for (size_t j = 0; j < 4; j++) {
+            for (size_t l = 0; l < L; l++) {
+                double d = S[j][j][l];
+                for (size_t k = 0; k < j; k++) {
+                    d -= S[j][k][l] * S[j][k][l];
+                }
+                double inverse = d > 0.0 ? 1.0 / sqrt(d) : 0.0;
+                S[j][j][l] = inverse;
+                for (size_t i = j + 1; i < 4; i++) {
+                    double sum = S[i][j][l];
+                    for (size_t k = 0; k < j; k++) {
+                        sum -= S[i][k][l] * S[j][k][l];
+                    }
+                    S[i][j][l] = sum * inverse;
+                }
+            }
+        }
+        for (size_t l = 0; l < L; l++) {
+            bool ok = true;
+            for (size_t j = 0; j < 4; j++) {
+                ok = ok && S[j][j][l] != 0.0;
+            }
+            for (size_t j = 0; j < 4; j++) {
+                for (size_t i = 0; i <= j; i++) {
+                    S[j][i][l] = ok ? S[j][i][l] : 0.0;
+                }
+            }
+        }
+
+        // K' = S⁻¹HP
+        double Kt[4][3][L];
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    double v = HP[i][j][l];
+                    for (size_t k = 0; k < i; k++) {
+                        v -= S[i][k][l] * Kt[k][j][l];
+                    }
+                    Kt[i][j][l] = v * S[i][i][l];
+                }
+            }
+        }
+        for (size_t i = 4; i-- > 0;) {
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    double v = Kt[i][j][l];
+                    for (size_t k = i + 1; k < 4; k++) {
+                        v -= S[k][i][l] * Kt[k][j][l];
+                    }
+                    Kt[i][j][l] = v * S[i][i][l];
+                }
+            }
+        }
+
+        // x += Ky
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t l = 0; l < L; l++) {
+                y[i][l] = z[i] - h[i][l];
+            }
+        }
+        for (size_t k = 0; k < 4; k++) {
+            for (size_t i = 0; i < 3; i++) {
+                for (size_t l = 0; l < L; l++) {
+                    x[i][l] += Kt[k][i][l] * y[k][l];
+                }
+            }
+        }
+
+        // P = APA' + KRK' with A = I - KH, R diagonal
+        double A[3][3][L];
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    A[i][j][l] = i == j ? 1.0 : 0.0;
+                }
+            }
+            for (size_t k = 0; k < 4; k++) {
+                for (size_t j = 0; j < 3; j++) {
+                    for (size_t l = 0; l < L; l++) {
+                        A[i][j][l] -= Kt[k][i][l] * H[k][j][l];
+                    }
+                }
+            }
+        }
+        double AP[3][3][L];
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    AP[i][j][l] = 0.0;
+                }
+            }
+            for (size_t k = 0; k < 3; k++) {
+                for (size_t j = 0; j < 3; j++) {
+                    for (size_t l = 0; l < L; l++) {
+                        AP[i][j][l] += A[i][k][l] * P[k][j][l];
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = i; j < 3; j++) {
+                for (size_t l = 0; l < L; l++) {
+                    double sum = 0.0;
+                    for (size_t k = 0; k < 3; k++) {
+                        sum += AP[i][k][l] * A[j][k][l];
+                    }
+                    for (size_t k = 0; k < 4; k++) {
+                        sum += Kt[k][i][l] * vacc[l] * Kt[k][j][l];
+                    }
+                    P[i][j][l] = P[j][i][l] = sum;
+                }
+            }
+        }
+    }
+
+    double F[3][3];
+    double Q[3][3][L];
+};
+
+#endif /* _EKF_LANES_H */
@@ -0,0 +1,431 @@
+#ifndef _EKF_SCHEDULE_H
+#define _EKF_SCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "ekf.h"
+
+//--------------------------------------------------------------------------------------------------
+// Gain scheduled crank filter
+//
+// The crank EKF's covariance does not depend on the measurements, only on the path of the state
+// through the linearization, so at a steady cadence it settles into a cycle set by ω and by where
+// the crank is in its turn. CrankGainSchedule runs the covariance recursion once for a grid of ω
+// and tabulates, at a grid of θ over the turn, the gain K, the innovation covariance S⁻¹ and the
+// posterior P. ScheduledCrankEkf then predicts, looks the gain up (bilinear in ω and θ) and
+// corrects, with no covariance propagation and no factorization.
+//
+// The table only holds while the ride is steady. The filter keeps the normalized innovation
+// y'S⁻¹y averaged over a few steps, which is 4 when the model fits, and when that climbs past
+// NIS_LIMIT, or ω leaves the grid, it hands over to the full EKF from the tabulated P. It takes
+// the table again once the EKF's P has stayed within SETTLED of it for SETTLE_STEPS and the
+// innovation is back down. It starts in the full EKF, as the table knows nothing of the start.
+//
+// One table serves any number of filters with the same model, and is only read once built.
+//--------------------------------------------------------------------------------------------------
+class CrankGainSchedule
+{
+public:
+    static const int THETAS = 32;                       // Across a turn
+    static const int CONVERGE = 4096;                   // Steps at each ω before tabulating
+
+    struct Entry {
+        double K[3][4];
+        double Sinv[4][4];
+        double P[3][3];
+    };
+
+    // ω from -omegaMaximum to omegaMaximum, rad/sec, in omegas steps
+    explicit CrankGainSchedule(const CrankModel &model, double omegaMaximum = 250.0 * 2.0 * M_PI / 60.0, int omegas = 51) :
+        model(model),
+        omegaMinimum(-omegaMaximum),
+        omegaStep(2.0 * omegaMaximum / (omegas - 1)),
+        omegas(omegas),
+        entries(omegas * THETAS)
+    {
+        for (int i = 0; i < omegas; i++) {
+            Tabulate(i, omegaMinimum + i * omegaStep);
+        }
+    }
+
+    const CrankModel &Model() const
+    {
+        return model;
+    }
+
+    // K and S⁻¹ at θ, ω, interpolated. False, with the nearest ω's, if ω is off the grid.
+    bool Gain(double theta, double omega, double K[3][4], double Sinv[4][4]) const
+    {
+        const Entry *e[4];
+        double w[4];
+        bool inside = Corners(theta, omega, e, w);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                K[i][j] = w[0] * e[0]->K[i][j] + w[1] * e[1]->K[i][j] + w[2] * e[2]->K[i][j] + w[3] * e[3]->K[i][j];
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                Sinv[i][j] = w[0] * e[0]->Sinv[i][j] + w[1] * e[1]->Sinv[i][j] + w[2] * e[2]->Sinv[i][j] + w[3] * e[3]->Sinv[i][j];
+            }
+        }
+        return inside;
+    }
+
+    // S⁻¹ alone
+    bool InnovationInverse(double theta, double omega, double Sinv[4][4]) const
+    {
+        const Entry *e[4];
+        double w[4];
+        bool inside = Corners(theta, omega, e, w);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                Sinv[i][j] = w[0] * e[0]->Sinv[i][j] + w[1] * e[1]->Sinv[i][j] + w[2] * e[2]->Sinv[i][j] + w[3] * e[3]->Sinv[i][j];
+            }
+        }
+        return inside;
+    }
+
+    // The posterior P there, likewise
+    bool Covariance(double theta, double omega, double P[3][3]) const
+    {
+        const Entry *e[4];
+        double w[4];
+        bool inside = Corners(theta, omega, e, w);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                P[i][j] = w[0] * e[0]->P[i][j] + w[1] * e[1]->P[i][j] + w[2] * e[2]->P[i][j] + w[3] * e[3]->P[i][j];
+            }
+        }
+        return inside;
+    }
+
+private:
+    // The four entries around θ, ω and their weights
+    bool Corners(double theta, double omega, const Entry *e[4], double w[4]) const
+    {
+        double u = (omega - omegaMinimum) / omegaStep;
+        bool inside = u >= 0.0 && u <= omegas - 1;
+        u = fmin(fmax(u, 0.0), omegas - 1);
+        int i = (int) u < omegas - 1 ? (int) u : omegas - 2;
+        double fu = u - i;
+        double v = theta / (2.0 * M_PI) * THETAS;
+        v -= floor(v / THETAS) * THETAS;
+        int j = (int) v % THETAS;
+        int k = (j + 1) % THETAS;
+        double fv = v - floor(v);
+        e[0] = &entries[i * THETAS + j];
+        e[1] = &entries[i * THETAS + k];
+        e[2] = &entries[(i + 1) * THETAS + j];
+        e[3] = &entries[(i + 1) * THETAS + k];
+        w[0] = (1.0 - fu) * (1.0 - fv);
+        w[1] = (1.0 - fu) * fv;
+        w[2] = fu * (1.0 - fv);
+        w[3] = fu * fv;
+        return inside;
+    }
+
+    // Steady state at ω: the EKF fed noise free measurements of a crank turning at ω tracks it
+    // exactly, so its covariance is that of any steady ride at ω
+    void Tabulate(int i, double omega)
+    {
+        double dt = model.F[0][1];                      // The step, as F has it
+        if (fabs(omega) * dt * CONVERGE < 2.0 * M_PI) {
+            // Hardly turning: settle at each θ in place
+            for (int j = 0; j < THETAS; j++) {
+                CrankEkf ekf(model);
+                Entry entry;
+                Start(ekf, 2.0 * M_PI * j / THETAS - omega * dt * CONVERGE, omega);
+                for (int n = 0; n < CONVERGE; n++) {
+                    Step(ekf, entry);
+                }
+                entries[i * THETAS + j] = entry;
+            }
+            return;
+        }
+
+        CrankEkf ekf(model);
+        Entry entry;
+        Start(ekf, 0.0, omega);
+        for (int n = 0; n < CONVERGE; n++) {
+            Step(ekf, entry);
+        }
+        // Then one more turn, each θ of the grid between two steps
+        double sign = omega > 0.0 ? 1.0 : -1.0;
+        double previousTheta = ekf.x[0];
+        Entry previous = entry;
+        double turned = 0.0;
+        std::vector<bool> done(THETAS, false);
+        while (turned < 2.0 * M_PI + fabs(omega) * dt) {
+            Step(ekf, entry);
+            double from = sign * previousTheta;
+            double to = sign * ekf.x[0];
+            for (int j = 0; j < THETAS; j++) {
+                // The grid angle, in the direction of turning, at or after from
+                double target = sign * 2.0 * M_PI * j / THETAS;
+                target += ceil((from - target) / (2.0 * M_PI)) * 2.0 * M_PI;
+                if (done[j] || target > to) {
+                    continue;
+                }
+                double f = (target - from) / (to - from);
+                Entry &e = entries[i * THETAS + j];
+                Blend(previous, entry, f, e);
+                done[j] = true;
+            }
+            turned += to - from;
+            previousTheta = ekf.x[0];
+            previous = entry;
+        }
+    }
+
+    void Start(CrankEkf &ekf, double theta, double omega) const
+    {
+        ekf.Reset();
+        ekf.x[0] = theta;
+        ekf.x[1] = omega;
+    }
+
+    // A step of the EKF, with the gain it used
+    void Step(CrankEkf &ekf, Entry &entry) const
+    {
+        ekf.Predict();
+        double h[4];
+        double H[4][3];
+        model.Measure(ekf.x, h, H);
+        double S[4][4];
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                S[i][j] = model.R[i][j];
+                for (int k = 0; k < 3; k++) {
+                    for (int l = 0; l < 3; l++) {
+                        S[i][j] += H[i][k] * ekf.P[k][l] * H[j][l];
+                    }
+                }
+            }
+        }
+        Invert(S, entry.Sinv);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                entry.K[i][j] = 0.0;
+                for (int k = 0; k < 3; k++) {
+                    for (int l = 0; l < 4; l++) {
+                        entry.K[i][j] += ekf.P[i][k] * H[l][k] * entry.Sinv[l][j];
+                    }
+                }
+            }
+        }
+        ekf.Update(h);
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                entry.P[i][j] = ekf.P[i][j];
+            }
+        }
+    }
+
+    static void Blend(const Entry &a, const Entry &b, double f, Entry &e)
+    {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 4; j++) {
+                e.K[i][j] = a.K[i][j] + f * (b.K[i][j] - a.K[i][j]);
+            }
+            for (int j = 0; j < 3; j++) {
+                e.P[i][j] = a.P[i][j] + f * (b.P[i][j] - a.P[i][j]);
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                e.Sinv[i][j] = a.Sinv[i][j] + f * (b.Sinv[i][j] - a.Sinv[i][j]);
+            }
+        }
+    }
+
+    // Gauss-Jordan with partial pivoting; S is positive definite, R alone sees to that
+    static void Invert(double S[4][4], double inverse[4][4])
+    {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                inverse[i][j] = i == j ? 1.0 : 0.0;
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            int pivot = c;
+            for (int r = c + 1; r < 4; r++) {
+                if (fabs(S[r][c]) > fabs(S[pivot][c])) {
+                    pivot = r;
+                }
+            }
+            for (int j = 0; j < 4; j++) {
+                std::swap(S[c][j], S[pivot][j]);
+                std::swap(inverse[c][j], inverse[pivot][j]);
+            }
+            double d = 1.0 / S[c][c];
+            for (int j = 0; j < 4; j++) {
+                S[c][j] *= d;
+                inverse[c][j] *= d;
+            }
+            for (int r = 0; r < 4; r++) {
+                if (r == c) {
+                    continue;
+                }
+                double f = S[r][c];
+                for (int j = 0; j < 4; j++) {
+                    S[r][j] -= f * S[c][j];
+                    inverse[r][j] -= f * inverse[c][j];
+                }
+            }
+        }
+    }
+
+    CrankModel model;
+    double omegaMinimum;
+    double omegaStep;
+    int omegas;
+    std::vector<Entry> entries;         // ω major
+};
+
+class ScheduledCrankEkf
+{
+public:
+    static constexpr double NIS_LIMIT = 12.0;           // Averaged y'S⁻¹y that leaves the table
+    static constexpr double NIS_RETURN = 6.0;           // and that may return to it
+    static constexpr double NIS_WEIGHT = 1.0 / 16.0;    // Of each step in the average
+    static constexpr double SETTLED = 0.05;             // Relative difference of P from the table
+    static const int SETTLE_STEPS = 128;
+
+    double x[3];                        // θ, ω, α
+    double y[4];                        // Innovation of the last step
+    uint64_t fullSteps = 0;             // Taken by the full EKF
+
+    explicit ScheduledCrankEkf(const CrankGainSchedule &schedule) :
+        schedule(schedule),
+        ekf(schedule.Model())
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        ekf.Reset();
+        for (int i = 0; i < 3; i++) {
+            x[i] = 0.0;
+        }
+        for (int i = 0; i < 4; i++) {
+            y[i] = 0.0;
+        }
+        scheduled = false;
+        nis = 4.0;
+        settled = 0;
+    }
+
+    bool IsScheduled() const
+    {
+        return scheduled;
+    }
+
+    void Step(const double z[4])
+    {
+        if (!scheduled || !Scheduled(z)) {
+            Full(z);
+        }
+    }
+
+private:
+    // False, with nothing changed, if the table does not cover the prediction
+    bool Scheduled(const double z[4])
+    {
+        const CrankModel &model = schedule.Model();
+        double xp[3];
+        for (int i = 0; i < 3; i++) {
+            xp[i] = model.F[i][0] * x[0] + model.F[i][1] * x[1] + model.F[i][2] * x[2];
+        }
+        double K[3][4];
+        double Sinv[4][4];
+        if (!schedule.Gain(xp[0], xp[1], K, Sinv)) {
+            Leave();
+            return false;
+        }
+        double h[4];
+        double H[4][3];
+        model.Measure(xp, h, H);
+        for (int i = 0; i < 4; i++) {
+            y[i] = z[i] - h[i];
+        }
+        for (int i = 0; i < 3; i++) {
+            x[i] = xp[i] + K[i][0] * y[0] + K[i][1] * y[1] + K[i][2] * y[2] + K[i][3] * y[3];
+        }
+        Normalized(Sinv);
+        if (nis > NIS_LIMIT) {
+            Leave();
+        }
+        return true;
+    }
+
+    void Full(const double z[4])
+    {
+        ekf.Step(z);
+        fullSteps++;
+        for (int i = 0; i < 3; i++) {
+            x[i] = ekf.x[i];
+        }
+        for (int i = 0; i < 4; i++) {
+            y[i] = ekf.y[i];
+        }
+
+        // Back to the table once the innovation is down and P has come to it
+        double Sinv[4][4];
+        double P[3][3];
+        if (!schedule.InnovationInverse(x[0], x[1], Sinv)) {
+            settled = 0;
+            return;
+        }
+        Normalized(Sinv);
+        if (nis >= NIS_RETURN) {
+            settled = 0;
+            return;
+        }
+        schedule.Covariance(x[0], x[1], P);
+        double difference = 0.0, size = 0.0;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                difference += (ekf.P[i][j] - P[i][j]) * (ekf.P[i][j] - P[i][j]);
+                size += P[i][j] * P[i][j];
+            }
+        }
+        settled = difference <= SETTLED * SETTLED * size ? settled + 1 : 0;
+        scheduled = settled >= SETTLE_STEPS;
+    }
+
+    // Hands the state to the EKF, with the table's covariance
+    void Leave()
+    {
+        scheduled = false;
+        settled = 0;
+        for (int i = 0; i < 3; i++) {
+            ekf.x[i] = x[i];
+        }
+        schedule.Covariance(x[0], x[1], ekf.P);
+    }
+
+    void Normalized(const double Sinv[4][4])
+    {
+        double n = 0.0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                n += y[i] * Sinv[i][j] * y[j];
+            }
+        }
+        nis += NIS_WEIGHT * (n - nis);
+    }
+
+    const CrankGainSchedule &schedule;
+    CrankEkf ekf;
+    bool scheduled;
+    double nis;                         // Averaged y'S⁻¹y
+    int settled;                        // Steps that P has been near the table
+};
+
+#endif /* _EKF_SCHEDULE_H */
@@ -0,0 +1,316 @@
+#ifndef _EKF_H
+#define _EKF_H
+
+#include <stddef.h>
+#include <math.h>
+
+//--------------------------------------------------------------------------------------------------
+// Cholesky factorization and solve, for the filter and the smoother
+//--------------------------------------------------------------------------------------------------
+// A = LL', L left in the lower triangle with the reciprocals of its diagonal on the diagonal
+template <size_t M> bool Cholesky(double (&A)[M][M])
+{
+    for (size_t j = 0; j < M; j++) {
+        double d = A[j][j];
+        for (size_t k = 0; k < j; k++) {
+            d -= A[j][k] * A[j][k];
+        }
+        if (!(d > 0.0)) {
+            return false;
+        }
+        double inverse = 1.0 / sqrt(d);
+        A[j][j] = inverse;
+        for (size_t i = j + 1; i < M; i++) {
+            double s = A[i][j];
+            for (size_t k = 0; k < j; k++) {
+                s -= A[i][k] * A[j][k];
+            }
+            A[i][j] = s * inverse;
+        }
+    }
+    return true;
+}
+
+// X = (LL')⁻¹B, a column of B at a time but with the N columns in the inner loops
+template <size_t M, size_t N> void CholeskySolve(const double (&L)[M][M], const double (&B)[M][N], double (&X)[M][N])
+{
+    // LY = B
+    for (size_t i = 0; i < M; i++) {
+        for (size_t j = 0; j < N; j++) {
+            X[i][j] = B[i][j];
+        }
+        for (size_t k = 0; k < i; k++) {
+            for (size_t j = 0; j < N; j++) {
+                X[i][j] -= L[i][k] * X[k][j];
+            }
+        }
+        for (size_t j = 0; j < N; j++) {
+            X[i][j] *= L[i][i];
+        }
+    }
+    // L'X = Y
+    for (size_t i = M; i-- > 0;) {
+        for (size_t k = i + 1; k < M; k++) {
+            for (size_t j = 0; j < N; j++) {
+                X[i][j] -= L[k][i] * X[k][j];
+            }
+        }
+        for (size_t j = 0; j < N; j++) {
+            X[i][j] *= L[i][i];
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Extended Kalman filter
+//
+// N states and M measurements fixed at compile time, so every matrix lives in the object, the loops
+// have constant trip counts the compiler unrolls and vectorizes, and a step makes no call other
+// than the model's. The model supplies the constant transition F, process noise Q and measurement
+// noise R, and linearizes the measurement about the predicted state:
+//
+//  struct Model {
+//      double F[N][N], Q[N][N], R[M][M];
+//      void Measure(const double x[N], double h[M], double H[M][N]) const;
+//  };
+//
+// P is symmetric, so only its upper triangle is computed and then mirrored. The gain comes from a
+// Cholesky factorization of the innovation covariance S and two triangular solves, never S⁻¹, and
+// the covariance update is the Joseph form (I - KH)P(I - KH)' + KRK', which keeps P positive
+// definite under rounding.
+//--------------------------------------------------------------------------------------------------
+template <size_t N, size_t M, class Model> class Ekf
+{
+public:
+    static constexpr size_t STATES = N;
+    static constexpr size_t MEASUREMENTS = M;
+
+    Model model;
+    double x[N];                        // State estimate
+    double P[N][N];                     // Its covariance
+    double y[M];                        // Innovation z - h(x) of the last update
+
+    explicit Ekf(const Model &model = Model()) :
+        model(model)
+    {
+        Reset();
+    }
+
+    // Zero state, known exactly
+    void Reset()
+    {
+        for (size_t i = 0; i < N; i++) {
+            x[i] = 0.0;
+            for (size_t j = 0; j < N; j++) {
+                P[i][j] = 0.0;
+            }
+        }
+        for (size_t i = 0; i < M; i++) {
+            y[i] = 0.0;
+        }
+    }
+
+    // x = Fx, P = FPF' + Q
+    void Predict()
+    {
+        const double (&F)[N][N] = model.F;
+        double Fx[N];
+        double FP[N][N];
+        for (size_t i = 0; i < N; i++) {
+            Fx[i] = 0.0;
+            for (size_t j = 0; j < N; j++) {
+                FP[i][j] = 0.0;
+            }
+            for (size_t k = 0; k < N; k++) {
+                Fx[i] += F[i][k] * x[k];
+                for (size_t j = 0; j < N; j++) {
+                    FP[i][j] += F[i][k] * P[k][j];
+                }
+            }
+        }
+        for (size_t i = 0; i < N; i++) {
+            x[i] = Fx[i];
+            for (size_t j = i; j < N; j++) {
+                double s = model.Q[i][j];
+                for (size_t k = 0; k < N; k++) {
+                    s += FP[i][k] * F[j][k];
+                }
+                P[i][j] = P[j][i] = s;
+            }
+        }
+    }
+
+    // Corrects the prediction with the measurements z. False, and nothing changed, if the
+    // innovation covariance is not positive definite.
+    bool Update(const double z[M])
+    {
+        double h[M];
+        double H[M][N];
+        model.Measure(x, h, H);
+
+        // HP, then S = HPH' + R
+        double HP[M][N];
+        for (size_t i = 0; i < M; i++) {
+            for (size_t j = 0; j < N; j++) {
+                HP[i][j] = 0.0;
+            }
+            for (size_t k = 0; k < N; k++) {
+                for (size_t j = 0; j < N; j++) {
+                    HP[i][j] += H[i][k] * P[k][j];
+                }
+            }
+        }
+        double S[M][M];
+        for (size_t i = 0; i < M; i++) {
+            for (size_t j = i; j < M; j++) {
+                double s = model.R[i][j];
+                for (size_t k = 0; k < N; k++) {
+                    s += HP[i][k] * H[j][k];
+                }
+                S[i][j] = S[j][i] = s;
+            }
+        }
+        if (!Cholesky(S)) {
+            return false;
+        }
+
+        // K' = S⁻¹HP, as S is symmetric and HP = (PH')'
+        double Kt[M][N];
+        CholeskySolve(S, HP, Kt);
+
+        // x += Ky
+        for (size_t i = 0; i < M; i++) {
+            y[i] = z[i] - h[i];
+        }
+        for (size_t k = 0; k < M; k++) {
+            for (size_t i = 0; i < N; i++) {
+                x[i] += Kt[k][i] * y[k];
+            }
+        }
+
+        // A = I - KH
+        double A[N][N];
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < N; j++) {
+                A[i][j] = i == j ? 1.0 : 0.0;
+            }
+            for (size_t k = 0; k < M; k++) {
+                for (size_t j = 0; j < N; j++) {
+                    A[i][j] -= Kt[k][i] * H[k][j];
+                }
+            }
+        }
+        // AP, and KR
+        double AP[N][N];
+        double KR[N][M];
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < N; j++) {
+                AP[i][j] = 0.0;
+            }
+            for (size_t k = 0; k < N; k++) {
+                for (size_t j = 0; j < N; j++) {
+                    AP[i][j] += A[i][k] * P[k][j];
+                }
+            }
+            for (size_t j = 0; j < M; j++) {
+                KR[i][j] = 0.0;
+            }
+            for (size_t k = 0; k < M; k++) {
+                for (size_t j = 0; j < M; j++) {
+                    KR[i][j] += Kt[k][i] * model.R[k][j];
+                }
+            }
+        }
+        // P = APA' + KRK'
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = i; j < N; j++) {
+                double s = 0.0;
+                for (size_t k = 0; k < N; k++) {
+                    s += AP[i][k] * A[j][k];
+                }
+                for (size_t k = 0; k < M; k++) {
+                    s += KR[i][k] * Kt[k][j];
+                }
+                P[i][j] = P[j][i] = s;
+            }
+        }
+        return true;
+    }
+
+    bool Step(const double z[M])
+    {
+        Predict();
+        return Update(z);
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Crank model
+//
+// State θ (rad), ω (rad/s) and α (rad/s²) with constant α between samples, driven by white noise
+// in α of variance va. The measurements are the x and y accelerations (m/s²) of the two radial
+// accelerometers, at radii r1 and r2, each of variance vacc: gravity turned through θ, less the
+// centripetal rω². ratio couples in α along the axes, zero to ignore it.
+//--------------------------------------------------------------------------------------------------
+struct CrankModel {
+    static constexpr double GRAVITY = 9.81;         // m/s²
+
+    double r1 = 0.0284;                 // m
+    double r2 = 0.0614;                 // m
+    double ratio = 0.0;
+    double F[3][3];
+    double Q[3][3];
+    double R[4][4];
+
+    explicit CrankModel(double dt = 1.0 / 128.0, double va = 0.10, double vacc = 10.0)
+    {
+        double dt2 = dt * dt;
+        double dt3 = dt2 * dt;
+        double dt4 = dt3 * dt;
+        double f[3][3] = {
+            {1.0, dt, 0.5 * dt * dt},
+            {0.0, 1.0, dt},
+            {0.0, 0.0, 1.0},
+        };
+        double q[3][3] = {
+            {va * dt4 / 4.0, va * dt3 / 2.0, va * dt2 / 2.0},
+            {va * dt3 / 2.0, va * dt2, va * dt},
+            {va * dt2 / 2.0, va * dt, va},
+        };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                F[i][j] = f[i][j];
+                Q[i][j] = q[i][j];
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                R[i][j] = i == j ? vacc : 0.0;
+            }
+        }
+    }
+
+    void Measure(const double x[3], double h[4], double H[4][3]) const
+    {
+        double s = sin(x[0]);
+        double c = cos(x[0]);
+        double w2 = x[1] * x[1];
+        h[0] = ratio * x[2] * c + GRAVITY * s - r1 * w2;
+        h[1] = -ratio * x[2] * s + GRAVITY * c + r1 * x[2];
+        h[2] = ratio * x[2] * c + GRAVITY * s - r2 * w2;
+        h[3] = -ratio * x[2] * s + GRAVITY * c + r2 * x[2];
+
+        H[0][0] = H[2][0] = -ratio * x[2] * s + GRAVITY * c;
+        H[1][0] = H[3][0] = -ratio * x[2] * c - GRAVITY * s;
+        H[0][1] = -2.0 * r1 * x[1];
+        H[1][1] = 0.0;
+        H[2][1] = -2.0 * r2 * x[1];
+        H[3][1] = 0.0;
+        H[0][2] = H[2][2] = ratio * c;
+        H[1][2] = H[3][2] = -ratio * s;
+    }
+};
+
+typedef Ekf<3, 4, CrankModel> CrankEkf;
+
+#endif /* _EKF_H */
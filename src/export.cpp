@@ -0,0 +1,427 @@
+//--------------------------------------------------------------------------------------------------
+// Export of recorded sessions for analysis
+//
+//  diagnostic-export [-f col|csv|tsv|fit] [-c channel,...] [-d decimation] [-j threads]
+//                    [-o output] log...
+//
+// Decodes the session logs into one column file, see column-file.h, with a channel for each
+// quantity. The output defaults to the first log with the format added. Logs are taken in the order
+// given, which should be the order they were recorded in.
+//
+// CSV and TSV are written from the column file, see text-export.h, with the channels given by -c
+// or all of them, keeping every nth row with -d, formatted on -j threads. The input can also be a
+// column file that was exported before. An output of - is standard output.
+//
+// FIT writes the power measurements and vectors as an activity file, see fit-encoder.h, for
+// training software.
+//
+// Channels keep the counts of the raw records, with the scale that turns them into the unit. All
+// the raw records of a notification have the time the notification was received. Cadence is kept
+// in thousandths of an RPM, which is the only channel that loses anything.
+//--------------------------------------------------------------------------------------------------
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "column-file.h"
+#include "decode.h"
+#include "fit-encoder.h"
+#include "raw-codec.h"
+#include "session-log.h"
+#include "text-export.h"
+
+enum channels {
+    STRAIN,
+    ACCEL1_X,
+    ACCEL1_Y,
+    ACCEL1_Z,
+    ACCEL2_X,
+    ACCEL2_Y,
+    ACCEL2_Z,
+    TEMPERATURE,
+    BATTERY,
+    THETA,
+    OMEGA,
+    ALPHA,
+    POWER,
+    CADENCE,
+    CHANNELS
+};
+
+static const struct {
+    const char *name;
+    const char *unit;
+    double scale;
+} channel_info[CHANNELS] = {
+    {"strain",      "",         1.0},
+    {"accel1_x",    "g",        ACCEL_G_PER_COUNT},
+    {"accel1_y",    "g",        ACCEL_G_PER_COUNT},
+    {"accel1_z",    "g",        ACCEL_G_PER_COUNT},
+    {"accel2_x",    "g",        ACCEL_G_PER_COUNT},
+    {"accel2_y",    "g",        ACCEL_G_PER_COUNT},
+    {"accel2_z",    "g",        ACCEL_G_PER_COUNT},
+    {"temperature", "°C",       1.0e-6},
+    {"battery",     "V",        0.6 * 6.0 * 0x01p-12},
+    {"theta",       "°",        360.0 * 0x01p-13},
+    {"omega",       "°/s",      360.0 * 128.0 * 0x01p-35},
+    {"alpha",       "°/s²",     360.0 * 16384.0 * 0x01p-40},
+    {"power",       "W",        1.0},
+    {"cadence",     "RPM",      1.0e-3},
+};
+
+struct Export {
+    ColumnFile::Writer writer;
+    int channel[CHANNELS];
+    MeasurementDecoder measurementDecoder;
+    RawDecoder rawDecoder;
+    uint64_t notifications = 0;
+    uint64_t measurements = 0;
+    uint64_t badBlocks = 0;
+    uint64_t badChunks = 0;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Decoding
+//--------------------------------------------------------------------------------------------------
+static void ExportRaw(Export &out, int64_t host_ns, const uint8_t *data, int length)
+{
+    ColumnFile::Writer &w = out.writer;
+    const int *c = out.channel;
+    ForEachRawRecord(data, length, [&](const struct raw_data &raw) {
+        switch (raw.op_code) {
+            case STRAIN_DATA:
+                w.Append(c[STRAIN], host_ns, raw.data.strain.strain);
+                break;
+            case ACCELERATION_DATA:
+                w.Append(c[ACCEL1_X], host_ns, raw.data.acceleration.accel1_x);
+                w.Append(c[ACCEL1_Y], host_ns, raw.data.acceleration.accel1_y);
+                w.Append(c[ACCEL1_Z], host_ns, raw.data.acceleration.accel1_z);
+                w.Append(c[ACCEL2_X], host_ns, raw.data.acceleration.accel2_x);
+                w.Append(c[ACCEL2_Y], host_ns, raw.data.acceleration.accel2_y);
+                w.Append(c[ACCEL2_Z], host_ns, raw.data.acceleration.accel2_z);
+                break;
+            case TEMPERATURE_DATA:
+                // Microdegrees, as RawTemperature() adds them up
+                w.Append(c[TEMPERATURE], host_ns, raw.data.temperature.integral * 1000000LL + raw.data.temperature.fractional);
+                break;
+            case BATTERY_DATA:
+                w.Append(c[BATTERY], host_ns, raw.data.voltage);
+                break;
+            case STATE_DATA:
+                w.Append(c[THETA], host_ns, raw.data.state.position);
+                w.Append(c[OMEGA], host_ns, raw.data.state.velocity);
+                w.Append(c[ALPHA], host_ns, raw.data.state.acceleration);
+                break;
+        }
+    });
+    out.notifications++;
+}
+
+static bool ExportLog(Export &out, const char *path)
+{
+    SessionLog::Reader reader;
+    if (!reader.Open(path)) {
+        return false;
+    }
+    for (size_t b = 0; b < reader.Blocks(); b++) {
+        if (!reader.VerifyBlock(b)) {
+            out.badBlocks++;
+            continue;
+        }
+        reader.ForEachRecordInBlock(b, [&](const SessionLog::RecordHeader &record, const uint8_t *payload) {
+            switch (record.stream) {
+                case SessionLog::RAW:
+                    ExportRaw(out, record.host_ns, payload, record.length);
+                    break;
+                case SessionLog::RAW_PACKED:
+                    if (!out.rawDecoder.Decode(payload, record.length, record.host_ns, [&](int64_t host_ns, const uint8_t *data, int length) {
+                            ExportRaw(out, host_ns, data, length);
+                        })) {
+                        out.badChunks++;
+                    }
+                    break;
+                case SessionLog::MEASUREMENT: {
+                    CyclingPowerMeasurement m;
+                    if (out.measurementDecoder.Decode(payload, record.length, m)) {
+                        out.writer.Append(out.channel[POWER], record.host_ns, m.instantaneous_power);
+                        out.writer.Append(out.channel[CADENCE], record.host_ns, llround(m.cadence * 1000.0));
+                        out.measurements++;
+                    }
+                    break;
+                }
+            }
+        });
+    }
+    return true;
+}
+
+// Decodes the logs into a column file at output
+static bool WriteColumns(const char *output, char *const logs[], int count, bool report)
+{
+    // The column file is dated from the first log
+    SessionLog::Reader first;
+    if (!first.Open(logs[0])) {
+        return false;
+    }
+    Export out;
+    if (!out.writer.Open(output, first.Header().created_realtime_ns, first.Header().created_monotonic_ns)) {
+        return false;
+    }
+    first.Close();
+    for (int c = 0; c < CHANNELS; c++) {
+        out.channel[c] = out.writer.AddChannel(channel_info[c].name, channel_info[c].unit, channel_info[c].scale);
+    }
+
+    bool failed = false;
+    for (int i = 0; i < count; i++) {
+        if (!ExportLog(out, logs[i])) {
+            printf("%s: not exported\n", logs[i]);
+            failed = true;
+        }
+    }
+    if (!out.writer.Close()) {
+        return false;
+    }
+    if (!report) {
+        return !failed;
+    }
+
+    ColumnFile::Reader check;
+    if (!check.Open(output)) {
+        return false;
+    }
+    printf("%s: %llu raw notifications, %llu measurements", output, (unsigned long long) out.notifications,
+           (unsigned long long) out.measurements);
+    if (out.badBlocks || out.badChunks) {
+        printf(", %llu bad blocks, %llu bad chunks", (unsigned long long) out.badBlocks, (unsigned long long) out.badChunks);
+    }
+    printf("\n");
+    for (int c = 0; c < check.Channels(); c++) {
+        const ColumnFile::ChannelInfo &info = check.Channel(c);
+        uint64_t bytes = 0;
+        for (uint32_t k = 0; k < info.chunks; k++) {
+            bytes += check.Chunk(c, k).bytes;
+        }
+        printf("    %-12s %10llu samples %6u chunks %10llu bytes\n", info.name, (unsigned long long) info.samples, info.chunks,
+               (unsigned long long) bytes);
+    }
+    return !failed;
+}
+
+//--------------------------------------------------------------------------------------------------
+// FIT
+//--------------------------------------------------------------------------------------------------
+// The measurement and vector records of one log, a block at a time
+struct FitSource {
+    SessionLog::Reader reader;
+    size_t block = 0;
+    size_t next = 0;
+    struct Pending {
+        int64_t host_ns;
+        uint8_t stream;
+        uint16_t length;
+        const uint8_t *payload;
+    };
+    std::vector<Pending> pending;
+
+    const Pending *Peek()
+    {
+        while (next == pending.size()) {
+            if (block >= reader.Blocks()) {
+                return nullptr;
+            }
+            pending.clear();
+            next = 0;
+            if (reader.VerifyBlock(block)) {
+                reader.ForEachRecordInBlock(block, [&](const SessionLog::RecordHeader &record, const uint8_t *payload) {
+                    if (record.stream == SessionLog::MEASUREMENT || record.stream == SessionLog::VECTOR) {
+                        pending.push_back(Pending{record.host_ns, record.stream, record.length, payload});
+                    }
+                });
+            }
+            block++;
+        }
+        return &pending[next];
+    }
+};
+
+// The logs are merged by time as they are read, since measurements and vectors can be logged to
+// different files
+static bool WriteFit(const char *output, char *const logs[], int count)
+{
+    std::vector<std::unique_ptr<FitSource>> sources;
+    for (int i = 0; i < count; i++) {
+        std::unique_ptr<FitSource> source(new FitSource);
+        if (!source->reader.Open(logs[i])) {
+            printf("%s: not exported\n", logs[i]);
+            continue;
+        }
+        sources.push_back(std::move(source));
+    }
+    if (sources.empty()) {
+        return false;
+    }
+
+    const SessionLog::FileHeader &header = sources[0]->reader.Header();
+    FitEncoder fit;
+    if (!fit.Open(output, header.created_realtime_ns, header.created_monotonic_ns, strtoul(header.serial, NULL, 10))) {
+        return false;
+    }
+    MeasurementDecoder measurementDecoder;
+    uint64_t measurements = 0;
+    uint64_t vectors = 0;
+    for (;;) {
+        FitSource *earliest = nullptr;
+        for (std::unique_ptr<FitSource> &source : sources) {
+            const FitSource::Pending *p = source->Peek();
+            if (p && (!earliest || p->host_ns < earliest->Peek()->host_ns)) {
+                earliest = source.get();
+            }
+        }
+        if (!earliest) {
+            break;
+        }
+        const FitSource::Pending &record = earliest->pending[earliest->next++];
+        if (record.stream == SessionLog::MEASUREMENT) {
+            CyclingPowerMeasurement m;
+            if (measurementDecoder.Decode(record.payload, record.length, m)) {
+                fit.AddMeasurement(record.host_ns, m);
+                measurements++;
+            }
+        } else {
+            CyclingPowerVector v;
+            if (DecodeCyclingPowerVector(record.payload, record.length, v)) {
+                fit.AddVector(record.host_ns, v);
+                vectors++;
+            }
+        }
+    }
+    if (!fit.Close()) {
+        return false;
+    }
+    printf("%s: %llu measurements, %llu vectors\n", output, (unsigned long long) measurements, (unsigned long long) vectors);
+    return sources.size() == (size_t) count;
+}
+
+static bool IsColumnFile(const char *path)
+{
+    char magic[sizeof(ColumnFile::MAGIC)] = {};
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool columns = read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, ColumnFile::MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return columns;
+}
+
+// Text from session logs goes through a column file of its own, gone once it is mapped
+static bool OpenColumns(ColumnFile::Reader &reader, const std::string &output, char *const inputs[], int count)
+{
+    if (count == 1 && IsColumnFile(inputs[0])) {
+        return reader.Open(inputs[0]);
+    }
+    std::string temporary = (output == "-" ? std::string("/tmp/diagnostic-export") : output) + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0) {
+        perror(temporary.c_str());
+        return false;
+    }
+    close(fd);
+    bool opened = WriteColumns(temporary.c_str(), inputs, count, false) && reader.Open(temporary.c_str());
+    unlink(temporary.c_str());
+    return opened;
+}
+
+static void Usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-f col|csv|tsv|fit] [-c channel,...] [-d decimation] [-j threads] [-o output] log...\n", program);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    std::string output;
+    std::string format = "col";
+    std::string channels;
+    TextExportOptions options;
+    options.threads = std::thread::hardware_concurrency();
+    int opt;
+    while ((opt = getopt(argc, argv, "o:f:c:d:j:h")) != -1) {
+        switch (opt) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'c':
+                channels = optarg;
+                break;
+            case 'd':
+                options.decimation = std::max(1, atoi(optarg));
+                break;
+            case 'j':
+                options.threads = std::max(1, atoi(optarg));
+                break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || (format != "col" && format != "csv" && format != "tsv" && format != "fit")) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (output.empty()) {
+        output = std::string(argv[optind]) + "." + format;
+    }
+    if (format == "col") {
+        return WriteColumns(output.c_str(), &argv[optind], argc - optind, true) ? 0 : 1;
+    }
+    if (format == "fit") {
+        return WriteFit(output.c_str(), &argv[optind], argc - optind) ? 0 : 1;
+    }
+
+    ColumnFile::Reader reader;
+    if (!OpenColumns(reader, output, &argv[optind], argc - optind)) {
+        return 1;
+    }
+    options.separator = format == "tsv" ? '\t' : ',';
+    for (size_t start = 0; start < channels.size();) {
+        size_t end = std::min(channels.find(',', start), channels.size());
+        std::string name = channels.substr(start, end - start);
+        int c = reader.Find(name.c_str());
+        if (c < 0) {
+            fprintf(stderr, "No channel %s\n", name.c_str());
+            return 1;
+        }
+        options.channels.push_back(c);
+        start = end + 1;
+    }
+
+    int fd = output == "-" ? STDOUT_FILENO : open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(output.c_str());
+        return 1;
+    }
+    long long rows = ExportText(reader, options, fd);
+    if (fd != STDOUT_FILENO && close(fd) < 0) {
+        perror(output.c_str());
+        rows = -1;
+    }
+    if (rows < 0) {
+        return 1;
+    }
+    fprintf(stderr, "%s: %lld rows\n", output.c_str(), rows);
+    return 0;
+}
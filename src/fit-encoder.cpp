@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "fit-encoder.h"
+
+// Seconds from the Unix epoch to the FIT epoch, 1989-12-31 00:00:00 UTC
+static const int64_t FIT_EPOCH = 631065600;
+
+static const uint8_t HEADER_SIZE = 14;
+static const uint8_t PROTOCOL_VERSION = 0x20;           // 2.0, for developer fields
+static const uint16_t PROFILE_VERSION = 2132;
+
+// Base types
+enum {
+    ENUM = 0x00,
+    UINT8 = 0x02,
+    SINT16 = 0x83,
+    UINT16 = 0x84,
+    UINT32 = 0x86,
+    STRING = 0x07,
+    FLOAT32 = 0x88,
+    UINT32Z = 0x8c,
+    BYTE = 0x0d,
+};
+
+// Global message numbers
+enum {
+    FILE_ID = 0,
+    SESSION = 18,
+    LAP = 19,
+    RECORD = 20,
+    EVENT = 21,
+    ACTIVITY = 34,
+    FIELD_DESCRIPTION = 206,
+    DEVELOPER_DATA_ID = 207,
+};
+
+// Local message types
+enum {
+    LOCAL_FILE_ID,
+    LOCAL_DEVELOPER,
+    LOCAL_FIELD,
+    LOCAL_EVENT,
+    LOCAL_RECORD,
+    LOCAL_VECTOR,
+    LOCAL_SUMMARY,
+};
+
+// Developer fields
+enum {
+    DEV_TORQUE,
+    DEV_ANGLE,
+    DEV_FORCE_ARRAY,
+    DEV_TORQUE_ARRAY,
+};
+
+static const uint8_t application_id[16] = {'I', 'n', 'f', 'o', 'C', 'r', 'a', 'n', 'k', ' ', 'd', 'i', 'a', 'g', 0, 1};
+
+static const uint8_t INVALID_U8 = 0xff;
+static const uint16_t INVALID_U16 = 0xffff;
+
+//--------------------------------------------------------------------------------------------------
+// CRC, as in the FIT SDK
+//--------------------------------------------------------------------------------------------------
+static const uint16_t crc_table[16] = {
+    0x0000, 0xcc01, 0xd801, 0x1400, 0xf001, 0x3c00, 0x2800, 0xe401,
+    0xa001, 0x6c00, 0x7800, 0xb401, 0x5000, 0x9c01, 0x8801, 0x4400,
+};
+
+uint16_t FitEncoder::Crc16(const uint8_t *data, size_t length, uint16_t crc)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint16_t tmp = crc_table[crc & 0xf];
+        crc = ((crc >> 4) & 0x0fff) ^ tmp ^ crc_table[data[i] & 0xf];
+        tmp = crc_table[crc & 0xf];
+        crc = ((crc >> 4) & 0x0fff) ^ tmp ^ crc_table[(data[i] >> 4) & 0xf];
+    }
+    return crc;
+}
+
+// The CRC is linear with no final xor, so the CRC of a followed by b is the CRC of a carried over
+// length zero bytes, xored with the CRC of b. Carrying over zeros is a 16x16 matrix over GF(2),
+// raised to the power by squaring as in zlib's crc32_combine().
+static uint16_t MatrixTimes(const uint16_t *matrix, uint16_t vector)
+{
+    uint16_t sum = 0;
+    for (int i = 0; vector; i++, vector >>= 1) {
+        if (vector & 1) {
+            sum ^= matrix[i];
+        }
+    }
+    return sum;
+}
+
+static void MatrixSquare(uint16_t *square, const uint16_t *matrix)
+{
+    for (int i = 0; i < 16; i++) {
+        square[i] = MatrixTimes(matrix, matrix[i]);
+    }
+}
+
+static uint16_t Crc16Combine(uint16_t crc1, uint16_t crc2, uint64_t length2)
+{
+    uint16_t even[16];
+    uint16_t odd[16];
+
+    // One zero bit
+    odd[0] = 0xa001;
+    for (int i = 1; i < 16; i++) {
+        odd[i] = 1 << (i - 1);
+    }
+    MatrixSquare(even, odd);                // Two zero bits
+    MatrixSquare(odd, even);                // Four
+    while (length2) {
+        MatrixSquare(even, odd);            // A byte at the first pass
+        if (length2 & 1) {
+            crc1 = MatrixTimes(even, crc1);
+        }
+        length2 >>= 1;
+        if (!length2) {
+            break;
+        }
+        MatrixSquare(odd, even);
+        if (length2 & 1) {
+            crc1 = MatrixTimes(odd, crc1);
+        }
+        length2 >>= 1;
+    }
+    return crc1 ^ crc2;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Output
+//--------------------------------------------------------------------------------------------------
+FitEncoder::~FitEncoder()
+{
+    if (fd >= 0) {
+        Close();
+    }
+}
+
+bool FitEncoder::Flush()
+{
+    const uint8_t *p = buffer;
+    while (buffered) {
+        ssize_t n = write(fd, p, buffered);
+        if (n <= 0) {
+            perror("FIT file");
+            failed = true;
+            buffered = 0;
+            return false;
+        }
+        p += n;
+        buffered -= n;
+    }
+    return true;
+}
+
+void FitEncoder::Put(const void *data, size_t length)
+{
+    if (buffered + length > BUFFER_SIZE) {
+        Flush();
+    }
+    memcpy(&buffer[buffered], data, length);
+    buffered += length;
+    dataCrc = Crc16((const uint8_t *) data, length, dataCrc);
+    dataSize += length;
+}
+
+void FitEncoder::PutString(const char *s, size_t size)
+{
+    char field[64] = {};
+    strncpy(field, s, std::min(size, sizeof(field)) - 1);
+    Put(field, size);
+}
+
+// fields and developerFields are {number, size, base type} and {number, size, developer index}
+void FitEncoder::Define(uint8_t local, uint16_t global, const uint8_t (*fields)[3], int count,
+                        const uint8_t (*developerFields)[3], int developerCount)
+{
+    PutU8(0x40 | (developerCount ? 0x20 : 0) | local);
+    PutU8(0);                               // Reserved
+    PutU8(0);                               // Little-endian
+    PutU16(global);
+    PutU8(count);
+    Put(fields, count * 3);
+    if (developerCount) {
+        PutU8(developerCount);
+        Put(developerFields, developerCount * 3);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open
+//--------------------------------------------------------------------------------------------------
+bool FitEncoder::Open(const char *path, int64_t realtime_ns, int64_t monotonic_ns, uint32_t serial)
+{
+    if (fd >= 0) {
+        Close();
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    failed = false;
+    buffered = 0;
+    dataSize = 0;
+    dataCrc = 0;
+    realtimeOffset = realtime_ns - monotonic_ns;
+    vectorLength = -1;
+    second = Second();
+    firstTimestamp = 0;
+    firstTimestamp = lastTimestamp = Timestamp(monotonic_ns);
+    records = 0;
+    powerSum = 0.0;
+    maximumPower = 0;
+    cadenceSum = 0.0;
+    cadenceCount = 0;
+    maximumCadence = 0;
+
+    // The header is filled in on Close()
+    uint8_t header[HEADER_SIZE] = {};
+    if (write(fd, header, sizeof(header)) != sizeof(header)) {
+        perror(path);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    static const uint8_t file_id[][3] = {{0, 1, ENUM}, {1, 2, UINT16}, {2, 2, UINT16}, {3, 4, UINT32Z}, {4, 4, UINT32}};
+    Define(LOCAL_FILE_ID, FILE_ID, file_id, 5);
+    PutU8(LOCAL_FILE_ID);
+    PutU8(4);                               // Activity
+    PutU16(255);                            // Development
+    PutU16(0);
+    PutU32(serial);
+    PutU32(firstTimestamp);
+
+    static const uint8_t developer_data_id[][3] = {{1, 16, BYTE}, {3, 1, UINT8}, {4, 4, UINT32}};
+    Define(LOCAL_DEVELOPER, DEVELOPER_DATA_ID, developer_data_id, 3);
+    PutU8(LOCAL_DEVELOPER);
+    Put(application_id, sizeof(application_id));
+    PutU8(0);
+    PutU32(1);
+
+    static const uint8_t field_description[][3] = {
+        {0, 1, UINT8}, {1, 1, UINT8}, {2, 1, UINT8}, {3, 24, STRING}, {6, 1, UINT8}, {8, 16, STRING},
+    };
+    static const struct {
+        uint8_t number;
+        uint8_t type;
+        const char *name;
+        uint8_t scale;
+        const char *units;
+    } developer_fields[] = {
+        {DEV_TORQUE,        FLOAT32,    "torque",           1,  "N-m"},
+        {DEV_ANGLE,         UINT16,     "vector_angle",     1,  "deg"},
+        {DEV_FORCE_ARRAY,   SINT16,     "vector_force",     1,  "N"},
+        {DEV_TORQUE_ARRAY,  SINT16,     "vector_torque",    32, "N-m"},
+    };
+    Define(LOCAL_FIELD, FIELD_DESCRIPTION, field_description, 6);
+    for (const auto &field : developer_fields) {
+        PutU8(LOCAL_FIELD);
+        PutU8(0);
+        PutU8(field.number);
+        PutU8(field.type);
+        PutString(field.name, 24);
+        PutU8(field.scale);
+        PutString(field.units, 16);
+    }
+
+    static const uint8_t event[][3] = {{253, 4, UINT32}, {0, 1, ENUM}, {1, 1, ENUM}, {4, 1, UINT8}};
+    Define(LOCAL_EVENT, EVENT, event, 4);
+    PutU8(LOCAL_EVENT);
+    PutU32(firstTimestamp);
+    PutU8(0);                               // Timer
+    PutU8(0);                               // Start
+    PutU8(0);
+
+    static const uint8_t record[][3] = {{253, 4, UINT32}, {7, 2, UINT16}, {4, 1, UINT8}, {30, 1, UINT8}};
+    static const uint8_t record_developer[][3] = {{DEV_TORQUE, 4, 0}};
+    Define(LOCAL_RECORD, RECORD, record, 4, record_developer, 1);
+    return Flush();
+}
+
+uint32_t FitEncoder::Timestamp(int64_t host_ns) const
+{
+    // Nothing before the timer start
+    int64_t seconds = (host_ns + realtimeOffset) / 1000000000LL - FIT_EPOCH;
+    return std::max((uint32_t) std::max(seconds, (int64_t) 0), firstTimestamp);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Data
+//--------------------------------------------------------------------------------------------------
+void FitEncoder::WriteRecord(const Second &s)
+{
+    uint16_t power = s.powerCount ? (uint16_t) lround(std::max(0.0, s.power / s.powerCount)) : INVALID_U16;
+    uint8_t cadence = s.cadence >= 0 ? (uint8_t) std::min(s.cadence, 254) : INVALID_U8;
+    uint8_t balance = INVALID_U8;
+    if (s.balanceCount) {
+        balance = (uint8_t) std::clamp(lround(s.balance / s.balanceCount), 0L, 100L) | (s.balanceRight ? 0x80 : 0);
+    }
+    float torque = s.torqueCount ? (float) (s.torque / s.torqueCount) : 0.0f;
+    uint32_t invalidFloat = 0xffffffff;
+
+    PutU8(LOCAL_RECORD);
+    PutU32(s.timestamp);
+    PutU16(power);
+    PutU8(cadence);
+    PutU8(balance);
+    if (s.torqueCount) {
+        Put(&torque, 4);
+    } else {
+        Put(&invalidFloat, 4);
+    }
+
+    records++;
+    lastTimestamp = std::max(lastTimestamp, s.timestamp);
+    if (s.powerCount) {
+        powerSum += power;
+        maximumPower = std::max(maximumPower, power);
+    }
+    if (s.cadence >= 0) {
+        cadenceSum += cadence;
+        cadenceCount++;
+        maximumCadence = std::max(maximumCadence, cadence);
+    }
+}
+
+// Measurements are gathered into a record a second
+void FitEncoder::AddMeasurement(int64_t host_ns, const CyclingPowerMeasurement &m)
+{
+    if (fd < 0) {
+        return;
+    }
+    uint32_t timestamp = Timestamp(host_ns);
+    if (timestamp > second.timestamp) {
+        if (second.timestamp) {
+            WriteRecord(second);
+        }
+        second = Second();
+        second.timestamp = timestamp;
+    }
+    second.power += m.instantaneous_power;
+    second.powerCount++;
+    if (m.flags.accumulated_torque_present) {
+        second.torque += m.torque;
+        second.torqueCount++;
+    }
+    // The reference is left or unknown, and FIT says which side the percentage is for
+    if (m.flags.pedal_power_balance_present && m.flags.pedal_power_balance_reference) {
+        second.balance += m.pedal_power_balance;
+        second.balanceCount++;
+    }
+    if (m.flags.crank_revolution_data_present) {
+        second.cadence = (int) lround(m.cadence);
+    }
+}
+
+void FitEncoder::AddVector(int64_t host_ns, const CyclingPowerVector &v)
+{
+    if (fd < 0) {
+        return;
+    }
+    bool torque = v.flags.instantaneous_torque_magnitude_array_present;
+    bool array = torque || v.flags.instantaneous_force_magnitude_array_present;
+    int length = array ? std::min(v.array_length, 127) * 2 : 0;
+
+    // The array is a fixed size in a definition, so a new length needs a new definition
+    if (length != vectorLength || torque != vectorTorque) {
+        static const uint8_t record[][3] = {{253, 4, UINT32}};
+        uint8_t developer[2][3] = {{DEV_ANGLE, 2, 0}, {torque ? DEV_TORQUE_ARRAY : DEV_FORCE_ARRAY, (uint8_t) length, 0}};
+        Define(LOCAL_VECTOR, RECORD, record, 1, developer, length ? 2 : 1);
+        vectorLength = length;
+        vectorTorque = torque;
+    }
+    // Records stay in time order: the second being gathered goes out before a later vector
+    uint32_t timestamp = Timestamp(host_ns);
+    if (second.timestamp && timestamp > second.timestamp) {
+        WriteRecord(second);
+        second = Second();
+    }
+    lastTimestamp = std::max(lastTimestamp, timestamp);
+    PutU8(LOCAL_VECTOR);
+    PutU32(timestamp);
+    PutU16(v.flags.first_crank_measurement_angle_present ? v.first_crank_measurement_angle : INVALID_U16);
+    if (length) {
+        Put(v.array, length);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Close
+//--------------------------------------------------------------------------------------------------
+void FitEncoder::WriteSummary(uint32_t timestamp)
+{
+    uint32_t elapsed = (timestamp - firstTimestamp) * 1000;
+    uint16_t averagePower = records ? (uint16_t) lround(powerSum / records) : INVALID_U16;
+    uint8_t averageCadence = cadenceCount ? (uint8_t) lround(cadenceSum / cadenceCount) : INVALID_U8;
+    uint32_t work = (uint32_t) powerSum;    // A record a second, so joules
+
+    PutU8(LOCAL_EVENT);
+    PutU32(timestamp);
+    PutU8(0);                               // Timer
+    PutU8(4);                               // Stop all
+    PutU8(0);
+
+    static const uint8_t lap[][3] = {
+        {253, 4, UINT32}, {0, 1, ENUM}, {1, 1, ENUM}, {2, 4, UINT32}, {7, 4, UINT32}, {8, 4, UINT32},
+        {19, 2, UINT16}, {20, 2, UINT16}, {17, 1, UINT8}, {18, 1, UINT8}, {41, 4, UINT32}, {25, 1, ENUM},
+    };
+    Define(LOCAL_SUMMARY, LAP, lap, 12);
+    PutU8(LOCAL_SUMMARY);
+    PutU32(timestamp);
+    PutU8(9);                               // Lap
+    PutU8(1);                               // Stop
+    PutU32(firstTimestamp);
+    PutU32(elapsed);
+    PutU32(elapsed);
+    PutU16(averagePower);
+    PutU16(maximumPower);
+    PutU8(averageCadence);
+    PutU8(maximumCadence);
+    PutU32(work);
+    PutU8(2);                               // Cycling
+
+    static const uint8_t session[][3] = {
+        {253, 4, UINT32}, {0, 1, ENUM}, {1, 1, ENUM}, {2, 4, UINT32}, {7, 4, UINT32}, {8, 4, UINT32},
+        {20, 2, UINT16}, {21, 2, UINT16}, {18, 1, UINT8}, {19, 1, UINT8}, {48, 4, UINT32}, {5, 1, ENUM},
+        {6, 1, ENUM}, {25, 2, UINT16}, {26, 2, UINT16},
+    };
+    Define(LOCAL_SUMMARY, SESSION, session, 15);
+    PutU8(LOCAL_SUMMARY);
+    PutU32(timestamp);
+    PutU8(8);                               // Session
+    PutU8(1);                               // Stop
+    PutU32(firstTimestamp);
+    PutU32(elapsed);
+    PutU32(elapsed);
+    PutU16(averagePower);
+    PutU16(maximumPower);
+    PutU8(averageCadence);
+    PutU8(maximumCadence);
+    PutU32(work);
+    PutU8(2);                               // Cycling
+    PutU8(0);                               // Generic
+    PutU16(0);
+    PutU16(1);
+
+    static const uint8_t activity[][3] = {{253, 4, UINT32}, {0, 4, UINT32}, {1, 2, UINT16}, {2, 1, ENUM}, {3, 1, ENUM}, {4, 1, ENUM}};
+    Define(LOCAL_SUMMARY, ACTIVITY, activity, 6);
+    PutU8(LOCAL_SUMMARY);
+    PutU32(timestamp);
+    PutU32(elapsed);
+    PutU16(1);
+    PutU8(0);                               // Manual
+    PutU8(26);                              // Activity
+    PutU8(1);                               // Stop
+}
+
+bool FitEncoder::Close()
+{
+    if (fd < 0) {
+        return false;
+    }
+    if (second.timestamp) {
+        WriteRecord(second);
+    }
+    second = Second();
+    WriteSummary(lastTimestamp);
+    Flush();
+
+    uint8_t header[HEADER_SIZE];
+    header[0] = HEADER_SIZE;
+    header[1] = PROTOCOL_VERSION;
+    memcpy(&header[2], &PROFILE_VERSION, 2);
+    memcpy(&header[4], &dataSize, 4);
+    memcpy(&header[8], ".FIT", 4);
+    uint16_t headerCrc = Crc16(header, 12);
+    memcpy(&header[12], &headerCrc, 2);
+    uint16_t fileCrc = Crc16Combine(Crc16(header, HEADER_SIZE), dataCrc, dataSize);
+
+    if (pwrite(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || write(fd, &fileCrc, 2) != 2) {
+        perror("FIT file");
+        failed = true;
+    }
+    if (close(fd) < 0) {
+        failed = true;
+    }
+    fd = -1;
+    return !failed;
+}
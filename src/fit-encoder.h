@@ -0,0 +1,113 @@
+#ifndef _FIT_ENCODER_H
+#define _FIT_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "decode.h"
+
+//--------------------------------------------------------------------------------------------------
+// FIT activity file encoder
+//
+// Writes cycling power measurements and vectors as a FIT activity file, the format training
+// software reads, as they arrive. Nothing is kept but the second being filled and a write buffer,
+// so memory does not grow with the session and the file needs no second pass:
+//
+//  file_id, developer_data_id and field_description messages, then a timer start event
+//  record          a message a second: mean power, cadence, left/right balance, and the mean
+//                  torque as a developer field
+//  record          a message per vector notification, with the first crank measurement angle
+//                  and the force or torque magnitude array as developer fields
+//  timer stop event, lap, session and activity messages with the totals, on Close()
+//
+// The header is rewritten on Close() with the data size. The file CRC covers the header too, so
+// the CRC of the data, kept as it is written, is combined with the CRC of the final header.
+//
+// Times are host CLOCK_MONOTONIC nanoseconds as in the session log, turned into FIT times (seconds
+// since 1989-12-31 UTC) from a pair of realtime and monotonic times taken together. Not thread
+// safe.
+//--------------------------------------------------------------------------------------------------
+class FitEncoder
+{
+public:
+    ~FitEncoder();
+
+    // serial is the device serial number, zero if unknown
+    bool Open(const char *path, int64_t realtime_ns, int64_t monotonic_ns, uint32_t serial);
+    bool IsOpened() const
+    {
+        return fd >= 0;
+    }
+
+    // Nothing is done unless the file is open
+    void AddMeasurement(int64_t host_ns, const CyclingPowerMeasurement &measurement);
+    void AddVector(int64_t host_ns, const CyclingPowerVector &vector);
+
+    // Writes the summary and fixes up the header. False if anything failed to write.
+    bool Close();
+
+    // The FIT CRC-16 of data, carried on from crc
+    static uint16_t Crc16(const uint8_t *data, size_t length, uint16_t crc = 0);
+
+private:
+    struct Second {
+        uint32_t timestamp = 0;
+        double power = 0.0;                 // Sums
+        int powerCount = 0;
+        double torque = 0.0;
+        int torqueCount = 0;
+        double balance = 0.0;
+        int balanceCount = 0;
+        bool balanceRight = false;
+        int cadence = -1;                   // Latest, RPM
+    };
+
+    uint32_t Timestamp(int64_t host_ns) const;
+    void WriteRecord(const Second &second);
+    void WriteSummary(uint32_t timestamp);
+
+    // Message encoding
+    void Define(uint8_t local, uint16_t global, const uint8_t (*fields)[3], int count,
+                const uint8_t (*developerFields)[3] = nullptr, int developerCount = 0);
+    void Put(const void *data, size_t length);
+    void PutU8(uint8_t v)
+    {
+        Put(&v, 1);
+    }
+    void PutU16(uint16_t v)
+    {
+        Put(&v, 2);
+    }
+    void PutU32(uint32_t v)
+    {
+        Put(&v, 4);
+    }
+    void PutString(const char *s, size_t size);
+    bool Flush();
+
+    static const size_t BUFFER_SIZE = 65536;
+
+    int fd = -1;
+    bool failed = false;
+    uint8_t buffer[BUFFER_SIZE];
+    size_t buffered = 0;
+    uint32_t dataSize = 0;
+    uint16_t dataCrc = 0;
+
+    int64_t realtimeOffset = 0;             // Realtime minus monotonic
+    int vectorLength = -1;                  // Array bytes of the defined vector record, -1 for none
+    bool vectorTorque = false;
+
+    // Totals
+    Second second;
+    uint32_t firstTimestamp = 0;
+    uint32_t lastTimestamp = 0;
+    uint32_t records = 0;
+    double powerSum = 0.0;
+    uint16_t maximumPower = 0;
+    double cadenceSum = 0.0;
+    uint32_t cadenceCount = 0;
+    uint8_t maximumCadence = 0;
+};
+
+#endif /* _FIT_ENCODER_H */
@@ -34,18 +34,36 @@ void CreateMenuBar(IC2Frame* frame) {
     file_menu->Append(wxID_EXIT, "E&xit", "Quit program");
 
     // Bind menu events
-    frame->Bind(wxEVT_MENU, [&](wxCommandEvent & evt) {
+    frame->Bind(wxEVT_MENU, [frame](wxCommandEvent & evt) {
         frame->SendCommand("Disconnect all\n");
+        frame->subscriptions.Forget();
     }, DISCONNECT);
     frame->Bind(wxEVT_MENU, [&](wxCommandEvent & evt) {
         frame->SendCommand("Quit\n");
     }, wxID_EXIT);
 
+    // How often the data pages are redrawn, independent of the notification rate
+    static const int display_rates[] = {5, 10, 20, 30, 60};
+    wxMenu *view_menu = new wxMenu;
+    view_menu->AppendCheckItem(AUTO_SUBSCRIBE, "&Notify visible pages only", "Subscribe only to streams that are shown, logged or analysed");
+    frame->Bind(wxEVT_MENU, [frame](wxCommandEvent & evt) {
+        frame->subscriptions.SetAutomatic(evt.IsChecked());
+    }, AUTO_SUBSCRIBE);
+    view_menu->AppendSeparator();
+    for (size_t i = 0; i < sizeof(display_rates) / sizeof(display_rates[0]); i ++) {
+        view_menu->AppendRadioItem(DISPLAY_RATE + i, wxString().Format("Refresh %d Hz", display_rates[i]));
+        view_menu->Check(DISPLAY_RATE + i, display_rates[i] == 20);
+        frame->Bind(wxEVT_MENU, [frame, i](wxCommandEvent & evt) {
+            frame->view.SetDisplayRate(display_rates[i]);
+        }, DISPLAY_RATE + i);
+    }
+
     wxMenu *help_menu = new wxMenu;
     help_menu->Append(wxID_ABOUT, "&About", "About layout demo...");
 
     wxMenuBar *menu_bar = new wxMenuBar;
     menu_bar->Append(file_menu, "&File");
+    menu_bar->Append(view_menu, "&View");
     menu_bar->Append(help_menu, "&Help");
     frame->SetMenuBar(menu_bar);
 
@@ -208,7 +226,7 @@ void SetupBatteryPage(IC2Frame* frame, wxSizerFlags& fieldFlags, wxSizerFlags& g
     frame->loggingBattery->Bind(wxEVT_CHECKBOX, [&](wxCommandEvent & evt) {
         wxCheckBox* checkBox = (wxCheckBox*) evt.GetEventObject();
         if (checkBox->IsChecked()) {
-            frame->logBattery.Open(checkBox->GetLabel(), wxFile::write);
+            frame->logBattery.Open(checkBox->GetLabel().utf8_str(), frame->sessionIdentity);
         } else {
             frame->logBattery.Close();
         }
@@ -428,6 +446,8 @@ void SetupMeasurementPage(IC2Frame* frame) {
     frame->broadcastMeasurement = new wxToggleButton(frame->measurement, wxID_ANY, "Broadcast");
     frame->loggingMeasurement = new wxCheckBox(frame->measurement, wxID_ANY, "/dev/null");
     frame->logFileMeasurement = new wxButton(frame->measurement, wxID_ANY, "...", wxDefaultPosition, wxSize(50, 20));
+    frame->loggingFit = new wxCheckBox(frame->measurement, wxID_ANY, "/dev/null");
+    frame->logFileFit = new wxButton(frame->measurement, wxID_ANY, "...", wxDefaultPosition, wxSize(50, 20));
 }
 
 void bindControls(IC2Frame* frame) {
@@ -436,11 +456,11 @@ void bindControls(IC2Frame* frame) {
         switch (evt.GetInt()) {
             case TRUE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Stop");
-                frame->SendCommand("Notify measurement on\n");
+                frame->subscriptions.SetRequested(StreamSubscriptions::MEASUREMENT, true);
                 break;
             case FALSE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Notify");
-                frame->SendCommand("Notify measurement off\n");
+                frame->subscriptions.SetRequested(StreamSubscriptions::MEASUREMENT, false);
                 break;
         }
     });
@@ -462,11 +482,42 @@ void bindControls(IC2Frame* frame) {
                                  wxCheckBox *checkBox = (wxCheckBox *) evt.GetEventObject();
                                  if (checkBox->IsChecked()) {
                                      //            logMeasurement.Create(checkBox->GetLabel(), true);
-                                     frame->logMeasurement.Open(checkBox->GetLabel(), wxFile::write);
+                                     frame->logMeasurement.Open(checkBox->GetLabel().utf8_str(), frame->sessionIdentity);
                                  } else {
                                      frame->logMeasurement.Close();
                                  }
+                                 frame->subscriptions.SetLogger(StreamSubscriptions::MEASUREMENT, frame->logMeasurement.IsOpened());
                              });
+    frame->logFileFit->Bind(wxEVT_BUTTON, &IC2Frame::LogFileName, frame, wxID_ANY, wxID_ANY, new IC2Frame::FileDialogParameters("session.fit", frame->loggingFit, "FIT files (*.fit)|*.fit"));
+    frame->loggingFit->Bind(wxEVT_CHECKBOX,
+                            [frame](wxCommandEvent & evt) {
+                                wxCheckBox *checkBox = (wxCheckBox *) evt.GetEventObject();
+                                bool opened;
+                                {
+                                    std::lock_guard<std::mutex> lock(frame->fitLock);
+                                    bool wasOpened = frame->fit.IsOpened();
+                                    if (checkBox->IsChecked()) {
+                                        struct timespec ts;
+                                        clock_gettime(CLOCK_REALTIME, &ts);
+                                        frame->fit.Open(checkBox->GetLabel().utf8_str(), ts.tv_sec * 1000000000LL + ts.tv_nsec,
+                                                        SessionLog::MonotonicNanoseconds(), strtoul(frame->sessionIdentity.serial, NULL, 10));
+                                    } else if (wasOpened) {
+                                        frame->fit.Close();
+                                    }
+                                    opened = frame->fit.IsOpened();
+                                    if (opened == wasOpened) {
+                                        return;
+                                    }
+                                }
+                                // The FIT file wants both measurements and vectors
+                                if (opened) {
+                                    frame->subscriptions.AddConsumer(StreamSubscriptions::MEASUREMENT);
+                                    frame->subscriptions.AddConsumer(StreamSubscriptions::VECTOR);
+                                } else {
+                                    frame->subscriptions.RemoveConsumer(StreamSubscriptions::MEASUREMENT);
+                                    frame->subscriptions.RemoveConsumer(StreamSubscriptions::VECTOR);
+                                }
+                            });
 
 }
 
@@ -623,6 +674,8 @@ void layoutPage(IC2Frame* frame, wxSizerFlags& fieldFlags, wxSizerFlags& groupBo
             wxBoxSizer *boxSizer = new wxBoxSizer(wxHORIZONTAL);
             boxSizer->Add(frame->loggingMeasurement, fieldFlags);
             boxSizer->Add(frame->logFileMeasurement, fieldFlags);
+            boxSizer->Add(frame->loggingFit, fieldFlags);
+            boxSizer->Add(frame->logFileFit, fieldFlags);
             boxSizer->AddStretchSpacer();
             boxSizer->Add(frame->notifyMeasurement, fieldFlags);
             boxSizer->Add(frame->broadcastMeasurement, rightFlags);
@@ -0,0 +1,158 @@
+#include <math.h>
+#include <algorithm>
+
+#include "history.h"
+
+const double History::TIER_SECONDS[TIERS] = {1.0, 10.0, 60.0};
+
+//--------------------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------------------
+History::History(size_t samples, size_t seconds, size_t tenSeconds, size_t minutes) :
+    samples(samples)
+{
+    tiers.emplace_back(seconds);
+    tiers.emplace_back(tenSeconds);
+    tiers.emplace_back(minutes);
+    Clear();
+}
+
+void History::Clear()
+{
+    samples.Clear();
+    for (int k = 0; k < TIERS; k++) {
+        tiers[k].Clear();
+        open[k] = Aggregate{0.0, 0.0, 0.0, 0.0, 0};
+    }
+    last = 0.0;
+}
+
+size_t History::Bytes() const
+{
+    size_t bytes = samples.Capacity() * sizeof(Sample);
+    for (const HistoryRing<Aggregate> &tier : tiers) {
+        bytes += tier.Capacity() * sizeof(Aggregate);
+    }
+    return bytes;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Append
+//--------------------------------------------------------------------------------------------------
+void History::Append(double t, double value)
+{
+    samples.Push(Sample{t, value});
+    last = t;
+    for (int k = 0; k < TIERS; k++) {
+        Aggregate &a = open[k];
+        double start = floor(t / TIER_SECONDS[k]) * TIER_SECONDS[k];
+        if (a.count && start > a.t) {
+            tiers[k].Push(a);
+            a.count = 0;
+        }
+        if (a.count == 0) {
+            a = Aggregate{start, value, value, value, 1};
+            continue;
+        }
+        a.minimum = std::min(a.minimum, value);
+        a.maximum = std::max(a.maximum, value);
+        a.sum += value;
+        a.count++;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Queries
+//--------------------------------------------------------------------------------------------------
+double History::FirstTime() const
+{
+    // The coarsest tier reaches furthest back
+    for (int k = TIERS - 1; k >= 0; k--) {
+        if (tiers[k].Size()) {
+            return tiers[k][0].t;
+        }
+    }
+    if (open[TIERS - 1].count) {
+        return open[TIERS - 1].t;
+    }
+    return samples.Size() ? samples[0].t : 0.0;
+}
+
+size_t History::Count(int tier, double from, double to) const
+{
+    if (tier < 0) {
+        return samples.LowerBound(to) - samples.LowerBound(from);
+    }
+    const HistoryRing<Aggregate> &ring = tiers[tier];
+    double period = TIER_SECONDS[tier];
+    size_t count = ring.LowerBound(to) - ring.LowerBound(from - period);
+    if (open[tier].count && open[tier].t < to && open[tier].t + period > from) {
+        count++;
+    }
+    return count;
+}
+
+void History::Collect(int tier, double from, double to, std::vector<HistoryPoint> &points) const
+{
+    if (tier < 0) {
+        size_t end = samples.LowerBound(to);
+        for (size_t i = samples.LowerBound(from); i < end; i++) {
+            const Sample &s = samples[i];
+            points.push_back(HistoryPoint{s.t, s.value, s.value, s.value});
+        }
+        return;
+    }
+    const HistoryRing<Aggregate> &ring = tiers[tier];
+    double period = TIER_SECONDS[tier];
+    size_t end = ring.LowerBound(to);
+    for (size_t i = ring.LowerBound(from - period); i < end; i++) {
+        if (ring[i].t + period > from) {
+            points.push_back(ring[i].Point());
+        }
+    }
+    if (open[tier].count && open[tier].t < to && open[tier].t + period > from) {
+        points.push_back(open[tier].Point());
+    }
+}
+
+int History::Query(double from, double to, size_t maximumPoints, std::vector<HistoryPoint> &points) const
+{
+    points.clear();
+    if (from >= to) {
+        return -1;
+    }
+
+    // The start of each tier's data, the samples first, infinite while there is none
+    double start[TIERS + 1];
+    start[0] = samples.Size() ? samples[0].t : INFINITY;
+    for (int k = 0; k < TIERS; k++) {
+        if (tiers[k].Size()) {
+            start[k + 1] = tiers[k][0].t;
+        } else {
+            start[k + 1] = open[k].count ? open[k].t : INFINITY;
+        }
+    }
+
+    // The finest tier with few enough points over the range it covers
+    int tier = TIERS - 1;
+    for (int k = -1; k < TIERS; k++) {
+        if (Count(k, std::max(from, start[k + 1]), to) <= maximumPoints) {
+            tier = k;
+            break;
+        }
+    }
+
+    // Then coarser tiers for whatever is older than that tier holds, collected oldest first
+    int coarsest = tier;
+    while (coarsest < TIERS - 1 && start[coarsest + 1] > from) {
+        coarsest++;
+    }
+    for (int k = coarsest; k >= tier; k--) {
+        double begin = k == coarsest ? from : std::max(from, start[k + 1]);
+        double end = k == tier ? to : std::min(to, start[k]);
+        if (begin < end) {
+            Collect(k, begin, end, points);
+        }
+    }
+    return tier;
+}
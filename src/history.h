@@ -0,0 +1,138 @@
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+#include <stddef.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Channel history
+//
+// The samples of one channel over a long session, in a fixed amount of memory. The most recent
+// samples are kept as they are. Going further back there are only aggregates: the minimum, maximum
+// and mean over each second, then each ten seconds, then each minute. Every tier is a ring that
+// overwrites its oldest entry once full, and every sample updates each tier in constant time, so
+// Append() is O(1) and nothing is allocated after construction.
+//
+// Times are in seconds, as given to the statistics, and must not go backwards. Not thread safe.
+//--------------------------------------------------------------------------------------------------
+struct HistoryPoint {
+    double t;                           // Of the sample, or the start of the aggregate
+    double minimum;
+    double maximum;
+    double mean;
+};
+
+template <class T> class HistoryRing
+{
+public:
+    explicit HistoryRing(size_t capacity) :
+        entries(capacity > 0 ? capacity : 1)
+    {
+    }
+
+    void Clear()
+    {
+        head = 0;
+        count = 0;
+    }
+    void Push(const T &entry)
+    {
+        entries[head] = entry;
+        head = head + 1 == entries.size() ? 0 : head + 1;
+        if (count < entries.size()) {
+            count++;
+        }
+    }
+    size_t Size() const
+    {
+        return count;
+    }
+    size_t Capacity() const
+    {
+        return entries.size();
+    }
+    // From the oldest
+    const T &operator[](size_t i) const
+    {
+        size_t index = head + entries.size() - count + i;
+        return entries[index >= entries.size() ? index - entries.size() : index];
+    }
+    // The first entry at or after t, Size() if there is none
+    size_t LowerBound(double t) const
+    {
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if ((*this)[middle].t < t) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+private:
+    std::vector<T> entries;
+    size_t head = 0;                    // Where the next entry goes
+    size_t count = 0;
+};
+
+class History
+{
+public:
+    static const int TIERS = 3;
+    static const double TIER_SECONDS[TIERS];        // 1 s, 10 s, 1 min
+
+    // Full rate samples kept, then aggregates kept in each tier. The defaults hold an hour of one
+    // second, six hours of ten second and a day of one minute aggregates.
+    explicit History(size_t samples, size_t seconds = 3600, size_t tenSeconds = 2160, size_t minutes = 1440);
+
+    void Clear();
+    void Append(double t, double value);
+
+    // Time of the oldest sample or aggregate held, and of the latest sample
+    double FirstTime() const;
+    double LastTime() const
+    {
+        return last;
+    }
+
+    // Points over from <= t < to, at most maximumPoints of them where the history allows. The
+    // finest tier that reaches back to from is used, or a coarser one if that would give too many
+    // points. Where a tier does not reach back to from, the coarser tiers fill in what is older.
+    // Returns the tier used: -1 for samples, else an index into TIER_SECONDS.
+    int Query(double from, double to, size_t maximumPoints, std::vector<HistoryPoint> &points) const;
+
+    // Bytes held, fixed at construction
+    size_t Bytes() const;
+
+private:
+    struct Sample {
+        double t;
+        double value;
+    };
+    struct Aggregate {
+        double t;
+        double minimum;
+        double maximum;
+        double sum;
+        size_t count;
+
+        HistoryPoint Point() const
+        {
+            return HistoryPoint{t, minimum, maximum, sum / count};
+        }
+    };
+
+    size_t Count(int tier, double from, double to) const;
+    void Collect(int tier, double from, double to, std::vector<HistoryPoint> &points) const;
+
+    HistoryRing<Sample> samples;
+    std::vector<HistoryRing<Aggregate>> tiers;
+    Aggregate open[TIERS];              // The aggregates being filled
+    double last = 0.0;
+};
+
+#endif /* _HISTORY_H */
@@ -0,0 +1,209 @@
+#include <math.h>
+#include <algorithm>
+
+#include "host-estimator.h"
+
+// Position in the firmware's default transform: 1 g, in 2^-11 m/sec²/g, along each axis
+static const double NOMINAL = 9.81 * 2048.0;
+
+// Degrees wrapped to [0, 360)
+static double Turn(double degrees)
+{
+    degrees = fmod(degrees, 360.0);
+    return degrees < 0.0 ? degrees + 360.0 : degrees;
+}
+
+// Row of a 3 × 4 accelerometer transform applied to counts, in m/sec²
+static double Transform(const double a[12], int row, const double counts[3])
+{
+    const double *r = &a[4 * row];
+    return (r[0] * counts[0] + r[1] * counts[1] + r[2] * counts[2]) * 0x01p-23 + r[3] * 0x01p-15;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Constructor and destructor
+//--------------------------------------------------------------------------------------------------
+HostEstimator::HostEstimator(Report report) :
+    report(report)
+{
+    for (int i = 0; i < 12; i++) {
+        parameters.a1[i] = parameters.a2[i] = i % 5 == 0 ? NOMINAL : 0.0;
+    }
+    parameters.va = 0.10;
+    parameters.vacc = 10.0;
+    parameters.driveRatio = 0.0;
+    parameters.r1 = 0.0284;
+    parameters.r2 = 0.0614;
+    Apply(parameters);
+}
+
+HostEstimator::~HostEstimator()
+{
+    Stop();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Control
+//--------------------------------------------------------------------------------------------------
+void HostEstimator::Start()
+{
+    Stop();
+    ekf.Reset();
+    error.Reset();
+    errorMaximum = 0.0;
+    firmwareTheta = 0.0;
+    compared = false;
+    steps = 0;
+    {
+        // A Submit() that saw running before Stop() may still be queueing
+        std::lock_guard<std::mutex> guard(lock);
+        queue.clear();
+        dropped = 0;
+        changed = true;
+        quit = false;
+    }
+    running.store(true, std::memory_order_relaxed);
+    thread = std::thread(&HostEstimator::Run, this);
+}
+
+void HostEstimator::Stop()
+{
+    if (!thread.joinable()) {
+        return;
+    }
+    running.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void HostEstimator::Configure(const SessionLog::Calibration &calibration)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (calibration.valid & SessionLog::Calibration::ACCEL1) {
+        std::copy(calibration.accel1, calibration.accel1 + 12, parameters.a1);
+    }
+    if (calibration.valid & SessionLog::Calibration::ACCEL2) {
+        std::copy(calibration.accel2, calibration.accel2 + 12, parameters.a2);
+    }
+    if (calibration.valid & SessionLog::Calibration::KF) {
+        parameters.va = calibration.kf[0];
+        parameters.vacc = calibration.kf[1];
+        parameters.driveRatio = calibration.kf[2];
+        parameters.r1 = calibration.kf[3];
+        parameters.r2 = calibration.kf[4];
+    }
+    changed = true;
+}
+
+void HostEstimator::Submit(const uint8_t *data, int length)
+{
+    if (!running.load(std::memory_order_relaxed) || length <= 0 || length > 0xffff) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (queue.size() + 2 + length > MAXIMUM_QUEUED) {
+            dropped++;
+            return;
+        }
+        queue.push_back(length & 0xff);
+        queue.push_back(length >> 8);
+        queue.insert(queue.end(), data, data + length);
+    }
+    wake.notify_one();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Estimator thread
+//--------------------------------------------------------------------------------------------------
+void HostEstimator::Run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [&] {
+            return quit || !queue.empty();
+        });
+        if (quit) {
+            return;
+        }
+        // Take the whole queue, leaving the emptied buffer of the last batch in its place
+        batch.swap(queue);
+        bool apply = changed;
+        Parameters p = parameters;
+        changed = false;
+        uint64_t lost = dropped;
+        guard.unlock();
+
+        if (apply) {
+            Apply(p);
+        }
+        for (size_t offset = 0; offset + 2 <= batch.size();) {
+            int length = batch[offset] | batch[offset + 1] << 8;
+            ForEachRawRecord(&batch[offset + 2], length, [&](const struct raw_data &raw) {
+                Step(raw);
+            });
+            offset += 2 + length;
+        }
+        batch.clear();
+
+        HostEstimate estimate;
+        estimate.theta = Turn(ekf.x[0] * 180.0 / M_PI);
+        estimate.omega = ekf.x[1] * 180.0 / M_PI;
+        estimate.alpha = ekf.x[2] * 180.0 / M_PI;
+        estimate.firmwareTheta = firmwareTheta;
+        estimate.compared = compared;
+        estimate.errorMean = error.mean[0];
+        estimate.errorSd = error.StandardDeviation(0);
+        estimate.errorMaximum = errorMaximum;
+        estimate.steps = steps;
+        estimate.dropped = lost;
+        report(estimate);
+
+        guard.lock();
+    }
+}
+
+void HostEstimator::Apply(const Parameters &p)
+{
+    applied = p;
+    CrankModel model(STEP, p.va, p.vacc);
+    model.r1 = p.r1;
+    model.r2 = p.r2;
+    // The bicycle's acceleration, in m/sec², per rad/sec² of the crank
+    model.ratio = p.driveRatio / (2.0 * M_PI);
+    ekf.model = model;
+}
+
+void HostEstimator::Step(const struct raw_data &raw)
+{
+    switch (raw.op_code) {
+        case ACCELERATION_DATA: {
+            double c1[3] = {(double) raw.data.acceleration.accel1_x, (double) raw.data.acceleration.accel1_y, (double) raw.data.acceleration.accel1_z};
+            double c2[3] = {(double) raw.data.acceleration.accel2_x, (double) raw.data.acceleration.accel2_y, (double) raw.data.acceleration.accel2_z};
+            double z[4] = {
+                Transform(applied.a1, 0, c1),
+                Transform(applied.a1, 1, c1),
+                Transform(applied.a2, 0, c2),
+                Transform(applied.a2, 1, c2),
+            };
+            ekf.Step(z);
+            steps++;
+            break;
+        }
+        case STATE_DATA: {
+            firmwareTheta = Turn(RawStatePosition(raw));
+            if (steps == 0) {
+                break;
+            }
+            double e = Turn(ekf.x[0] * 180.0 / M_PI - firmwareTheta + 180.0) - 180.0;
+            error.Add(&e);
+            errorMaximum = std::max(errorMaximum, fabs(e));
+            compared = true;
+            break;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef _HOST_ESTIMATOR_H
+#define _HOST_ESTIMATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "decode.h"
+#include "ekf.h"
+#include "session-log.h"
+#include "statistics.h"
+
+//--------------------------------------------------------------------------------------------------
+// Host side crank estimator
+//
+// Runs the crank EKF of extras/TestData/kalmanFilter.cpp on the live acceleration records, so the
+// firmware's own θ, ω and α can be checked against an independent estimate while riding. Each
+// acceleration record is calibrated with the device's accelerometer transforms and is one filter
+// step of 1/128 s. Each state record is compared with the host estimate at that point in the
+// stream, and the angle error goes into running statistics.
+//
+// Submit() copies the notification and returns, so the data path only ever waits for a short
+// queue lock. The filter runs on a thread of its own and hands every result to the report
+// callback from there. If the thread falls more than a second behind, notifications are dropped
+// and counted rather than queued without bound.
+//--------------------------------------------------------------------------------------------------
+struct HostEstimate {
+    double theta;                           // °, 0 to 360
+    double omega;                           // °/sec
+    double alpha;                           // °/sec²
+    double firmwareTheta;                   // °, at the last state record
+    bool compared;                          // A state record has been seen since Start()
+    double errorMean;                       // °, host less firmware, wrapped to ±180
+    double errorSd;
+    double errorMaximum;                    // Largest magnitude
+    uint64_t steps;
+    uint64_t dropped;                       // Notifications
+};
+
+class HostEstimator
+{
+public:
+    using Report = std::function<void(const HostEstimate &)>;
+
+    static constexpr double STEP = 1.0 / 128.0;         // s between acceleration records
+    static const size_t MAXIMUM_QUEUED = 8192;          // Bytes, about a second of raw data
+
+    explicit HostEstimator(Report report);
+    ~HostEstimator();
+
+    // Starts again from a stationary crank at zero, with fresh error statistics
+    void Start();
+    void Stop();
+    bool IsRunning() const
+    {
+        return running.load(std::memory_order_relaxed);
+    }
+
+    // Any valid parts are used from the next record. The firmware's defaults hold until then.
+    void Configure(const SessionLog::Calibration &calibration);
+
+    // A raw data notification, from any thread
+    void Submit(const uint8_t *data, int length);
+
+private:
+    struct Parameters {
+        double a1[12];                      // Accelerometer transforms, as the firmware has them
+        double a2[12];
+        double va;                          // σ² α, (rad/sec²)²
+        double vacc;                        // σ² accel, (m/sec²)²
+        double driveRatio;                  // m/revolution
+        double r1;                          // m
+        double r2;
+    };
+
+    // Estimator thread
+    void Run();
+    void Apply(const Parameters &p);
+    void Step(const struct raw_data &raw);
+
+    Report report;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit = false;
+    std::atomic<bool> running{false};
+    std::vector<uint8_t> queue;             // Notifications, each preceded by its 16 bit length
+    uint64_t dropped = 0;
+    Parameters parameters;
+    bool changed = false;                   // parameters since the thread last took them
+
+    // Estimator thread only
+    Parameters applied;
+    CrankEkf ekf;
+    Moments<1> error;
+    double errorMaximum = 0.0;
+    double firmwareTheta = 0.0;
+    bool compared = false;
+    uint64_t steps = 0;
+    std::vector<uint8_t> batch;
+};
+
+#endif /* _HOST_ESTIMATOR_H */
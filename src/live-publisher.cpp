@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "live-publisher.h"
+
+namespace Live
+{
+
+Publisher::~Publisher()
+{
+    Close();
+}
+
+bool Publisher::Open(const char *name, uint32_t slotCount)
+{
+    Close();
+    if (slotCount == 0 || (slotCount & (slotCount - 1))) {
+        fprintf(stderr, "Live data: %u slots is not a power of two\n", slotCount);
+        return false;
+    }
+
+    // A ring already under the name, left by a publisher that died or still in use, is unlinked
+    // rather than truncated: whoever has it mapped keeps that object, and this one is new
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(name);
+        return false;
+    }
+    size_t bytes = sizeof(LiveHeader) + (size_t) slotCount * sizeof(LiveSlot);
+    struct stat st;
+    if (ftruncate(fd, bytes) < 0 || fstat(fd, &st) < 0) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // The pages are fresh zeros, so every slot sequence reads as not yet written
+    LiveHeader *h = (LiveHeader *) p;
+    h->version_major = VERSION_MAJOR;
+    h->version_minor = VERSION_MINOR;
+    h->header_size = sizeof(LiveHeader);
+    h->slot_size = sizeof(LiveSlot);
+    h->slots = slotCount;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h->created_realtime_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    h->created_monotonic_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    h->publisher_pid = getpid();
+    h->published.store(0, std::memory_order_relaxed);
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(h->magic, MAGIC, sizeof(h->magic));
+
+    this->name = name;
+    device = st.st_dev;
+    inode = st.st_ino;
+    header = h;
+    slots = (LiveSlot *) ((uint8_t *) p + sizeof(LiveHeader));
+    mask = slotCount - 1;
+    size = bytes;
+    return true;
+}
+
+void Publisher::Close()
+{
+    if (!header) {
+        return;
+    }
+    // Only if the name is still this ring, and not one another publisher has made since
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_dev == device && st.st_ino == inode) {
+            shm_unlink(name.c_str());
+        }
+        close(fd);
+    }
+    munmap(header, size);
+    header = nullptr;
+    slots = nullptr;
+}
+
+}
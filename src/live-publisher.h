@@ -0,0 +1,60 @@
+#ifndef _LIVE_PUBLISHER_H
+#define _LIVE_PUBLISHER_H
+
+#include <string>
+
+#include "live-shm.h"
+
+//--------------------------------------------------------------------------------------------------
+// Live data publisher
+//
+// Writes samples into the shared memory ring described in live-shm.h. A sample costs a fetch_add
+// and a slot write, with no lock and no system call, and it never waits for the readers. Several
+// threads can publish at once (the BLE thread and a playback), each claiming its own slot.
+//--------------------------------------------------------------------------------------------------
+namespace Live
+{
+    class Publisher
+    {
+    public:
+        static const uint32_t DEFAULT_SLOTS = 65536;
+
+        ~Publisher();
+
+        // Creates the named ring, slots a power of two. One already there is unlinked, not reused,
+        // so its readers and any publisher still writing it are left undisturbed
+        bool Open(const char *name = DEFAULT_NAME, uint32_t slots = DEFAULT_SLOTS);
+        // Removes the name if it is still this ring, readers keep what they have mapped
+        void Close();
+        bool IsOpened() const
+        {
+            return header != nullptr;
+        }
+
+        void Publish(int channel, int64_t host_ns, double value)
+        {
+            if (!header) {
+                return;
+            }
+            uint64_t n = header->published.fetch_add(1, std::memory_order_relaxed);
+            LiveSlot &slot = slots[n & mask];
+            slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.sample.host_ns = host_ns;
+            slot.sample.value = value;
+            slot.sample.channel = channel;
+            slot.sequence.store(2 * n + 2, std::memory_order_release);
+        }
+
+    private:
+        std::string name;
+        LiveHeader *header = nullptr;
+        LiveSlot *slots = nullptr;
+        uint64_t mask = 0;
+        size_t size = 0;
+        dev_t device = 0;               // The object created, to unlink only that
+        ino_t inode = 0;
+    };
+}
+
+#endif /* _LIVE_PUBLISHER_H */
@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------------------------------------
+// Example reader of the live data
+//
+//  diagnostic-live [-n name] [-c channel]... [-i interval]
+//
+// Follows the shared memory ring of a running diagnostic tool and prints the latest value of each
+// channel, and the sample rate, every interval seconds. Only live-shm.h is needed to do the same
+// in another program.
+//--------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "live-shm.h"
+
+static const char *const channel_names[Live::CHANNELS] = {
+    "strain", "accel1_x", "accel1_y", "accel1_z", "accel2_x", "accel2_y", "accel2_z", "temperature",
+    "battery", "theta", "omega", "alpha", "power", "cadence", "torque", "balance",
+};
+
+int main(int argc, char *argv[])
+{
+    const char *name = Live::DEFAULT_NAME;
+    bool wanted[Live::CHANNELS] = {};
+    bool any = false;
+    double interval = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:i:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                name = optarg;
+                break;
+            case 'c': {
+                int c = 0;
+                while (c < Live::CHANNELS && strcmp(channel_names[c], optarg)) {
+                    c++;
+                }
+                if (c == Live::CHANNELS) {
+                    fprintf(stderr, "No channel %s\n", optarg);
+                    return 1;
+                }
+                wanted[c] = any = true;
+                break;
+            }
+            case 'i':
+                interval = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n name] [-c channel]... [-i interval]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    Live::Reader reader;
+    while (!reader.Open(name)) {
+        fprintf(stderr, "Waiting for %s\n", name);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    const Live::LiveHeader &header = reader.Header();
+    printf("%s: version %u.%u, %u slots, publisher %d\n", name, header.version_major, header.version_minor, header.slots,
+           header.publisher_pid);
+
+    // Only what is published from now on
+    uint64_t cursor = reader.Published();
+    Live::LiveSample latest[Live::CHANNELS] = {};
+    uint64_t counts[Live::CHANNELS] = {};
+    uint64_t lost = 0;
+    auto report = std::chrono::steady_clock::now() + std::chrono::duration<double>(interval);
+    for (;;) {
+        lost += reader.Poll(cursor, [&](const Live::LiveSample &sample) {
+            if (sample.channel < Live::CHANNELS) {
+                latest[sample.channel] = sample;
+                counts[sample.channel]++;
+            }
+        });
+        if (std::chrono::steady_clock::now() >= report) {
+            for (int c = 0; c < Live::CHANNELS; c++) {
+                if (counts[c] && (!any || wanted[c])) {
+                    printf("%s %g (%.0f/s) ", channel_names[c], latest[c].value, counts[c] / interval);
+                }
+                counts[c] = 0;
+            }
+            printf("lost %llu\n", (unsigned long long) lost);
+            fflush(stdout);
+            report += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
@@ -0,0 +1,206 @@
+#ifndef _LIVE_SHM_H
+#define _LIVE_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+//--------------------------------------------------------------------------------------------------
+// Live data in shared memory
+//
+// The diagnostic tool publishes every decoded sample into a POSIX shared memory ring, by default
+// /ic2-live, for other programs on the same machine. This header is all a reader needs, with no
+// other part of the tool.
+//
+//  LiveHeader      one page: layout, creation times and the count of samples published
+//  LiveSlot        slots of them, a power of two, sample n in slot n % slots
+//
+// Each slot is a seqlock. The publisher makes the slot sequence odd, writes the sample, then sets
+// the sequence to 2n + 2 for sample n. A reader copies the sample between two reads of the
+// sequence and keeps it only if both were 2n + 2. Readers never write to the ring, so there can be
+// any number of them and none can hold up the publisher. A reader that falls more than a ring
+// behind finds its samples overwritten and skips ahead.
+//
+// The major version changes with any change readers would misread. Fields only ever get added at
+// the end of the header or a slot, so readers use header_size and slot_size rather than sizeof.
+//--------------------------------------------------------------------------------------------------
+namespace Live
+{
+    constexpr char MAGIC[8] = {'I', 'C', '2', 'L', 'I', 'V', 'E', 0};
+    constexpr uint16_t VERSION_MAJOR = 1;
+    constexpr uint16_t VERSION_MINOR = 0;
+    constexpr const char *DEFAULT_NAME = "/ic2-live";
+
+    enum channels {
+        STRAIN,                 // Counts
+        ACCEL1_X,               // g
+        ACCEL1_Y,
+        ACCEL1_Z,
+        ACCEL2_X,
+        ACCEL2_Y,
+        ACCEL2_Z,
+        TEMPERATURE,            // °C
+        BATTERY,                // V
+        THETA,                  // °
+        OMEGA,                  // °/s
+        ALPHA,                  // °/s²
+        POWER,                  // W
+        CADENCE,                // RPM
+        TORQUE,                 // N.m
+        BALANCE,                // % left
+        CHANNELS
+    };
+
+    struct alignas(64) LiveHeader {
+        char magic[8];
+        uint16_t version_major;
+        uint16_t version_minor;
+        uint32_t header_size;
+        uint32_t slot_size;
+        uint32_t slots;
+        int64_t created_realtime_ns;
+        int64_t created_monotonic_ns;
+        int32_t publisher_pid;
+        uint32_t reserved;
+        uint8_t reserved2[8];
+        alignas(64) std::atomic<uint64_t> published;    // Samples claimed by the publisher
+        uint8_t reserved3[4096 - 128];
+    };
+    static_assert(sizeof(LiveHeader) == 4096, "Live header layout");
+
+    struct LiveSample {
+        int64_t host_ns;        // CLOCK_MONOTONIC
+        double value;
+        uint16_t channel;
+        uint16_t reserved;
+        uint32_t reserved2;
+    };
+
+    struct LiveSlot {
+        std::atomic<uint64_t> sequence;                 // 2n + 2 once sample n is complete
+        LiveSample sample;
+    };
+    static_assert(sizeof(LiveSlot) == 32, "Live slot layout");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory atomics");
+
+    //----------------------------------------------------------------------------------------------
+    // Reader
+    //----------------------------------------------------------------------------------------------
+    class Reader
+    {
+    public:
+        enum result {
+            OK,
+            NOT_YET,            // Not published yet
+            LAPPED,             // Overwritten before it could be read
+        };
+
+        ~Reader()
+        {
+            Close();
+        }
+
+        // False if there is no publisher, or it is of an incompatible version
+        bool Open(const char *name = DEFAULT_NAME)
+        {
+            Close();
+            int fd = shm_open(name, O_RDONLY, 0);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(LiveHeader)) {
+                close(fd);
+                return false;
+            }
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) {
+                return false;
+            }
+            map = (const uint8_t *) p;
+            size = st.st_size;
+            const LiveHeader &h = Header();
+            if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version_major != VERSION_MAJOR || h.slot_size < sizeof(LiveSlot) ||
+                h.slots == 0 || (h.slots & (h.slots - 1)) || h.header_size + (uint64_t) h.slots * h.slot_size > size) {
+                Close();
+                return false;
+            }
+            return true;
+        }
+
+        void Close()
+        {
+            if (map) {
+                munmap((void *) map, size);
+            }
+            map = nullptr;
+            size = 0;
+        }
+
+        bool IsOpened() const
+        {
+            return map != nullptr;
+        }
+        const LiveHeader &Header() const
+        {
+            return *(const LiveHeader *) map;
+        }
+        // Samples published so far. The latest is Published() - 1.
+        uint64_t Published() const
+        {
+            return Header().published.load(std::memory_order_acquire);
+        }
+
+        result Read(uint64_t n, LiveSample &sample) const
+        {
+            const LiveHeader &h = Header();
+            const LiveSlot &slot = *(const LiveSlot *) (map + h.header_size + (n & (h.slots - 1)) * h.slot_size);
+            uint64_t expected = 2 * n + 2;
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before != expected) {
+                return before < expected ? NOT_YET : LAPPED;
+            }
+            memcpy(&sample, (const void *) &slot.sample, sizeof(sample));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return slot.sequence.load(std::memory_order_relaxed) == expected ? OK : LAPPED;
+        }
+
+        // Calls callback(const LiveSample &) for the samples from cursor on, and moves cursor past
+        // them. Returns the number of samples lost to overwriting.
+        template <class Callback> uint64_t Poll(uint64_t &cursor, Callback &&callback) const
+        {
+            uint64_t lost = 0;
+            uint64_t published = Published();
+            uint64_t slots = Header().slots;
+            if (published > cursor + slots) {
+                lost += published - slots - cursor;
+                cursor = published - slots;
+            }
+            LiveSample sample;
+            while (cursor < published) {
+                result r = Read(cursor, sample);
+                if (r == NOT_YET) {
+                    break;              // Claimed, still being written
+                }
+                if (r == OK) {
+                    callback(sample);
+                } else {
+                    lost++;
+                }
+                cursor++;
+            }
+            return lost;
+        }
+
+    private:
+        const uint8_t *map = nullptr;
+        size_t size = 0;
+    };
+}
+
+#endif /* _LIVE_SHM_H */
@@ -39,6 +39,7 @@
 
 #include "thread.h"
 #include "crank-canvas.h"
+#include "control-point.h"
 
 // -------------------------------------------------------------------------------------------------
 // The application
@@ -105,14 +106,68 @@ wxEND_EVENT_TABLE()
 // -------------------------------------------------------------------------------------------------
 // The main frame
 // -------------------------------------------------------------------------------------------------
-IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool"), wxPoint(50, 50), wxSize(800, 600))
+IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool"), wxPoint(50, 50), wxSize(800, 600)),
+    subscriptions([this](const char *cmd) {
+        SendCommand(cmd);
+    }),
+    hostEstimator([this](const HostEstimate &estimate) {
+        view.SetFixed(host_x, estimate.theta, 1, "°", true);
+        view.SetFixed(host_x_dot, estimate.omega, 1, "°/sec", true);
+        view.SetFixed(host_x_ddot, estimate.alpha, 1, "°/sec²", true);
+        if (estimate.compared) {
+            view.SetFixed(angleError[0], estimate.errorMean, 2, "°", true);
+            view.SetFixed(angleError[1], estimate.errorSd, 2, "°");
+            view.SetFixed(angleError[2], estimate.errorMaximum, 2, "°");
+        }
+        if (estimate.dropped) {
+            view.SetInteger(hostDropped, estimate.dropped, " notifications dropped");
+        }
+    }),
+    playback([this](uint8_t stream, uint8_t *data, int length) {
+        switch (stream) {
+            case SessionLog::MEASUREMENT:
+                SetCyclingPowerMeasurement(data, length);
+                break;
+            case SessionLog::VECTOR:
+                SetCyclingPowerVector(data, length);
+                break;
+            case SessionLog::RAW:
+                SetInfoCrankRawData(data, length);
+                break;
+            case SessionLog::BATTERY:
+                if (length >= 1) {
+                    SetBatteryLevel(data[0]);
+                }
+                break;
+        }
+    })
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
     // The icon in the title bar
     SetIcon(wxICON(icon));
 
     CreateMenuBar(this); //helper function found in gui-helper
+    view.SetDisplayRate(20);
     CreateNotebookPages(this);
+    playbackBar = new PlaybackBar(this, playback);
+    GetSizer()->Add(playbackBar, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 5);
+
+    // Without it the tool works as before, other programs just cannot follow the data
+    if (!live.Open()) {
+        printf("Live data is not published\n");
+    }
+
+    // The pages that show each notification stream
+    subscriptions.AddPage(measurement, StreamSubscriptions::MEASUREMENT);
+    subscriptions.AddPage(vector, StreamSubscriptions::VECTOR);
+    subscriptions.AddPage(infoCrank_raw, StreamSubscriptions::RAW);
+    subscriptions.AddPage(crank_graphics, StreamSubscriptions::RAW);
+    // The page already showing gets no page changed event
+    subscriptions.SetVisiblePage(notebook->GetCurrentPage());
+    notebook->Bind(wxEVT_NOTEBOOK_PAGE_CHANGED, [&](wxBookCtrlEvent & evt) {
+        subscriptions.SetVisiblePage(notebook->GetCurrentPage());
+        evt.Skip();
+    });
 
     wxSizerFlags fieldFlags, groupBoxFlags, groupBoxInnerFlags, rightFlags, bottomRightFlags, centreFlags, gridFlags;
     InitializeSizerFlags(fieldFlags, groupBoxFlags, groupBoxInnerFlags, rightFlags, bottomRightFlags, centreFlags, gridFlags);
@@ -242,8 +297,11 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
     cumulativeCrankVectorRevolutions = new wxStaticText(vector, wxID_ANY, "-");
     lastCrankEventVectorTime = new wxStaticText(vector, wxID_ANY, "-");
     firstCrankMeasurementAngle = new wxStaticText(vector, wxID_ANY, "-");
-    forceArraySizer = new wxWrapSizer(wxHORIZONTAL);
-    torqueArraySizer = new wxWrapSizer(wxHORIZONTAL);
+    forceArray = new ArrayView(vector, 1.0, 0);
+    torqueArray = new ArrayView(vector, 1.0 / 32.0, 2);
+    wxString arrayModes[] = {"Numbers", "Bars", "Sparkline"};
+    wxChoice *arrayMode = new wxChoice(vector, wxID_ANY, wxDefaultPosition, wxDefaultSize, 3, arrayModes);
+    arrayMode->SetSelection(ArrayView::NUMBERS);
     wxToggleButton *notifyVector = new wxToggleButton(vector, wxID_ANY, "Notify");
     wxCheckBox *loggingVector = new wxCheckBox(vector, wxID_ANY, "/dev/null");
     wxButton *logFileVector = new wxButton(vector, wxID_ANY, "...", wxDefaultPosition, wxSize(50, 20));
@@ -253,14 +311,18 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
         switch (evt.GetInt()) {
             case TRUE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Stop");
-                SendCommand("Notify vector on\n");
+                subscriptions.SetRequested(StreamSubscriptions::VECTOR, true);
                 break;
             case FALSE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Notify");
-                SendCommand("Notify vector off\n");
+                subscriptions.SetRequested(StreamSubscriptions::VECTOR, false);
                 break;
         }
     });
+    arrayMode->Bind(wxEVT_CHOICE, [&](wxCommandEvent & evt) {
+        forceArray->SetMode(evt.GetSelection());
+        torqueArray->SetMode(evt.GetSelection());
+    });
     logFileVector->Bind(wxEVT_BUTTON, &IC2Frame::LogFileName, this, wxID_ANY, wxID_ANY, new FileDialogParameters("vector.log", loggingVector));
     //    loggingVector->Bind(wxEVT_CHECKBOX, &IC2Frame::LogFileOpen, this, wxID_ANY, wxID_ANY, new LogFile(&logVector));
 
@@ -269,10 +331,11 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
                             wxCheckBox *checkBox = (wxCheckBox *) evt.GetEventObject();
                             if (checkBox->IsChecked()) {
                                 //            logMeasurement.Create(checkBox->GetLabel(), true);
-                                logVector.Open(checkBox->GetLabel(), wxFile::write);
+                                logVector.Open(checkBox->GetLabel().utf8_str(), sessionIdentity);
                             } else {
                                 logVector.Close();
                             }
+                            subscriptions.SetLogger(StreamSubscriptions::VECTOR, logVector.IsOpened());
                         });
 
 
@@ -319,15 +382,13 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
 
         {
             wxStaticBoxSizer *boxSizer = new wxStaticBoxSizer(wxVERTICAL, vector, "Instantaneous force measurement array");
-            forceArraySizer->Add(new wxStaticText(vector, wxID_ANY, ""), fieldFlags);
-            boxSizer->Add(forceArraySizer, groupBoxFlags);
+            boxSizer->Add(forceArray, groupBoxInnerFlags);
             sizer->Add(boxSizer, groupBoxFlags);
         }
 
         {
             wxStaticBoxSizer *boxSizer = new wxStaticBoxSizer(wxVERTICAL, vector, "Instantaneous torque measurement array");
-            torqueArraySizer->Add(new wxStaticText(vector, wxID_ANY, ""), fieldFlags);
-            boxSizer->Add(torqueArraySizer, groupBoxInnerFlags);
+            boxSizer->Add(torqueArray, groupBoxInnerFlags);
             sizer->Add(boxSizer, groupBoxFlags);
         }
 
@@ -338,6 +399,7 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
             boxSizer->Add(loggingVector, fieldFlags);
             boxSizer->Add(logFileVector, fieldFlags);
             boxSizer->AddStretchSpacer();
+            boxSizer->Add(arrayMode, fieldFlags);
             boxSizer->Add(notifyVector, rightFlags);
             sizer->Add(boxSizer, groupBoxInnerFlags);
         }
@@ -696,10 +758,26 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
     processAccel2->SetBitmap(arrow);
     wxString choices[] = {wxString("+X"), wxString("-X"), wxString("+Y"), wxString("-Y"), wxString("+Z"), wxString("-Z"),};
     orientation = new wxRadioBox(infoCrank_raw, wxID_ANY, "Orientation", wxDefaultPosition, wxDefaultSize, 6, choices);
+    wxString windows[] = {wxString("All samples"), wxString("Last 1000 samples"), wxString("Last 10 s"), wxString("Last 60 s"), wxString("Last 10 min"),};
+    statisticsWindow = new wxChoice(infoCrank_raw, wxID_ANY, wxDefaultPosition, wxDefaultSize, WXSIZEOF(windows), windows);
+    statisticsWindow->SetSelection(0);
+    statisticsWindow->SetToolTip("Statistics window");
 
     x = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0, wxTextValidator(wxFILTER_NUMERIC));
     x_dot = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0, wxTextValidator(wxFILTER_NUMERIC));
     x_ddot = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, 0, wxTextValidator(wxFILTER_NUMERIC));
+    hostEstimate = new wxCheckBox(infoCrank_raw, wxID_ANY, "Host");
+    hostEstimate->SetToolTip("Run the Kalman filter on the accelerometers here too
+Uses the transforms and KF parameters last read from the device");
+    host_x = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_READONLY);
+    host_x_dot = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_READONLY);
+    host_x_ddot = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_READONLY);
+    const char *errorTips[] = {"Mean", "Standard deviation", "Largest"};
+    for (int i = 0; i < 3; i++) {
+        angleError[i] = new wxTextCtrl(infoCrank_raw, wxID_ANY, "", wxDefaultPosition, wxDefaultSize, wxTE_READONLY);
+        angleError[i]->SetToolTip(wxString().Format("%s host less firmware position\nSince the host filter started", errorTips[i]));
+    }
+    hostDropped = new wxStaticText(infoCrank_raw, wxID_ANY, "");
 
     wxToggleButton *notifyRaw = new wxToggleButton(infoCrank_raw, wxID_ANY, "Notify");
     wxCheckBox *loggingRaw = new wxCheckBox(infoCrank_raw, wxID_ANY, "/dev/null");
@@ -710,54 +788,64 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
     resetStrain->Bind(
         wxEVT_BUTTON,
         [&](wxCommandEvent & evt) {
-            strain_num = 0;
-            strain_sum = 0.0;
-            strain_sum2 = 0.0;
-            strain->SetValue("");
-            strain_avg->SetValue("");
-            strain_sd->SetValue("");
+            {
+                std::lock_guard<std::mutex> lock(statisticsLock);
+                rawAnalysis.strainStatistics.Reset();
+            }
+            view.SetText(strain, "");
+            view.SetText(strain_avg, "");
+            view.SetText(strain_sd, "");
         }
     );
     resetAccel1->Bind(
         wxEVT_BUTTON,
         [&](wxCommandEvent & evt) {
-            accel1_num = 0.001;
-            accel1X_sum = 0.0;
-            accel1X_sum2 = 0.0;
-            accel1Y_sum = 0.0;
-            accel1Y_sum2 = 0.0;
-            accel1Z_sum = 0.0;
-            accel1Z_sum2 = 0.0;
-            accel1[0]->SetValue("");
-            accel1_avg[0]->SetValue("");
-            accel1_sd[0]->SetValue("");
-            accel1[1]->SetValue("");
-            accel1_avg[1]->SetValue("");
-            accel1_sd[1]->SetValue("");
-            accel1[2]->SetValue("");
-            accel1_avg[2]->SetValue("");
-            accel1_sd[2]->SetValue("");
+            {
+                std::lock_guard<std::mutex> lock(statisticsLock);
+                rawAnalysis.accel1Statistics.Reset();
+            }
+            view.SetText(accel1[0], "");
+            view.SetText(accel1_avg[0], "");
+            view.SetText(accel1_sd[0], "");
+            view.SetText(accel1[1], "");
+            view.SetText(accel1_avg[1], "");
+            view.SetText(accel1_sd[1], "");
+            view.SetText(accel1[2], "");
+            view.SetText(accel1_avg[2], "");
+            view.SetText(accel1_sd[2], "");
         }
     );
     resetAccel2->Bind(
         wxEVT_BUTTON,
         [&](wxCommandEvent & evt) {
-            accel2_num = 0.001;
-            accel2X_sum = 0.0;
-            accel2X_sum2 = 0.0;
-            accel2Y_sum = 0.0;
-            accel2Y_sum2 = 0.0;
-            accel2Z_sum = 0.0;
-            accel2Z_sum2 = 0.0;
-            accel2[0]->SetValue("");
-            accel2_avg[0]->SetValue("");
-            accel2_sd[0]->SetValue("");
-            accel2[1]->SetValue("");
-            accel2_avg[1]->SetValue("");
-            accel2_sd[1]->SetValue("");
-            accel2[2]->SetValue("");
-            accel2_avg[2]->SetValue("");
-            accel2_sd[2]->SetValue("");
+            {
+                std::lock_guard<std::mutex> lock(statisticsLock);
+                rawAnalysis.accel2Statistics.Reset();
+            }
+            view.SetText(accel2[0], "");
+            view.SetText(accel2_avg[0], "");
+            view.SetText(accel2_sd[0], "");
+            view.SetText(accel2[1], "");
+            view.SetText(accel2_avg[1], "");
+            view.SetText(accel2_sd[1], "");
+            view.SetText(accel2[2], "");
+            view.SetText(accel2_avg[2], "");
+            view.SetText(accel2_sd[2], "");
+        }
+    );
+
+    statisticsWindow->Bind(
+        wxEVT_CHOICE,
+        [&](wxCommandEvent & evt) {
+            static const struct {
+                size_t samples;
+                double seconds;
+            } window[] = {{0, 0.0}, {1000, 0.0}, {0, 10.0}, {0, 60.0}, {0, 600.0}};
+            int i = statisticsWindow->GetSelection();
+            std::lock_guard<std::mutex> lock(statisticsLock);
+            rawAnalysis.strainStatistics.SetWindow(window[i].samples, window[i].seconds);
+            rawAnalysis.accel1Statistics.SetWindow(window[i].samples, window[i].seconds);
+            rawAnalysis.accel2Statistics.SetWindow(window[i].samples, window[i].seconds);
         }
     );
 
@@ -766,9 +854,14 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
         [&](wxCommandEvent & evt) {
             // Refer to CrankAngleEstimate.odt - Transforming Sensor Data to Crank Reference Frame
             // Copy row based on orientation to the gravity matrix
-            gravity1matrix[orientation->GetSelection() * 3 + 0] = accel1X_sum / accel1_num;
-            gravity1matrix[orientation->GetSelection() * 3 + 1] = accel1Y_sum / accel1_num;
-            gravity1matrix[orientation->GetSelection() * 3 + 2] = accel1Z_sum / accel1_num;
+            Moments<3> gravity;
+            {
+                std::lock_guard<std::mutex> lock(statisticsLock);
+                gravity = rawAnalysis.accel1Statistics.Summary();
+            }
+            gravity1matrix[orientation->GetSelection() * 3 + 0] = gravity.mean[0];
+            gravity1matrix[orientation->GetSelection() * 3 + 1] = gravity.mean[1];
+            gravity1matrix[orientation->GetSelection() * 3 + 2] = gravity.mean[2];
 
             // Build the coefficient matrix
             double sx = + gravity1matrix[0]
@@ -932,9 +1025,14 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
 
             // Refer to CrankAngleEstimate.odt - Transforming Sensor Data to Crank Reference Frame
             // Copy row based on orientation to the gravity matrix
-            gravity2matrix[orientation->GetSelection() * 3 + 0] = accel2X_sum / accel2_num;
-            gravity2matrix[orientation->GetSelection() * 3 + 1] = accel2Y_sum / accel2_num;
-            gravity2matrix[orientation->GetSelection() * 3 + 2] = accel2Z_sum / accel2_num;
+            Moments<3> gravity;
+            {
+                std::lock_guard<std::mutex> lock(statisticsLock);
+                gravity = rawAnalysis.accel2Statistics.Summary();
+            }
+            gravity2matrix[orientation->GetSelection() * 3 + 0] = gravity.mean[0];
+            gravity2matrix[orientation->GetSelection() * 3 + 1] = gravity.mean[1];
+            gravity2matrix[orientation->GetSelection() * 3 + 2] = gravity.mean[2];
 
             // Build the coefficient matrix
             double sx = + gravity2matrix[0]
@@ -1073,11 +1171,11 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
         switch (evt.GetInt()) {
             case TRUE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Stop");
-                SendCommand("Notify raw on\n");
+                subscriptions.SetRequested(StreamSubscriptions::RAW, true);
                 break;
             case FALSE:
                 ((wxToggleButton *) evt.GetEventObject())->SetLabel("Notify");
-                SendCommand("Notify raw off\n");
+                subscriptions.SetRequested(StreamSubscriptions::RAW, false);
                 break;
         }
     });
@@ -1085,16 +1183,47 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
     //    loggingRaw->Bind(wxEVT_CHECKBOX, &IC2Frame::LogFileOpen, this, wxID_ANY, wxID_ANY, new LogFile(&logRaw));
 
 
+    // A chunk is otherwise only written when a notification comes after its second is up, so the
+    // last one of a stream that goes quiet would wait in the encoder indefinitely
+    rawChunkTimer.SetOwner(this);
+    Bind(wxEVT_TIMER, [this](wxTimerEvent &) {
+        std::lock_guard<std::mutex> lock(rawLogLock);
+        if (rawEncoder.Notifications() && SessionLog::MonotonicNanoseconds() - rawEncoder.FirstHost() >= 1000000000LL) {
+            WriteRawChunk();
+        }
+    }, rawChunkTimer.GetId());
     loggingRaw->Bind(wxEVT_CHECKBOX,
                      [&](wxCommandEvent & evt) {
                          wxCheckBox *checkBox = (wxCheckBox *) evt.GetEventObject();
+                         {
+                             // Writes out the last chunk, or drops one left over from the last log
+                             std::lock_guard<std::mutex> lock(rawLogLock);
+                             WriteRawChunk();
+                         }
                          if (checkBox->IsChecked()) {
                              //            logMeasurement.Create(checkBox->GetLabel(), true);
-                             logRaw.Open(checkBox->GetLabel(), wxFile::write);
+                             logRaw.Open(checkBox->GetLabel().utf8_str(), sessionIdentity);
                          } else {
                              logRaw.Close();
                          }
+                         if (logRaw.IsOpened()) {
+                             rawChunkTimer.Start(250);
+                         } else {
+                             rawChunkTimer.Stop();
+                         }
+                         subscriptions.SetLogger(StreamSubscriptions::RAW, logRaw.IsOpened());
                      });
+    hostEstimate->Bind(wxEVT_CHECKBOX, [&](wxCommandEvent & evt) {
+        if (evt.IsChecked()) {
+            hostEstimator.Configure(sessionIdentity.calibration);
+            hostEstimator.Start();
+            subscriptions.AddConsumer(StreamSubscriptions::RAW);
+        } else {
+            hostEstimator.Stop();
+            subscriptions.RemoveConsumer(StreamSubscriptions::RAW);
+        }
+        hostDropped->SetLabel("");
+    });
 
     features->Layout();
 
@@ -1200,21 +1329,39 @@ IC2Frame::IC2Frame() : wxFrame(NULL, wxID_ANY,  wxT("Verve IC2 Diagnostic Tool")
             sizer->Add(staticBoxSizer, groupBoxFlags);
         }
         {
-            sizer->Add(orientation, groupBoxFlags);
+            wxBoxSizer *boxSizer = new wxBoxSizer(wxHORIZONTAL);
+            boxSizer->Add(orientation, groupBoxFlags);
+            {
+                wxStaticBoxSizer *staticBoxSizer = new wxStaticBoxSizer(wxVERTICAL, infoCrank_raw, "Statistics");
+                staticBoxSizer->Add(statisticsWindow, centreFlags);
+                boxSizer->Add(staticBoxSizer, groupBoxFlags);
+            }
+            sizer->Add(boxSizer, groupBoxFlags);
         }
 
 
         {
             wxStaticBoxSizer *staticBoxSizer = new wxStaticBoxSizer(wxVERTICAL, infoCrank_raw, "State");
             {
-                wxFlexGridSizer *gridSizer = new wxFlexGridSizer(3, 0, 0);
+                wxFlexGridSizer *gridSizer = new wxFlexGridSizer(4, 0, 0);
+                gridSizer->Add(-1, -1);
                 gridSizer->Add(new wxStaticText(infoCrank_raw, wxID_ANY, "Position"), centreFlags);
                 gridSizer->Add(new wxStaticText(infoCrank_raw, wxID_ANY, "Velocity"), centreFlags);
                 gridSizer->Add(new wxStaticText(infoCrank_raw, wxID_ANY, "Acceleration"), centreFlags);
+                gridSizer->Add(new wxStaticText(infoCrank_raw, wxID_ANY, "Firmware"), centreFlags);
                 gridSizer->Add(x);
                 gridSizer->Add(x_dot);
                 gridSizer->Add(x_ddot);
+                gridSizer->Add(hostEstimate, centreFlags);
+                gridSizer->Add(host_x);
+                gridSizer->Add(host_x_dot);
+                gridSizer->Add(host_x_ddot);
+                gridSizer->Add(new wxStaticText(infoCrank_raw, wxID_ANY, "Error"), centreFlags);
+                for (int i = 0; i < 3; i++) {
+                    gridSizer->Add(angleError[i]);
+                }
                 staticBoxSizer->Add(gridSizer, centreFlags);
+                staticBoxSizer->Add(hostDropped, centreFlags);
             }
             sizer->Add(staticBoxSizer, groupBoxFlags);
         }
@@ -1349,7 +1496,7 @@ void IC2Frame::LogFileName(wxCommandEvent &evt)
         return;
     }
 
-    wxFileDialog logFileDialog(this, "Open logging file", "~/Documents", userData->m_fileName, "Log files (*.log)|*.log", wxFD_SAVE);
+    wxFileDialog logFileDialog(this, "Open logging file", "~/Documents", userData->m_fileName, userData->m_wildcard, wxFD_SAVE);
     if (logFileDialog.ShowModal() == wxID_CANCEL) {
         return;
     }
@@ -1399,6 +1546,7 @@ void IC2Frame::OnDisconnect(wxCommandEvent &evt)
     if (n < 0) {
         printf("ERROR writing to socket\n");
     }
+    subscriptions.Forget();
 }
 
 //##################################################################################################
@@ -1494,6 +1642,11 @@ void IC2Frame::OnConnect(wxCommandEvent &evt)
 
     // Toggle the button label between Connect and Disconnect
     ((wxToggleButton *) evt.GetEventObject())->SetLabel(evt.GetInt() ? "Disconnect" : "Connect");
+    if (evt.GetInt()) {
+        sessionIdentity = SessionLog::Identity();
+        snprintf(sessionIdentity.address, sizeof(sessionIdentity.address), "%s", ((BLEDevice::UserData *) evt.GetEventUserData())->address);
+        crankClock.Reset();
+    }
 
     SendCommand(cmd);
 }
@@ -1516,13 +1669,11 @@ void IC2Frame::OnConnect(wxCommandEvent &evt)
 //##################################################################################################
 void IC2Frame::SetBatteryLevel(uint8_t level)
 {
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
-
     if (logBattery.IsOpened()) {
-        logBattery.Write(&level, sizeof(level));
+        logBattery.Write(SessionLog::BATTERY, &level, sizeof(level));
     }
 
-    batteryLevel->SetLabel(wxString().Format("%hhu%%", level));
+    view.SetInteger(batteryLevel, level, "%");
 }
 
 //void IC2Frame::RefreshBatteryInformation(wxCommandEvent &evt)
@@ -1564,6 +1715,7 @@ void IC2Frame::SetSerialNumber(const char *str)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
     serialNumber->SetLabel(str);
+    snprintf(sessionIdentity.serial, sizeof(sessionIdentity.serial), "%s", str);
 }
 void IC2Frame::SetHardwareRevisionNumber(const char *str)
 {
@@ -1574,6 +1726,7 @@ void IC2Frame::SetFirmwareRevisionNumber(const char *str)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
     firmwareRevisionNumber->SetLabel(str);
+    snprintf(sessionIdentity.firmware, sizeof(sessionIdentity.firmware), "%s", str);
 }
 void IC2Frame::SetSoftwareRevisionNumber(const char *str)
 {
@@ -1723,193 +1876,112 @@ void IC2Frame::SetCyclingPowerFeature(void *str)
 
 void IC2Frame::SetCyclingPowerMeasurement(void *str, int length)
 {
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
+    CyclingPowerMeasurement m;
+    bool valid = measurementDecoder.Decode((uint8_t *) str, length, m);
+
+    if (valid) {
+        std::lock_guard<std::mutex> lock(fitLock);
+        fit.AddMeasurement(SessionLog::MonotonicNanoseconds(), m);
+    }
     if (logMeasurement.IsOpened()) {
-        logMeasurement.Write(str, length);
+        // The crank event time, when present, dates the packet better than its arrival
+        int64_t now = SessionLog::MonotonicNanoseconds();
+        if (valid && m.flags.crank_revolution_data_present) {
+            logMeasurement.Write(SessionLog::MEASUREMENT, now, crankClock.Correct(now, m.last_crank_event_time), SessionLog::DEVICE_TIME, str, length);
+        } else {
+            logMeasurement.Write(SessionLog::MEASUREMENT, now, now, 0, str, length);
+        }
+    }
+    if (!valid) {
+        return;
     }
 
-    uint8_t index = 2;
-
-    #pragma pack(push, 1)
-    struct cycling_power_measurement_flags {
-        uint16_t pedal_power_balance_present: 1;
-        uint16_t pedal_power_balance_reference: 1;
-        uint16_t accumulated_torque_present: 1;
-        uint16_t accumulated_torque_source: 1;
-        uint16_t wheel_revolution_data_present: 1;
-        uint16_t crank_revolution_data_present: 1;
-        uint16_t extreme_force_magnitudes_present: 1;
-        uint16_t extreme_torque_magnitudes_present: 1;
-        uint16_t extreme_angles_present: 1;
-        uint16_t top_dead_spot_angle_present: 1;
-        uint16_t bottom_dead_spot_angle_present: 1;
-        uint16_t accumulated_energy_present: 1;
-        uint16_t offset_compensation_indicator: 1;
-    } *flags = (struct cycling_power_measurement_flags *) str;
-    #pragma pack(pop)
-
-    int16_t *instantaneous_power = (int16_t *)(((uint8_t *) str) + index);
-
-    instantaneousPower->SetLabel(wxString().Format("%hd W", *instantaneous_power));
-    index += sizeof(int16_t);
+    {
+        int64_t host_ns = SessionLog::MonotonicNanoseconds();
+        live.Publish(Live::POWER, host_ns, m.instantaneous_power);
+        if (m.flags.crank_revolution_data_present) {
+            live.Publish(Live::CADENCE, host_ns, m.cadence);
+        }
+        if (m.flags.accumulated_torque_present) {
+            live.Publish(Live::TORQUE, host_ns, m.torque);
+        }
+        if (m.flags.pedal_power_balance_present && m.flags.pedal_power_balance_reference) {
+            live.Publish(Live::BALANCE, host_ns, m.pedal_power_balance);
+        }
 
-    if (flags->pedal_power_balance_present) {
-        pedalPowerBalancePresent->SetValue(true);
-        uint8_t *pedal_power_balance = ((uint8_t *) str) + index;
-        pedalPowerBalance->SetLabel(wxString().Format("%0.1f %%", *pedal_power_balance * 0.5f));
-        index += sizeof(uint8_t);
-    } else {
-        pedalPowerBalancePresent->SetValue(false);
+        double now = host_ns * 1.0e-9;
+        std::lock_guard<std::mutex> lock(statisticsLock);
+        powerHistory.Append(now, m.instantaneous_power);
+        if (m.flags.crank_revolution_data_present) {
+            cadenceHistory.Append(now, m.cadence);
+        }
     }
 
-    if (flags->pedal_power_balance_reference) {
-        pedalPowerBalancePresent->SetLabel("Balance: Left");
-    } else {
-        pedalPowerBalancePresent->SetLabel("Balance: Unknown");
-    }
+    view.SetInteger(instantaneousPower, m.instantaneous_power, " W");
 
-    if (flags->accumulated_torque_present) {
-        accumulatedTorquePresent->SetValue(true);
-        uint16_t *accumulated_torque = (uint16_t *)(((uint8_t *) str) + index);
-        accumulatedTorque->SetLabel(wxString().Format("%0.2f", *accumulated_torque / 32.0f));
-        static uint16_t previous_accumulated_torque = 0;
-        torque->SetLabel(wxString().Format("%0.2f N.m", ((int16_t) (*accumulated_torque - previous_accumulated_torque)) / 32.0f));
-        previous_accumulated_torque = *accumulated_torque;
-        index += sizeof(uint16_t);
-    } else {
-        accumulatedTorquePresent->SetValue(false);
+    view.SetCheck(pedalPowerBalancePresent, m.flags.pedal_power_balance_present);
+    if (m.flags.pedal_power_balance_present) {
+        view.SetFixed(pedalPowerBalance, m.pedal_power_balance, 1, " %");
     }
+    view.SetText(pedalPowerBalancePresent, m.flags.pedal_power_balance_reference ? "Balance: Left" : "Balance: Unknown");
 
-    if (flags->accumulated_torque_source) {
-        accumulatedTorquePresent->SetLabel("Accumulated torque: Crank based");
-    } else {
-        accumulatedTorquePresent->SetLabel("Accumulated torque: Wheel based");
+    view.SetCheck(accumulatedTorquePresent, m.flags.accumulated_torque_present);
+    if (m.flags.accumulated_torque_present) {
+        view.SetFixed(accumulatedTorque, m.accumulated_torque, 2);
+        view.SetFixed(torque, m.torque, 2, " N.m");
     }
+    view.SetText(accumulatedTorquePresent, m.flags.accumulated_torque_source ? "Accumulated torque: Crank based" : "Accumulated torque: Wheel based");
 
-    if (flags->wheel_revolution_data_present) {
-        wheelRevolutionDataPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct wheel_revolution_data_s {
-            uint32_t cumulative_wheel_revolutions;
-            uint16_t last_wheel_event_time;
-        } *wheel_revolution_data = (struct wheel_revolution_data_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        cumulativeWheelRevolutions->SetLabel(wxString().Format("%u", wheel_revolution_data->cumulative_wheel_revolutions));
-        lastWheelEventTime->SetLabel(wxString().Format("%hu s/2048", wheel_revolution_data->last_wheel_event_time));
-        static uint32_t previous_cumulative_wheel_revolutions = 0;
-        static uint16_t previous_last_wheel_event_time = 0;
-        wheelSpeed->SetLabel(wxString().Format("%0.1lf RPM", 60.0 * ((uint32_t)(wheel_revolution_data->cumulative_wheel_revolutions - previous_cumulative_wheel_revolutions)) / (((uint16_t)(wheel_revolution_data->last_wheel_event_time - previous_last_wheel_event_time)) / 2048.0)));
-        previous_cumulative_wheel_revolutions = wheel_revolution_data->cumulative_wheel_revolutions;
-        previous_last_wheel_event_time = wheel_revolution_data->last_wheel_event_time;
-        index += sizeof(struct wheel_revolution_data_s);
-    } else {
-        wheelRevolutionDataPresent->SetValue(false);
+    view.SetCheck(wheelRevolutionDataPresent, m.flags.wheel_revolution_data_present);
+    if (m.flags.wheel_revolution_data_present) {
+        view.SetInteger(cumulativeWheelRevolutions, m.cumulative_wheel_revolutions);
+        view.SetInteger(lastWheelEventTime, m.last_wheel_event_time, " s/2048");
+        view.SetFixed(wheelSpeed, m.wheel_speed, 1, " RPM");
     }
 
-    if (flags->crank_revolution_data_present) {
-        crankRevolutionDataPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct crank_revolution_data_s {
-            uint16_t cumulative_crank_revolutions;
-            uint16_t last_crank_event_time;
-        } *crank_revolution_data = (struct crank_revolution_data_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        cumulativeCrankRevolutions->SetLabel(wxString().Format("%hu", crank_revolution_data->cumulative_crank_revolutions));
-        lastCrankEventTime->SetLabel(wxString().Format("%hu s/1024", crank_revolution_data->last_crank_event_time));
-        static uint16_t previous_cumulative_crank_revolutions = 0;
-        static uint16_t previous_last_crank_event_time = 0;
-        cadence->SetLabel(wxString().Format("%0.1lf RPM", 60.0 * ((uint16_t)(crank_revolution_data->cumulative_crank_revolutions - previous_cumulative_crank_revolutions)) / (((uint16_t)(crank_revolution_data->last_crank_event_time - previous_last_crank_event_time)) / 1024.0)));
-        previous_cumulative_crank_revolutions = crank_revolution_data->cumulative_crank_revolutions;
-        previous_last_crank_event_time = crank_revolution_data->last_crank_event_time;
-        index += sizeof(struct crank_revolution_data_s);
-    } else {
-        crankRevolutionDataPresent->SetValue(false);
+    view.SetCheck(crankRevolutionDataPresent, m.flags.crank_revolution_data_present);
+    if (m.flags.crank_revolution_data_present) {
+        view.SetInteger(cumulativeCrankRevolutions, m.cumulative_crank_revolutions);
+        view.SetInteger(lastCrankEventTime, m.last_crank_event_time, " s/1024");
+        view.SetFixed(cadence, m.cadence, 1, " RPM");
     }
 
-    if (flags->extreme_force_magnitudes_present) {
-        extremeForceMagnitudesPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct extreme_force_magnitudes_s {
-            int16_t maximum_force_magnitude;
-            int16_t minimum_force_magnitude;
-        } *extreme_force_magnitudes = (struct extreme_force_magnitudes_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        maximumForceMagnitude->SetLabel(wxString().Format("%hd N", extreme_force_magnitudes->maximum_force_magnitude));
-        minimumForceMagnitude->SetLabel(wxString().Format("%hd N", extreme_force_magnitudes->minimum_force_magnitude));
-        index += sizeof(struct extreme_force_magnitudes_s);
-    } else {
-        extremeForceMagnitudesPresent->SetValue(false);
+    view.SetCheck(extremeForceMagnitudesPresent, m.flags.extreme_force_magnitudes_present);
+    if (m.flags.extreme_force_magnitudes_present) {
+        view.SetInteger(maximumForceMagnitude, m.maximum_force_magnitude, " N");
+        view.SetInteger(minimumForceMagnitude, m.minimum_force_magnitude, " N");
     }
 
-    if (flags->extreme_torque_magnitudes_present) {
-        extremeTorqueMagnitudesPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct extreme_torque_magnitudes_s {
-            int16_t maximum_torque_magnitude;
-            int16_t minimum_torque_magnitude;
-        } *extreme_torque_magnitudes = (struct extreme_torque_magnitudes_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        maximumTorqueMagnitude->SetLabel(wxString().Format("%0.2f N.m", extreme_torque_magnitudes->maximum_torque_magnitude / 32.0f));
-        minimumTorqueMagnitude->SetLabel(wxString().Format("%0.2f N.m", extreme_torque_magnitudes->minimum_torque_magnitude / 32.0f));
-        index += sizeof(struct extreme_torque_magnitudes_s);
-    } else {
-        extremeTorqueMagnitudesPresent->SetValue(false);
+    view.SetCheck(extremeTorqueMagnitudesPresent, m.flags.extreme_torque_magnitudes_present);
+    if (m.flags.extreme_torque_magnitudes_present) {
+        view.SetFixed(maximumTorqueMagnitude, m.maximum_torque_magnitude, 2, " N.m");
+        view.SetFixed(minimumTorqueMagnitude, m.minimum_torque_magnitude, 2, " N.m");
     }
 
-    printf("about to extreme angles\n");
-    if (flags->extreme_angles_present) {
-        extremeAnglesPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct extreme_angles_s {
-            uint32_t maximum_angle: 12;
-            uint32_t minimum_angle: 12;
-        } *extreme_angles = (struct extreme_angles_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        printf("sizeof(struct extreme_angles_s) %lu\n", sizeof(struct extreme_angles_s));
-        maximumAngle->SetLabel(wxString().Format(L"%hu°", extreme_angles->maximum_angle));
-        minimumAngle->SetLabel(wxString().Format(L"%hu°", extreme_angles->minimum_angle));
-        index += sizeof(struct extreme_angles_s);
-    } else {
-        extremeAnglesPresent->SetValue(false);
+    view.SetCheck(extremeAnglesPresent, m.flags.extreme_angles_present);
+    if (m.flags.extreme_angles_present) {
+        view.SetInteger(maximumAngle, m.maximum_angle, "°");
+        view.SetInteger(minimumAngle, m.minimum_angle, "°");
     }
 
-    printf("about to top dead spot angle\n");
-    if (flags->top_dead_spot_angle_present) {
-        topDeadSpotAnglePresent->SetValue(true);
-        uint16_t *top_dead_spot_angle = (uint16_t *)(((uint8_t *) str) + index);
-        topDeadSpotAngle->SetLabel(wxString().Format(L"%hu°", *top_dead_spot_angle));
-        index += sizeof(uint16_t);
-    } else {
-        topDeadSpotAnglePresent->SetValue(false);
+    view.SetCheck(topDeadSpotAnglePresent, m.flags.top_dead_spot_angle_present);
+    if (m.flags.top_dead_spot_angle_present) {
+        view.SetInteger(topDeadSpotAngle, m.top_dead_spot_angle, "°");
     }
 
-    if (flags->bottom_dead_spot_angle_present) {
-        bottomDeadSpotAnglePresent->SetValue(true);
-        uint16_t *bottom_dead_spot_angle = (uint16_t *)(((uint8_t *) str) + index);
-        bottomDeadSpotAngle->SetLabel(wxString().Format(L"%hu°", *bottom_dead_spot_angle));
-        index += sizeof(uint16_t);
-    } else {
-        bottomDeadSpotAnglePresent->SetValue(false);
+    view.SetCheck(bottomDeadSpotAnglePresent, m.flags.bottom_dead_spot_angle_present);
+    if (m.flags.bottom_dead_spot_angle_present) {
+        view.SetInteger(bottomDeadSpotAngle, m.bottom_dead_spot_angle, "°");
     }
 
-    if (flags->accumulated_energy_present) {
-        accumulatedEnergyPresent->SetValue(true);
-        uint16_t *accumulated_energy = (uint16_t *)(((uint8_t *) str) + index);
-        accumulatedEnergy->SetLabel(wxString().Format("%hd KJ", *accumulated_energy));
-        index += sizeof(uint16_t);
-    } else {
-        accumulatedEnergyPresent->SetValue(false);
+    view.SetCheck(accumulatedEnergyPresent, m.flags.accumulated_energy_present);
+    if (m.flags.accumulated_energy_present) {
+        view.SetInteger(accumulatedEnergy, m.accumulated_energy, " KJ");
     }
 
-    if (flags->offset_compensation_indicator) {
-        offsetCompensationIndicator->SetValue(true);
-    } else {
-        offsetCompensationIndicator->SetValue(false);
-    }
-    measurement->PostSizeEvent();
+    view.SetCheck(offsetCompensationIndicator, m.flags.offset_compensation_indicator);
 }
 
-
 //##################################################################################################
 // Cycling power control point page
 //##################################################################################################
@@ -1936,6 +2008,9 @@ struct IC2Frame::sensorLocations_s IC2Frame::sensorLocations[17] = {
 void IC2Frame::SetCyclingPowerControlPoint(void *str, int length)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
+    using namespace ControlPoint;
+    using namespace ControlPoint::CyclingPower;
+
     #pragma pack(push, 1)
     struct control_point_data {
         uint8_t op_code;
@@ -1945,33 +2020,7 @@ void IC2Frame::SetCyclingPowerControlPoint(void *str, int length)
     } *cp_data = (struct control_point_data *) str;
     #pragma pack(pop)
 
-    enum op_codes {
-        SET_CUMULATIVE_VALUE = 1,
-        UPDATE_SENSOR_LOCATION,
-        REQUEST_SUPPORTED_SENSOR_LOCATIONS,
-        SET_CRANK_LENGTH,
-        REQUEST_CRANK_LENGTH,
-        SET_CHAIN_LENGTH,
-        REQUEST_CHAIN_LENGTH,
-        SET_CHAIN_WEIGHT,
-        REQUEST_CHAIN_WEIGHT,
-        SET_SPAN_LENGTH,
-        REQUEST_SPAN_LENGTH,
-        START_OFFSET_COMPENSATION,
-        MAST_CYCLING_POWER_MEASUREMENT_CHARACTERISTIC_CONTENT,
-        REQUEST_SAMPLING_RATE,
-        REQUEST_FACTORY_CALIBRATION_DATE,
-        START_ENHANCED_OFFSET_COMPENSATION,
-        RESPONSE_CODE = 0x20,
-    };
-
-    enum response_codes {
-        SUCCESS = 1,
-        NOT_SUPPORTED,
-        INVALID_OPERAND,
-        OPERATION_FAILED,
-    };
-    if (cp_data->op_code != RESPONSE_CODE) {
+    if (length < (int) RESPONSE_HEADER_SIZE || cp_data->op_code != RESPONSE_CODE) {
         SetStatusText("Failed - Unknown response", 1);
         return;
     }
@@ -1992,42 +2041,48 @@ void IC2Frame::SetCyclingPowerControlPoint(void *str, int length)
             SetStatusText("Failed - Unknown response", 1);
             return;
     }
-    wxString fmt;
-    switch (cp_data->request_code) {
-        case REQUEST_SUPPORTED_SENSOR_LOCATIONS:
-            location->Clear();
-            for (int i = 3; i < length; i++) {
-                location->Append(sensorLocations[cp_data->data[i - 3]].location, &sensorLocations[cp_data->data[i - 3]].index);
+    size_t payload = length - RESPONSE_HEADER_SIZE;
+
+    // The supported locations are a list, which has no fixed layout
+    if (cp_data->request_code == RequestSupportedSensorLocations::op_code) {
+        location->Clear();
+        for (size_t i = 0; i < payload; i++) {
+            if (cp_data->data[i] < WXSIZEOF(sensorLocations)) {
+                location->Append(sensorLocations[cp_data->data[i]].location, &sensorLocations[cp_data->data[i]].index);
             }
-            break;
-        case REQUEST_CRANK_LENGTH:
-            crankLength->SetValue(wxString() << (*((uint16_t *) cp_data->data)) / 2.0);
-            break;
-        case REQUEST_CHAIN_LENGTH:
-            chainLength->SetValue(wxString() << (*((uint16_t *) cp_data->data)));
-            break;
-        case REQUEST_CHAIN_WEIGHT:
-            chainWeight->SetValue(wxString() << (*((uint16_t *) cp_data->data)));
-            break;
-        case REQUEST_SPAN_LENGTH:
-            span->SetValue(wxString() << (*((uint16_t *) cp_data->data)));
-            break;
-        case START_OFFSET_COMPENSATION:
-            offsetCompensationValue->SetLabel(wxString().Format("%0.2f N.m", (*((int16_t *) cp_data->data)) / 32.0f));
-            break;
-        case REQUEST_SAMPLING_RATE:
-            samplingRate->SetLabel(wxString().Format("%hhu Hz", *((uint8_t *) cp_data->data)));
-            break;
-        case REQUEST_FACTORY_CALIBRATION_DATE:
-            fmt.Printf("%04hu-%02hhu-%02hhu %02hhu:%02hhu:%02hhu", *((uint16_t *) cp_data->data), cp_data->data[2], cp_data->data[3], cp_data->data[4], cp_data->data[5], cp_data->data[6]);
-            calibrationDate->SetLabel(fmt);
-            break;
-        case START_ENHANCED_OFFSET_COMPENSATION:
-            enhancedOffsetCompensationValue->SetLabel(wxString().Format("%0.2f N.m", (*((int16_t *) cp_data->data)) / 32.0f));
-            break;
+        }
+        return;
     }
 
-
+    Commands::Decode(cp_data->request_code, cp_data->data, payload, Handlers {
+        [&](RequestCrankLength, const RequestCrankLength::Response::Values &values) {
+            crankLength->SetValue(wxString() << std::get<0>(values));
+        },
+        [&](RequestChainLength, const RequestChainLength::Response::Values &values) {
+            chainLength->SetValue(wxString() << std::get<0>(values));
+        },
+        [&](RequestChainWeight, const RequestChainWeight::Response::Values &values) {
+            chainWeight->SetValue(wxString() << std::get<0>(values));
+        },
+        [&](RequestSpanLength, const RequestSpanLength::Response::Values &values) {
+            span->SetValue(wxString() << std::get<0>(values));
+        },
+        [&](StartOffsetCompensation, const StartOffsetCompensation::Response::Values &values) {
+            offsetCompensationValue->SetLabel(wxString().Format("%0.2f N.m", std::get<0>(values)));
+        },
+        [&](RequestSamplingRate, const RequestSamplingRate::Response::Values &values) {
+            samplingRate->SetLabel(wxString().Format("%hhu Hz", std::get<0>(values)));
+        },
+        [&](RequestFactoryCalibrationDate, const RequestFactoryCalibrationDate::Response::Values &values) {
+            const DateTime &date = std::get<0>(values);
+            calibrationDate->SetLabel(wxString().Format("%04hu-%02hhu-%02hhu %02hhu:%02hhu:%02hhu",
+                                                        date.year, date.month, date.day, date.hour, date.minute, date.second));
+        },
+        [&](StartEnhancedOffsetCompensation, const StartEnhancedOffsetCompensation::Response::Values &values) {
+            enhancedOffsetCompensationValue->SetLabel(wxString().Format("%0.2f N.m", std::get<0>(values)));
+        },
+        [](auto, const auto &) {},          // Nothing to show
+    });
 }
 
 //void IC2Frame::SetCumulativeValue(wxCommandEvent &evt)
@@ -2242,90 +2297,52 @@ void IC2Frame::SetSensorLocation(uint8_t idx)
 
 void IC2Frame::SetCyclingPowerVector(void *str, int length)
 {
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
     if (logVector.IsOpened()) {
-        logVector.Write(str, length);
+        logVector.Write(SessionLog::VECTOR, str, length);
     }
 
-    uint8_t index = 1;
-
-    #pragma pack(push, 1)
-    struct cycling_power_vector_flags {
-        uint8_t crank_revolution_data_present: 1;
-        uint8_t first_crank_measurement_angle_present: 1;
-        uint8_t instantaneous_force_magnitude_array_present: 1;
-        uint8_t instantaneous_torque_magnitude_array_present: 1;
-        uint8_t instantaneous_measurement_direction: 2;
-    } *flags = (struct cycling_power_vector_flags *) str;
-    #pragma pack(pop)
-
-    char direction[][21] = {"Unknown", "Tangential Component", "Radial Component", "Lateral Component"};
-
-    instantaneousMeasurementDirection->SetLabel(direction[flags->instantaneous_measurement_direction]);
-
-    if (flags->crank_revolution_data_present) {
-        crankRevolutionDataVectorPresent->SetValue(true);
-        #pragma pack(push,1)
-        struct crank_revolution_data_s {
-            uint16_t cumulative_crank_revolutions;
-            uint16_t last_crank_event_time;
-        } *crank_revolution_data = (struct crank_revolution_data_s *)(((uint8_t *) str) + index);
-        #pragma pack(pop)
-        cumulativeCrankVectorRevolutions->SetLabel(wxString().Format("%hu", crank_revolution_data->cumulative_crank_revolutions));
-        lastCrankEventVectorTime->SetLabel(wxString().Format("%hu s/1024", crank_revolution_data->last_crank_event_time));
-        index += sizeof(struct crank_revolution_data_s);
-    } else {
-        crankRevolutionDataVectorPresent->SetValue(false);
+    CyclingPowerVector v;
+    if (!DecodeCyclingPowerVector((uint8_t *) str, length, v)) {
+        return;
     }
-
-    if (flags->first_crank_measurement_angle_present) {
-        firstCrankMeasurementAnglePresent->SetValue(true);
-        uint16_t *first_crank_angle_measurement = (uint16_t *)(((uint8_t *) str) + index);
-        firstCrankMeasurementAngle->SetLabel(wxString().Format(L"%hu°", *first_crank_angle_measurement));
-        index += sizeof(uint16_t);
-    } else {
-        firstCrankMeasurementAnglePresent->SetValue(false);
+    {
+        std::lock_guard<std::mutex> lock(fitLock);
+        fit.AddVector(SessionLog::MonotonicNanoseconds(), v);
     }
 
-    wxSizerFlags fieldFlags;
-    fieldFlags.Border(wxLEFT | wxRIGHT, 10);
+    view.SetText(instantaneousMeasurementDirection, measurement_directions[v.flags.instantaneous_measurement_direction]);
 
-    if (flags->instantaneous_force_magnitude_array_present) {
-        instantaneousForceMagnitudeArrayPresent->SetValue(true);
-        int16_t *instantaneous_force_magnitude_array = (int16_t *)(((uint8_t *) str) + index);
-        forceArraySizer->Clear(true);
-        for (int i = 0; index < length; i ++) {
-            forceArraySizer->Add(new wxStaticText(vector, wxID_ANY, wxString().Format("%hd", instantaneous_force_magnitude_array[i])), fieldFlags);
-            index += sizeof(uint16_t);
-        }
-        vector->PostSizeEvent();        // wxWrapSizer needs a resize to layout correctly
-    } else {
-        instantaneousForceMagnitudeArrayPresent->SetValue(false);
+    view.SetCheck(crankRevolutionDataVectorPresent, v.flags.crank_revolution_data_present);
+    if (v.flags.crank_revolution_data_present) {
+        view.SetInteger(cumulativeCrankVectorRevolutions, v.cumulative_crank_revolutions);
+        view.SetInteger(lastCrankEventVectorTime, v.last_crank_event_time, " s/1024");
     }
 
-    if (flags->instantaneous_torque_magnitude_array_present) {
-        instantaneousTorqueMagnitudeArrayPresent->SetValue(true);
-        int16_t *instantaneous_torque_magnitude_array = (int16_t *)(((uint8_t *) str) + index);
-        torqueArraySizer->Clear(true);
-        for (int i = 0; index < length; i ++) {
-            torqueArraySizer->Add(new wxStaticText(vector, wxID_ANY, wxString().Format("%0.2f", instantaneous_torque_magnitude_array[i] / 32.0f)), fieldFlags);
-            index += sizeof(uint16_t);
-        }
-        vector->PostSizeEvent();        // wxWrapSizer needs a resize to layout correctly
-    } else {
-        instantaneousTorqueMagnitudeArrayPresent->SetValue(false);
+    view.SetCheck(firstCrankMeasurementAnglePresent, v.flags.first_crank_measurement_angle_present);
+    if (v.flags.first_crank_measurement_angle_present) {
+        view.SetInteger(firstCrankMeasurementAngle, v.first_crank_measurement_angle, "°");
     }
 
+    view.SetCheck(instantaneousForceMagnitudeArrayPresent, v.flags.instantaneous_force_magnitude_array_present);
+    if (v.flags.instantaneous_force_magnitude_array_present && forceArray->SetValues(v.array, v.array_length)) {
+        view.Refresh(forceArray);
+    }
 
+    view.SetCheck(instantaneousTorqueMagnitudeArrayPresent, v.flags.instantaneous_torque_magnitude_array_present);
+    if (v.flags.instantaneous_torque_magnitude_array_present && torqueArray->SetValues(v.array, v.array_length)) {
+        view.Refresh(torqueArray);
+    }
 }
 
-
 //##################################################################################################
 // InfoCrank control point page
 //##################################################################################################
 void IC2Frame::SetInfoCrankControlPoint(void *str, int length)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
+    using namespace ControlPoint;
+    using namespace ControlPoint::InfoCrank;
+
     #pragma pack(push, 1)
     struct control_point_data {
         uint8_t op_code;
@@ -2335,32 +2352,7 @@ void IC2Frame::SetInfoCrankControlPoint(void *str, int length)
     } *cp_data = (struct control_point_data *) str;
     #pragma pack(pop)
 
-    enum op_codes {
-        SET_SERIAL_NUMBER = 1,
-        SET_FACTORY_CALIBRATION_DATE,
-        SET_CALIBRATION_PARAMETERS,
-        REQUEST_CALIBRATION_PARAMETERS,
-        SET_ACCEL1_TRANSFORM,
-        REQUEST_ACCEL1_TRANSFORM,
-        SET_ACCEL2_TRANSFORM,
-        REQUEST_ACCEL2_TRANSFORM,
-        SET_KF_PARAMETERS,
-        REQUEST_KF_PARAMETERS,
-        SET_PARTNER_ADDRESS,
-        REQUEST_PARTNER_ADDRESS,
-        DELETE_PARTNER_ADDRESS,
-        SET_CYCLING_POWER_VECTOR_PARAMETERS,
-        REQUEST_CYCLING_POWER_VECTOR_PARAMETERS,
-        RESPONSE_CODE = 0x20,
-    };
-
-    enum response_codes {
-        SUCCESS = 1,
-        NOT_SUPPORTED,
-        INVALID_OPERAND,
-        OPERATION_FAILED,
-    };
-    if (cp_data->op_code != RESPONSE_CODE) {
+    if (length < (int) RESPONSE_HEADER_SIZE || cp_data->op_code != RESPONSE_CODE) {
         SetStatusText("Failed - Unknown response", 1);
         return;
     }
@@ -2381,63 +2373,53 @@ void IC2Frame::SetInfoCrankControlPoint(void *str, int length)
             SetStatusText("Failed - Unknown response", 1);
             return;
     }
-    switch (cp_data->request_code) {
-        case REQUEST_CALIBRATION_PARAMETERS:
-            k1->SetValue(wxString().Format("%f", *((float *) &cp_data->data[0])));
-            k2->SetValue(wxString().Format("%f", *((float *) &cp_data->data[4])));
-            k3->SetValue(wxString().Format("%f", *((float *) &cp_data->data[8])));
-            k4->SetValue(wxString().Format("%f", *((float *) &cp_data->data[12])));
-            k5->SetValue(wxString().Format("%f", *((float *) &cp_data->data[16])));
-            k6->SetValue(wxString().Format("%f", *((float *) &cp_data->data[20])));
-            break;
-        case REQUEST_ACCEL1_TRANSFORM:
-            a1[0]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[0])));
-            a1[1]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[2])));
-            a1[2]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[4])));
-            a1[3]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[6])));
-            a1[4]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[8])));
-            a1[5]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[10])));
-            a1[6]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[12])));
-            a1[7]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[14])));
-            a1[8]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[16])));
-            a1[9]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[18])));
-            a1[10]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[20])));
-            a1[11]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[22])));
-            break;
-        case REQUEST_ACCEL2_TRANSFORM:
-            a2[0]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[0])));
-            a2[1]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[2])));
-            a2[2]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[4])));
-            a2[3]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[6])));
-            a2[4]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[8])));
-            a2[5]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[10])));
-            a2[6]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[12])));
-            a2[7]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[14])));
-            a2[8]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[16])));
-            a2[9]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[18])));
-            a2[10]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[20])));
-            a2[11]->SetValue(wxString().Format("%hd", *((int16_t *) &cp_data->data[22])));
-            break;
-        case REQUEST_KF_PARAMETERS:
-            s2alpha->SetValue(wxString().Format("%0.4f", *((float *) &cp_data->data[0])));
-            s2accel->SetValue(wxString().Format("%0.4f", *((float *) &cp_data->data[4])));
-            driveRatio->SetValue(wxString().Format("%0.2f", *((float *) &cp_data->data[8])));
-            r1->SetValue(wxString().Format("%0.4f", *((float *) &cp_data->data[12])));
-            r2->SetValue(wxString().Format("%0.4f", *((float *) &cp_data->data[16])));
-            break;
-        case REQUEST_PARTNER_ADDRESS:
-            ble_addr[0]->SetValue(wxString().Format("%02hhX", cp_data->data[0]));
-            ble_addr[1]->SetValue(wxString().Format("%02hhX", cp_data->data[1]));
-            ble_addr[2]->SetValue(wxString().Format("%02hhX", cp_data->data[2]));
-            ble_addr[3]->SetValue(wxString().Format("%02hhX", cp_data->data[3]));
-            ble_addr[4]->SetValue(wxString().Format("%02hhX", cp_data->data[4]));
-            ble_addr[5]->SetValue(wxString().Format("%02hhX", cp_data->data[5]));
-            break;
-        case REQUEST_CYCLING_POWER_VECTOR_PARAMETERS:
-            cpvSize->SetValue(wxString().Format("%hhu", cp_data->data[0]));
-            cpvDownsample->SetValue(wxString().Format("%hhu", cp_data->data[1]));
-            break;
-    }
+    size_t payload = length - RESPONSE_HEADER_SIZE;
+    Commands::Decode(cp_data->request_code, cp_data->data, payload, Handlers {
+        [&](RequestCalibrationParameters, const RequestCalibrationParameters::Response::Values &values) {
+            wxTextCtrl *k[] = {k1, k2, k3, k4, k5, k6};
+            for (size_t i = 0; i < WXSIZEOF(k); i++) {
+                k[i]->SetValue(wxString().Format("%f", std::get<0>(values)[i]));
+                sessionIdentity.calibration.strain[i] = std::get<0>(values)[i];
+            }
+            sessionIdentity.calibration.valid |= SessionLog::Calibration::STRAIN;
+        },
+        [&](RequestAccel1Transform, const RequestAccel1Transform::Response::Values &values) {
+            for (int i = 0; i < 12; i++) {
+                a1[i]->SetValue(wxString().Format("%hd", std::get<0>(values)[i]));
+                sessionIdentity.calibration.accel1[i] = std::get<0>(values)[i];
+            }
+            sessionIdentity.calibration.valid |= SessionLog::Calibration::ACCEL1;
+        },
+        [&](RequestAccel2Transform, const RequestAccel2Transform::Response::Values &values) {
+            for (int i = 0; i < 12; i++) {
+                a2[i]->SetValue(wxString().Format("%hd", std::get<0>(values)[i]));
+                sessionIdentity.calibration.accel2[i] = std::get<0>(values)[i];
+            }
+            sessionIdentity.calibration.valid |= SessionLog::Calibration::ACCEL2;
+        },
+        [&](RequestKFParameters, const RequestKFParameters::Response::Values &values) {
+            s2alpha->SetValue(wxString().Format("%0.4f", std::get<0>(values)));
+            s2accel->SetValue(wxString().Format("%0.4f", std::get<1>(values)));
+            driveRatio->SetValue(wxString().Format("%0.2f", std::get<2>(values)));
+            r1->SetValue(wxString().Format("%0.4f", std::get<3>(values)));
+            r2->SetValue(wxString().Format("%0.4f", std::get<4>(values)));
+            float kf[] = {std::get<0>(values), std::get<1>(values), std::get<2>(values), std::get<3>(values), std::get<4>(values)};
+            memcpy(sessionIdentity.calibration.kf, kf, sizeof(kf));
+            sessionIdentity.calibration.valid |= SessionLog::Calibration::KF;
+        },
+        [&](RequestPartnerAddress, const RequestPartnerAddress::Response::Values &values) {
+            for (int i = 0; i < 6; i++) {
+                ble_addr[i]->SetValue(wxString().Format("%02hhX", std::get<0>(values)[i]));
+            }
+        },
+        [&](RequestCyclingPowerVectorParameters, const RequestCyclingPowerVectorParameters::Response::Values &values) {
+            cpvSize->SetValue(wxString().Format("%hhu", std::get<0>(values)));
+            cpvDownsample->SetValue(wxString().Format("%hhu", std::get<1>(values)));
+        },
+        [](auto, const auto &) {},          // Nothing to show
+    });
+    // The host filter follows whatever the device reported
+    hostEstimator.Configure(sessionIdentity.calibration);
 }
 
 
@@ -2484,200 +2466,120 @@ void IC2Frame::SetInfoCrankControlPoint(void *str, int length)
 //##################################################################################################
 // InfoCrank raw data page
 //##################################################################################################
+// Called with rawLogLock held
+void IC2Frame::WriteRawChunk()
+{
+    if (rawEncoder.Notifications() == 0) {
+        return;
+    }
+    rawChunk.resize(RawEncoder::MAXIMUM_CHUNK);
+    int64_t first = rawEncoder.FirstHost();
+    size_t size = rawEncoder.Finish(rawChunk.data());
+    if (logRaw.IsOpened()) {
+        logRaw.Write(SessionLog::RAW_PACKED, first, first, 0, rawChunk.data(), size);
+    }
+}
+
 void IC2Frame::SetInfoCrankRawData(void *str, int length)
 {
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
+    hostEstimator.Submit((const uint8_t *) str, length);
+
     if (logRaw.IsOpened()) {
-        logRaw.Write(str, length);
+        // Notifications are gathered into chunks of at most a second
+        std::lock_guard<std::mutex> lock(rawLogLock);
+        int64_t now = SessionLog::MonotonicNanoseconds();
+        rawEncoder.Add(now, (const uint8_t *) str, length);
+        if (rawEncoder.Full() || now - rawEncoder.FirstHost() >= 1000000000LL) {
+            WriteRawChunk();
+        }
     }
-    #pragma pack(push, 1)
-    struct raw_data {
-        uint8_t op_code;
-        union {
-            struct {
-                int32_t unused: 6;
-                int32_t strain: 18;
-            } strain;
-            struct {
-                int16_t accel1_x;
-                int16_t accel1_y;
-                int16_t accel1_z;
-                int16_t accel2_x;
-                int16_t accel2_y;
-                int16_t accel2_z;
-            } acceleration;
-            struct {
-                int16_t integral;
-                int32_t fractional;
-            } temperature;
-            uint16_t voltage;
-            struct {
-                int32_t position;
-                int32_t velocity;
-                int32_t acceleration;
-            } state;
-            float vector4[4];
-            float matrix33[3][3];
-        } data;
-    } *raw_data = (struct raw_data *) str;
-    uint8_t *byte_pointer_to_raw_data = (uint8_t *) raw_data;
-    #pragma pack(pop)
 
-    enum op_codes {
-        STRAIN_DATA = 0,
-        ACCELERATION_DATA,
-        TEMPERATURE_DATA,
-        BATTERY_DATA,
-        STATE_DATA,
-        VECTOR4,
-        MATRIX33,
-    };
-    while (length) {
-        switch (raw_data->op_code) {
+    // Monotonic, so clock steps do not upset the time windows
+    int64_t host_ns = SessionLog::MonotonicNanoseconds();
+    double now = host_ns * 1.0e-9;
+    std::lock_guard<std::mutex> lock(statisticsLock);
+
+    RawSnapshot snapshot;
+    int consumed = rawAnalysis.Process((uint8_t *) str, length, now, snapshot, [&](const struct raw_data &raw) {
+        switch (raw.op_code) {
             case STRAIN_DATA:
-                strain_num ++;
-                strain_sum += raw_data->data.strain.strain;
-                strain_sum2 += (long)(raw_data->data.strain.strain) * (long)(raw_data->data.strain.strain);
-                {
-                    double mean = (double) strain_sum / (double) strain_num;
-                    double sd = pow((double) strain_sum2 / (double) strain_num - mean*mean, 0.5);
-                    strain->SetValue(wxString().Format("%d", raw_data->data.strain.strain));
-                    strain_avg->SetValue(wxString().Format("%0.3lf", mean));
-                    strain_sd->SetValue(wxString().Format("%0.3lf", sd));
-                }
-                length -= 4;
-                byte_pointer_to_raw_data += 4;
-                raw_data = (struct raw_data *) byte_pointer_to_raw_data;
+                strainHistory.Append(now, raw.data.strain.strain);
+                live.Publish(Live::STRAIN, host_ns, raw.data.strain.strain);
                 break;
             case ACCELERATION_DATA:
-                accel1_num ++;
-                accel1X_sum += raw_data->data.acceleration.accel1_x;
-                accel1X_sum2 += (raw_data->data.acceleration.accel1_x) * (raw_data->data.acceleration.accel1_x);
-                accel1Y_sum += raw_data->data.acceleration.accel1_y;
-                accel1Y_sum2 += (raw_data->data.acceleration.accel1_y) * (raw_data->data.acceleration.accel1_y);
-                accel1Z_sum += raw_data->data.acceleration.accel1_z;
-                accel1Z_sum2 += (raw_data->data.acceleration.accel1_z) * (raw_data->data.acceleration.accel1_z);
-
-                accel2_num ++;
-                accel2X_sum += raw_data->data.acceleration.accel2_x;
-                accel2X_sum2 += (raw_data->data.acceleration.accel2_x) * (raw_data->data.acceleration.accel2_x);
-                accel2Y_sum += raw_data->data.acceleration.accel2_y;
-                accel2Y_sum2 += (raw_data->data.acceleration.accel2_y) * (raw_data->data.acceleration.accel2_y);
-                accel2Z_sum += raw_data->data.acceleration.accel2_z;
-                accel2Z_sum2 += (raw_data->data.acceleration.accel2_z) * (raw_data->data.acceleration.accel2_z);
-
-                {
-                    double mean = accel1X_sum / accel1_num;
-                    double sd = pow(accel1X_sum2 / accel1_num - (accel1X_sum / accel1_num) * (accel1X_sum / accel1_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel1[0]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel1_x) * 8.0 / 32768.0));
-                    accel1_avg[0]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel1_sd[0]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-
-                {
-                    double mean = accel1Y_sum / accel1_num;
-                    double sd = pow(accel1Y_sum2 / accel1_num - (accel1Y_sum / accel1_num) * (accel1Y_sum / accel1_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel1[1]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel1_y) * 8.0 / 32768.0));
-                    accel1_avg[1]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel1_sd[1]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-
-                {
-                    double mean = accel1Z_sum / accel1_num;
-                    double sd = pow(accel1Z_sum2 / accel1_num - (accel1Z_sum / accel1_num) * (accel1Z_sum / accel1_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel1[2]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel1_z) * 8.0 / 32768.0));
-                    accel1_avg[2]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel1_sd[2]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-
-                {
-                    double mean = accel2X_sum / accel2_num;
-                    double sd = pow(accel2X_sum2 / accel2_num - (accel2X_sum / accel2_num) * (accel2X_sum / accel2_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel2[0]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel2_x) * 8.0 / 32768.0));
-                    accel2_avg[0]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel2_sd[0]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-
-                {
-                    double mean = accel2Y_sum / accel2_num;
-                    double sd = pow(accel2Y_sum2 / accel2_num - (accel2Y_sum / accel2_num) * (accel2Y_sum / accel2_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel2[1]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel2_y) * 8.0 / 32768.0));
-                    accel2_avg[1]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel2_sd[1]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-
-                {
-                    double mean = accel2Z_sum / accel2_num;
-                    double sd = pow(accel2Z_sum2 / accel2_num - (accel2Z_sum / accel2_num) * (accel2Z_sum / accel2_num), 0.5);
-                    // Convert to g. ±8g full scale, 14 bit resolution
-                    accel2[2]->SetValue(wxString().Format("%0.3f", (raw_data->data.acceleration.accel2_z) * 8.0 / 32768.0));
-                    accel2_avg[2]->SetValue(wxString().Format("%0.3f", mean * 8.0 / 32768.0));
-                    accel2_sd[2]->SetValue(wxString().Format("%0.3f", sd * 8.0 / 32768.0));
-                }
-                length -= 13;
-                byte_pointer_to_raw_data += 13;
-                raw_data = (struct raw_data *) byte_pointer_to_raw_data;
+                live.Publish(Live::ACCEL1_X, host_ns, raw.data.acceleration.accel1_x * ACCEL_G_PER_COUNT);
+                live.Publish(Live::ACCEL1_Y, host_ns, raw.data.acceleration.accel1_y * ACCEL_G_PER_COUNT);
+                live.Publish(Live::ACCEL1_Z, host_ns, raw.data.acceleration.accel1_z * ACCEL_G_PER_COUNT);
+                live.Publish(Live::ACCEL2_X, host_ns, raw.data.acceleration.accel2_x * ACCEL_G_PER_COUNT);
+                live.Publish(Live::ACCEL2_Y, host_ns, raw.data.acceleration.accel2_y * ACCEL_G_PER_COUNT);
+                live.Publish(Live::ACCEL2_Z, host_ns, raw.data.acceleration.accel2_z * ACCEL_G_PER_COUNT);
+                break;
+            case TEMPERATURE_DATA:
+                live.Publish(Live::TEMPERATURE, host_ns, RawTemperature(raw));
+                break;
+            case BATTERY_DATA:
+                live.Publish(Live::BATTERY, host_ns, RawBatteryVoltage(raw));
+                break;
+            case STATE_DATA:
+                live.Publish(Live::THETA, host_ns, RawStatePosition(raw));
+                live.Publish(Live::OMEGA, host_ns, RawStateVelocity(raw));
+                live.Publish(Live::ALPHA, host_ns, RawStateAcceleration(raw));
+                // Only the latest state is shown, the crank graphic follows every one
+                crank_graphics->angle = RawStatePosition(raw);
+                crank_graphics->newAngle = true;
                 break;
-                case TEMPERATURE_DATA:
-                    temp = raw_data->data.temperature.integral + 1.0e-6 * (raw_data->data.temperature.fractional);
-                    {
-                        temperature->SetValue(wxString().Format("%0.2lf", temp));
-                    }
-                    length -= 7;
-                    byte_pointer_to_raw_data += 7;
-                    raw_data = (struct raw_data *) byte_pointer_to_raw_data;
-                    break;
-                case BATTERY_DATA:
-                    volts = 0.6f*6.0f*raw_data->data.voltage*0x01p-12;
-                    {
-                        batteryVoltage->SetValue(wxString().Format("%0.2lf", volts));
-                    }
-                    length -= 3;
-                    byte_pointer_to_raw_data += 3;
-                    raw_data = (struct raw_data *) byte_pointer_to_raw_data;
-                    break;
-                case STATE_DATA:
-                    x->SetValue(wxString().Format(L"%+10.1f°", raw_data->data.state.position * 360.0 * 0x01p-13));
-                    x_dot->SetValue(wxString().Format(L"%+10.1f°/sec", raw_data->data.state.velocity * 360.0 * 128.0 * 0x01p-35));
-                    x_ddot->SetValue(wxString().Format(L"%+10.1f°/sec²", raw_data->data.state.acceleration * 360.0 * 16384.0 * 0x01p-40));
-                    crank_graphics->angle = raw_data->data.state.position * 360.0 / 8192.0;
-                    crank_graphics->newAngle = true;
-                    length -= 13;
-                    byte_pointer_to_raw_data += 13;
-                    raw_data = (struct raw_data *) byte_pointer_to_raw_data;
-                    break;
-                case VECTOR4:
-                    printf("Vector: %0.4g, %0.4g, %0.4g, %0.4g\n",
-                           raw_data->data.vector4[0],
-                           raw_data->data.vector4[1],
-                           raw_data->data.vector4[2],
-                           raw_data->data.vector4[3]);
-                    length -= 17;
-                    byte_pointer_to_raw_data += 17;
-                    raw_data = (struct raw_data *) byte_pointer_to_raw_data;
-                    break;
-                case MATRIX33:
-                    printf("Matrix: %0.4g, %0.4g, %0.4g\n"
-                    "        %0.4g, %0.4g, %0.4g\n"
-                    "        %0.4g, %0.4g, %0.4g\n",
-                    raw_data->data.matrix33[0][0], raw_data->data.matrix33[0][1], raw_data->data.matrix33[0][2],
-                    raw_data->data.matrix33[1][0], raw_data->data.matrix33[1][1], raw_data->data.matrix33[1][2],
-                    raw_data->data.matrix33[1][0], raw_data->data.matrix33[2][1], raw_data->data.matrix33[2][2]);
-                    length -= 37;
-                    byte_pointer_to_raw_data += 37;
-                    raw_data = (struct raw_data *) byte_pointer_to_raw_data;
-                    break;
-                default :
-                    printf("WARNING: Undefined Op Code %d\n", raw_data->op_code);
-                    length = 0;
-                    break;
+            case VECTOR4:
+                printf("Vector: %0.4g, %0.4g, %0.4g, %0.4g\n",
+                       raw.data.vector4[0],
+                       raw.data.vector4[1],
+                       raw.data.vector4[2],
+                       raw.data.vector4[3]);
+                break;
+            case MATRIX33:
+                printf("Matrix: %0.4g, %0.4g, %0.4g\n"
+                "        %0.4g, %0.4g, %0.4g\n"
+                "        %0.4g, %0.4g, %0.4g\n",
+                raw.data.matrix33[0][0], raw.data.matrix33[0][1], raw.data.matrix33[0][2],
+                raw.data.matrix33[1][0], raw.data.matrix33[1][1], raw.data.matrix33[1][2],
+                raw.data.matrix33[2][0], raw.data.matrix33[2][1], raw.data.matrix33[2][2]);
+                break;
+        }
+    });
+    if (consumed < length) {
+        printf("WARNING: Undefined Op Code %d\n", ((uint8_t *) str)[consumed]);
+    }
+
+    if (snapshot.hasTemperature) {
+        temp = snapshot.temperature;
+        view.SetFixed(temperature, temp, 2);
+    }
+    if (snapshot.hasBattery) {
+        volts = snapshot.volts;
+        view.SetFixed(batteryVoltage, volts, 2);
+    }
+    if (snapshot.strainSamples) {
+        Moments<1> statistics = rawAnalysis.strainStatistics.Summary();
+        view.SetInteger(strain, snapshot.lastStrain);
+        view.SetFixed(strain_avg, statistics.mean[0], 3);
+        view.SetFixed(strain_sd, statistics.StandardDeviation(0), 3);
+    }
+    if (snapshot.accelSamples) {
+        Moments<3> statistics1 = rawAnalysis.accel1Statistics.Summary();
+        Moments<3> statistics2 = rawAnalysis.accel2Statistics.Summary();
+        for (int i = 0; i < 3; i ++) {
+            view.SetFixed(accel1[i], snapshot.lastAccel1[i] * ACCEL_G_PER_COUNT, 3);
+            view.SetFixed(accel1_avg[i], statistics1.mean[i] * ACCEL_G_PER_COUNT, 3);
+            view.SetFixed(accel1_sd[i], statistics1.StandardDeviation(i) * ACCEL_G_PER_COUNT, 3);
+            view.SetFixed(accel2[i], snapshot.lastAccel2[i] * ACCEL_G_PER_COUNT, 3);
+            view.SetFixed(accel2_avg[i], statistics2.mean[i] * ACCEL_G_PER_COUNT, 3);
+            view.SetFixed(accel2_sd[i], statistics2.StandardDeviation(i) * ACCEL_G_PER_COUNT, 3);
         }
     }
+    if (snapshot.hasState) {
+        view.SetFixed(x, RawStatePosition(snapshot.state), 1, "°", true);
+        view.SetFixed(x_dot, RawStateVelocity(snapshot.state), 1, "°/sec", true);
+        view.SetFixed(x_ddot, RawStateAcceleration(snapshot.state), 1, "°/sec²", true);
+    }
 
     //    crank_graphics->Refresh();
     //    crank_graphics->Update();
@@ -12,6 +12,20 @@
 
 #include "crank-canvas.h"
 #include "gui-helper.h"
+#include "statistics.h"
+#include "history.h"
+#include "decode.h"
+#include "raw-analysis.h"
+#include "view-model.h"
+#include "array-view.h"
+#include "subscriptions.h"
+#include "session-writer.h"
+#include "raw-codec.h"
+#include "fit-encoder.h"
+#include "live-publisher.h"
+#include "host-estimator.h"
+#include "playback.h"
+#include "playback-bar.h"
 
 //--------------------------------------------------------------------------------------------------
 // Forward declarations
@@ -120,6 +134,8 @@ public:
     wxToggleButton *broadcastMeasurement;
     wxCheckBox *loggingMeasurement;
     wxButton *logFileMeasurement;
+    wxCheckBox *loggingFit;
+    wxButton *logFileFit;
 
 
     wxPanel* devices;
@@ -146,6 +162,17 @@ public:
 
     int sockfd;
 
+    // Decoded values wait here until the next display refresh
+    ViewModel view;
+    MeasurementDecoder measurementDecoder;
+
+    // Which notifications are subscribed
+    StreamSubscriptions subscriptions;
+
+    // Written into the header of every session log
+    SessionLog::Identity sessionIdentity;
+    SessionLog::DeviceClock crankClock{1024.0, 16};
+
     struct sensorLocations_s {
         int index;
         wxString location;
@@ -158,10 +185,12 @@ public:
     public:
         wxString m_fileName;
         wxCheckBox *m_checkBox;
-        FileDialogParameters(wxString fileName, wxCheckBox *checkBox)
+        wxString m_wildcard;
+        FileDialogParameters(wxString fileName, wxCheckBox *checkBox, wxString wildcard = "Log files (*.log)|*.log")
         {
             m_fileName = fileName;
             m_checkBox = checkBox;
+            m_wildcard = wildcard;
         }
     };
 
@@ -216,7 +245,7 @@ public:
 
     // Battery information page
     wxStaticText *batteryLevel;
-    wxFile logBattery;
+    SessionLog::Writer logBattery;
 
     // Features page
     wxCheckBox *balanceFeature;
@@ -274,7 +303,9 @@ public:
     wxStaticText *topDeadSpotAngle;
     wxStaticText *bottomDeadSpotAngle;
     wxStaticText *accumulatedEnergy;
-    wxFile logMeasurement;
+    SessionLog::Writer logMeasurement;
+    FitEncoder fit;                         // Measurements and vectors for training software
+    std::mutex fitLock;                     // fit between the data path and the checkbox
 
     // Sensor location page
     wxStaticText *sensorLocation;
@@ -309,9 +340,9 @@ public:
     wxStaticText *cumulativeCrankVectorRevolutions;
     wxStaticText *lastCrankEventVectorTime;
     wxStaticText *firstCrankMeasurementAngle;
-    wxWrapSizer *forceArraySizer;
-    wxWrapSizer *torqueArraySizer;
-    wxFile logVector;
+    ArrayView *forceArray;
+    ArrayView *torqueArray;
+    SessionLog::Writer logVector;
 
     // InfoCrank control point page
     wxTextCtrl *setSerialNumber;
@@ -351,32 +382,35 @@ public:
     wxTextCtrl *x;
     wxTextCtrl *x_dot;
     wxTextCtrl *x_ddot;
-
-    wxFile logRaw;
-
-    int strain_num;
-    long strain_sum;
-    long strain_sum2;
+    wxCheckBox *hostEstimate;
+    wxTextCtrl *host_x;
+    wxTextCtrl *host_x_dot;
+    wxTextCtrl *host_x_ddot;
+    wxTextCtrl *angleError[3];              // Host less firmware position: mean, SD and maximum
+    wxStaticText *hostDropped;
+
+    SessionLog::Writer logRaw;
+    RawEncoder rawEncoder;                  // Raw data notifications are logged compressed
+    std::vector<uint8_t> rawChunk;
+    std::mutex rawLogLock;                  // Encoder between the data path, the logger checkbox and the timer
+    wxTimer rawChunkTimer;                  // Writes out a chunk the data path has left waiting
+    void WriteRawChunk();
+
+    wxChoice *statisticsWindow;
+    RawAnalysis rawAnalysis;
+    std::mutex statisticsLock;              // rawAnalysis and the histories between the data path and the GUI
+
+    // For charts: a minute of raw strain, and four hours of measurements at one a second, then
+    // aggregates
+    History strainHistory{60 * 1024};
+    History powerHistory{4 * 3600};
+    History cadenceHistory{4 * 3600};
+
+    Live::Publisher live;                   // Decoded samples for other programs, see live-shm.h
 
     double temp;
     double volts;
 
-    double accel1_num;
-    double accel1X_sum;
-    double accel1X_sum2;
-    double accel1Y_sum;
-    double accel1Y_sum2;
-    double accel1Z_sum;
-    double accel1Z_sum2;
-
-    double accel2_num;
-    double accel2X_sum;
-    double accel2X_sum2;
-    double accel2Y_sum;
-    double accel2Y_sum2;
-    double accel2Z_sum;
-    double accel2Z_sum2;
-
     // The accelerometer output in each of the 6 orientations
     double gravity1matrix[18] = {
         1.0,0.0,0.0,
@@ -399,6 +433,14 @@ public:
 
     //    CrankTimer *crank_timer;
 
+    // Host side EKF next to the firmware state, fed by the data path and the playback
+    HostEstimator hostEstimator;
+
+    // Recorded sessions played back through the same Set... functions as live data. Declared
+    // last, so its thread stops before anything it feeds is destroyed.
+    Playback playback;
+    PlaybackBar *playbackBar;
+
 
     IC2Frame();
     void ConnectSocket();
@@ -514,6 +556,8 @@ enum {
     LAYOUT_TEST_SET_MINIMAL,
     LAYOUT_TEST_NESTED,
     LAYOUT_TEST_WRAP,
+    AUTO_SUBSCRIBE,
+    DISPLAY_RATE,           // First of the View menu display rates
 };
 
 #endif // _MAIN_H
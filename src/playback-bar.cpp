@@ -0,0 +1,154 @@
+#include "playback-bar.h"
+
+static const double speeds[] = {0.1, 0.25, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0, 50.0};
+static const int NORMAL_SPEED = 3;
+
+//--------------------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------------------
+PlaybackBar::PlaybackBar(wxWindow *parent, Playback &playback) :
+    wxPanel(parent, wxID_ANY), playback(playback), timer(this)
+{
+    open = new wxButton(this, wxID_ANY, "Play log...");
+    play = new wxToggleButton(this, wxID_ANY, "Play");
+    speed = new wxChoice(this, wxID_ANY);
+    for (double s : speeds) {
+        speed->Append(wxString().Format("%g×", s));
+    }
+    speed->SetSelection(NORMAL_SPEED);
+    timeline = new wxSlider(this, wxID_ANY, 0, 0, STEPS);
+    time = new wxStaticText(this, wxID_ANY, "-:--.- / -:--.-");
+
+    wxBoxSizer *sizer = new wxBoxSizer(wxHORIZONTAL);
+    wxSizerFlags flags = wxSizerFlags().Centre().Border(wxLEFT | wxRIGHT, 3);
+    sizer->Add(open, flags);
+    sizer->Add(play, flags);
+    sizer->Add(speed, flags);
+    sizer->Add(timeline, wxSizerFlags(flags).Proportion(1));
+    sizer->Add(time, flags);
+    SetSizer(sizer);
+    EnableControls(false);
+
+    open->Bind(wxEVT_BUTTON, &PlaybackBar::OnOpen, this);
+    play->Bind(wxEVT_TOGGLEBUTTON, &PlaybackBar::OnPlay, this);
+    speed->Bind(wxEVT_CHOICE, &PlaybackBar::OnSpeed, this);
+    timeline->Bind(wxEVT_SCROLL_THUMBTRACK, &PlaybackBar::OnTrack, this);
+    timeline->Bind(wxEVT_SCROLL_THUMBRELEASE, &PlaybackBar::OnRelease, this);
+    timeline->Bind(wxEVT_SLIDER, &PlaybackBar::OnSlider, this);
+    Bind(wxEVT_TIMER, &PlaybackBar::OnTimer, this, timer.GetId());
+}
+
+void PlaybackBar::EnableControls(bool opened)
+{
+    play->Enable(opened);
+    speed->Enable(opened);
+    timeline->Enable(opened);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Controls
+//--------------------------------------------------------------------------------------------------
+void PlaybackBar::OnOpen(wxCommandEvent &evt)
+{
+    wxFileDialog dialog(this, "Play session logs", "~/Documents", "", "Log files (*.log)|*.log|All files|*", wxFD_OPEN | wxFD_FILE_MUST_EXIST | wxFD_MULTIPLE);
+    if (dialog.ShowModal() == wxID_CANCEL) {
+        return;
+    }
+    wxArrayString paths;
+    dialog.GetPaths(paths);
+    std::vector<std::string> logs;
+    for (const wxString &path : paths) {
+        logs.push_back(std::string(path.utf8_str()));
+    }
+
+    bool opened = playback.Open(logs);
+    EnableControls(opened);
+    play->SetValue(false);
+    play->SetLabel("Play");
+    playback.SetSpeed(speeds[speed->GetSelection()]);
+    timeline->SetValue(0);
+    if (opened) {
+        ShowTime(playback.FirstTime());
+        timer.Start(100);
+    } else {
+        timer.Stop();
+        wxMessageBox("None of the files is a session log", "Play log", wxOK | wxICON_ERROR, this);
+    }
+}
+
+void PlaybackBar::OnPlay(wxCommandEvent &evt)
+{
+    if (play->GetValue()) {
+        playback.Play();
+        play->SetLabel("Pause");
+    } else {
+        playback.Pause();
+        play->SetLabel("Play");
+    }
+}
+
+void PlaybackBar::OnSpeed(wxCommandEvent &evt)
+{
+    playback.SetSpeed(speeds[speed->GetSelection()]);
+}
+
+// Only the label follows the thumb while it is dragged; the seek is done once on release
+void PlaybackBar::OnTrack(wxScrollEvent &evt)
+{
+    dragging = true;
+    ShowTime(SliderTime());
+}
+
+void PlaybackBar::OnRelease(wxScrollEvent &evt)
+{
+    dragging = false;
+    playback.Seek(SliderTime());
+}
+
+// Clicks and keys
+void PlaybackBar::OnSlider(wxCommandEvent &evt)
+{
+    if (!dragging) {
+        playback.Seek(SliderTime());
+        ShowTime(SliderTime());
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Timeline
+//--------------------------------------------------------------------------------------------------
+int64_t PlaybackBar::SliderTime() const
+{
+    int64_t span = playback.LastTime() - playback.FirstTime();
+    return playback.FirstTime() + (int64_t) ((double) span * timeline->GetValue() / STEPS);
+}
+
+void PlaybackBar::ShowTime(int64_t host_ns)
+{
+    auto format = [](int64_t ns) {
+        int tenths = ns / 100000000LL;
+        return wxString().Format("%d:%02d.%d", tenths / 600, tenths / 10 % 60, tenths % 10);
+    };
+    int64_t first = playback.FirstTime();
+    time->SetLabel(format(host_ns - first) + " / " + format(playback.LastTime() - first));
+}
+
+void PlaybackBar::OnTimer(wxTimerEvent &evt)
+{
+    if (!playback.IsOpened() || dragging) {
+        return;
+    }
+    int64_t position = playback.Position();
+    int64_t span = playback.LastTime() - playback.FirstTime();
+    int step = span > 0 ? (int) ((double) (position - playback.FirstTime()) * STEPS / span) : 0;
+    if (timeline->GetValue() != step) {
+        timeline->SetValue(step);
+    }
+    ShowTime(position);
+
+    // The playback pauses itself at the end
+    if (play->GetValue() && !playback.IsPlaying()) {
+        play->SetValue(false);
+        play->SetLabel("Play");
+    }
+}
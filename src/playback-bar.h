@@ -0,0 +1,47 @@
+#ifndef _PLAYBACK_BAR_H
+#define _PLAYBACK_BAR_H
+
+#include <wx/wx.h>
+#include <wx/tglbtn.h>
+#include <wx/timer.h>
+
+#include "playback.h"
+
+//--------------------------------------------------------------------------------------------------
+// Playback controls
+//
+// A strip under the notebook: open logs, play and pause, the speed, and a timeline that can be
+// dragged to any point of the logs. The timeline follows the playback a few times a second from a
+// timer, not from the playback thread.
+//--------------------------------------------------------------------------------------------------
+class PlaybackBar : public wxPanel
+{
+public:
+    PlaybackBar(wxWindow *parent, Playback &playback);
+
+private:
+    void OnOpen(wxCommandEvent &evt);
+    void OnPlay(wxCommandEvent &evt);
+    void OnSpeed(wxCommandEvent &evt);
+    void OnTrack(wxScrollEvent &evt);
+    void OnRelease(wxScrollEvent &evt);
+    void OnSlider(wxCommandEvent &evt);
+    void OnTimer(wxTimerEvent &evt);
+
+    void EnableControls(bool opened);
+    int64_t SliderTime() const;
+    void ShowTime(int64_t host_ns);
+
+    static const int STEPS = 1000;          // Of the timeline
+
+    Playback &playback;
+    wxButton *open;
+    wxToggleButton *play;
+    wxChoice *speed;
+    wxSlider *timeline;
+    wxStaticText *time;
+    wxTimer timer;
+    bool dragging = false;
+};
+
+#endif /* _PLAYBACK_BAR_H */
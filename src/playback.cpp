@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "playback.h"
+
+// Wall time of a slice. The log time covered grows with the speed.
+static const int64_t SLICE_NS = 50000000LL;
+
+//--------------------------------------------------------------------------------------------------
+// Constructor and destructor
+//--------------------------------------------------------------------------------------------------
+Playback::Playback(Sink sink) :
+    sink(std::move(sink))
+{
+}
+
+Playback::~Playback()
+{
+    Close();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open and close, GUI thread
+//--------------------------------------------------------------------------------------------------
+bool Playback::Open(const std::vector<std::string> &paths)
+{
+    Close();
+
+    first = INT64_MAX;
+    last = INT64_MIN;
+    for (const std::string &path : paths) {
+        std::unique_ptr<SessionLog::Store> store(new SessionLog::Store);
+        if (!store->Open(path.c_str()) || store->Index().Entries() == 0) {
+            printf("%s: not a session log\n", path.c_str());
+            continue;
+        }
+        first = std::min(first, store->Index().FirstTime());
+        last = std::max(last, store->Index().LastTime());
+        stores.push_back(std::move(store));
+    }
+    if (stores.empty()) {
+        first = last = 0;
+        return false;
+    }
+
+    quit = false;
+    playing = false;
+    speed = 1.0;
+    cursor = clock = first;
+    position = first;
+    generation++;
+    thread = std::thread(&Playback::Run, this);
+    return true;
+}
+
+void Playback::Close()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    stores.clear();
+    playing = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Transport controls, GUI thread
+//--------------------------------------------------------------------------------------------------
+int64_t Playback::Now() const
+{
+    if (!playing) {
+        return clock;
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - anchor).count();
+    return clock + (int64_t) (elapsed * speed);
+}
+
+// The thread drops what it was waiting for and picks up the new clock
+void Playback::Restart()
+{
+    anchor = Clock::now();
+    generation++;
+    wake.notify_one();
+}
+
+void Playback::Play()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (stores.empty() || playing) {
+        return;
+    }
+    // From the start again once the end was reached
+    if (cursor >= last) {
+        cursor = clock = first;
+        position = first;
+    }
+    playing = true;
+    Restart();
+}
+
+void Playback::Pause()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!playing) {
+        return;
+    }
+    clock = std::min(Now(), last);
+    playing = false;
+    position = clock;
+    Restart();
+}
+
+void Playback::SetSpeed(double speed)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    clock = Now();
+    this->speed = std::clamp(speed, MINIMUM_SPEED, MAXIMUM_SPEED);
+    Restart();
+}
+
+void Playback::Seek(int64_t host_ns)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    cursor = clock = std::clamp(host_ns, first, last);
+    position = clock;
+    Restart();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Playback thread
+//--------------------------------------------------------------------------------------------------
+void Playback::Run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!quit) {
+        if (!playing) {
+            wake.wait(guard, [this] {
+                return quit || playing;
+            });
+            continue;
+        }
+        if (cursor > last) {
+            // The end: stay there, paused
+            clock = last;
+            position = last;
+            playing = false;
+            continue;
+        }
+
+        // The slice is gathered without the lock, so the controls stay responsive
+        uint32_t started = generation;
+        int64_t from = cursor;
+        int64_t to = from + (int64_t) (SLICE_NS * speed) + 1;
+        guard.unlock();
+        Gather(from, to);
+        guard.lock();
+
+        // Each event at its time on the playback clock
+        auto changed = [this, started] {
+            return quit || generation != started;
+        };
+        auto due = [this](int64_t host_ns) {
+            return anchor + std::chrono::nanoseconds((int64_t) ((host_ns - clock) / speed));
+        };
+        bool interrupted = false;
+        for (const Event &event : events) {
+            if (event.host_ns < cursor) {
+                continue;
+            }
+            if (wake.wait_until(guard, due(event.host_ns), changed)) {
+                interrupted = true;
+                break;
+            }
+            cursor = event.host_ns + 1;
+            position = event.host_ns;
+
+            // The sink may take a while and must not hold up the controls
+            scratch.assign(&bytes[event.offset], &bytes[event.offset] + event.length);
+            guard.unlock();
+            sink(event.stream, scratch.data(), (int) scratch.size());
+            guard.lock();
+            if (changed()) {
+                interrupted = true;
+                break;
+            }
+        }
+        if (!interrupted && !wake.wait_until(guard, due(to), changed)) {
+            cursor = to;
+            position = std::min(to, last);
+        }
+    }
+}
+
+void Playback::Add(int64_t host_ns, uint8_t stream, const uint8_t *data, size_t length)
+{
+    events.push_back(Event{host_ns, stream, (uint32_t) bytes.size(), (uint32_t) length});
+    bytes.insert(bytes.end(), data, data + length);
+}
+
+void Playback::Gather(int64_t from, int64_t to)
+{
+    events.clear();
+    bytes.clear();
+    for (const std::unique_ptr<SessionLog::Store> &store : stores) {
+        store->ForEachInRange(from, to, 0, [&](const SessionLog::RecordView &view) {
+            const SessionLog::RecordHeader &record = *view.header;
+            switch (record.stream) {
+                case SessionLog::MEASUREMENT:
+                case SessionLog::VECTOR:
+                case SessionLog::RAW:
+                case SessionLog::BATTERY:
+                    Add(record.host_ns, record.stream, view.payload, record.length);
+                    break;
+                case SessionLog::RAW_PACKED:
+                    // A chunk can start before the slice and end after it
+                    rawDecoder.Decode(view.payload, record.length, record.host_ns, [&](int64_t host_ns, const uint8_t *data, int length) {
+                        if (host_ns >= from && host_ns < to) {
+                            Add(host_ns, SessionLog::RAW, data, length);
+                        }
+                    });
+                    break;
+            }
+        });
+    }
+    // The logs are merged in time, keeping the order of records with the same time
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.host_ns < b.host_ns;
+    });
+}
@@ -0,0 +1,121 @@
+#ifndef _PLAYBACK_H
+#define _PLAYBACK_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "session-index.h"
+#include "raw-codec.h"
+
+//--------------------------------------------------------------------------------------------------
+// Session log playback
+//
+// Plays recorded session logs back in place of the Bluetooth thread. The records of every open log
+// are merged by host time and handed to the sink at the time they were received, scaled by the
+// playback speed, from a thread of their own. The sink gets the notification bytes exactly as they
+// arrived, so the frame decodes them with the same Set... functions as live data, and the view
+// model limits the GUI to the display rate however fast the log is played.
+//
+// The thread works through the logs in slices of 50 ms of wall time, each found through the index,
+// so seeking is a binary search rather than a rescan. Packed raw chunks are expanded again and
+// their notifications played one at a time.
+//
+// Control functions are called from the GUI thread. Position() may be called from any thread.
+//--------------------------------------------------------------------------------------------------
+class Playback
+{
+public:
+    // Given the stream (SessionLog::MEASUREMENT, VECTOR, RAW or BATTERY) and a copy of the
+    // notification that may be modified
+    using Sink = std::function<void(uint8_t stream, uint8_t *data, int length)>;
+
+    static constexpr double MINIMUM_SPEED = 0.1;
+    static constexpr double MAXIMUM_SPEED = 50.0;
+
+    explicit Playback(Sink sink);
+    ~Playback();
+
+    // Logs recorded together, for example the measurement, vector and raw logs of one session.
+    // Playback starts paused at the earliest record. False if none of them could be opened.
+    bool Open(const std::vector<std::string> &paths);
+    void Close();
+    bool IsOpened() const
+    {
+        return !stores.empty();
+    }
+
+    void Play();
+    void Pause();
+    bool IsPlaying() const
+    {
+        return playing.load(std::memory_order_relaxed);
+    }
+    void SetSpeed(double speed);
+    void Seek(int64_t host_ns);
+
+    // Host time span of the logs and the time being played
+    int64_t FirstTime() const
+    {
+        return first;
+    }
+    int64_t LastTime() const
+    {
+        return last;
+    }
+    int64_t Position() const
+    {
+        return position.load(std::memory_order_relaxed);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        int64_t host_ns;
+        uint8_t stream;
+        uint32_t offset;                    // In bytes
+        uint32_t length;
+    };
+
+    // Called with lock held
+    int64_t Now() const;
+    void Restart();
+
+    // Playback thread
+    void Run();
+    void Gather(int64_t from, int64_t to);
+    void Add(int64_t host_ns, uint8_t stream, const uint8_t *data, size_t length);
+
+    Sink sink;
+    std::vector<std::unique_ptr<SessionLog::Store>> stores;
+    int64_t first = 0;
+    int64_t last = 0;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit = false;
+    std::atomic<bool> playing{false};
+    double speed = 1.0;
+    uint32_t generation = 0;                // Changed by every Play, Pause, Seek and SetSpeed
+    int64_t cursor = 0;                     // Everything before it has been played
+    int64_t clock = 0;                      // Log time at anchor
+    Clock::time_point anchor;
+    std::atomic<int64_t> position{0};
+
+    // Playback thread only, reused from slice to slice
+    RawDecoder rawDecoder;
+    std::vector<Event> events;
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> scratch;
+};
+
+#endif /* _PLAYBACK_H */
@@ -0,0 +1,112 @@
+#ifndef _RAW_ANALYSIS_H
+#define _RAW_ANALYSIS_H
+
+#include <string.h>
+
+#include "decode.h"
+#include "statistics.h"
+
+//--------------------------------------------------------------------------------------------------
+// InfoCrank raw data analysis
+//
+// Decodes raw data notifications into the strain and acceleration statistics and the latest value
+// of everything else. It has no GUI, so live data and replayed logs go through the same code.
+//--------------------------------------------------------------------------------------------------
+struct RawSnapshot {
+    int strainSamples = 0;                  // In the notification
+    int accelSamples = 0;
+    int lastStrain = 0;
+    double lastAccel1[3];                   // Counts, see ACCEL_G_PER_COUNT
+    double lastAccel2[3];
+    bool hasTemperature = false;
+    double temperature;                     // °C
+    bool hasBattery = false;
+    double volts;
+    bool hasState = false;
+    struct raw_data state;                  // Latest state record
+};
+
+class RawAnalysis
+{
+public:
+    RunningStatistics<1> strainStatistics;
+    RunningStatistics<3> accel1Statistics;
+    RunningStatistics<3> accel2Statistics;
+
+    // Calls hook(const struct raw_data &) for every record after it has been analysed. Returns the
+    // bytes consumed, short of length if an unknown op code was found.
+    template <class Hook> int Process(const uint8_t *data, int length, double now, RawSnapshot &snapshot, Hook &&hook)
+    {
+        // Samples are batched per notification and drained into the statistics as one block
+        int consumed = ForEachRawRecord(data, length, [&](const struct raw_data &raw) {
+            switch (raw.op_code) {
+                case STRAIN_DATA: {
+                    double sample = raw.data.strain.strain;
+                    strainBatch.Push(&sample);
+                    if (strainBatch.Full()) {
+                        strainBatch.Drain(strainStatistics, now);
+                    }
+                    snapshot.lastStrain = raw.data.strain.strain;
+                    snapshot.strainSamples++;
+                    break;
+                }
+                case ACCELERATION_DATA: {
+                    double sample1[3] = {
+                        (double) raw.data.acceleration.accel1_x,
+                        (double) raw.data.acceleration.accel1_y,
+                        (double) raw.data.acceleration.accel1_z,
+                    };
+                    double sample2[3] = {
+                        (double) raw.data.acceleration.accel2_x,
+                        (double) raw.data.acceleration.accel2_y,
+                        (double) raw.data.acceleration.accel2_z,
+                    };
+                    accel1Batch.Push(sample1);
+                    accel2Batch.Push(sample2);
+                    if (accel1Batch.Full()) {
+                        accel1Batch.Drain(accel1Statistics, now);
+                        accel2Batch.Drain(accel2Statistics, now);
+                    }
+                    memcpy(snapshot.lastAccel1, sample1, sizeof(snapshot.lastAccel1));
+                    memcpy(snapshot.lastAccel2, sample2, sizeof(snapshot.lastAccel2));
+                    snapshot.accelSamples++;
+                    break;
+                }
+                case TEMPERATURE_DATA:
+                    snapshot.temperature = RawTemperature(raw);
+                    snapshot.hasTemperature = true;
+                    break;
+                case BATTERY_DATA:
+                    snapshot.volts = RawBatteryVoltage(raw);
+                    snapshot.hasBattery = true;
+                    break;
+                case STATE_DATA:
+                    memcpy(&snapshot.state, &raw, RawRecordSize(STATE_DATA));
+                    snapshot.hasState = true;
+                    break;
+            }
+            hook(raw);
+        });
+
+        if (strainBatch.count) {
+            strainBatch.Drain(strainStatistics, now);
+        }
+        if (accel1Batch.count) {
+            accel1Batch.Drain(accel1Statistics, now);
+            accel2Batch.Drain(accel2Statistics, now);
+        }
+        return consumed;
+    }
+
+    int Process(const uint8_t *data, int length, double now, RawSnapshot &snapshot)
+    {
+        return Process(data, length, now, snapshot, [](const struct raw_data &) {});
+    }
+
+private:
+    SampleBatch<1, 64> strainBatch;
+    SampleBatch<3, 32> accel1Batch;
+    SampleBatch<3, 32> accel2Batch;
+};
+
+#endif /* _RAW_ANALYSIS_H */
@@ -0,0 +1,331 @@
+#include <string.h>
+
+#include "decode.h"
+#include "raw-codec.h"
+#include "varint.h"
+
+//--------------------------------------------------------------------------------------------------
+// Unaligned loads and stores
+//--------------------------------------------------------------------------------------------------
+template <class T> static inline T Load(const uint8_t *p)
+{
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <class T> static inline void Store(uint8_t *p, T v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Channels that are delta coded, as (offset in the record after the op code, size, signed)
+//--------------------------------------------------------------------------------------------------
+struct Channel {
+    uint8_t offset;
+    uint8_t size;
+    bool isSigned;
+};
+
+struct ChannelLayout {
+    int channels;
+    int first;                  // Index of the first predictor
+    Channel channel[6];
+};
+
+static const int PREDICTORS = 1 + 6 + 2 + 1 + 3;
+
+static const ChannelLayout layouts[RAW_OP_CODES] = {
+    {1, 0, {{0, 3, true}}},                                                             // STRAIN_DATA, see StrainWord
+    {6, 1, {{0, 2, true}, {2, 2, true}, {4, 2, true}, {6, 2, true}, {8, 2, true}, {10, 2, true}}},  // ACCELERATION_DATA
+    {2, 7, {{0, 2, true}, {2, 4, true}}},                                               // TEMPERATURE_DATA
+    {1, 9, {{0, 2, false}}},                                                            // BATTERY_DATA
+    {3, 10, {{0, 4, true}, {4, 4, true}, {8, 4, true}}},                                // STATE_DATA
+    {0, 0, {}},                                                                         // VECTOR4
+    {0, 0, {}},                                                                         // MATRIX33
+};
+
+static int64_t LoadChannel(const uint8_t *p, const Channel &c)
+{
+    switch (c.size) {
+        case 2:
+            return c.isSigned ? (int64_t) Load<int16_t>(p + c.offset) : (int64_t) Load<uint16_t>(p + c.offset);
+        case 4:
+            return Load<int32_t>(p + c.offset);
+    }
+    return 0;
+}
+
+static void StoreChannel(uint8_t *p, const Channel &c, int64_t v)
+{
+    switch (c.size) {
+        case 2:
+            Store<uint16_t>(p + c.offset, (uint16_t) v);
+            break;
+        case 4:
+            Store<int32_t>(p + c.offset, (int32_t) v);
+            break;
+    }
+}
+
+// The strain record is a 24 bit word: 6 low bits that are normally zero, then the 18 bit sample
+static inline uint32_t StrainWord(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16;
+}
+
+static inline int32_t StrainSample(uint32_t word)
+{
+    return ((int32_t) (word << 8)) >> 14;
+}
+
+enum run_flags {
+    STRAIN_LOW_BITS = 0x01,     // Each strain residual is followed by a byte of the low 6 bits
+};
+
+//--------------------------------------------------------------------------------------------------
+// Encoder
+//--------------------------------------------------------------------------------------------------
+RawEncoder::RawEncoder()
+{
+    notifications.reserve(MAXIMUM_NOTIFICATIONS);
+    payload.reserve(MAXIMUM_PAYLOAD + MAXIMUM_NOTIFICATION_SIZE);
+    records.reserve((MAXIMUM_PAYLOAD + MAXIMUM_NOTIFICATION_SIZE) / 3 + MAXIMUM_NOTIFICATIONS);
+}
+
+void RawEncoder::Add(int64_t host_ns, const uint8_t *data, int length)
+{
+    if (length > MAXIMUM_NOTIFICATION_SIZE) {
+        length = MAXIMUM_NOTIFICATION_SIZE;
+    }
+    if (notifications.empty()) {
+        firstHost = host_ns;
+    }
+    notifications.push_back({host_ns, (uint32_t) payload.size(), (uint32_t) length});
+    payload.insert(payload.end(), data, data + length);
+}
+
+size_t RawEncoder::Finish(uint8_t *out)
+{
+    records.clear();
+
+    uint8_t *p = PutVarint(out, notifications.size());
+    for (const Notification &n : notifications) {
+        const uint8_t *data = &payload[n.offset];
+        size_t first = records.size();
+        int consumed = ForEachRawRecord(data, n.length, [&](const struct raw_data &raw) {
+            records.push_back({raw.op_code, 0, (const uint8_t *) &raw + 1});
+        });
+        if (consumed < (int) n.length) {
+            records.push_back({VERBATIM, (uint16_t) (n.length - consumed), data + consumed});
+        }
+        int64_t microseconds = (n.host_ns - firstHost) / 1000;
+        p = PutVarint(p, microseconds > 0 ? microseconds : 0);
+        p = PutVarint(p, records.size() - first);
+    }
+    int count = records.size();
+
+    // Runs of one op code
+    int runs = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || records[i].op_code != records[i - 1].op_code) {
+            runs++;
+        }
+    }
+    p = PutVarint(p, runs);
+
+    int64_t prediction[PREDICTORS] = {};
+    for (int start = 0; start < count;) {
+        uint8_t op = records[start].op_code;
+        int end = start;
+        while (end < count && records[end].op_code == op) {
+            end++;
+        }
+
+        uint8_t flags = 0;
+        if (op == STRAIN_DATA) {
+            for (int i = start; i < end; i++) {
+                if (StrainWord(records[i].data) & 0x3f) {
+                    flags |= STRAIN_LOW_BITS;
+                }
+            }
+        }
+        *p++ = op;
+        *p++ = flags;
+        p = PutVarint(p, end - start);
+
+        for (int i = start; i < end; i++) {
+            const uint8_t *data = records[i].data;
+            if (op == VERBATIM) {
+                p = PutVarint(p, records[i].length);
+                memcpy(p, data, records[i].length);
+                p += records[i].length;
+            } else if (op == STRAIN_DATA) {
+                uint32_t word = StrainWord(data);
+                int64_t sample = StrainSample(word);
+                p = PutVarint(p, ZigZag(sample - prediction[0]));
+                prediction[0] = sample;
+                if (flags & STRAIN_LOW_BITS) {
+                    *p++ = word & 0x3f;
+                }
+            } else if (layouts[op].channels) {
+                const ChannelLayout &layout = layouts[op];
+                for (int c = 0; c < layout.channels; c++) {
+                    int64_t value = LoadChannel(data, layout.channel[c]);
+                    p = PutVarint(p, ZigZag(value - prediction[layout.first + c]));
+                    prediction[layout.first + c] = value;
+                }
+            } else {
+                int size = RawRecordSize(op) - 1;
+                memcpy(p, data, size);
+                p += size;
+            }
+        }
+        start = end;
+    }
+
+    notifications.clear();
+    payload.clear();
+    records.clear();
+    return p - out;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Decoder
+//--------------------------------------------------------------------------------------------------
+int RawDecoder::Notifications(const uint8_t *chunk, size_t length)
+{
+    uint64_t count;
+    if (!GetVarint(chunk, chunk + length, count) || count > RawEncoder::MAXIMUM_NOTIFICATIONS) {
+        return 0;
+    }
+    return count;
+}
+
+int RawDecoder::Times(const uint8_t *chunk, size_t length, int64_t *microseconds)
+{
+    const uint8_t *end = chunk + length;
+    uint64_t count, v, records;
+    if (!GetVarint(chunk, end, count) || count > RawEncoder::MAXIMUM_NOTIFICATIONS) {
+        return 0;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (!GetVarint(chunk, end, v) || !GetVarint(chunk, end, records)) {
+            return 0;
+        }
+        microseconds[i] = v;
+    }
+    return count;
+}
+
+bool RawDecoder::Expand(const uint8_t *chunk, size_t length)
+{
+    const uint8_t *p = chunk;
+    const uint8_t *end = chunk + length;
+    uint64_t v;
+
+    notifications.clear();
+    recordCounts.clear();
+    recordEnds.clear();
+    payload.clear();
+
+    uint64_t count;
+    if (!GetVarint(p, end, count) || count > RawEncoder::MAXIMUM_NOTIFICATIONS) {
+        return false;
+    }
+    uint64_t totalRecords = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t microseconds, records;
+        if (!GetVarint(p, end, microseconds) || !GetVarint(p, end, records)) {
+            return false;
+        }
+        notifications.push_back({(int64_t) microseconds, 0, 0});
+        recordCounts.push_back(records);
+        totalRecords += records;
+    }
+
+    uint64_t runs;
+    if (!GetVarint(p, end, runs)) {
+        return false;
+    }
+    int64_t prediction[PREDICTORS] = {};
+    for (uint64_t r = 0; r < runs; r++) {
+        if (end - p < 2) {
+            return false;
+        }
+        uint8_t op = *p++;
+        uint8_t flags = *p++;
+        uint64_t records;
+        if (!GetVarint(p, end, records) || records > totalRecords) {
+            return false;
+        }
+        if (op != RawEncoder::VERBATIM && RawRecordSize(op) == 0) {
+            return false;
+        }
+
+        for (uint64_t i = 0; i < records; i++) {
+            if (op == RawEncoder::VERBATIM) {
+                if (!GetVarint(p, end, v) || (uint64_t) (end - p) < v) {
+                    return false;
+                }
+                payload.insert(payload.end(), p, p + v);
+                p += v;
+                recordEnds.push_back(payload.size());
+                continue;
+            }
+
+            size_t at = payload.size();
+            int size = RawRecordSize(op);
+            payload.resize(at + size);
+            uint8_t *record = &payload[at];
+            record[0] = op;
+            if (op == STRAIN_DATA) {
+                if (!GetVarint(p, end, v)) {
+                    return false;
+                }
+                prediction[0] += UnZigZag(v);
+                uint32_t word = ((uint32_t) prediction[0] & 0x3ffff) << 6;
+                if (flags & STRAIN_LOW_BITS) {
+                    if (p >= end) {
+                        return false;
+                    }
+                    word |= *p++ & 0x3f;
+                }
+                record[1] = word;
+                record[2] = word >> 8;
+                record[3] = word >> 16;
+            } else if (layouts[op].channels) {
+                const ChannelLayout &layout = layouts[op];
+                for (int c = 0; c < layout.channels; c++) {
+                    if (!GetVarint(p, end, v)) {
+                        return false;
+                    }
+                    prediction[layout.first + c] += UnZigZag(v);
+                    StoreChannel(record + 1, layout.channel[c], prediction[layout.first + c]);
+                }
+            } else {
+                if (end - p < size - 1) {
+                    return false;
+                }
+                memcpy(record + 1, p, size - 1);
+                p += size - 1;
+            }
+            recordEnds.push_back(payload.size());
+        }
+    }
+    if (recordEnds.size() != totalRecords) {
+        return false;
+    }
+
+    // Notifications are consecutive runs of records
+    size_t record = 0;
+    for (size_t i = 0; i < notifications.size(); i++) {
+        uint32_t begin = record ? recordEnds[record - 1] : 0;
+        record += recordCounts[i];
+        uint32_t finish = record ? recordEnds[record - 1] : 0;
+        notifications[i].offset = begin;
+        notifications[i].length = finish - begin;
+    }
+    return true;
+}
@@ -0,0 +1,124 @@
+#ifndef _RAW_CODEC_H
+#define _RAW_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Raw data compression
+//
+// Lossless codec for InfoCrank raw data notifications, used for the RAW_PACKED stream of the
+// session log. A chunk holds up to MAXIMUM_NOTIFICATIONS notifications and can be decoded alone:
+//
+//  varint  notifications
+//  notifications x {
+//      varint  microseconds since the chunk time
+//      varint  raw records in the notification
+//  }
+//  varint  runs
+//  runs x {
+//      u8      op code, or VERBATIM
+//      u8      run flags
+//      varint  records
+//      records x residuals
+//  }
+//
+// A run is consecutive records with the same op code, so the op code is stored once per run rather
+// than once per sample. Strain, acceleration, temperature, battery and state values are coded as
+// the zigzag varint of their difference from the previous value of the same channel. Every channel
+// starts from zero at the start of a chunk. Vector and matrix records are stored as they are. Bytes
+// that are not a whole known record go into a VERBATIM run of one record: a varint length, then the
+// bytes.
+//
+// Varints are LEB128. A zigzag value is (v << 1) ^ (v >> 63).
+//--------------------------------------------------------------------------------------------------
+class RawEncoder
+{
+public:
+    static const int MAXIMUM_NOTIFICATIONS = 128;
+    static const int MAXIMUM_PAYLOAD = 16384;       // Raw bytes in a chunk before it is full
+    static const uint8_t VERBATIM = 0xff;
+
+    RawEncoder();
+
+    // Notifications longer than MAXIMUM_NOTIFICATION_SIZE bytes are cut short
+    static const int MAXIMUM_NOTIFICATION_SIZE = 512;
+    void Add(int64_t host_ns, const uint8_t *data, int length);
+
+    int Notifications() const
+    {
+        return notifications.size();
+    }
+    bool Full() const
+    {
+        return notifications.size() >= MAXIMUM_NOTIFICATIONS || payload.size() >= MAXIMUM_PAYLOAD;
+    }
+    int64_t FirstHost() const
+    {
+        return firstHost;
+    }
+
+    // Worst case size of an encoded chunk. No record grows by more than three times, a notification
+    // costs at most 24 bytes more, and the whole chunk fits in one session log record.
+    static const size_t MAXIMUM_CHUNK = 3 * (MAXIMUM_PAYLOAD + MAXIMUM_NOTIFICATION_SIZE) + 24 * MAXIMUM_NOTIFICATIONS + 16;
+
+    // Encodes the notifications added since the last call into out, at least MAXIMUM_CHUNK bytes,
+    // and starts a new chunk. Returns the encoded size.
+    size_t Finish(uint8_t *out);
+
+private:
+    struct Notification {
+        int64_t host_ns;
+        uint32_t offset;
+        uint32_t length;
+    };
+    std::vector<Notification> notifications;
+    std::vector<uint8_t> payload;           // The notifications back to back
+    int64_t firstHost = 0;
+
+    struct Record {
+        uint8_t op_code;
+        uint16_t length;                    // Of a VERBATIM record
+        const uint8_t *data;                // After the op code, or the verbatim bytes
+    };
+    std::vector<Record> records;
+};
+
+class RawDecoder
+{
+public:
+    // Calls callback(int64_t host_ns, const uint8_t *notification, int length) for every
+    // notification of the chunk, rebuilt byte for byte. False if the chunk is malformed.
+    template <class Callback> bool Decode(const uint8_t *chunk, size_t length, int64_t host_ns, Callback &&callback)
+    {
+        if (!Expand(chunk, length)) {
+            return false;
+        }
+        for (const Notification &n : notifications) {
+            callback(host_ns + n.microseconds * 1000, &payload[n.offset], (int) n.length);
+        }
+        return true;
+    }
+
+    // Notifications in a chunk, without decoding it. Zero if the chunk is malformed.
+    static int Notifications(const uint8_t *chunk, size_t length);
+    // The same, filling in the time of each notification in microseconds after the chunk time,
+    // at most RawEncoder::MAXIMUM_NOTIFICATIONS of them
+    static int Times(const uint8_t *chunk, size_t length, int64_t *microseconds);
+
+private:
+    bool Expand(const uint8_t *chunk, size_t length);
+
+    struct Notification {
+        int64_t microseconds;
+        uint32_t offset;                    // In payload
+        uint32_t length;
+    };
+    std::vector<Notification> notifications;
+    std::vector<uint32_t> recordCounts;
+    std::vector<uint32_t> recordEnds;       // End of each rebuilt record in payload
+    std::vector<uint8_t> payload;           // Rebuilt records, and so notifications, back to back
+};
+
+#endif /* _RAW_CODEC_H */
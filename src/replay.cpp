@@ -0,0 +1,383 @@
+//--------------------------------------------------------------------------------------------------
+// Headless replay of recorded sessions
+//
+//  diagnostic-replay [-j threads] [-n passes] log...
+//
+// Maps each log and puts every record through the decoders and the raw data analysis the GUI
+// uses, as fast as it will go, with no BLE and no GUI. Logs are shared out between threads. Each
+// log gets a line of results, which should not change between runs or builds, and then the time
+// spent in each stage is reported:
+//
+//  read        block CRC checks, which is also where the log is first touched
+//  unpack      RAW_PACKED chunks back into notifications
+//  decode      cycling power measurement, vector and battery notifications
+//  analyse     raw data notifications, see raw-analysis.h
+//
+// A file that is not a session log is taken to be an old raw.log: raw data records back to back.
+//--------------------------------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "decode.h"
+#include "raw-analysis.h"
+#include "raw-codec.h"
+#include "session-log.h"
+
+enum stages {
+    READ,
+    UNPACK,
+    DECODE,
+    ANALYSE,
+    STAGES
+};
+
+static const char *const stage_names[STAGES] = {"read", "unpack", "decode", "analyse"};
+
+struct StageCounters {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+};
+
+struct Replay {
+    std::string path;
+    bool opened = false;
+    bool legacy = false;
+    StageCounters stage[STAGES];
+
+    // Results
+    size_t blocks = 0;
+    size_t badBlocks = 0;
+    uint64_t measurements = 0;
+    uint64_t badMeasurements = 0;
+    double powerSum = 0.0;
+    uint16_t crankRevolutions = 0;
+    uint64_t vectors = 0;
+    uint64_t vectorElements = 0;
+    uint64_t battery = 0;
+    uint64_t notifications = 0;
+    uint64_t rawRecords = 0;
+    uint64_t unknownOpCodes = 0;
+    uint64_t badChunks = 0;
+    RawAnalysis analysis;
+    RawSnapshot snapshot;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static inline double Seconds(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double>(to - from).count();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Raw data notifications, shared by session logs and old raw logs
+//--------------------------------------------------------------------------------------------------
+static void Analyse(Replay &replay, const uint8_t *data, int length, int64_t host_ns)
+{
+    int consumed = replay.analysis.Process(data, length, host_ns * 1.0e-9, replay.snapshot, [&](const struct raw_data &) {
+        replay.rawRecords++;
+    });
+    if (consumed < length) {
+        replay.unknownOpCodes++;
+    }
+    replay.stage[ANALYSE].bytes += length;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Session logs
+//--------------------------------------------------------------------------------------------------
+struct Notification {
+    int64_t host_ns;
+    uint32_t offset;            // In the unpacked buffer, or
+    const uint8_t *data;        // in the log
+    uint32_t length;
+};
+
+static void ReplaySessionLog(Replay &replay, const SessionLog::Reader &reader)
+{
+    MeasurementDecoder measurementDecoder;
+    RawDecoder rawDecoder;
+    std::vector<Notification> notifications;
+    std::vector<uint8_t> unpacked;
+
+    replay.blocks = reader.Blocks();
+    for (size_t b = 0; b < reader.Blocks(); b++) {
+        Clock::time_point t0 = Clock::now();
+        bool good = reader.VerifyBlock(b);
+        Clock::time_point t1 = Clock::now();
+        replay.stage[READ].records++;
+        replay.stage[READ].bytes += SessionLog::BLOCK_SIZE;
+        replay.stage[READ].seconds += Seconds(t0, t1);
+        if (!good) {
+            replay.badBlocks++;
+            continue;
+        }
+
+        // Raw data, unpacked where it was logged compressed
+        notifications.clear();
+        unpacked.clear();
+        reader.ForEachRecordInBlock(b, [&](const SessionLog::RecordHeader &record, const uint8_t *payload) {
+            if (record.stream == SessionLog::RAW) {
+                notifications.push_back({record.host_ns, 0, payload, record.length});
+            } else if (record.stream == SessionLog::RAW_PACKED) {
+                bool ok = rawDecoder.Decode(payload, record.length, record.host_ns, [&](int64_t host_ns, const uint8_t *data, int length) {
+                    notifications.push_back({host_ns, (uint32_t) unpacked.size(), nullptr, (uint32_t) length});
+                    unpacked.insert(unpacked.end(), data, data + length);
+                });
+                replay.badChunks += !ok;
+                replay.stage[UNPACK].records++;
+                replay.stage[UNPACK].bytes += record.length;
+            }
+        });
+        Clock::time_point t2 = Clock::now();
+        replay.stage[UNPACK].seconds += Seconds(t1, t2);
+
+        reader.ForEachRecordInBlock(b, [&](const SessionLog::RecordHeader &record, const uint8_t *payload) {
+            switch (record.stream) {
+                case SessionLog::MEASUREMENT: {
+                    CyclingPowerMeasurement m;
+                    if (measurementDecoder.Decode(payload, record.length, m)) {
+                        replay.measurements++;
+                        replay.powerSum += m.instantaneous_power;
+                        replay.crankRevolutions = m.cumulative_crank_revolutions;
+                    } else {
+                        replay.badMeasurements++;
+                    }
+                    break;
+                }
+                case SessionLog::VECTOR: {
+                    CyclingPowerVector vector;
+                    if (DecodeCyclingPowerVector(payload, record.length, vector)) {
+                        replay.vectors++;
+                        replay.vectorElements += vector.array_length;
+                    }
+                    break;
+                }
+                case SessionLog::BATTERY:
+                    replay.battery++;
+                    break;
+                default:
+                    return;
+            }
+            replay.stage[DECODE].records++;
+            replay.stage[DECODE].bytes += record.length;
+        });
+        Clock::time_point t3 = Clock::now();
+        replay.stage[DECODE].seconds += Seconds(t2, t3);
+
+        for (const Notification &n : notifications) {
+            Analyse(replay, n.data ? n.data : &unpacked[n.offset], n.length, n.host_ns);
+        }
+        replay.notifications += notifications.size();
+        replay.stage[ANALYSE].records += notifications.size();
+        replay.stage[ANALYSE].seconds += Seconds(t3, Clock::now());
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Old raw logs: the records as received, with no framing or times
+//--------------------------------------------------------------------------------------------------
+static bool ReplayRawLog(Replay &replay)
+{
+    int fd = open(replay.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(replay.path.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(replay.path.c_str());
+        return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    // Taken as notifications of at most 512 bytes, cut at record boundaries, one every 7.8125 ms
+    const uint8_t *data = (const uint8_t *) map;
+    size_t offset = 0;
+    int64_t host_ns = 0;
+    Clock::time_point t0 = Clock::now();
+    while (offset < (size_t) st.st_size) {
+        size_t length = 0;
+        while (offset + length < (size_t) st.st_size) {
+            int size = RawRecordSize(data[offset + length]);
+            if (size == 0 || length + size > RawEncoder::MAXIMUM_NOTIFICATION_SIZE || offset + length + size > (size_t) st.st_size) {
+                break;
+            }
+            length += size;
+        }
+        if (length == 0) {
+            length = 1;                 // Unknown op code or a truncated record, step over it
+        }
+        Analyse(replay, &data[offset], length, host_ns);
+        replay.notifications++;
+        replay.stage[ANALYSE].records++;
+        offset += length;
+        host_ns += 7812500;
+    }
+    replay.stage[ANALYSE].seconds += Seconds(t0, Clock::now());
+    munmap(map, st.st_size);
+    return true;
+}
+
+static void ReplayFile(Replay &replay)
+{
+    char magic[sizeof(SessionLog::MAGIC)] = {};
+    int fd = open(replay.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(replay.path.c_str());
+        return;
+    }
+    bool session = read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, SessionLog::MAGIC, sizeof(magic)) == 0;
+    close(fd);
+
+    if (session) {
+        SessionLog::Reader reader;
+        if (reader.Open(replay.path.c_str())) {
+            ReplaySessionLog(replay, reader);
+            replay.opened = true;
+        }
+    } else {
+        replay.legacy = true;
+        replay.opened = ReplayRawLog(replay);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Report
+//--------------------------------------------------------------------------------------------------
+static void PrintResults(const Replay &replay)
+{
+    if (!replay.opened) {
+        printf("%s: not replayed\n", replay.path.c_str());
+        return;
+    }
+    printf("%s:%s", replay.path.c_str(), replay.legacy ? " raw log" : "");
+    if (!replay.legacy) {
+        printf(" %zu blocks (%zu bad), %llu measurements", replay.blocks, replay.badBlocks, (unsigned long long) replay.measurements);
+        if (replay.measurements) {
+            printf(" (%.1f W mean, %u crank revolutions)", replay.powerSum / replay.measurements, replay.crankRevolutions);
+        }
+        printf(", %llu vectors, %llu battery,", (unsigned long long) replay.vectors, (unsigned long long) replay.battery);
+    }
+    printf(" %llu raw notifications, %llu raw records", (unsigned long long) replay.notifications, (unsigned long long) replay.rawRecords);
+    if (replay.unknownOpCodes || replay.badChunks || replay.badMeasurements) {
+        printf(", %llu unknown op codes, %llu bad chunks, %llu bad measurements", (unsigned long long) replay.unknownOpCodes,
+               (unsigned long long) replay.badChunks, (unsigned long long) replay.badMeasurements);
+    }
+    printf("\n");
+
+    Moments<1> strain = replay.analysis.strainStatistics.Summary();
+    Moments<3> accel1 = replay.analysis.accel1Statistics.Summary();
+    Moments<3> accel2 = replay.analysis.accel2Statistics.Summary();
+    if (strain.count) {
+        printf("    strain %.3f ± %.3f\n", strain.mean[0], strain.StandardDeviation(0));
+    }
+    if (accel1.count) {
+        printf("    accel1 %.4f %.4f %.4f g, accel2 %.4f %.4f %.4f g\n",
+               accel1.mean[0] * ACCEL_G_PER_COUNT, accel1.mean[1] * ACCEL_G_PER_COUNT, accel1.mean[2] * ACCEL_G_PER_COUNT,
+               accel2.mean[0] * ACCEL_G_PER_COUNT, accel2.mean[1] * ACCEL_G_PER_COUNT, accel2.mean[2] * ACCEL_G_PER_COUNT);
+    }
+}
+
+static void PrintThroughput(const StageCounters *stage, double wall, int threads)
+{
+    printf("\n%-8s %12s %10s %10s %14s %10s\n", "stage", "records", "MB", "seconds", "records/s", "MB/s");
+    for (int s = 0; s < STAGES; s++) {
+        double mb = stage[s].bytes * 1.0e-6;
+        double seconds = stage[s].seconds;
+        printf("%-8s %12llu %10.1f %10.3f %14.0f %10.1f\n", stage_names[s], (unsigned long long) stage[s].records, mb, seconds,
+               seconds > 0.0 ? stage[s].records / seconds : 0.0, seconds > 0.0 ? mb / seconds : 0.0);
+    }
+    uint64_t bytes = stage[READ].bytes ? stage[READ].bytes : stage[ANALYSE].bytes;
+    printf("%.3f s on %d threads, %.1f MB/s overall\n", wall, threads, wall > 0.0 ? bytes * 1.0e-6 / wall : 0.0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Main
+//--------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int threads = std::thread::hardware_concurrency();
+    int passes = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:n:h")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-j threads] [-n passes] log...\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    int files = argc - optind;
+    if (files <= 0) {
+        fprintf(stderr, "Usage: %s [-j threads] [-n passes] log...\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (passes < 1) {
+        passes = 1;
+    }
+    if (threads > files * passes) {
+        threads = files * passes;
+    }
+
+    // Each pass of each file is one job, taken by whichever thread is free
+    std::vector<Replay> replays(files * passes);
+    for (int i = 0; i < files * passes; i++) {
+        replays[i].path = argv[optind + i % files];
+    }
+    std::atomic<size_t> next{0};
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (size_t i; (i = next.fetch_add(1)) < replays.size();) {
+                ReplayFile(replays[i]);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double wall = Seconds(start, Clock::now());
+
+    StageCounters total[STAGES];
+    for (const Replay &replay : replays) {
+        for (int s = 0; s < STAGES; s++) {
+            total[s].records += replay.stage[s].records;
+            total[s].bytes += replay.stage[s].bytes;
+            total[s].seconds += replay.stage[s].seconds;
+        }
+    }
+    bool failed = false;
+    for (int i = 0; i < files; i++) {
+        PrintResults(replays[i]);
+        failed = failed || !replays[i].opened;
+    }
+    PrintThroughput(total, wall, threads);
+    return failed ? 1 : 0;
+}
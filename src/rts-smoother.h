@@ -0,0 +1,135 @@
+#ifndef _RTS_SMOOTHER_H
+#define _RTS_SMOOTHER_H
+
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+
+#include "ekf.h"
+
+//--------------------------------------------------------------------------------------------------
+// Rauch–Tung–Striebel smoother
+//
+// Add() records the EKF's estimate after each step. Smooth() then runs back over the records,
+// each filtered estimate becoming the smoothed one, the estimate given every measurement before
+// and after it:
+//
+//  C = P F' (F P F' + Q)⁻¹
+//  x = x + C (xs⁺ - F x)
+//  P = P + C (Ps⁺ - (F P F' + Q)) C'
+//
+// with xs⁺, Ps⁺ the smoothed estimate of the step after. The prediction is formed again from the
+// filtered estimate rather than stored, so a step costs N + N² doubles. The model must be the
+// filter's, and is linear in its transition, so the extended smoother needs no other
+// linearization. The last record stays as it was filtered; a smoother run on a segment of a
+// longer log is only good some way back from its end.
+//--------------------------------------------------------------------------------------------------
+template <size_t N, size_t M, class Model> class RtsSmoother
+{
+public:
+    struct Estimate {
+        double x[N];
+        double P[N][N];
+    };
+
+    std::vector<Estimate> estimates;
+
+    void Clear()
+    {
+        estimates.clear();
+    }
+
+    void Add(const Ekf<N, M, Model> &ekf)
+    {
+        estimates.emplace_back();
+        Estimate &e = estimates.back();
+        for (size_t i = 0; i < N; i++) {
+            e.x[i] = ekf.x[i];
+            for (size_t j = 0; j < N; j++) {
+                e.P[i][j] = ekf.P[i][j];
+            }
+        }
+    }
+
+    void Smooth(const Model &model)
+    {
+        const double (&F)[N][N] = model.F;
+        if (estimates.size() < 2) {
+            return;
+        }
+        for (size_t k = estimates.size() - 1; k-- > 0;) {
+            Estimate &e = estimates[k];
+            const Estimate &next = estimates[k + 1];
+
+            // The prediction from here: x⁻ = Fx, P⁻ = FPF' + Q, and FP
+            double xp[N];
+            double FP[N][N];
+            double Pp[N][N];
+            for (size_t i = 0; i < N; i++) {
+                xp[i] = 0.0;
+                for (size_t j = 0; j < N; j++) {
+                    FP[i][j] = 0.0;
+                }
+                for (size_t l = 0; l < N; l++) {
+                    xp[i] += F[i][l] * e.x[l];
+                    for (size_t j = 0; j < N; j++) {
+                        FP[i][j] += F[i][l] * e.P[l][j];
+                    }
+                }
+            }
+            for (size_t i = 0; i < N; i++) {
+                for (size_t j = i; j < N; j++) {
+                    double s = model.Q[i][j];
+                    for (size_t l = 0; l < N; l++) {
+                        s += FP[i][l] * F[j][l];
+                    }
+                    Pp[i][j] = Pp[j][i] = s;
+                }
+            }
+
+            // C' = P⁻⁻¹FP, as P and P⁻ are symmetric
+            double L[N][N];
+            double Ct[N][N];
+            double dx[N];
+            double dP[N][N];
+            for (size_t i = 0; i < N; i++) {
+                dx[i] = next.x[i] - xp[i];
+                for (size_t j = 0; j < N; j++) {
+                    L[i][j] = Pp[i][j];
+                    dP[i][j] = next.P[i][j] - Pp[i][j];
+                }
+            }
+            if (!Cholesky(L)) {
+                continue;                       // Nothing to carry back
+            }
+            CholeskySolve(L, FP, Ct);
+
+            // x += C dx, P += C dP C'
+            double CdP[N][N];
+            for (size_t i = 0; i < N; i++) {
+                for (size_t l = 0; l < N; l++) {
+                    e.x[i] += Ct[l][i] * dx[l];
+                }
+                for (size_t j = 0; j < N; j++) {
+                    CdP[i][j] = 0.0;
+                    for (size_t l = 0; l < N; l++) {
+                        CdP[i][j] += Ct[l][i] * dP[l][j];
+                    }
+                }
+            }
+            for (size_t i = 0; i < N; i++) {
+                for (size_t j = i; j < N; j++) {
+                    double s = e.P[i][j];
+                    for (size_t l = 0; l < N; l++) {
+                        s += CdP[i][l] * Ct[l][j];
+                    }
+                    e.P[i][j] = e.P[j][i] = s;
+                }
+            }
+        }
+    }
+};
+
+typedef RtsSmoother<3, 4, CrankModel> CrankSmoother;
+
+#endif /* _RTS_SMOOTHER_H */
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "raw-codec.h"
+#include "session-index.h"
+
+namespace SessionLog
+{
+
+//--------------------------------------------------------------------------------------------------
+// Index entries
+//--------------------------------------------------------------------------------------------------
+std::string IndexPath(const std::string &logPath)
+{
+    return logPath + ".idx";
+}
+
+void InitializeIndexHeader(IndexHeader &header, const FileHeader &log)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.entry_size = sizeof(IndexEntry);
+    header.block_size = log.block_size;
+    header.created_realtime_ns = log.created_realtime_ns;
+    header.created_monotonic_ns = log.created_monotonic_ns;
+    header.log_crc = log.crc;
+    header.crc = Crc32(&header, offsetof(IndexHeader, crc));
+}
+
+uint32_t RecordSamples(const RecordHeader &record, const uint8_t *payload)
+{
+    if (record.stream == RAW_PACKED) {
+        return RawDecoder::Notifications(payload, record.length);
+    }
+    return 1;
+}
+
+int64_t RecordLastHost(const RecordHeader &record, const uint8_t *payload)
+{
+    if (record.stream == RAW_PACKED) {
+        int64_t microseconds[RawEncoder::MAXIMUM_NOTIFICATIONS];
+        int n = RawDecoder::Times(payload, record.length, microseconds);
+        if (n) {
+            return record.host_ns + microseconds[n - 1] * 1000;
+        }
+    }
+    return record.host_ns;
+}
+
+bool RecordInRange(const RecordHeader &record, const uint8_t *payload, int64_t from, int64_t to, uint32_t &first)
+{
+    first = 0;
+    if (record.host_ns >= to) {
+        return false;
+    }
+    if (record.host_ns >= from) {
+        return true;
+    }
+    if (record.stream != RAW_PACKED) {
+        return false;
+    }
+
+    // A chunk is dated by its first notification, and may run on into the range
+    int64_t microseconds[RawEncoder::MAXIMUM_NOTIFICATIONS];
+    int n = RawDecoder::Times(payload, record.length, microseconds);
+    for (int i = 0; i < n; i++) {
+        int64_t host_ns = record.host_ns + microseconds[i] * 1000;
+        if (host_ns >= to) {
+            return false;
+        }
+        if (host_ns >= from) {
+            first = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IndexBlock(const BlockHeader &block, bool good, const IndexEntry *previous, IndexEntry &entry)
+{
+    memset(&entry, 0, sizeof(entry));
+    if (previous) {
+        memcpy(entry.samples, previous->samples, sizeof(entry.samples));
+    }
+    entry.first_host_ns = INT64_MAX;
+    entry.last_host_ns = INT64_MIN;
+    entry.crc = block.crc;
+    if (!good) {
+        return;
+    }
+
+    const uint8_t *p = (const uint8_t *) &block + sizeof(BlockHeader);
+    const uint8_t *end = p + block.used;
+    for (uint32_t r = 0; r < block.records && p + sizeof(RecordHeader) <= end; r++) {
+        const RecordHeader &record = *(const RecordHeader *) p;
+        const uint8_t *payload = p + sizeof(RecordHeader);
+        if (payload + record.length > end) {
+            break;
+        }
+        entry.first_host_ns = std::min(entry.first_host_ns, record.host_ns);
+        entry.last_host_ns = std::max(entry.last_host_ns, RecordLastHost(record, payload));
+        if (record.stream < INDEXED_STREAMS) {
+            entry.samples[record.stream] += RecordSamples(record, payload);
+        }
+        entry.records++;
+        p = payload + Padded(record.length);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Index
+//--------------------------------------------------------------------------------------------------
+bool Index::Open(const Reader &reader, const std::string &logPath)
+{
+    std::string path = IndexPath(logPath);
+    entries.clear();
+    if (!Load(reader, path)) {
+        entries.clear();
+    }
+
+    // Index whatever the sidecar does not cover
+    size_t loaded = entries.size();
+    entries.reserve(reader.Blocks());
+    for (size_t i = loaded; i < reader.Blocks(); i++) {
+        IndexEntry entry;
+        IndexBlock(reader.Block(i), reader.VerifyBlock(i), i ? &entries[i - 1] : nullptr, entry);
+        entries.push_back(entry);
+    }
+    if (entries.size() > loaded) {
+        Save(reader, path);
+    }
+
+    size_t n = entries.size();
+    latest.resize(n);
+    earliest.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        latest[i] = std::max(i ? latest[i - 1] : INT64_MIN, entries[i].last_host_ns);
+    }
+    for (size_t i = n; i-- > 0;) {
+        earliest[i] = std::min(i + 1 < n ? earliest[i + 1] : INT64_MAX, entries[i].first_host_ns);
+    }
+    return n > 0;
+}
+
+bool Index::Load(const Reader &reader, const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    IndexHeader header, expected;
+    InitializeIndexHeader(expected, reader.Header());
+    bool ok = read(fd, &header, sizeof(header)) == sizeof(header) && memcmp(&header, &expected, sizeof(header)) == 0;
+    if (ok) {
+        off_t size = lseek(fd, 0, SEEK_END);
+        size_t n = size > (off_t) sizeof(header) ? (size - sizeof(header)) / sizeof(IndexEntry) : 0;
+        n = std::min(n, reader.Blocks());
+        entries.resize(n);
+        ok = pread(fd, entries.data(), n * sizeof(IndexEntry), sizeof(header)) == (ssize_t) (n * sizeof(IndexEntry));
+    }
+    close(fd);
+
+    // The last entry must still describe its block, or the log was rewritten
+    if (ok && !entries.empty()) {
+        size_t last = entries.size() - 1;
+        ok = entries[last].crc == reader.Block(last).crc;
+    }
+    return ok;
+}
+
+bool Index::Save(const Reader &reader, const std::string &path) const
+{
+    // Written aside and renamed, so a reader never sees half an index. A log in a directory that
+    // cannot be written to is simply indexed again next time.
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    IndexHeader header;
+    InitializeIndexHeader(header, reader.Header());
+    size_t size = entries.size() * sizeof(IndexEntry);
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header) && write(fd, entries.data(), size) == (ssize_t) size;
+    close(fd);
+    if (!ok || rename(temporary.c_str(), path.c_str()) < 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+size_t Index::FindTime(int64_t host_ns) const
+{
+    return std::lower_bound(latest.begin(), latest.end(), host_ns) - latest.begin();
+}
+
+size_t Index::FindSample(int stream, uint64_t n) const
+{
+    if (stream < 0 || stream >= INDEXED_STREAMS) {
+        return entries.size();
+    }
+    auto after = std::upper_bound(entries.begin(), entries.end(), n, [stream](uint64_t n, const IndexEntry &entry) {
+        return n < entry.samples[stream];
+    });
+    return after - entries.begin();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Store
+//--------------------------------------------------------------------------------------------------
+bool Store::Open(const char *path)
+{
+    Close();
+    if (!reader.Open(path)) {
+        return false;
+    }
+    index.Open(reader, path);
+    return true;
+}
+
+void Store::Close()
+{
+    reader.Close();
+}
+
+bool Store::SeekSample(int stream, uint64_t n, RecordView &view) const
+{
+    size_t b = index.FindSample(stream, n);
+    if (b >= index.Entries()) {
+        return false;
+    }
+    uint64_t sample = index.SamplesBefore(b, stream);
+    bool found = false;
+    reader.ForEachRecordInBlock(b, [&](const RecordHeader &record, const uint8_t *payload) {
+        if (found || record.stream != stream) {
+            return;
+        }
+        uint32_t samples = RecordSamples(record, payload);
+        if (n < sample + samples) {
+            view = RecordView{&record, payload, sample, (uint32_t) (n - sample)};
+            found = true;
+        }
+        sample += samples;
+    });
+    return found;
+}
+
+}
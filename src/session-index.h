@@ -0,0 +1,203 @@
+#ifndef _SESSION_INDEX_H
+#define _SESSION_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "session-log.h"
+
+//--------------------------------------------------------------------------------------------------
+// Session log index
+//
+// A sidecar file <log>.idx holds one IndexEntry per block of the log: the earliest and latest host
+// times in the block and, for every stream, the number of samples up to the end of the block. A
+// sample is one notification, so a RAW_PACKED record counts as the notifications in its chunk,
+// and covers the time from its first notification to its last.
+// Finding a time or a sample number is then a binary search over the entries followed by a walk
+// of one block, without touching the rest of the log.
+//
+//  IndexHeader     64 bytes, identifying the log it belongs to
+//  IndexEntry      for block 0
+//  IndexEntry      for block 1
+//  ...
+//
+// The writer thread appends an entry after each block it writes. A missing, stale or short index
+// (a log from before indexes, or a crash) is completed from the log itself when it is opened.
+//--------------------------------------------------------------------------------------------------
+namespace SessionLog
+{
+    constexpr char INDEX_MAGIC[8] = {'I', 'C', '2', 'S', 'I', 'D', 'X', 0};
+    constexpr uint16_t INDEX_VERSION = 2;      // 2: times include the whole of RAW_PACKED chunks
+    constexpr int INDEXED_STREAMS = 8;          // Stream numbers below this are counted
+
+    struct IndexHeader {
+        char magic[8];
+        uint16_t version;
+        uint16_t entry_size;
+        uint32_t block_size;
+        int64_t created_realtime_ns;            // From the log file header
+        int64_t created_monotonic_ns;
+        uint32_t log_crc;                       // CRC of the log file header
+        uint32_t crc;                           // Of this header up to here, with crc zero
+        uint8_t reserved[24];
+    };
+    static_assert(sizeof(IndexHeader) == 64, "Index header layout");
+
+    struct IndexEntry {
+        int64_t first_host_ns;                  // Earliest record in the block
+        int64_t last_host_ns;                   // Latest record in the block
+        uint32_t records;                       // Zero for an empty or bad block
+        uint32_t crc;                           // Copy of the block CRC
+        uint64_t samples[INDEXED_STREAMS];      // Samples of each stream to the end of the block
+    };
+    static_assert(sizeof(IndexEntry) == 88, "Index entry layout");
+
+    std::string IndexPath(const std::string &logPath);
+    void InitializeIndexHeader(IndexHeader &header, const FileHeader &log);
+
+    // Samples in one record, one apart from RAW_PACKED chunks
+    uint32_t RecordSamples(const RecordHeader &record, const uint8_t *payload);
+    // Host time of the last sample in a record
+    int64_t RecordLastHost(const RecordHeader &record, const uint8_t *payload);
+    // True if a sample of the record has from <= host_ns < to. first is set to the first such
+    // sample within the record.
+    bool RecordInRange(const RecordHeader &record, const uint8_t *payload, int64_t from, int64_t to, uint32_t &first);
+
+    // Entry for a block that has been checked, following previous or the start of the file. A
+    // block that is not good gets an entry with no records.
+    void IndexBlock(const BlockHeader &block, bool good, const IndexEntry *previous, IndexEntry &entry);
+
+    //----------------------------------------------------------------------------------------------
+    // Index of an open log
+    //----------------------------------------------------------------------------------------------
+    class Index
+    {
+    public:
+        // Loads the sidecar of the log if it belongs to it, indexes the blocks it is missing and
+        // saves it again if that added anything. False only if the log has no blocks.
+        bool Open(const Reader &reader, const std::string &logPath);
+
+        size_t Entries() const
+        {
+            return entries.size();
+        }
+        const IndexEntry &Entry(size_t i) const
+        {
+            return entries[i];
+        }
+        uint64_t SamplesBefore(size_t block, int stream) const
+        {
+            return block ? entries[block - 1].samples[stream] : 0;
+        }
+        uint64_t Samples(int stream) const
+        {
+            return entries.empty() ? 0 : entries.back().samples[stream];
+        }
+        int64_t FirstTime() const
+        {
+            return entries.empty() ? 0 : earliest.front();
+        }
+        int64_t LastTime() const
+        {
+            return entries.empty() ? 0 : latest.back();
+        }
+
+        // First block that can hold a record at or after host_ns, Entries() if none
+        size_t FindTime(int64_t host_ns) const;
+        // True if no block from this one on holds a record before host_ns
+        bool AllAfter(size_t block, int64_t host_ns) const
+        {
+            return earliest[block] >= host_ns;
+        }
+        // Block holding sample n of the stream, Entries() if there is no such sample
+        size_t FindSample(int stream, uint64_t n) const;
+
+    private:
+        bool Load(const Reader &reader, const std::string &path);
+        bool Save(const Reader &reader, const std::string &path) const;
+
+        std::vector<IndexEntry> entries;
+        std::vector<int64_t> latest;            // Latest host time up to each block
+        std::vector<int64_t> earliest;          // Earliest host time from each block on
+    };
+
+    //----------------------------------------------------------------------------------------------
+    // Indexed session store
+    //
+    // A log and its index. Records are handed out as views into the mapped log, valid until the
+    // store is closed.
+    //----------------------------------------------------------------------------------------------
+    struct RecordView {
+        const RecordHeader *header;
+        const uint8_t *payload;
+        uint64_t sample;                        // Number of the first sample of the record
+        uint32_t offset;                        // Sample within the record that was asked for
+    };
+
+    class Store
+    {
+    public:
+        bool Open(const char *path);
+        void Close();
+
+        const SessionLog::Reader &Reader() const
+        {
+            return reader;
+        }
+        const SessionLog::Index &Index() const
+        {
+            return index;
+        }
+
+        // Calls callback(const RecordView &) for the records of stream, or of every stream if
+        // stream is zero, with a sample from <= host_ns < to. A RAW_PACKED chunk that overlaps
+        // the range is included, with the offset of its first notification in the range. Returns
+        // the number of records.
+        template <class Callback> size_t ForEachInRange(int64_t from, int64_t to, int stream, Callback &&callback) const
+        {
+            size_t count = 0;
+            for (size_t b = index.FindTime(from); b < index.Entries() && !index.AllAfter(b, to); b++) {
+                const IndexEntry &entry = index.Entry(b);
+                if (entry.records == 0 || entry.last_host_ns < from || entry.first_host_ns >= to) {
+                    continue;
+                }
+                uint64_t sample[INDEXED_STREAMS];
+                for (int s = 0; s < INDEXED_STREAMS; s++) {
+                    sample[s] = index.SamplesBefore(b, s);
+                }
+                reader.ForEachRecordInBlock(b, [&](const RecordHeader &record, const uint8_t *payload) {
+                    uint64_t first = 0;
+                    if (record.stream < INDEXED_STREAMS) {
+                        first = sample[record.stream];
+                        sample[record.stream] += RecordSamples(record, payload);
+                    }
+                    uint32_t offset;
+                    if ((stream == 0 || record.stream == stream) && RecordInRange(record, payload, from, to, offset)) {
+                        callback(RecordView{&record, payload, first, offset});
+                        count++;
+                    }
+                });
+            }
+            return count;
+        }
+
+        // Views of the records in a range, appended to views
+        size_t Range(int64_t from, int64_t to, int stream, std::vector<RecordView> &views) const
+        {
+            return ForEachInRange(from, to, stream, [&](const RecordView &view) {
+                views.push_back(view);
+            });
+        }
+
+        // The record holding sample n of the stream, with the offset of the sample in it
+        bool SeekSample(int stream, uint64_t n, RecordView &view) const;
+
+    private:
+        SessionLog::Reader reader;
+        SessionLog::Index index;
+    };
+}
+
+#endif /* _SESSION_INDEX_H */
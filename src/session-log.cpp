@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "session-log.h"
+
+namespace SessionLog
+{
+
+//--------------------------------------------------------------------------------------------------
+// CRC-32 (IEEE 802.3, reflected), as used by zlib
+//--------------------------------------------------------------------------------------------------
+static struct Crc32Table {
+    uint32_t entry[256];
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            entry[i] = c;
+        }
+    }
+} crc32Table;
+
+uint32_t Crc32(const void *data, size_t length, uint32_t crc)
+{
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    while (length--) {
+        crc = crc32Table.entry[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Device clock
+//--------------------------------------------------------------------------------------------------
+DeviceClock::DeviceClock(double ticksPerSecond, int bits, double driftPerSecond) :
+    nsPerTick(1.0e9 / ticksPerSecond), mask(bits >= 32 ? 0xffffffff : (1u << bits) - 1), drift(driftPerSecond)
+{
+}
+
+void DeviceClock::Reset()
+{
+    started = false;
+    ticks = 0;
+}
+
+int64_t DeviceClock::Correct(int64_t host_ns, uint32_t counter)
+{
+    counter &= mask;
+    if (!started) {
+        started = true;
+        lastCounter = counter;
+        ticks = counter;
+        offset = host_ns - ticks * nsPerTick;
+        lastHost = host_ns;
+        return host_ns;
+    }
+
+    // The counter says nothing about how many times it wrapped while no notification arrived, so
+    // that is taken from the host clock: the event happened no later than the device time now,
+    // less a margin for the delay of the packet that set the offset. An unchanged counter is the
+    // same event reported again, however long ago it was.
+    if (counter != lastCounter) {
+        int64_t wrap = (int64_t) mask + 1;
+        int64_t next = ticks + ((counter - lastCounter) & mask);
+        int64_t now = (int64_t) ((host_ns - offset) / nsPerTick) + wrap / 8;
+        if (now > next) {
+            next += (now - next) / wrap * wrap;
+        }
+        ticks = next;
+        lastCounter = counter;
+    }
+
+    // Let the offset rise slowly, so a drifting device clock does not leave it behind, but take
+    // every lower sample at once: that packet was delayed less.
+    offset += (host_ns - lastHost) * drift;
+    lastHost = host_ns;
+    double sample = host_ns - ticks * nsPerTick;
+    if (sample < offset) {
+        offset = sample;
+    }
+    return (int64_t) llround(ticks * nsPerTick + offset);
+}
+
+//--------------------------------------------------------------------------------------------------
+// File header
+//--------------------------------------------------------------------------------------------------
+void InitializeHeader(FileHeader &header, const Identity &identity)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.header_size = HEADER_SIZE;
+    header.block_size = BLOCK_SIZE;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.created_realtime_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    header.created_monotonic_ns = MonotonicNanoseconds();
+    static_assert(sizeof(header.address) == sizeof(identity.address), "Identity layout");
+    static_assert(sizeof(header.firmware) == sizeof(identity.firmware), "Identity layout");
+    static_assert(sizeof(header.serial) == sizeof(identity.serial), "Identity layout");
+    memcpy(header.address, identity.address, sizeof(header.address) - 1);
+    memcpy(header.firmware, identity.firmware, sizeof(header.firmware) - 1);
+    memcpy(header.serial, identity.serial, sizeof(header.serial) - 1);
+    header.calibration = identity.calibration;
+    header.crc = Crc32(&header, offsetof(FileHeader, crc));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Reader
+//--------------------------------------------------------------------------------------------------
+Reader::~Reader()
+{
+    Close();
+}
+
+bool Reader::Open(const char *path)
+{
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) HEADER_SIZE) {
+        fprintf(stderr, "%s: not a session log\n", path);
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    map = (const uint8_t *) p;
+    size = st.st_size;
+    madvise((void *) map, size, MADV_SEQUENTIAL);
+
+    const FileHeader &header = Header();
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.version != VERSION ||
+        header.header_size != HEADER_SIZE || header.block_size != BLOCK_SIZE ||
+        header.crc != Crc32(&header, offsetof(FileHeader, crc))) {
+        fprintf(stderr, "%s: not a session log\n", path);
+        Close();
+        return false;
+    }
+    blocks = (size - HEADER_SIZE) / BLOCK_SIZE;
+    return true;
+}
+
+void Reader::Close()
+{
+    if (map) {
+        munmap((void *) map, size);
+    }
+    map = nullptr;
+    size = 0;
+    blocks = 0;
+}
+
+bool Reader::VerifyBlock(size_t i) const
+{
+    const BlockHeader &header = Block(i);
+    return header.magic == BLOCK_MAGIC && header.sequence == i &&
+           header.used <= BLOCK_SIZE - sizeof(BlockHeader) &&
+           header.crc == Crc32((const uint8_t *) &header + sizeof(BlockHeader), header.used);
+}
+
+}
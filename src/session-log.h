@@ -0,0 +1,225 @@
+#ifndef _SESSION_LOG_H
+#define _SESSION_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+//--------------------------------------------------------------------------------------------------
+// Session log format
+//
+//  File header     HEADER_SIZE bytes: identity, firmware, calibration snapshot, CRC
+//  Block 0         BLOCK_SIZE bytes at offset HEADER_SIZE
+//  Block 1         BLOCK_SIZE bytes at offset HEADER_SIZE + BLOCK_SIZE
+//  ...
+//
+// Every block starts with a BlockHeader and is followed by records. Each record is a RecordHeader,
+// then the notification payload exactly as received, padded to RECORD_ALIGNMENT. The CRC in a
+// block covers its used bytes after the block header. Any unused space in a block is zero.
+// Headers, blocks and records are all naturally aligned in the file, so a reader can mmap the file
+// and use records and payloads in place.
+//
+// All integers are little-endian. Host times are CLOCK_MONOTONIC nanoseconds. The file header
+// records the CLOCK_REALTIME and CLOCK_MONOTONIC times of its creation so they can be converted to
+// wall clock time.
+//--------------------------------------------------------------------------------------------------
+namespace SessionLog
+{
+    constexpr char MAGIC[8] = {'I', 'C', '2', 'S', 'L', 'O', 'G', 0};
+    constexpr uint16_t VERSION = 1;
+    constexpr uint32_t HEADER_SIZE = 4096;
+    constexpr uint32_t BLOCK_SIZE = 65536;
+    constexpr uint32_t BLOCK_MAGIC = 0x4b4c4230;       // "0BLK"
+    constexpr uint32_t RECORD_ALIGNMENT = 8;
+
+    enum streams {
+        MEASUREMENT = 1,        // Cycling power measurement notification
+        VECTOR,                 // Cycling power vector notification
+        RAW,                    // InfoCrank raw data notification
+        BATTERY,                // Battery level, one byte
+        RAW_PACKED,             // Chunk of InfoCrank raw data notifications, see raw-codec.h
+    };
+
+    enum record_flags {
+        DEVICE_TIME = 0x01,     // device_ns comes from a device event time, not the host clock
+    };
+
+    // Control point values in effect when the log was opened. Each member is valid only if its bit
+    // is set in valid.
+    struct Calibration {
+        enum {
+            STRAIN = 0x01,
+            ACCEL1 = 0x02,
+            ACCEL2 = 0x04,
+            KF = 0x08,
+        };
+        uint32_t valid;
+        float strain[6];        // RequestCalibrationParameters
+        int16_t accel1[12];     // RequestAccel1Transform
+        int16_t accel2[12];     // RequestAccel2Transform
+        float kf[5];            // RequestKFParameters
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint16_t version;
+        uint16_t header_size;
+        uint32_t block_size;
+        int64_t created_realtime_ns;
+        int64_t created_monotonic_ns;
+        char address[24];       // Bluetooth address of the device, NUL terminated
+        char firmware[32];      // Firmware revision string, NUL terminated
+        char serial[32];        // Serial number string, NUL terminated
+        Calibration calibration;
+        uint32_t crc;           // Of the header up to here, with crc zero
+    };
+    static_assert(sizeof(FileHeader) <= HEADER_SIZE, "File header too large");
+
+    struct BlockHeader {
+        uint32_t magic;
+        uint32_t sequence;      // Block number in the file
+        uint32_t records;
+        uint32_t used;          // Bytes of records after the block header
+        int64_t first_host_ns;
+        uint32_t crc;           // Of the used bytes
+        uint32_t reserved;
+    };
+    static_assert(sizeof(BlockHeader) == 32, "Block header layout");
+
+    struct RecordHeader {
+        uint16_t length;        // Payload bytes, without padding
+        uint8_t stream;
+        uint8_t flags;
+        uint32_t reserved;
+        int64_t host_ns;
+        int64_t device_ns;
+    };
+    static_assert(sizeof(RecordHeader) == 24, "Record header layout");
+
+    constexpr uint32_t MAXIMUM_PAYLOAD = BLOCK_SIZE - sizeof(BlockHeader) - sizeof(RecordHeader);
+
+    inline uint32_t Padded(uint32_t length)
+    {
+        return (length + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+    }
+
+    inline int64_t MonotonicNanoseconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    uint32_t Crc32(const void *data, size_t length, uint32_t crc = 0);
+
+    // What the file header says about the device
+    struct Identity {
+        char address[24] = "";
+        char firmware[32] = "";
+        char serial[32] = "";
+        Calibration calibration = {};
+    };
+
+    // Fill in a file header, including its CRC
+    void InitializeHeader(FileHeader &header, const Identity &identity);
+
+    //----------------------------------------------------------------------------------------------
+    // Device clock
+    //
+    // Maps a device event counter (for example the crank event time in 1/1024 s) onto the host
+    // clock. Notifications reach the host after a variable delay, so the offset between the two
+    // clocks is taken as the lower envelope of host time minus device time. It relaxes by at most
+    // driftPerSecond so crystal drift is followed. Wraps during a pause in notifications are
+    // counted from the time that passed on the host.
+    //----------------------------------------------------------------------------------------------
+    class DeviceClock
+    {
+    public:
+        // ticksPerSecond of a counter that wraps at 2^bits
+        DeviceClock(double ticksPerSecond, int bits, double driftPerSecond = 100.0e-6);
+
+        // Host time in nanoseconds of the device event with the given counter value
+        int64_t Correct(int64_t host_ns, uint32_t counter);
+        void Reset();
+
+    private:
+        double nsPerTick;
+        uint32_t mask;
+        double drift;
+        bool started = false;
+        uint32_t lastCounter = 0;
+        int64_t ticks = 0;          // Unwrapped counter
+        double offset = 0.0;        // Host minus device, ns
+        int64_t lastHost = 0;
+    };
+
+    //----------------------------------------------------------------------------------------------
+    // Reader
+    //
+    // Maps the whole file read-only. Records are handed out in place.
+    //----------------------------------------------------------------------------------------------
+    class Reader
+    {
+    public:
+        ~Reader();
+
+        // False if the file cannot be mapped or the header is not a valid session log header
+        bool Open(const char *path);
+        void Close();
+
+        const FileHeader &Header() const
+        {
+            return *(const FileHeader *) map;
+        }
+        size_t Blocks() const
+        {
+            return blocks;
+        }
+        const BlockHeader &Block(size_t i) const
+        {
+            return *(const BlockHeader *) &map[HEADER_SIZE + i * (size_t) BLOCK_SIZE];
+        }
+
+        // True if the block magic, length and CRC are good
+        bool VerifyBlock(size_t i) const;
+
+        // Calls callback(const RecordHeader &, const uint8_t *payload) for every record of every
+        // good block. Returns the number of bad blocks that were skipped.
+        template <class Callback> size_t ForEachRecord(Callback &&callback) const
+        {
+            size_t bad = 0;
+            for (size_t i = 0; i < blocks; i++) {
+                if (!VerifyBlock(i)) {
+                    bad++;
+                    continue;
+                }
+                ForEachRecordInBlock(i, callback);
+            }
+            return bad;
+        }
+
+        // Records of one block, which must have been verified
+        template <class Callback> void ForEachRecordInBlock(size_t i, Callback &&callback) const
+        {
+            const BlockHeader &header = Block(i);
+            const uint8_t *p = (const uint8_t *) &header + sizeof(BlockHeader);
+            const uint8_t *end = p + header.used;
+            for (uint32_t r = 0; r < header.records && p + sizeof(RecordHeader) <= end; r++) {
+                const RecordHeader &record = *(const RecordHeader *) p;
+                const uint8_t *payload = p + sizeof(RecordHeader);
+                if (payload + record.length > end) {
+                    break;
+                }
+                callback(record, payload);
+                p = payload + Padded(record.length);
+            }
+        }
+
+    private:
+        const uint8_t *map = nullptr;
+        size_t size = 0;
+        size_t blocks = 0;
+    };
+}
+
+#endif /* _SESSION_LOG_H */
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <chrono>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "session-writer.h"
+
+namespace SessionLog
+{
+
+static const off_t PREALLOCATE = 16 * 1024 * 1024;
+
+//--------------------------------------------------------------------------------------------------
+// Single producer, single consumer ring
+//--------------------------------------------------------------------------------------------------
+bool Writer::Ring::Push(uint8_t index)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == BUFFERS) {
+        return false;
+    }
+    slot[h % BUFFERS] = index;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+bool Writer::Ring::Pop(uint8_t &index)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    index = slot[t % BUFFERS];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Constructor, destructor and settings
+//--------------------------------------------------------------------------------------------------
+Writer::Writer()
+{
+    static_assert((BUFFERS & (BUFFERS - 1)) == 0, "BUFFERS must be a power of two");
+    for (int i = 0; i < BUFFERS; i++) {
+        buffer[i] = (uint8_t *) aligned_alloc(4096, BLOCK_SIZE);
+    }
+}
+
+Writer::~Writer()
+{
+    Close();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    for (int i = 0; i < BUFFERS; i++) {
+        free(buffer[i]);
+    }
+}
+
+void Writer::SetRotation(uint64_t bytes, int seconds)
+{
+    rotateBytes = bytes;
+    rotateNanoseconds = seconds * 1000000000LL;
+}
+
+void Writer::SetFlushInterval(int milliseconds)
+{
+    flushNanoseconds = milliseconds * 1000000LL;
+}
+
+void Writer::SetSyncInterval(int milliseconds)
+{
+    syncNanoseconds = milliseconds * 1000000LL;
+}
+
+WriterStatistics Writer::Statistics() const
+{
+    WriterStatistics s;
+    s.records = counters.records.load(std::memory_order_relaxed);
+    s.blocks = counters.blocks.load(std::memory_order_relaxed);
+    s.bytes = counters.bytes.load(std::memory_order_relaxed);
+    s.droppedRecords = counters.droppedRecords.load(std::memory_order_relaxed);
+    s.droppedBlocks = counters.droppedBlocks.load(std::memory_order_relaxed);
+    s.writeErrors = counters.writeErrors.load(std::memory_order_relaxed);
+    s.syncs = counters.syncs.load(std::memory_order_relaxed);
+    s.rotations = counters.rotations.load(std::memory_order_relaxed);
+    s.maximumQueued = counters.maximumQueued.load(std::memory_order_relaxed);
+    return s;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open and close, GUI thread
+//--------------------------------------------------------------------------------------------------
+bool Writer::Open(const char *path, const Identity &identity)
+{
+    Close();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    this->path = path;
+    this->identity = identity;
+    fileIndex = 0;
+    if (!OpenFile()) {
+        return false;
+    }
+
+#ifdef HAVE_LIBURING
+    struct io_uring *ring = new struct io_uring;
+    if (io_uring_queue_init(BUFFERS, ring, 0) < 0) {
+        delete ring;
+        ring = nullptr;             // Fall back to pwritev()
+    }
+    uring = ring;
+#endif
+
+    // Every buffer but the first starts out free
+    queued.head = queued.tail = 0;
+    spare.head = spare.tail = 0;
+    for (int i = 1; i < BUFFERS; i++) {
+        spare.Push(i);
+    }
+    std::lock_guard<std::mutex> guard(producer);
+    current = 0;
+    continued = false;
+    Header(current).records = 0;
+    Header(current).used = 0;
+    dirtySince = 0;
+    stopping = false;
+    thread = std::thread(&Writer::Run, this);
+    opened = true;
+    return true;
+}
+
+void Writer::Close()
+{
+    // Only long enough for the data path to see the writer closed
+    int last;
+    {
+        std::lock_guard<std::mutex> guard(producer);
+        if (current < 0) {
+            return;
+        }
+        last = current;
+        current = -1;
+        opened = false;
+    }
+
+    // Nothing else pushes once current is -1, and the ring has room for every buffer
+    if (Header(last).records) {
+        partial[last] = false;
+        queued.Push(last);
+    }
+    stopping = true;
+    wake.notify_one();
+}
+
+void Writer::Flush()
+{
+    std::lock_guard<std::mutex> guard(producer);
+    if (current >= 0) {
+        SubmitPartial();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Data path
+//--------------------------------------------------------------------------------------------------
+bool Writer::Submit()
+{
+    BlockHeader &header = Header(current);
+    if (header.records == 0) {
+        return true;
+    }
+
+    uint8_t next;
+    dirtySince = 0;
+    if (spare.Pop(next)) {
+        partial[current] = false;
+        queued.Push(current);
+        current = next;
+        continued = false;
+        uint32_t depth = queued.Size();
+        if (depth > counters.maximumQueued.load(std::memory_order_relaxed)) {
+            counters.maximumQueued.store(depth, std::memory_order_relaxed);
+        }
+        wake.notify_one();
+    } else if (continued) {
+        // Its first records are already on disk as a partial block, under the sequence number
+        // the next block would take; it is kept whole to be written over that partial later
+        return false;
+    } else {
+        counters.droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        counters.droppedRecords.fetch_add(header.records, std::memory_order_relaxed);
+    }
+    Header(current).records = 0;
+    Header(current).used = 0;
+    return true;
+}
+
+void Writer::SubmitPartial()
+{
+    BlockHeader &header = Header(current);
+    uint8_t next;
+    if (header.records == 0 || !spare.Pop(next)) {
+        return;                     // Tried again when the thread next wakes
+    }
+    memcpy(buffer[next], buffer[current], sizeof(BlockHeader) + header.used);
+    partial[current] = true;
+    queued.Push(current);
+    current = next;
+    continued = true;
+    dirtySince = 0;
+    uint32_t depth = queued.Size();
+    if (depth > counters.maximumQueued.load(std::memory_order_relaxed)) {
+        counters.maximumQueued.store(depth, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+}
+
+bool Writer::Write(uint8_t stream, int64_t host_ns, int64_t device_ns, uint8_t flags, const void *data, size_t length)
+{
+    if (length > MAXIMUM_PAYLOAD) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(producer);
+    if (current < 0) {
+        return false;
+    }
+
+    uint32_t size = sizeof(RecordHeader) + Padded(length);
+    if (sizeof(BlockHeader) + Header(current).used + size > BLOCK_SIZE && !Submit()) {
+        counters.droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    BlockHeader &header = Header(current);
+    if (header.records == 0) {
+        header.first_host_ns = host_ns;
+    }
+    uint8_t *p = buffer[current] + sizeof(BlockHeader) + header.used;
+    RecordHeader *record = (RecordHeader *) p;
+    record->length = length;
+    record->stream = stream;
+    record->flags = flags;
+    record->reserved = 0;
+    record->host_ns = host_ns;
+    record->device_ns = device_ns;
+    memcpy(p + sizeof(RecordHeader), data, length);
+    memset(p + sizeof(RecordHeader) + length, 0, Padded(length) - length);
+    header.used += size;
+    header.records++;
+    if (!dirtySince) {
+        dirtySince = MonotonicNanoseconds();
+    }
+    counters.records.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Writer thread
+//--------------------------------------------------------------------------------------------------
+void Writer::Run()
+{
+    uint8_t batch[BUFFERS];
+    for (;;) {
+        int count = 0;
+        while (count < BUFFERS && queued.Pop(batch[count])) {
+            count++;
+        }
+        if (count) {
+            WriteBlocks(batch, count);
+            for (int i = 0; i < count; i++) {
+                spare.Push(batch[i]);
+            }
+        }
+
+        // Don't let a slow stream sit in memory indefinitely
+        int64_t now = MonotonicNanoseconds();
+        if (flushNanoseconds && !stopping) {
+            std::lock_guard<std::mutex> guard(producer);
+            if (current >= 0 && dirtySince && now - dirtySince >= flushNanoseconds) {
+                SubmitPartial();
+            }
+        }
+
+        if (fd >= 0 && syncNanoseconds && now - lastSync >= syncNanoseconds) {
+            fdatasync(fd);
+            lastSync = now;
+            counters.syncs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (count == 0) {
+            // Close() queues the last block before it sets stopping
+            if (stopping && queued.Size() == 0) {
+                break;
+            }
+            // The producer does not take wakeLock, so a wakeup can be missed. The timeout bounds
+            // that.
+            std::unique_lock<std::mutex> lock(wakeLock);
+            wake.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return queued.Size() || stopping;
+            });
+        }
+    }
+    CloseFile();
+
+#ifdef HAVE_LIBURING
+    if (uring) {
+        io_uring_queue_exit((struct io_uring *) uring);
+        delete (struct io_uring *) uring;
+        uring = nullptr;
+    }
+#endif
+
+    WriterStatistics s = Statistics();
+    if (s.droppedRecords || s.writeErrors) {
+        printf("%s: %llu records dropped, %llu write errors\n", path.c_str(), (unsigned long long) s.droppedRecords, (unsigned long long) s.writeErrors);
+    }
+}
+
+bool Writer::OpenFile()
+{
+    std::string name = fileIndex ? path + "." + std::to_string(fileIndex) : path;
+    fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror(name.c_str());
+        return false;
+    }
+
+    alignas(8) uint8_t header[HEADER_SIZE] = {};
+    InitializeHeader(*(FileHeader *) header, identity);
+    if (pwrite(fd, header, HEADER_SIZE, 0) != HEADER_SIZE) {
+        perror(name.c_str());
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // Reserve space ahead of the writes without changing the file size, so readers never see
+    // unwritten blocks. Not every file system supports it, which only costs some fragmentation.
+    allocated = HEADER_SIZE;
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, PREALLOCATE) == 0) {
+        allocated += PREALLOCATE;
+    }
+
+    // The index is a convenience: without it the log is indexed again when it is read
+    std::string indexName = IndexPath(name);
+    indexFd = open(indexName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (indexFd >= 0) {
+        IndexHeader index;
+        InitializeIndexHeader(index, *(const FileHeader *) header);
+        if (pwrite(indexFd, &index, sizeof(index), 0) != sizeof(index)) {
+            close(indexFd);
+            indexFd = -1;
+        }
+    }
+
+    written = HEADER_SIZE;
+    sequence = 0;
+    partialWritten = false;
+    fileOpened = lastSync = MonotonicNanoseconds();
+    return true;
+}
+
+void Writer::CloseFile()
+{
+    if (fd < 0) {
+        return;
+    }
+    // Give back the preallocated space past the last block
+    if (allocated > written && ftruncate(fd, written) < 0) {
+        perror(path.c_str());
+    }
+    fdatasync(fd);
+    close(fd);
+    fd = -1;
+    if (indexFd >= 0) {
+        close(indexFd);
+        indexFd = -1;
+    }
+}
+
+void Writer::Rotate()
+{
+    CloseFile();
+    fileIndex++;
+    if (OpenFile()) {
+        counters.rotations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Writer::WriteBlocks(const uint8_t *queuedIndices, int queuedCount)
+{
+    // Every block queued after a partial block starts as a copy of it, so only the last partial
+    // block of the batch is worth writing
+    uint8_t indices[BUFFERS];
+    int count = 0;
+    for (int i = 0; i < queuedCount; i++) {
+        if (!partial[queuedIndices[i]] || i == queuedCount - 1) {
+            indices[count++] = queuedIndices[i];
+        }
+    }
+
+    int start = 0;
+    while (start < count) {
+        // A file is not left with a partial block for the next one to complete
+        int64_t now = MonotonicNanoseconds();
+        off_t offset = HEADER_SIZE + (off_t) sequence * BLOCK_SIZE;
+        bool large = rotateBytes && (uint64_t) offset + BLOCK_SIZE > rotateBytes;
+        bool old = rotateNanoseconds && now - fileOpened >= rotateNanoseconds;
+        if (fd >= 0 && sequence && !partialWritten && (large || old)) {
+            Rotate();
+            offset = HEADER_SIZE;
+        }
+        if (fd < 0) {
+            counters.writeErrors.fetch_add(count - start, std::memory_order_relaxed);
+            return;
+        }
+
+        // As many blocks as fit in the current file
+        int n = count - start;
+        if (rotateBytes) {
+            uint64_t room = rotateBytes > (uint64_t) offset ? (rotateBytes - offset) / BLOCK_SIZE : 0;
+            if (room == 0) {
+                room = 1;                   // A file holds at least one block
+            }
+            if ((uint64_t) n > room) {
+                n = room;
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint8_t *block = buffer[indices[start + i]];
+            BlockHeader &header = *(BlockHeader *) block;
+            header.magic = BLOCK_MAGIC;
+            header.sequence = sequence + i;
+            header.crc = Crc32(block + sizeof(BlockHeader), header.used);
+            header.reserved = 0;
+            memset(block + sizeof(BlockHeader) + header.used, 0, BLOCK_SIZE - sizeof(BlockHeader) - header.used);
+        }
+
+        off_t end = offset + (off_t) n * BLOCK_SIZE;
+        if (end > allocated && fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, end - allocated + PREALLOCATE) == 0) {
+            allocated = end + PREALLOCATE;
+        }
+
+        bool good = WriteRun(&indices[start], n, offset);
+        if (good) {
+            counters.blocks.fetch_add(n, std::memory_order_relaxed);
+            counters.bytes.fetch_add((uint64_t) n * BLOCK_SIZE, std::memory_order_relaxed);
+        } else {
+            counters.writeErrors.fetch_add(n, std::memory_order_relaxed);
+        }
+        WriteIndex(&indices[start], n, good);
+        // A failed block leaves a hole that readers skip as a bad block. A partial block is always
+        // the last one, and is written again at the same place.
+        partialWritten = partial[indices[start + n - 1]];
+        sequence += partialWritten ? n - 1 : n;
+        written = std::max(written, end);
+        start += n;
+    }
+}
+
+// Called before sequence moves past the blocks
+void Writer::WriteIndex(const uint8_t *indices, int count, bool good)
+{
+    if (indexFd < 0) {
+        return;
+    }
+    IndexEntry entries[BUFFERS];
+    for (int i = 0; i < count; i++) {
+        const IndexEntry *previous = i ? &entries[i - 1] : sequence ? &lastEntry : nullptr;
+        IndexBlock(Header(indices[i]), good, previous, entries[i]);
+    }
+    // The entry of a partial block is rewritten with the block, so it is not a previous entry
+    int last = partial[indices[count - 1]] ? count - 2 : count - 1;
+    if (last >= 0) {
+        lastEntry = entries[last];
+    }
+    off_t offset = sizeof(IndexHeader) + (off_t) sequence * sizeof(IndexEntry);
+    ssize_t size = count * sizeof(IndexEntry);
+    if (pwrite(indexFd, entries, size, offset) != size) {
+        close(indexFd);             // Left short, so readers complete it from the log
+        indexFd = -1;
+    }
+}
+
+bool Writer::WriteRun(const uint8_t *indices, int count, off_t offset)
+{
+#ifdef HAVE_LIBURING
+    if (uring) {
+        struct io_uring *ring = (struct io_uring *) uring;
+        for (int i = 0; i < count; i++) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+            io_uring_prep_write(sqe, fd, buffer[indices[i]], BLOCK_SIZE, offset + (off_t) i * BLOCK_SIZE);
+        }
+        bool ok = io_uring_submit_and_wait(ring, count) >= 0;
+        for (int i = 0; i < count; i++) {
+            struct io_uring_cqe *cqe;
+            if (io_uring_wait_cqe(ring, &cqe) < 0) {
+                return false;
+            }
+            ok = ok && cqe->res == (int) BLOCK_SIZE;
+            io_uring_cqe_seen(ring, cqe);
+        }
+        return ok;
+    }
+#endif
+
+    struct iovec iov[BUFFERS];
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = buffer[indices[i]];
+        iov[i].iov_len = BLOCK_SIZE;
+    }
+    size_t remaining = (size_t) count * BLOCK_SIZE;
+    int first = 0;
+    while (remaining) {
+        ssize_t n = pwritev(fd, &iov[first], count - first, offset);
+        if (n <= 0) {
+            perror(path.c_str());
+            return false;
+        }
+        remaining -= n;
+        offset += n;
+        // Step over whatever was written, which may end inside a block
+        while (first < count && (size_t) n >= iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count) {
+            iov[first].iov_base = (uint8_t *) iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    return true;
+}
+
+}
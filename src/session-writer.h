@@ -0,0 +1,174 @@
+#ifndef _SESSION_WRITER_H
+#define _SESSION_WRITER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "session-log.h"
+#include "session-index.h"
+
+//--------------------------------------------------------------------------------------------------
+// Asynchronous session log writer
+//
+// The data path only copies records into a block buffer in memory. Full blocks go to a writer
+// thread through a single producer, single consumer ring of buffer indices, and the thread returns
+// the buffers through a second ring once they are written. Neither side ever waits for the other.
+// If the thread falls behind (slow disk, stalled network share) and no buffer is free, the block
+// being filled is dropped and counted, or if part of it is already on disk, the new records are.
+// Logging never blocks the live data. A partly filled block
+// is handed over by the thread itself once it has waited for the flush interval, so a stream that
+// goes quiet is still written. It is written where it belongs and the producer carries on filling
+// a copy of it, so the next flush or the full block rewrites it in place rather than a slow stream
+// costing a whole block per flush.
+//
+// The writer thread fills in block sequence numbers and CRCs. It writes every queued block in one
+// pwritev(), or through io_uring when built with HAVE_LIBURING. Space is preallocated ahead of the
+// writes, the data is fdatasync()ed periodically, and the log can rotate to a new file by size or
+// by age. Rotated files are named <path>.1, <path>.2, ... and each starts with its own header.
+// Every file gets an index sidecar, appended to as its blocks are written.
+//--------------------------------------------------------------------------------------------------
+namespace SessionLog
+{
+    struct WriterStatistics {
+        uint64_t records;           // Records accepted
+        uint64_t blocks;            // Blocks written, partial blocks every time they are written
+        uint64_t bytes;             // Bytes written, headers included
+        uint64_t droppedRecords;    // Records lost because no buffer was free
+        uint64_t droppedBlocks;
+        uint64_t writeErrors;
+        uint64_t syncs;
+        uint64_t rotations;
+        uint32_t maximumQueued;     // Most blocks waiting for the writer thread at once
+    };
+
+    class Writer
+    {
+    public:
+        static const int BUFFERS = 16;              // Blocks in flight, a power of two
+
+        Writer();
+        ~Writer();
+
+        // Rotate when a file reaches bytes or is seconds old, zero for never
+        void SetRotation(uint64_t bytes, int seconds);
+        // Longest time a record waits in a partly filled block
+        void SetFlushInterval(int milliseconds);
+        void SetSyncInterval(int milliseconds);
+
+        // GUI thread. Creates the file and its header before returning.
+        bool Open(const char *path, const Identity &identity);
+        bool IsOpened() const
+        {
+            return opened.load(std::memory_order_relaxed);
+        }
+        // Queues what is left and returns; the thread finishes writing in the background. Open()
+        // and the destructor wait for it.
+        void Close();
+        void Flush();                               // Writes out the partly filled block
+
+        // Data path
+        bool Write(uint8_t stream, int64_t host_ns, int64_t device_ns, uint8_t flags, const void *data, size_t length);
+        bool Write(uint8_t stream, const void *data, size_t length)
+        {
+            int64_t now = MonotonicNanoseconds();
+            return Write(stream, now, now, 0, data, length);
+        }
+
+        WriterStatistics Statistics() const;
+
+    private:
+        // Single producer, single consumer ring of buffer indices
+        struct Ring {
+            std::atomic<uint32_t> head{0};          // Written by the producer
+            std::atomic<uint32_t> tail{0};          // Written by the consumer
+            uint8_t slot[BUFFERS];
+
+            bool Push(uint8_t index);
+            bool Pop(uint8_t &index);
+            uint32_t Size() const
+            {
+                return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+            }
+        };
+
+        BlockHeader &Header(int index)
+        {
+            return *(BlockHeader *) buffer[index];
+        }
+
+        // Producer side, called with the producer lock held. The block is dropped when no buffer
+        // is free to carry on with, unless it continues a partial block already handed over: then
+        // it is kept and Submit() returns false, and the record that did not fit is dropped
+        // instead. A partial block is only handed over when there is a buffer to copy it to, so it
+        // is never dropped.
+        bool Submit();
+        void SubmitPartial();
+
+        // Writer thread
+        void Run();
+        bool OpenFile();
+        void CloseFile();
+        void Rotate();
+        void WriteBlocks(const uint8_t *indices, int count);
+        bool WriteRun(const uint8_t *indices, int count, off_t offset);
+        void WriteIndex(const uint8_t *indices, int count, bool good);
+
+        uint8_t *buffer[BUFFERS];
+        Ring queued;                // Full blocks, producer to writer thread
+        bool partial[BUFFERS];      // Set by the producer before a block is queued
+        Ring spare;                 // Written blocks, writer thread to producer
+
+        // Data path against Open/Close/Flush and the timed flush. Nothing waits while holding it.
+        std::mutex producer;
+        int current = -1;           // Buffer being filled, -1 when closed
+        int64_t dirtySince = 0;     // When the first record went into it, zero if none
+        bool continued = false;     // It is the copy of a partial block already queued
+        std::atomic<bool> opened{false};
+
+        std::thread thread;
+        std::mutex wakeLock;
+        std::condition_variable wake;
+        std::atomic<bool> stopping{false};
+
+        // Writer thread only, apart from Open
+        std::string path;
+        Identity identity;
+        int fd = -1;
+        int indexFd = -1;           // Sidecar, -1 if it could not be created
+        IndexEntry lastEntry;       // Of the last block written to the current file
+        int fileIndex = 0;
+        uint32_t sequence = 0;      // Next block of the current file
+        bool partialWritten = false;    // Block sequence is on disk, but only partly filled
+        off_t allocated = 0;
+        off_t written = 0;          // End of the last block written
+        int64_t fileOpened = 0;
+        int64_t lastSync = 0;
+#ifdef HAVE_LIBURING
+        void *uring = nullptr;
+#endif
+
+        uint64_t rotateBytes = 0;
+        int64_t rotateNanoseconds = 0;
+        int64_t flushNanoseconds = 1000000000LL;
+        int64_t syncNanoseconds = 5000000000LL;
+
+        struct Counters {
+            std::atomic<uint64_t> records{0};
+            std::atomic<uint64_t> blocks{0};
+            std::atomic<uint64_t> bytes{0};
+            std::atomic<uint64_t> droppedRecords{0};
+            std::atomic<uint64_t> droppedBlocks{0};
+            std::atomic<uint64_t> writeErrors{0};
+            std::atomic<uint64_t> syncs{0};
+            std::atomic<uint64_t> rotations{0};
+            std::atomic<uint32_t> maximumQueued{0};
+        } counters;
+    };
+}
+
+#endif /* _SESSION_WRITER_H */
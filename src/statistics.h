@@ -0,0 +1,274 @@
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+#include <stddef.h>
+#include <math.h>
+
+//--------------------------------------------------------------------------------------------------
+// Streaming statistics
+//
+// Mean and variance are accumulated with Welford's update and Kahan compensated sums, not from
+// Σx and Σx², so offset and noise figures hold their precision over multi-hour static captures.
+// Each moment is stored as one array across the channels (struct of arrays), so the per channel
+// loops and the block reductions are contiguous and vectorizable.
+//--------------------------------------------------------------------------------------------------
+
+// s += value, keeping the low order bits lost by the addition in error
+inline void KahanAdd(double &s, double &error, double value)
+{
+    double y = value - error;
+    double t = s + y;
+    error = (t - s) - y;
+    s = t;
+}
+
+template <size_t Channels> struct Moments {
+    double count = 0.0;
+    double mean[Channels] = {};
+    double m2[Channels] = {};           // Sum of squared deviations from the mean
+    double meanError[Channels] = {};
+    double m2Error[Channels] = {};
+
+    void Reset()
+    {
+        *this = Moments();
+    }
+
+    // One sample of every channel
+    void Add(const double *x)
+    {
+        count += 1.0;
+        double inverse = 1.0 / count;
+        for (size_t c = 0; c < Channels; c++) {
+            double delta = x[c] - mean[c];
+            KahanAdd(mean[c], meanError[c], delta * inverse);
+            KahanAdd(m2[c], m2Error[c], delta * (x[c] - mean[c]));
+        }
+    }
+
+    // A block of n samples per channel, channel c starting at values[c * stride]. Every channel is
+    // reduced with a two pass mean and deviation over its contiguous run, using four independent
+    // partial sums so the loops vectorize without reassociating floating point, then merged in.
+    void AddBlock(const double *values, size_t stride, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        Moments block;
+        block.count = n;
+        for (size_t c = 0; c < Channels; c++) {
+            const double *v = &values[c * stride];
+            double partial[4] = {0.0, 0.0, 0.0, 0.0};
+            size_t i = 0;
+            for (; i < n / 4 * 4; i += 4) {
+                for (int lane = 0; lane < 4; lane++) {
+                    partial[lane] += v[i + lane];
+                }
+            }
+            for (size_t tail = i; tail < n; tail++) {
+                partial[0] += v[tail];
+            }
+            double m = ((partial[0] + partial[1]) + (partial[2] + partial[3])) / n;
+
+            double squares[4] = {0.0, 0.0, 0.0, 0.0};
+            for (i = 0; i < n / 4 * 4; i += 4) {
+                for (int lane = 0; lane < 4; lane++) {
+                    double d = v[i + lane] - m;
+                    squares[lane] += d * d;
+                }
+            }
+            for (size_t tail = i; tail < n; tail++) {
+                double d = v[tail] - m;
+                squares[0] += d * d;
+            }
+            block.mean[c] = m;
+            block.m2[c] = (squares[0] + squares[1]) + (squares[2] + squares[3]);
+        }
+        Merge(block);
+    }
+
+    // Combine two sets of moments (Chan, Golub and LeVeque)
+    void Merge(const Moments &other)
+    {
+        if (other.count == 0.0) {
+            return;
+        }
+        if (count == 0.0) {
+            *this = other;
+            return;
+        }
+        double total = count + other.count;
+        double weight = other.count / total;
+        double cross = count * weight;
+        for (size_t c = 0; c < Channels; c++) {
+            double delta = other.mean[c] - mean[c];
+            KahanAdd(mean[c], meanError[c], delta * weight);
+            KahanAdd(m2[c], m2Error[c], other.m2[c] + delta * delta * cross);
+        }
+        count = total;
+    }
+
+    // Population variance, as displayed on the raw data page
+    double Variance(size_t c) const
+    {
+        return count > 0.0 ? m2[c] / count : 0.0;
+    }
+
+    double StandardDeviation(size_t c) const
+    {
+        return sqrt(Variance(c));
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Statistics over the whole capture or over a sliding window of the last N samples or seconds.
+//
+// The window is kept as a ring of Buckets partial moments that are merged on demand, so a window
+// costs a fixed amount of memory, samples never have to be subtracted back out, and the window
+// boundary is exact to within one bucket (1 / (Buckets - 1) of the window).
+//--------------------------------------------------------------------------------------------------
+template <size_t Channels, size_t Buckets = 32> class RunningStatistics
+{
+public:
+    // Zero for both means statistics since the last reset
+    void SetWindow(size_t samples, double seconds)
+    {
+        windowSamples = samples;
+        windowSeconds = samples ? 0.0 : seconds;
+        Reset();
+    }
+
+    void Reset()
+    {
+        total.Reset();
+        for (size_t b = 0; b < Buckets; b++) {
+            bucket[b].Reset();
+            bucketStart[b] = 0.0;
+        }
+        head = 0;
+        last = 0.0;
+    }
+
+    void Add(const double *x, double t)
+    {
+        Rotate(t);
+        total.Add(x);
+        if (Windowed()) {
+            bucket[head].Add(x);
+        }
+    }
+
+    // Block of n samples per channel (see Moments::AddBlock) that arrived at time t
+    void AddBlock(const double *values, size_t stride, size_t n, double t)
+    {
+        last = t;
+        total.AddBlock(values, stride, n);
+        if (windowSamples) {
+            // Split the block at bucket boundaries
+            double size = BucketSamples();
+            size_t offset = 0;
+            while (offset < n) {
+                if (bucket[head].count >= size) {
+                    Advance(t);
+                }
+                size_t room = (size_t) (size - bucket[head].count);
+                size_t take = n - offset;
+                if (take > room) {
+                    take = room;
+                }
+                bucket[head].AddBlock(&values[offset], stride, take);
+                offset += take;
+            }
+        } else if (windowSeconds > 0.0) {
+            Rotate(t);
+            bucket[head].AddBlock(values, stride, n);
+        }
+    }
+
+    Moments<Channels> Summary() const
+    {
+        if (!Windowed()) {
+            return total;
+        }
+        Moments<Channels> window;
+        for (size_t b = 0; b < Buckets; b++) {
+            if (windowSeconds > 0.0 && bucketStart[b] < last - windowSeconds) {
+                continue;
+            }
+            window.Merge(bucket[b]);
+        }
+        return window;
+    }
+
+private:
+    bool Windowed() const
+    {
+        return windowSamples || windowSeconds > 0.0;
+    }
+
+    double BucketSamples() const
+    {
+        double size = ceil((double) windowSamples / (Buckets - 1));
+        return size < 1.0 ? 1.0 : size;
+    }
+
+    void Advance(double t)
+    {
+        head = (head + 1) % Buckets;
+        bucket[head].Reset();
+        bucketStart[head] = t;
+    }
+
+    void Rotate(double t)
+    {
+        last = t;
+        if (windowSamples) {
+            if (bucket[head].count >= BucketSamples()) {
+                Advance(t);
+            }
+        } else if (windowSeconds > 0.0) {
+            if (bucket[head].count == 0.0) {
+                bucketStart[head] = t;
+            } else if (t - bucketStart[head] >= windowSeconds / (Buckets - 1)) {
+                Advance(t);
+            }
+        }
+    }
+
+    Moments<Channels> total;
+    Moments<Channels> bucket[Buckets];
+    double bucketStart[Buckets] = {};
+    size_t head = 0;
+    double last = 0.0;
+    size_t windowSamples = 0;
+    double windowSeconds = 0.0;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Samples collected channel major while a notification is decoded, then drained as one block
+//--------------------------------------------------------------------------------------------------
+template <size_t Channels, size_t Capacity> struct SampleBatch {
+    double values[Channels][Capacity];
+    size_t count = 0;
+
+    bool Full() const
+    {
+        return count == Capacity;
+    }
+
+    void Push(const double *x)
+    {
+        for (size_t c = 0; c < Channels; c++) {
+            values[c][count] = x[c];
+        }
+        count++;
+    }
+
+    template <class Statistics> void Drain(Statistics &statistics, double t)
+    {
+        statistics.AddBlock(&values[0][0], Capacity, count, t);
+        count = 0;
+    }
+};
+
+#endif /* _STATISTICS_H */
@@ -0,0 +1,147 @@
+#include <stdio.h>
+
+#include "subscriptions.h"
+
+const char *const StreamSubscriptions::names[STREAMS] = {"measurement", "vector", "raw"};
+
+//--------------------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------------------
+StreamSubscriptions::StreamSubscriptions(std::function<void(const char *)> send) : send(send), timer(this)
+{
+    Bind(wxEVT_TIMER, &StreamSubscriptions::OnTimer, this);
+}
+
+void StreamSubscriptions::SetAutomatic(bool automatic)
+{
+    this->automatic = automatic;
+    Update();
+}
+
+void StreamSubscriptions::SetHoldTime(int milliseconds)
+{
+    holdTime = milliseconds;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Who needs each stream
+//--------------------------------------------------------------------------------------------------
+void StreamSubscriptions::AddPage(wxWindow *page, int stream)
+{
+    if (pageCount < (int) (sizeof(pages) / sizeof(pages[0]))) {
+        pages[pageCount] = page;
+        pageStreams[pageCount] = stream;
+        pageCount ++;
+    }
+}
+
+void StreamSubscriptions::SetVisiblePage(wxWindow *page)
+{
+    for (int s = 0; s < STREAMS; s ++) {
+        stream[s].visible = false;
+    }
+    for (int i = 0; i < pageCount; i ++) {
+        if (pages[i] == page) {
+            stream[pageStreams[i]].visible = true;
+        }
+    }
+    Update();
+}
+
+void StreamSubscriptions::SetRequested(int s, bool requested)
+{
+    stream[s].requested = requested;
+    Update();
+}
+
+void StreamSubscriptions::SetLogger(int s, bool attached)
+{
+    stream[s].logger = attached;
+    Update();
+}
+
+void StreamSubscriptions::AddConsumer(int s)
+{
+    stream[s].consumers ++;
+    Update();
+}
+
+void StreamSubscriptions::RemoveConsumer(int s)
+{
+    if (stream[s].consumers > 0) {
+        stream[s].consumers --;
+    }
+    Update();
+}
+
+void StreamSubscriptions::Forget()
+{
+    for (int s = 0; s < STREAMS; s ++) {
+        stream[s].subscribed = false;
+        stream[s].unneededSince = 0;
+    }
+    timer.Stop();
+}
+
+bool StreamSubscriptions::Needed(int s) const
+{
+    const Stream &st = stream[s];
+    if (!st.requested) {
+        return false;
+    }
+    return !automatic || st.visible || st.logger || st.consumers > 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start and stop notifications
+//--------------------------------------------------------------------------------------------------
+void StreamSubscriptions::Send(int s, bool on)
+{
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "Notify %s %s\n", names[s], on ? "on" : "off");
+    send(cmd);
+    stream[s].subscribed = on;
+    stream[s].unneededSince = 0;
+}
+
+void StreamSubscriptions::Update()
+{
+    wxLongLong now = wxGetLocalTimeMillis();
+    int wait = -1;
+
+    for (int s = 0; s < STREAMS; s ++) {
+        Stream &st = stream[s];
+        if (Needed(s)) {
+            st.unneededSince = 0;
+            if (!st.subscribed) {
+                Send(s, true);
+            }
+        } else if (st.subscribed) {
+            // A released Notify button stops at once, anything else waits out the hold time
+            if (!st.requested) {
+                Send(s, false);
+                continue;
+            }
+            if (st.unneededSince == 0) {
+                st.unneededSince = now;
+            }
+            int remaining = (st.unneededSince + holdTime - now).ToLong();
+            if (remaining <= 0) {
+                Send(s, false);
+            } else if (wait < 0 || remaining < wait) {
+                wait = remaining;
+            }
+        }
+    }
+
+    if (wait >= 0) {
+        timer.StartOnce(wait);
+    } else {
+        timer.Stop();
+    }
+}
+
+void StreamSubscriptions::OnTimer(wxTimerEvent &evt)
+{
+    Update();
+}
@@ -0,0 +1,80 @@
+#ifndef _SUBSCRIPTIONS_H
+#define _SUBSCRIPTIONS_H
+
+#include <functional>
+
+#include <wx/wx.h>
+#include <wx/timer.h>
+
+//--------------------------------------------------------------------------------------------------
+// Notification subscriptions
+//
+// Decides when the measurement, vector and raw notifications are started and stopped. By default a
+// stream is subscribed while its Notify button is on, as before. In automatic mode the button only
+// says the stream is wanted. It is actually subscribed while one of its pages is visible, its log
+// file is open or an analysis stage has registered as a consumer. Subscribing happens at once.
+// Unsubscribing waits for the hold time, so flicking through the notebook does not start and stop
+// notifications on every page change.
+//
+// GUI thread only.
+//--------------------------------------------------------------------------------------------------
+class StreamSubscriptions : public wxEvtHandler
+{
+public:
+    enum streams {
+        MEASUREMENT,
+        VECTOR,
+        RAW,
+        STREAMS
+    };
+
+    // send is given "Notify <stream> on\n" or "Notify <stream> off\n"
+    explicit StreamSubscriptions(std::function<void(const char *)> send);
+
+    void SetAutomatic(bool automatic);
+    bool IsAutomatic() const
+    {
+        return automatic;
+    }
+    void SetHoldTime(int milliseconds);
+
+    // A page that shows this stream. Several pages may show the same stream.
+    void AddPage(wxWindow *page, int stream);
+    void SetVisiblePage(wxWindow *page);
+
+    void SetRequested(int stream, bool requested);      // The Notify button
+    void SetLogger(int stream, bool attached);
+    void AddConsumer(int stream);
+    void RemoveConsumer(int stream);
+
+    // The device went away, so nothing is subscribed any more
+    void Forget();
+
+private:
+    bool Needed(int stream) const;
+    void Update();
+    void Send(int stream, bool on);
+    void OnTimer(wxTimerEvent &evt);
+
+    struct Stream {
+        bool requested = false;
+        bool visible = false;
+        bool logger = false;
+        int consumers = 0;
+        bool subscribed = false;
+        wxLongLong unneededSince = 0;       // Zero while needed
+    };
+
+    static const char *const names[STREAMS];
+
+    std::function<void(const char *)> send;
+    Stream stream[STREAMS];
+    wxWindow *pages[16] = {};
+    int pageStreams[16] = {};
+    int pageCount = 0;
+    bool automatic = false;
+    int holdTime = 5000;
+    wxTimer timer;
+};
+
+#endif /* _SUBSCRIPTIONS_H */
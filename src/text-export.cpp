@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "text-export.h"
+
+// Longest field: a sign, 17 significant digits, a point, an exponent and the separator
+static const int FIELD_SIZE = 32;
+
+//--------------------------------------------------------------------------------------------------
+// The latest value of a channel, following the rows forward in time
+//--------------------------------------------------------------------------------------------------
+struct HeldChannel {
+    int channel = 0;
+    double scale = 1.0;
+    uint32_t chunk = 0;
+    size_t next = 0;
+    bool has = false;
+    int64_t value = 0;
+    std::vector<int64_t> times;
+    std::vector<int64_t> values;
+
+    void Load(const ColumnFile::Reader &reader, uint32_t c)
+    {
+        chunk = c;
+        next = 0;
+        times.clear();
+        values.clear();
+        reader.DecodeChunk(reader.Chunk(channel, c), times, values);
+    }
+
+    // To the last chunk that starts at or before host_ns, with no value yet
+    void Seek(const ColumnFile::Reader &reader, int64_t host_ns)
+    {
+        const ColumnFile::ChannelInfo &info = reader.Channel(channel);
+        uint32_t low = 0;
+        uint32_t high = info.chunks;
+        while (low < high) {
+            uint32_t middle = (low + high) / 2;
+            if (reader.Chunk(channel, middle).first_ns <= host_ns) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        has = false;
+        times.clear();
+        values.clear();
+        next = 0;
+        chunk = 0;
+        if (low > 0) {
+            Load(reader, low - 1);
+        }
+    }
+
+    void Advance(const ColumnFile::Reader &reader, int64_t host_ns)
+    {
+        const ColumnFile::ChannelInfo &info = reader.Channel(channel);
+        for (;;) {
+            while (next < times.size() && times[next] <= host_ns) {
+                value = values[next++];
+                has = true;
+            }
+            if (next < times.size() || chunk + 1 >= info.chunks || reader.Chunk(channel, chunk + 1).first_ns > host_ns) {
+                return;
+            }
+            Load(reader, chunk + 1);
+        }
+    }
+};
+
+//--------------------------------------------------------------------------------------------------
+// Formatting
+//--------------------------------------------------------------------------------------------------
+static inline char *PutTime(char *p, int64_t ns)
+{
+    if (ns < 0) {
+        *p++ = '-';
+        ns = -ns;
+    }
+    p = std::to_chars(p, p + 20, ns / 1000000000).ptr;
+    *p++ = '.';
+    int64_t fraction = ns % 1000000000;
+    for (int i = 8; i >= 0; i--) {
+        p[i] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    return p + 9;
+}
+
+static inline char *PutValue(char *p, int64_t counts, double scale)
+{
+    // Counts that are already in the unit need no floating point
+    if (scale == 1.0) {
+        return std::to_chars(p, p + FIELD_SIZE, counts).ptr;
+    }
+    return std::to_chars(p, p + FIELD_SIZE, counts * scale).ptr;
+}
+
+struct Task {
+    uint32_t chunk;                         // Of the row channel
+    uint64_t firstRow;                      // Before decimation
+};
+
+// Formats the rows of one chunk of the row channel into out
+static void FormatChunk(const ColumnFile::Reader &reader, const TextExportOptions &options, int rowChannel,
+                        const std::vector<int> &columns, const Task &task, std::vector<HeldChannel> &held,
+                        std::vector<int64_t> &times, std::vector<int64_t> &values, std::vector<char> &out,
+                        uint64_t &rows)
+{
+    const ColumnFile::ChunkInfo &chunk = reader.Chunk(rowChannel, task.chunk);
+    times.clear();
+    values.clear();
+    out.clear();
+    rows = 0;
+    if (!reader.DecodeChunk(chunk, times, values)) {
+        fprintf(stderr, "Column file: damaged chunk %u of %s skipped\n", task.chunk, reader.Channel(rowChannel).name);
+        return;
+    }
+    for (HeldChannel &h : held) {
+        h.Seek(reader, times.empty() ? chunk.first_ns : times[0]);
+    }
+
+    int64_t origin = reader.Header().created_monotonic_ns;
+    double rowScale = reader.Channel(rowChannel).scale;
+    size_t rowSize = (columns.size() + 1) * FIELD_SIZE;
+    out.resize((times.size() / options.decimation + 1) * rowSize);
+    char *p = out.data();
+    for (size_t i = 0; i < times.size(); i++) {
+        if ((task.firstRow + i) % options.decimation != 0) {
+            continue;
+        }
+        p = PutTime(p, times[i] - origin);
+        size_t h = 0;
+        for (int channel : columns) {
+            *p++ = options.separator;
+            if (channel == rowChannel) {
+                p = PutValue(p, values[i], rowScale);
+                continue;
+            }
+            HeldChannel &hc = held[h++];
+            hc.Advance(reader, times[i]);
+            if (hc.has) {
+                p = PutValue(p, hc.value, hc.scale);
+            }
+        }
+        *p++ = '\n';
+        rows++;
+    }
+    out.resize(p - out.data());
+}
+
+static bool WriteAll(int fd, const char *data, size_t length)
+{
+    while (length) {
+        ssize_t n = write(fd, data, length);
+        if (n <= 0) {
+            perror("Text export");
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Export
+//--------------------------------------------------------------------------------------------------
+long long ExportText(const ColumnFile::Reader &reader, const TextExportOptions &options, int fd)
+{
+    std::vector<int> columns = options.channels;
+    if (columns.empty()) {
+        for (int c = 0; c < reader.Channels(); c++) {
+            if (reader.Channel(c).samples) {
+                columns.push_back(c);
+            }
+        }
+    }
+    if (columns.empty()) {
+        return 0;
+    }
+    int rowChannel = columns[0];
+    for (int c : columns) {
+        if (reader.Channel(c).samples > reader.Channel(rowChannel).samples) {
+            rowChannel = c;
+        }
+    }
+
+    std::string header = "time";
+    for (int c : columns) {
+        header += options.separator;
+        header += reader.Channel(c).name;
+        if (reader.Channel(c).unit[0]) {
+            header += std::string(" (") + reader.Channel(c).unit + ")";
+        }
+    }
+    header += '\n';
+    if (!WriteAll(fd, header.data(), header.size())) {
+        return -1;
+    }
+
+    std::vector<Task> tasks;
+    uint64_t row = 0;
+    for (uint32_t k = 0; k < reader.Channel(rowChannel).chunks; k++) {
+        tasks.push_back(Task{k, row});
+        row += reader.Chunk(rowChannel, k).samples;
+    }
+
+    // A window of buffers: a task is formatted into slot task % window, and no further ahead of
+    // the writer than the window, so memory stays bounded however long the session
+    int threads = std::max(1, std::min(options.threads, (int) tasks.size()));
+    size_t window = 2 * threads;
+    struct Slot {
+        std::vector<char> text;
+        uint64_t rows = 0;
+        bool ready = false;
+    };
+    std::vector<Slot> slots(window);
+    std::mutex lock;
+    std::condition_variable changed;
+    size_t next = 0;
+    size_t written = 0;
+    bool failed = false;
+
+    auto work = [&] {
+        std::vector<HeldChannel> held;
+        for (int c : columns) {
+            if (c != rowChannel) {
+                held.emplace_back();
+                held.back().channel = c;
+                held.back().scale = reader.Channel(c).scale;
+            }
+        }
+        std::vector<int64_t> times;
+        std::vector<int64_t> values;
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;) {
+            changed.wait(guard, [&] {
+                return failed || next >= tasks.size() || next < written + window;
+            });
+            if (failed || next >= tasks.size()) {
+                return;
+            }
+            size_t t = next++;
+            Slot &slot = slots[t % window];
+            guard.unlock();
+            FormatChunk(reader, options, rowChannel, columns, tasks[t], held, times, values, slot.text, slot.rows);
+            guard.lock();
+            slot.ready = true;
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back(work);
+    }
+
+    // Stitched in order on this thread
+    long long rows = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (written < tasks.size() && !failed) {
+        Slot &slot = slots[written % window];
+        changed.wait(guard, [&] {
+            return slot.ready;
+        });
+        guard.unlock();
+        bool ok = WriteAll(fd, slot.text.data(), slot.text.size());
+        rows += slot.rows;
+        guard.lock();
+        slot.ready = false;
+        failed = !ok;
+        written++;
+        changed.notify_all();
+    }
+    guard.unlock();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    return failed ? -1 : rows;
+}
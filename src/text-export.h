@@ -0,0 +1,30 @@
+#ifndef _TEXT_EXPORT_H
+#define _TEXT_EXPORT_H
+
+#include <vector>
+
+#include "column-file.h"
+
+//--------------------------------------------------------------------------------------------------
+// Text export of column files
+//
+// Writes chosen channels of a column file as CSV or TSV, a row per sample of the chosen channel
+// with the most samples. The other channels give the latest value they had at the time of the
+// row, or nothing before their first sample. The first column is the time in seconds since the
+// session was created.
+//
+// Rows are formatted by chunks of that channel on several threads, each into a buffer of its own,
+// and the buffers are written out in order, so the output is the same whatever the threads.
+// Numbers are formatted with std::to_chars, the shortest text that reads back as the same value.
+//--------------------------------------------------------------------------------------------------
+struct TextExportOptions {
+    char separator = ',';
+    std::vector<int> channels;              // Empty for every channel with samples
+    int decimation = 1;                     // Every nth row
+    int threads = 1;
+};
+
+// Returns the number of rows written, -1 if writing failed
+long long ExportText(const ColumnFile::Reader &reader, const TextExportOptions &options, int fd);
+
+#endif /* _TEXT_EXPORT_H */
@@ -13,6 +13,7 @@
 #include "/home/anna/Downloads/new_folder/bluez-5.66/gdbus/gdbus.h" //gdbus/gdbus.h
 
 #include "uuid.h"
+#include "control-point.h"
 #include "thread.h"
 
 //--------------------------------------------------------------------------------------------------
@@ -1007,41 +1008,29 @@ void IC2Thread::disconnect(const char *address)
 
 
 //--------------------------------------------------------------------------------------------------
-// Helper function for concatenating commands for control point write
+// Control point - write
 //--------------------------------------------------------------------------------------------------
-int IC2Thread::concat(uint8_t *cmd)
+void IC2Thread::write_proxy(GDBusProxy *proxy, uint8_t *cmd, int len)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
-    return 0;
-}
-
-template <class T, class... Rest> int IC2Thread::concat(uint8_t *cmd, T arg1, Rest...args)
-{
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
-    memcpy(cmd, &arg1, sizeof(T));
-    return sizeof(T) + concat(&cmd[sizeof(T)], args...);
-}
-
-template <class... Rest> int IC2Thread::concat(uint8_t *cmd, const char *arg1, Rest...args)
-{
-    printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
-    memcpy(cmd, arg1, strlen(arg1));
-    return strlen(arg1) + concat(&cmd[strlen(arg1)], args...);
+    struct write_attribute_data write_attribute_data = { .len = len, .data = cmd};
+    g_dbus_proxy_method_call(proxy, "StartNotify", NULL, notify_reply, NULL, NULL);
+    g_dbus_proxy_method_call(proxy, "WriteValue", write_setup, write_reply, &write_attribute_data, NULL);
 }
 
-
 //--------------------------------------------------------------------------------------------------
-// Cycling power control point - write
+// Control point - parse the operands of a user interface command and write the op code
 //--------------------------------------------------------------------------------------------------
-template <class ...T> void IC2Thread::write_proxy(GDBusProxy *proxy, uint8_t op_code, T ...args)
+template <class Op> void IC2Thread::write_command(GDBusProxy *proxy, const char *operands)
 {
     printf("\n%d %s %s\n", __LINE__, __FUNCTION__, __FILE__);
-    uint8_t cmd[32] = {op_code};
-    int len = 1;
-    len += concat(&cmd[1], args...);
-    struct write_attribute_data write_attribute_data = { .len = len, .data = cmd};
-    g_dbus_proxy_method_call(proxy, "StartNotify", NULL, notify_reply, NULL, NULL);
-    g_dbus_proxy_method_call(proxy, "WriteValue", write_setup, write_reply, &write_attribute_data, NULL);
+    typename Op::Request::Values values{};
+    if (!Op::Request::Parse(operands, values)) {
+        printf("Invalid operands for op code 0x%02x: %s\n", Op::op_code, operands);
+        return;
+    }
+    typename Op::Buffer cmd;
+    write_proxy(proxy, cmd.data(), Op::Encode(cmd, values));
 }
 
 
@@ -1065,6 +1054,18 @@ gboolean IC2Thread::command_dispatcher(GIOChannel *channel, GIOCondition cond, g
 
     printf("Command received: %lu %s\n", length, command);
 
+    // Control point op codes, by the text commands in their tables (control-point.h)
+    if (ControlPoint::CyclingPower::Commands::Dispatch(command, [thread](auto op, const char *operands) {
+            thread->write_command<decltype(op)>(thread->proxies.cycling_power.cycling_power_control_point, operands);
+        })) {
+        return TRUE;
+    }
+    if (ControlPoint::InfoCrank::Commands::Dispatch(command, [thread](auto op, const char *operands) {
+            thread->write_command<decltype(op)>(thread->proxies.custom.control_point, operands);
+        })) {
+        return TRUE;
+    }
+
     if (!strcmp(command, "Quit")) {
         thread->quit = true;
         thread->disconnect();
@@ -1103,105 +1104,10 @@ gboolean IC2Thread::command_dispatcher(GIOChannel *channel, GIOCondition cond, g
         g_dbus_proxy_method_call(thread->proxies.cycling_power.cycling_power_measurement_broadcast, "WriteValue", write_setup, write_reply, &write_attribute_data, NULL);
     } else if (!strncmp(command, "Get sensor location", 19)) {
         g_dbus_proxy_method_call(thread->proxies.cycling_power.sensor_location, "ReadValue", read_setup, read_sensor_location, thread->m_frame, NULL);
-    } else if (!strncmp(command, "Set cumulative value", 20)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x01, (uint32_t) atoi(&command[21]));
-    } else if (!strncmp(command, "Set sensor location", 19)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x02, (uint8_t) atoi(&command[20]));
-    } else if (!strncmp(command, "Get supported sensor locations", 30)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x03);
-    } else if (!strncmp(command, "Set crank length", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x04, (uint16_t) lround(atof(&command[17]) * 2.0));
-    } else if (!strncmp(command, "Get crank length", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x05);
-    } else if (!strncmp(command, "Set chain length", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x06, (uint16_t) atoi(&command[17]));
-    } else if (!strncmp(command, "Get chain length", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x07);
-    } else if (!strncmp(command, "Set chain weight", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x08, (uint16_t) atoi(&command[17]));
-    } else if (!strncmp(command, "Get chain weight", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x09);
-    } else if (!strncmp(command, "Set span", 8)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0a, (uint16_t) atoi(&command[9]));
-    } else if (!strncmp(command, "Get span", 8)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0b);
-    } else if (!strncmp(command, "Start offset compensation", 25)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0c);
-    } else if (!strncmp(command, "Mask measurement", 16)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0d, (uint16_t) atoi(&command[17]));
-    } else if (!strncmp(command, "Get sampling rate", 17)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0e);
-    } else if (!strncmp(command, "Get factory calibration date", 28)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x0f);
-    } else if (!strncmp(command, "Start enhanced offset compensation", 34)) {
-        thread->write_proxy(thread->proxies.cycling_power.cycling_power_control_point, 0x10);
     } else if (!strncmp(command, "Notify vector on", 16)) {
         g_dbus_proxy_method_call(thread->proxies.cycling_power.cycling_power_vector, "StartNotify", NULL, notify_reply, NULL, NULL);
     } else if (!strncmp(command, "Notify vector off", 16)) {
         g_dbus_proxy_method_call(thread->proxies.cycling_power.cycling_power_vector, "StopNotify", NULL, NULL, NULL, NULL);
-    } else if (!strncmp(command, "Set serial number ", 18)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x01, (const char *) &command[18]);
-    } else if (!strncmp(command, "Set factory calibration date ", 29)) {
-        uint16_t year = 0;
-        uint8_t month = 0;
-        uint8_t day = 0;
-        uint8_t hour = 0;
-        uint8_t minute = 0;
-        uint8_t second = 0;
-        sscanf(&command[29], "%hu-%hhu-%hhuT%hhu:%hhu:%hhu", &year, &month, &day, &hour, &minute, &second);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x02, year, month, day, hour, minute, second);
-    } else if (!strncmp(command, "Set strain parameters ", 22)) {
-        float k1 = 0;
-        float k2 = 0;
-        float k3 = 0;
-        float k4 = 0;
-        float k5 = 0;
-        float k6 = 0;
-        sscanf(&command[22], "%f %f %f %f %f %f", &k1, &k2, &k3, &k4, &k5, &k6);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x03, k1, k2, k3, k4, k5, k6);
-    } else if (!strncmp(command, "Get strain parameters", 21)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x04);
-    } else if (!strncmp(command, "Set accelerometer 1 transform ", 30)) {
-        int16_t a[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
-        sscanf(&command[30], "%hd %hd %hd %hd %hd %hd %hd %hd %hd %hd %hd %hd", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &a[6], &a[7], &a[8], &a[9], &a[10], &a[11]);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x05, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]);
-    } else if (!strncmp(command, "Get accelerometer 1 transform", 29)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x06);
-    } else if (!strncmp(command, "Set accelerometer 2 transform ", 30)) {
-        int16_t a[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
-        sscanf(&command[30], "%hd %hd %hd %hd %hd %hd %hd %hd %hd %hd %hd %hd", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &a[6], &a[7], &a[8], &a[9], &a[10], &a[11]);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x07, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]);
-    } else if (!strncmp(command, "Get accelerometer 2 transform", 29)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x08);
-    } else if (!strncmp(command, "Set KF parameters ", 18)) {
-        float s2alpha = 0;
-        float s2accel = 0;
-        float driveRatio = 0;
-        float r1 = 0;
-        float_t r2 = 0;
-        sscanf(&command[18], "%f %f %f %f %f", &s2alpha, &s2accel, &driveRatio, &r1, &r2);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x09, s2alpha, s2accel, driveRatio, r1, r2);
-    } else if (!strncmp(command, "Get KF parameters", 17)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0A);
-    } else if (!strncmp(command, "Set partner address", 19)) {
-        uint8_t ble_addr[6] = {0, 0, 0, 0, 0, 0};
-        sscanf(&command[20], "%hhx %hhx %hhx %hhx %hhx %hhx", &ble_addr[0], &ble_addr[1], &ble_addr[2], &ble_addr[3], &ble_addr[4], &ble_addr[5]);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0B, ble_addr[0], ble_addr[1], ble_addr[2], ble_addr[3], ble_addr[4], ble_addr[5]);
-    } else if (!strncmp(command, "Get partner address", 19)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0C);
-    } else if (!strncmp(command, "Delete partner address", 22)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0D);
-    } else if (!strncmp(command, "Set cycling power vector parameters ", 36)) {
-        uint8_t size = 0;
-        uint8_t downsample = 0;
-        sscanf(&command[36], "%hhu %hhu", &size, &downsample);
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0E, size, downsample);
-    } else if (!strncmp(command, "Get cycling power vector parameters", 35)) {
-        thread->write_proxy(thread->proxies.custom.control_point, 0x0F);
-
-
-
-
     } else if (!strncmp(command, "Notify raw on", 13)) {
         g_dbus_proxy_method_call(thread->proxies.custom.raw_data, "StartNotify", NULL, notify_reply, NULL, NULL);
     } else if (!strncmp(command, "Notify raw off", 14)) {
@@ -148,10 +148,8 @@ public:
 
 //    template <class input> void set_control_value(uint8_t op_code, input value);
 
-    int concat(uint8_t *cmd);
-    template <class T, class... Rest> int concat(uint8_t *cmd, T arg1, Rest...args);
-    template <class... Rest> int concat(uint8_t *cmd, const char *arg1, Rest...args);
-    template <class ...T> void write_proxy(GDBusProxy *proxy, uint8_t op_code, T ...args);
+    void write_proxy(GDBusProxy *proxy, uint8_t *cmd, int len);
+    template <class Op> void write_command(GDBusProxy *proxy, const char *operands = "");
 
     static gboolean command_dispatcher(GIOChannel *channel, GIOCondition cond, gpointer data);
 };
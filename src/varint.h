@@ -0,0 +1,44 @@
+#ifndef _VARINT_H
+#define _VARINT_H
+
+#include <stdint.h>
+
+//--------------------------------------------------------------------------------------------------
+// Varint and zigzag helpers
+//
+// Varints are LEB128. A zigzag value is (v << 1) ^ (v >> 63), so small negative numbers stay short.
+//--------------------------------------------------------------------------------------------------
+static inline uint8_t *PutVarint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+static inline bool GetVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        v |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline uint64_t ZigZag(int64_t v)
+{
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t v)
+{
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+#endif /* _VARINT_H */
@@ -0,0 +1,182 @@
+#include <string.h>
+#include <charconv>
+#include <algorithm>
+
+#include "view-model.h"
+
+//--------------------------------------------------------------------------------------------------
+// Constructor and destructor
+//--------------------------------------------------------------------------------------------------
+ViewModel::ViewModel() : timer(this)
+{
+    Bind(wxEVT_TIMER, &ViewModel::OnTimer, this);
+}
+
+ViewModel::~ViewModel()
+{
+    timer.Stop();
+}
+
+void ViewModel::SetDisplayRate(int hz)
+{
+    rate = hz;
+    if (hz > 0) {
+        timer.Start(1000 / hz);
+    } else {
+        timer.Stop();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Field lookup, by widget and by what is being set on it
+//--------------------------------------------------------------------------------------------------
+ViewModel::Field &ViewModel::Find(wxWindow *widget, uint8_t kind)
+{
+    // Widgets are at least 4 byte aligned, leaving the low bits for the kind
+    uintptr_t key = (uintptr_t) widget | kind;
+    auto it = index.find(key);
+    if (it != index.end()) {
+        return fields[it->second];
+    }
+    Field field;
+    memset(&field, 0, sizeof(field));
+    field.widget = widget;
+    field.kind = kind;
+    fields.push_back(field);
+    index[key] = fields.size() - 1;
+    return fields.back();
+}
+
+void ViewModel::Set(wxWindow *widget, uint8_t kind, const char *text, size_t length)
+{
+    if (length > TEXT_SIZE) {
+        length = TEXT_SIZE;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    Field &field = Find(widget, kind);
+    if (field.length == length && !memcmp(field.text, text, length)) {
+        return;
+    }
+    memcpy(field.text, text, length);
+    field.length = length;
+    if (!field.dirty) {
+        field.dirty = true;
+        dirty.push_back(&field - fields.data());
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Setters
+//--------------------------------------------------------------------------------------------------
+void ViewModel::SetText(wxWindow *widget, const char *text, size_t length)
+{
+    Set(widget, wxDynamicCast(widget, wxTextCtrl) ? TEXT : LABEL, text, length);
+}
+
+void ViewModel::SetText(wxWindow *widget, const char *text)
+{
+    SetText(widget, text, strlen(text));
+}
+
+void ViewModel::SetInteger(wxWindow *widget, long value, const char *suffix)
+{
+    char text[TEXT_SIZE];
+    char *end = std::to_chars(text, text + TEXT_SIZE, value).ptr;
+    size_t length = std::min(strlen(suffix), (size_t) (text + TEXT_SIZE - end));
+    memcpy(end, suffix, length);
+    SetText(widget, text, end + length - text);
+}
+
+void ViewModel::SetFixed(wxWindow *widget, double value, int precision, const char *suffix, bool sign)
+{
+    char text[TEXT_SIZE];
+    char *end = text;
+    if (sign && value >= 0.0) {
+        *end++ = '+';
+    }
+    std::to_chars_result result = std::to_chars(end, text + TEXT_SIZE, value, std::chars_format::fixed, precision);
+    end = result.ec == std::errc() ? result.ptr : end;
+    size_t length = std::min(strlen(suffix), (size_t) (text + TEXT_SIZE - end));
+    memcpy(end, suffix, length);
+    SetText(widget, text, end + length - text);
+}
+
+void ViewModel::SetCheck(wxCheckBox *widget, bool value)
+{
+    char state = value;
+    Set(widget, CHECK, &state, 1);
+}
+
+void ViewModel::Refresh(wxWindow *widget)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (std::find(refresh.begin(), refresh.end(), widget) == refresh.end()) {
+        refresh.push_back(widget);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Commit the pending values to the widgets
+//--------------------------------------------------------------------------------------------------
+void ViewModel::OnTimer(wxTimerEvent &evt)
+{
+    Commit();
+}
+
+void ViewModel::Commit()
+{
+    // Snapshot under the lock, then talk to the widgets without holding it
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (dirty.empty() && refresh.empty()) {
+            return;
+        }
+        commit.clear();
+        for (size_t i : dirty) {
+            fields[i].dirty = false;
+            commit.push_back(fields[i]);
+        }
+        dirty.clear();
+        repaint.swap(refresh);
+        refresh.clear();
+    }
+
+    for (wxWindow *widget : repaint) {
+        widget->Refresh(false);
+    }
+
+    relayout.clear();
+    for (const Field &update : commit) {
+        Shown &current = shown[(uintptr_t) update.widget | update.kind];
+        if (current.length == update.length && !memcmp(current.text, update.text, update.length)) {
+            continue;
+        }
+        memcpy(current.text, update.text, update.length);
+        current.length = update.length;
+
+        wxString text = wxString::FromUTF8(update.text, update.length);
+        switch (update.kind) {
+            case CHECK:
+                ((wxCheckBox *) update.widget)->SetValue(update.text[0]);
+                break;
+            case TEXT:
+                ((wxTextCtrl *) update.widget)->ChangeValue(text);
+                break;
+            case LABEL: {
+                wxSize size = update.widget->GetBestSize();
+                update.widget->SetLabel(text);
+                if (update.widget->GetBestSize() != size) {
+                    wxWindow *page = update.widget->GetParent();
+                    if (std::find(relayout.begin(), relayout.end(), page) == relayout.end()) {
+                        relayout.push_back(page);
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    for (wxWindow *page : relayout) {
+        page->Layout();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef _VIEW_MODEL_H
+#define _VIEW_MODEL_H
+
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/wx.h>
+#include <wx/timer.h>
+
+//--------------------------------------------------------------------------------------------------
+// View-model for the data pages
+//
+// Notifications write formatted values here, from whichever thread decoded them. The text goes into
+// fixed buffers (std::to_chars, no wxString), and nothing touches a widget at that point. A timer
+// on the GUI thread commits the latest value of every field at the display rate. It only calls
+// SetLabel/ChangeValue/SetValue when the text or state actually changed, and only lays out a page
+// when a label changed size. GUI cost therefore depends on the display rate, not the data rate.
+//--------------------------------------------------------------------------------------------------
+class ViewModel : public wxEvtHandler
+{
+public:
+    ViewModel();
+    ~ViewModel();
+
+    // Commits per second, zero to stop committing
+    void SetDisplayRate(int hz);
+    int GetDisplayRate() const
+    {
+        return rate;
+    }
+
+    // Any thread
+    void SetText(wxWindow *widget, const char *text, size_t length);
+    void SetText(wxWindow *widget, const char *text);
+    void SetInteger(wxWindow *widget, long value, const char *suffix = "");
+    void SetFixed(wxWindow *widget, double value, int precision, const char *suffix = "", bool sign = false);
+    void SetCheck(wxCheckBox *widget, bool value);
+    void Refresh(wxWindow *widget);     // Repaint a custom drawn control at the next commit
+
+    // GUI thread
+    void Commit();
+
+    static const size_t TEXT_SIZE = 48;
+
+private:
+    enum kinds {
+        LABEL,          // wxStaticText, wxCheckBox label, ...
+        TEXT,           // wxTextCtrl, updated without generating an event
+        CHECK,          // wxCheckBox value
+    };
+
+    struct Field {
+        wxWindow *widget;
+        uint8_t kind;
+        bool dirty;
+        uint8_t length;
+        char text[TEXT_SIZE];
+    };
+
+    // What the widget currently shows, only touched on the GUI thread
+    struct Shown {
+        uint8_t length;
+        char text[TEXT_SIZE];
+    };
+
+    // Caller holds the lock
+    Field &Find(wxWindow *widget, uint8_t kind);
+    void Set(wxWindow *widget, uint8_t kind, const char *text, size_t length);
+
+    void OnTimer(wxTimerEvent &evt);
+
+    std::mutex lock;
+    std::vector<Field> fields;
+    std::unordered_map<uintptr_t, size_t> index;
+    std::unordered_map<uintptr_t, Shown> shown;
+    std::vector<size_t> dirty;              // Fields waiting for the next commit
+    std::vector<wxWindow *> refresh;        // Custom drawn controls waiting for the next commit
+    std::vector<Field> commit;              // Reused snapshot of the dirty fields
+    std::vector<wxWindow *> repaint;        // Reused snapshot of refresh
+    std::vector<wxWindow *> relayout;       // Reused list of pages to lay out again
+    wxTimer timer;
+    int rate = 0;
+};
+
+#endif /* _VIEW_MODEL_H */
@@ -0,0 +1,161 @@
+#ifndef _WORK_POOL_H
+#define _WORK_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Work stealing thread pool
+//
+// ForEach(n, task) runs task(i) for every i below n across the pool and returns once all have
+// finished, the calling thread working too. Each worker starts with its own contiguous share of the
+// indices and takes them from the front of its queue. One that runs out steals from the back of the
+// others' queues, so uneven tasks (log files of very different lengths, say) still keep every
+// thread busy to the end.
+//
+// Tasks must not call ForEach on the same pool. Only one thread at a time may call ForEach.
+//--------------------------------------------------------------------------------------------------
+class WorkPool
+{
+public:
+    // Zero for one thread per core
+    explicit WorkPool(unsigned threads = 0)
+    {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; i++) {
+            queues.emplace_back(new Queue);
+        }
+        // The last worker is the thread calling ForEach
+        for (unsigned i = 0; i + 1 < threads; i++) {
+            workers.emplace_back(&WorkPool::Run, this, i);
+        }
+    }
+
+    ~WorkPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    unsigned Threads() const
+    {
+        return queues.size();
+    }
+
+    template <class Task> void ForEach(size_t n, Task &&task)
+    {
+        if (n == 0) {
+            return;
+        }
+        job = [&task](size_t i) {
+            task(i);
+        };
+        remaining.store(n, std::memory_order_relaxed);
+        size_t threads = queues.size();
+        for (size_t w = 0; w < threads; w++) {
+            std::lock_guard<std::mutex> guard(queues[w]->lock);
+            for (size_t i = w * n / threads; i < (w + 1) * n / threads; i++) {
+                queues[w]->tasks.push_back(i);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            generation++;
+        }
+        wake.notify_all();
+
+        Work(threads - 1);
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&] {
+            return remaining.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    void Run(unsigned self)
+    {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] {
+                    return quit || generation != seen;
+                });
+                if (quit) {
+                    return;
+                }
+                seen = generation;
+            }
+            Work(self);
+        }
+    }
+
+    void Work(unsigned self)
+    {
+        size_t task;
+        while (Next(self, task)) {
+            job(task);
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> guard(lock);
+                done.notify_all();
+            }
+        }
+    }
+
+    // Own queue first, then the others, starting with the next one along
+    bool Next(unsigned self, size_t &task)
+    {
+        size_t threads = queues.size();
+        for (size_t k = 0; k < threads; k++) {
+            Queue &q = *queues[(self + k) % threads];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tasks.empty()) {
+                continue;
+            }
+            if (k == 0) {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            } else {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::function<void(size_t)> job;
+    std::atomic<size_t> remaining{0};
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool quit = false;
+};
+
+#endif /* _WORK_POOL_H */